@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "arena.h"
+
+#define ARENA_CHUNK_SIZE (256 * 1024)   // covers a conversion's stream buffers
+#define ARENA_ALIGN 16
+#define ARENA_KEEP_BYTES (4u << 20)     // chunk memory an idle arena holds on to
+#define POOL_ARENAS 4                   // idle arenas per thread
+
+typedef struct arena_chunk {
+    struct arena_chunk *prev;           // the chunk in use before this one
+    size_t size, used;
+    _Alignas(ARENA_ALIGN) unsigned char data[];
+} arena_chunk;
+
+struct fc_arena {
+    arena_chunk *current;               // top of the stack of chunks in use
+    arena_chunk *spare;                 // emptied chunks, kept for reuse
+    uint64_t allocations, bytes;        // not yet added to the global stats
+    fc_arena *next;                     // in a thread's pool
+};
+
+static struct {
+    uint64_t allocations, bytes;
+    uint64_t chunk_allocations, chunk_bytes;
+    uint64_t arenas_created, arenas_reused;
+} stats;
+
+// Idle arenas of this thread, freed when it exits
+static __thread fc_arena *pool;
+static __thread int pool_count;
+static pthread_key_t pool_key;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+static void count(uint64_t *counter, uint64_t n) {
+    __atomic_add_fetch(counter, n, __ATOMIC_RELAXED);
+}
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static void free_chunks(arena_chunk *c) {
+    while (c) {
+        arena_chunk *prev = c->prev;
+        free(c);
+        c = prev;
+    }
+}
+
+static void arena_destroy(fc_arena *arena) {
+    free_chunks(arena->current);
+    free_chunks(arena->spare);
+    free(arena);
+}
+
+static void flush_counts(fc_arena *arena) {
+    if (!arena->allocations) return;
+    count(&stats.allocations, arena->allocations);
+    count(&stats.bytes, arena->bytes);
+    arena->allocations = arena->bytes = 0;
+}
+
+static void pool_destroy(void *unused) {
+    (void)unused;
+    while (pool) {
+        fc_arena *arena = pool;
+        pool = arena->next;
+        arena_destroy(arena);
+    }
+    pool_count = 0;
+}
+
+static void pool_key_create(void) {
+    pthread_key_create(&pool_key, pool_destroy);
+}
+
+fc_arena *fc_arena_acquire(void) {
+    if (pool) {
+        fc_arena *arena = pool;
+        pool = arena->next;
+        pool_count--;
+        arena->next = NULL;
+        count(&stats.arenas_reused, 1);
+        return arena;
+    }
+    fc_arena *arena = calloc(1, sizeof(*arena));
+    if (arena) count(&stats.arenas_created, 1);
+    return arena;
+}
+
+void fc_arena_release(fc_arena *arena) {
+    if (!arena) return;
+    fc_arena_reset(arena);
+
+    // Keep spares up to the limit; one-off large chunks go back to malloc
+    size_t kept = 0;
+    for (arena_chunk **link = &arena->spare; *link;) {
+        arena_chunk *c = *link;
+        if (kept + c->size > ARENA_KEEP_BYTES) {
+            *link = c->prev;
+            free(c);
+        } else {
+            kept += c->size;
+            link = &c->prev;
+        }
+    }
+
+    if (pool_count >= POOL_ARENAS) {
+        arena_destroy(arena);
+        return;
+    }
+    pthread_once(&pool_once, pool_key_create);
+    pthread_setspecific(pool_key, arena);   // any non-NULL value runs the destructor
+    arena->next = pool;
+    pool = arena;
+    pool_count++;
+}
+
+// Make a chunk with room for size bytes current: a spare if one fits
+static int push_chunk(fc_arena *arena, size_t size) {
+    arena_chunk *c = NULL;
+    for (arena_chunk **link = &arena->spare; *link; link = &(*link)->prev) {
+        if ((*link)->size >= size) {
+            c = *link;
+            *link = c->prev;
+            break;
+        }
+    }
+    if (!c) {
+        size_t chunk_size = size > ARENA_CHUNK_SIZE ? align_up(size) : ARENA_CHUNK_SIZE;
+        c = malloc(sizeof(arena_chunk) + chunk_size);
+        if (!c) return -1;
+        c->size = chunk_size;
+        count(&stats.chunk_allocations, 1);
+        count(&stats.chunk_bytes, chunk_size);
+    }
+    c->used = 0;
+    c->prev = arena->current;
+    arena->current = c;
+    return 0;
+}
+
+void *fc_arena_alloc(fc_arena *arena, size_t size) {
+    size = align_up(size ? size : 1);
+    arena_chunk *c = arena->current;
+    if (!c || c->size - c->used < size) {
+        if (push_chunk(arena, size) != 0) return NULL;
+        c = arena->current;
+    }
+    void *p = c->data + c->used;
+    c->used += size;
+    arena->allocations++;
+    arena->bytes += size;
+    return p;
+}
+
+void *fc_arena_grow(fc_arena *arena, void *ptr, size_t old_size, size_t new_size) {
+    if (!ptr) return fc_arena_alloc(arena, new_size);
+
+    arena_chunk *c = arena->current;
+    size_t old_aligned = align_up(old_size ? old_size : 1), new_aligned = align_up(new_size ? new_size : 1);
+    if (c && (unsigned char *)ptr + old_aligned == c->data + c->used &&
+        new_aligned <= c->size - c->used + old_aligned) {
+        c->used = c->used - old_aligned + new_aligned;
+        arena->allocations++;
+        if (new_aligned > old_aligned) arena->bytes += new_aligned - old_aligned;
+        return ptr;
+    }
+
+    void *p = fc_arena_alloc(arena, new_size);
+    if (p) memcpy(p, ptr, old_size < new_size ? old_size : new_size);
+    return p;
+}
+
+fc_arena_mark fc_arena_save(const fc_arena *arena) {
+    fc_arena_mark mark = { arena->current, arena->current ? arena->current->used : 0 };
+    return mark;
+}
+
+void fc_arena_rewind(fc_arena *arena, fc_arena_mark mark) {
+    while (arena->current && arena->current != mark.chunk) {
+        arena_chunk *c = arena->current;
+        arena->current = c->prev;
+        c->prev = arena->spare;
+        arena->spare = c;
+    }
+    if (arena->current) arena->current->used = mark.used;
+    flush_counts(arena);
+}
+
+void fc_arena_reset(fc_arena *arena) {
+    fc_arena_mark start = { NULL, 0 };
+    fc_arena_rewind(arena, start);
+}
+
+void fc_arena_get_stats(fc_arena_stats *out) {
+    out->allocations = __atomic_load_n(&stats.allocations, __ATOMIC_RELAXED);
+    out->bytes = __atomic_load_n(&stats.bytes, __ATOMIC_RELAXED);
+    out->chunk_allocations = __atomic_load_n(&stats.chunk_allocations, __ATOMIC_RELAXED);
+    out->chunk_bytes = __atomic_load_n(&stats.chunk_bytes, __ATOMIC_RELAXED);
+    out->arenas_created = __atomic_load_n(&stats.arenas_created, __ATOMIC_RELAXED);
+    out->arenas_reused = __atomic_load_n(&stats.arenas_reused, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,63 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bump allocator for per-job scratch memory (stream buffers, result text,
+// parse state). Allocations are never freed one by one; the whole arena is
+// rewound or reset in one step when the job ends, and its chunks are kept
+// for the next job.
+//
+// Arenas are handed out from a small per-thread pool, so a job that takes
+// one, fills it and gives it back costs no malloc once the pool is warm and
+// never touches another thread's memory. An arena must only be used by one
+// thread at a time.
+
+typedef struct fc_arena fc_arena;
+
+// A position to rewind to, for scratch used inside a larger job
+typedef struct {
+    void *chunk;
+    size_t used;
+} fc_arena_mark;
+
+// Take an arena from this thread's pool, or make a new one. NULL if out of
+// memory.
+fc_arena *fc_arena_acquire(void);
+
+// Reset the arena and return it to this thread's pool (freeing it if the
+// pool is full). Trims chunks beyond what a typical job needs.
+void fc_arena_release(fc_arena *arena);
+
+// size bytes aligned to 16, valid until the arena is rewound past them or
+// reset. NULL if out of memory.
+void *fc_arena_alloc(fc_arena *arena, size_t size);
+
+// Resize the allocation at ptr (old_size bytes, NULL for none) to new_size.
+// The last allocation grows in place when the chunk has room; otherwise the
+// contents are copied to a new allocation and the old one is left unused
+// until the next rewind. NULL if out of memory (ptr stays valid).
+void *fc_arena_grow(fc_arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+fc_arena_mark fc_arena_save(const fc_arena *arena);
+void fc_arena_rewind(fc_arena *arena, fc_arena_mark mark);
+
+// Drop every allocation at once; chunks are kept for reuse
+void fc_arena_reset(fc_arena *arena);
+
+// Process-wide counters. chunk_allocations is the number of times arenas
+// went to malloc: once the pools are warm it stays flat from job to job, and
+// a rise per job is a regression.
+typedef struct {
+    uint64_t allocations;           // fc_arena_alloc/grow calls served
+    uint64_t bytes;                 // bytes handed out by them
+    uint64_t chunk_allocations;     // chunks taken from malloc
+    uint64_t chunk_bytes;
+    uint64_t arenas_created;
+    uint64_t arenas_reused;         // acquires served from a thread's pool
+} fc_arena_stats;
+
+void fc_arena_get_stats(fc_arena_stats *stats);
+
+#endif
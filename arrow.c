@@ -0,0 +1,681 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "arrow.h"
+
+#define BATCH_BYTES (16 << 20)      // string bytes that end a batch early
+#define STRING_MAX INT32_MAX        // string offsets are int32
+#define METADATA_VERSION 4          // V5
+#define ALIGN 8                     // every message and buffer starts on this
+
+// Flatbuffer ids from Schema.fbs, Message.fbs and File.fbs
+enum { TYPE_INT = 2, TYPE_FLOAT = 3, TYPE_UTF8 = 5, TYPE_BOOL = 6 };
+enum { HEADER_SCHEMA = 1, HEADER_DICTIONARY = 2, HEADER_RECORD_BATCH = 3 };
+enum { PRECISION_DOUBLE = 2 };
+
+// Growable byte buffers
+
+typedef struct {
+    uint8_t *data;
+    size_t len, cap;
+} buffer;
+
+static int reserve(buffer *b, size_t more) {
+    if (b->len + more <= b->cap) return 0;
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + more) cap *= 2;
+    uint8_t *data = realloc(b->data, cap);
+    if (!data) return -1;
+    b->data = data;
+    b->cap = cap;
+    return 0;
+}
+
+static int append(buffer *b, const void *p, size_t n) {
+    if (n == 0) return 0;
+    if (reserve(b, n) != 0) return -1;
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+    return 0;
+}
+
+static int append_i32(buffer *b, int32_t v) {
+    return append(b, &v, sizeof(v));
+}
+
+// A flatbuffer builder. The buffer fills from the back, children before the
+// tables that point at them, since offsets only point forward. Objects are
+// named by their distance from the end, which growing does not change.
+
+#define FB_MAX_FIELDS 8
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap, used;
+    size_t minalign;
+    size_t table_start;
+    size_t fields[FB_MAX_FIELDS];   // where each field of the open table is, 0 if absent
+    int field_count;
+    int failed;
+} fb_builder;
+
+static void fb_init(fb_builder *fb) {
+    fb->used = 0;
+    fb->minalign = ALIGN;
+    fb->failed = 0;
+}
+
+static uint8_t *fb_grow(fb_builder *fb, size_t n) {
+    if (fb->used + n > fb->cap) {
+        size_t cap = fb->cap ? fb->cap : 1024;
+        while (cap < fb->used + n) cap *= 2;
+        uint8_t *buf = malloc(cap);
+        if (!buf) {
+            fb->failed = 1;
+            return NULL;
+        }
+        if (fb->used) memcpy(buf + cap - fb->used, fb->buf + fb->cap - fb->used, fb->used);
+        free(fb->buf);
+        fb->buf = buf;
+        fb->cap = cap;
+    }
+    fb->used += n;
+    return fb->buf + fb->cap - fb->used;
+}
+
+static void fb_push(fb_builder *fb, const void *p, size_t n) {
+    if (n == 0) return;
+    uint8_t *dst = fb_grow(fb, n);
+    if (dst) memcpy(dst, p, n);
+}
+
+// Pad so that after another `extra` bytes the front is aligned to `align`
+static void fb_prep(fb_builder *fb, size_t align, size_t extra) {
+    if (align > fb->minalign) fb->minalign = align;
+    size_t pad = (0 - (fb->used + extra)) & (align - 1);
+    uint8_t *dst = fb_grow(fb, pad);
+    if (dst) memset(dst, 0, pad);
+}
+
+static void fb_scalar(fb_builder *fb, const void *p, size_t n) {
+    fb_prep(fb, n, 0);
+    fb_push(fb, p, n);
+}
+
+// An offset to obj, stored at the front
+static void fb_offset(fb_builder *fb, size_t obj) {
+    fb_prep(fb, 4, 0);
+    uint32_t off = (uint32_t)(fb->used + 4 - obj);
+    fb_push(fb, &off, 4);
+}
+
+static size_t fb_string(fb_builder *fb, const char *s, size_t len) {
+    fb_prep(fb, 4, len + 1);
+    fb_push(fb, "", 1);
+    fb_push(fb, s, len);
+    uint32_t n = (uint32_t)len;
+    fb_push(fb, &n, 4);
+    return fb->used;
+}
+
+static size_t fb_offset_vector(fb_builder *fb, const size_t *objs, size_t n) {
+    fb_prep(fb, 4, 4 * n);
+    for (size_t i = n; i-- > 0;) fb_offset(fb, objs[i]);
+    uint32_t count = (uint32_t)n;
+    fb_push(fb, &count, 4);
+    return fb->used;
+}
+
+// A vector of structs, already laid out in memory order
+static size_t fb_struct_vector(fb_builder *fb, const void *data, size_t size, size_t n) {
+    fb_prep(fb, 4, size * n);
+    fb_prep(fb, ALIGN, size * n);
+    fb_push(fb, data, size * n);
+    uint32_t count = (uint32_t)n;
+    fb_push(fb, &count, 4);
+    return fb->used;
+}
+
+static void fb_start(fb_builder *fb) {
+    memset(fb->fields, 0, sizeof(fb->fields));
+    fb->field_count = 0;
+    fb->table_start = fb->used;
+}
+
+static void fb_note(fb_builder *fb, int id) {
+    fb->fields[id] = fb->used;
+    if (id + 1 > fb->field_count) fb->field_count = id + 1;
+}
+
+static void fb_add(fb_builder *fb, int id, const void *p, size_t n) {
+    fb_scalar(fb, p, n);
+    fb_note(fb, id);
+}
+
+static void fb_add_i64(fb_builder *fb, int id, int64_t v) { fb_add(fb, id, &v, 8); }
+static void fb_add_i32(fb_builder *fb, int id, int32_t v) { fb_add(fb, id, &v, 4); }
+static void fb_add_i16(fb_builder *fb, int id, int16_t v) { fb_add(fb, id, &v, 2); }
+static void fb_add_u8(fb_builder *fb, int id, uint8_t v) { fb_add(fb, id, &v, 1); }
+
+static void fb_add_offset(fb_builder *fb, int id, size_t obj) {
+    fb_offset(fb, obj);
+    fb_note(fb, id);
+}
+
+// Close the table with its vtable just in front of it
+static size_t fb_end(fb_builder *fb) {
+    int32_t placeholder = 0;
+    fb_scalar(fb, &placeholder, 4);
+    size_t table = fb->used;
+    for (int id = fb->field_count - 1; id >= 0; id--) {
+        uint16_t off = fb->fields[id] ? (uint16_t)(table - fb->fields[id]) : 0;
+        fb_push(fb, &off, 2);
+    }
+    uint16_t sizes[2] = { (uint16_t)((fb->field_count + 2) * 2), (uint16_t)(table - fb->table_start) };
+    fb_push(fb, sizes, 4);
+    if (fb->failed) return table;
+    int32_t vtable = (int32_t)(fb->used - table);
+    memcpy(fb->buf + fb->cap - table, &vtable, 4);
+    return table;
+}
+
+// Put the root offset in front; the size comes out a multiple of ALIGN
+static const uint8_t *fb_finish(fb_builder *fb, size_t root, size_t *size) {
+    fb_prep(fb, fb->minalign, 4);
+    fb_offset(fb, root);
+    *size = fb->used;
+    return fb->failed ? NULL : fb->buf + fb->cap - fb->used;
+}
+
+// File layout structs, in memory order
+
+typedef struct {
+    int64_t offset;
+    int32_t metadata_length;
+    int32_t pad;
+    int64_t body_length;
+} block;
+
+typedef struct {
+    int64_t length, null_count;
+} field_node;
+
+typedef struct {
+    int64_t offset, length;
+} body_buffer;
+
+// Columns
+
+typedef struct {
+    buffer offsets;         // int32, count + 1 of them
+    buffer data;
+    uint32_t *slots;        // entry + 1, 0 for a free slot
+    size_t slot_count;      // a power of two, at least twice the entries
+    size_t count;
+} dictionary;
+
+typedef struct {
+    fc_arrow_type type;
+    int set;                // given a value in the current row
+    size_t null_count;
+    buffer validity;        // one bit per row, set if not null
+    buffer values;          // int64, double, bool bits, int32 string offsets or int32 indices
+    buffer data;            // string bytes
+    dictionary *dict;
+} column;
+
+struct fc_arrow_writer {
+    FILE *out;
+    fc_status status;
+    uint64_t offset;        // bytes written so far
+    char *names;            // the column names, back to back
+    size_t *name_offs, *name_lens;
+    column *columns;
+    size_t column_count;
+    size_t rows;            // in the current batch
+    size_t string_bytes;
+    buffer batches;         // a block per record batch
+    fb_builder fb;
+    field_node *nodes;
+    body_buffer *buffers;
+    const buffer **bodies;  // the data of each body buffer
+};
+
+static void fail(fc_arrow_writer *w, fc_status status) {
+    if (w->status == FC_OK) w->status = status;
+}
+
+static void emit(fc_arrow_writer *w, const void *p, size_t n) {
+    if (w->status != FC_OK || n == 0) return;
+    if (fwrite(p, 1, n, w->out) != n) fail(w, FC_ERR_IO);
+    w->offset += n;
+}
+
+static void emit_pad(fc_arrow_writer *w, size_t n) {
+    static const uint8_t zeros[ALIGN];
+    emit(w, zeros, (0 - n) & (ALIGN - 1));
+}
+
+static size_t padded(size_t n) {
+    return (n + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+}
+
+static void set_bit(buffer *b, size_t bit) {
+    b->data[bit / 8] |= 1 << (bit % 8);
+}
+
+// Dictionaries
+
+static size_t hash_bytes(const uint8_t *s, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++) h = (h ^ s[i]) * 0x100000001b3ull;
+    return (size_t)h;
+}
+
+static uint32_t *dict_slot(const dictionary *d, const uint8_t *s, size_t len) {
+    const int32_t *offs = (const int32_t *)d->offsets.data;
+    size_t mask = d->slot_count - 1;
+    for (size_t i = hash_bytes(s, len) & mask;; i = (i + 1) & mask) {
+        uint32_t entry = d->slots[i];
+        if (!entry) return &d->slots[i];
+        size_t off = offs[entry - 1], n = offs[entry] - off;
+        if (n == len && memcmp(d->data.data + off, s, len) == 0) return &d->slots[i];
+    }
+}
+
+// The index of s, added if new; -1 if out of memory, -2 if int32 offsets
+// or indices cannot reach it
+static long dict_index(dictionary *d, const uint8_t *s, size_t len) {
+    uint32_t *slot = dict_slot(d, s, len);
+    if (*slot) return (long)*slot - 1;
+    if (d->count == INT32_MAX || d->data.len + len > STRING_MAX) return -2;
+    if (2 * (d->count + 1) > d->slot_count) {
+        size_t count = d->slot_count * 2;
+        uint32_t *slots = calloc(count, sizeof(*slots));
+        if (!slots) return -1;
+        free(d->slots);
+        d->slots = slots;
+        d->slot_count = count;
+        const int32_t *offs = (const int32_t *)d->offsets.data;
+        for (size_t e = 0; e < d->count; e++) {
+            *dict_slot(d, d->data.data + offs[e], offs[e + 1] - offs[e]) = e + 1;
+        }
+        slot = dict_slot(d, s, len);
+    }
+    if (append(&d->data, s, len) != 0 || append_i32(&d->offsets, (int32_t)d->data.len) != 0) return -1;
+    *slot = ++d->count;
+    return (long)d->count - 1;
+}
+
+static dictionary *dict_new(void) {
+    dictionary *d = calloc(1, sizeof(*d));
+    if (!d) return NULL;
+    d->slot_count = 64;
+    d->slots = calloc(d->slot_count, sizeof(*d->slots));
+    if (!d->slots || append_i32(&d->offsets, 0) != 0) {
+        free(d->slots);
+        free(d->offsets.data);
+        free(d);
+        return NULL;
+    }
+    return d;
+}
+
+static void dict_free(dictionary *d) {
+    if (!d) return;
+    free(d->offsets.data);
+    free(d->data.data);
+    free(d->slots);
+    free(d);
+}
+
+// Metadata
+
+static size_t build_int_type(fb_builder *fb, int bits) {
+    fb_start(fb);
+    fb_add_i32(fb, 0, bits);
+    fb_add_u8(fb, 1, 1);        // signed
+    return fb_end(fb);
+}
+
+static size_t build_field(fb_builder *fb, const fc_arrow_writer *w, size_t col) {
+    fc_arrow_type type = w->columns[col].type;
+    size_t name = fb_string(fb, w->names + w->name_offs[col], w->name_lens[col]);
+    size_t type_table, dict = 0;
+    uint8_t type_type = type == FC_ARROW_INT64 ? TYPE_INT : type == FC_ARROW_DOUBLE ? TYPE_FLOAT :
+                        type == FC_ARROW_BOOL ? TYPE_BOOL : TYPE_UTF8;
+
+    if (type == FC_ARROW_INT64) {
+        type_table = build_int_type(fb, 64);
+    } else {
+        fb_start(fb);
+        if (type == FC_ARROW_DOUBLE) fb_add_i16(fb, 0, PRECISION_DOUBLE);
+        type_table = fb_end(fb);        // Bool and Utf8 have no fields
+    }
+    if (type == FC_ARROW_DICT_UTF8) {
+        size_t index_type = build_int_type(fb, 32);
+        fb_start(fb);
+        fb_add_i64(fb, 0, (int64_t)col);        // dictionary id
+        fb_add_offset(fb, 1, index_type);
+        dict = fb_end(fb);
+    }
+    // Readers want the children vector even when it is empty
+    size_t children = fb_offset_vector(fb, NULL, 0);
+
+    fb_start(fb);
+    fb_add_offset(fb, 0, name);
+    fb_add_u8(fb, 1, 1);                        // nullable
+    fb_add_u8(fb, 2, type_type);
+    fb_add_offset(fb, 3, type_table);
+    if (dict) fb_add_offset(fb, 4, dict);
+    fb_add_offset(fb, 5, children);
+    return fb_end(fb);
+}
+
+static size_t build_schema(fb_builder *fb, const fc_arrow_writer *w) {
+    size_t *fields = malloc((w->column_count ? w->column_count : 1) * sizeof(*fields));
+    if (!fields) {
+        fb->failed = 1;
+        return 0;
+    }
+    for (size_t col = 0; col < w->column_count; col++) fields[col] = build_field(fb, w, col);
+    size_t vector = fb_offset_vector(fb, fields, w->column_count);
+    free(fields);
+    fb_start(fb);
+    fb_add_offset(fb, 1, vector);               // endianness (0) stays Little
+    return fb_end(fb);
+}
+
+static size_t build_record_batch(fb_builder *fb, size_t length, const field_node *nodes, size_t node_count,
+                                 const body_buffer *buffers, size_t buffer_count) {
+    size_t buffer_vector = fb_struct_vector(fb, buffers, sizeof(*buffers), buffer_count);
+    size_t node_vector = fb_struct_vector(fb, nodes, sizeof(*nodes), node_count);
+    fb_start(fb);
+    fb_add_i64(fb, 0, (int64_t)length);
+    fb_add_offset(fb, 1, node_vector);
+    fb_add_offset(fb, 2, buffer_vector);
+    return fb_end(fb);
+}
+
+// Write an encapsulated message: the continuation marker, the metadata
+// length and the Message, then the body buffers each padded out
+static void write_message(fc_arrow_writer *w, uint8_t header_type, size_t header,
+                          const body_buffer *buffers, const buffer *const *bodies, size_t buffer_count,
+                          block *where) {
+    fb_builder *fb = &w->fb;
+    uint64_t body_length = 0;
+    for (size_t i = 0; i < buffer_count; i++) body_length += padded(buffers[i].length);
+
+    fb_start(fb);
+    fb_add_i64(fb, 3, (int64_t)body_length);
+    fb_add_offset(fb, 2, header);
+    fb_add_i16(fb, 0, METADATA_VERSION);
+    fb_add_u8(fb, 1, header_type);
+    size_t size;
+    const uint8_t *metadata = fb_finish(fb, fb_end(fb), &size);
+    if (!metadata) {
+        fail(w, FC_ERR_NOMEM);
+        return;
+    }
+
+    if (where) *where = (block){ (int64_t)w->offset, (int32_t)(8 + size), 0, (int64_t)body_length };
+    int32_t prefix[2] = { -1, (int32_t)size };
+    emit(w, prefix, sizeof(prefix));
+    emit(w, metadata, size);
+    for (size_t i = 0; i < buffer_count; i++) {
+        emit(w, bodies[i] ? bodies[i]->data : NULL, buffers[i].length);
+        emit_pad(w, buffers[i].length);
+    }
+}
+
+// Record batches
+
+static void reset_column(column *c) {
+    c->null_count = 0;
+    memset(c->validity.data, 0, c->validity.cap);
+    c->values.len = 0;
+    c->data.len = 0;
+    if (c->type == FC_ARROW_BOOL) memset(c->values.data, 0, c->values.cap);
+    if (c->type == FC_ARROW_UTF8) append_i32(&c->values, 0);   // room was kept
+}
+
+static void write_batch(fc_arrow_writer *w) {
+    size_t n = 0, bits = (w->rows + 7) / 8;
+    uint64_t offset = 0;
+    for (size_t col = 0; col < w->column_count; col++) {
+        column *c = &w->columns[col];
+        w->nodes[col] = (field_node){ (int64_t)w->rows, (int64_t)c->null_count };
+        // The validity bitmap may be left out when nothing is null
+        size_t lens[3] = { c->null_count ? bits : 0, c->type == FC_ARROW_BOOL ? bits : c->values.len, c->data.len };
+        const buffer *data[3] = { &c->validity, &c->values, &c->data };
+        for (int i = 0; i < (c->type == FC_ARROW_UTF8 ? 3 : 2); i++, n++) {
+            w->buffers[n] = (body_buffer){ (int64_t)offset, (int64_t)lens[i] };
+            w->bodies[n] = data[i];
+            offset += padded(lens[i]);
+        }
+    }
+
+    block where;
+    fb_init(&w->fb);
+    size_t header = build_record_batch(&w->fb, w->rows, w->nodes, w->column_count, w->buffers, n);
+    write_message(w, HEADER_RECORD_BATCH, header, w->buffers, w->bodies, n, &where);
+    if (append(&w->batches, &where, sizeof(where)) != 0) fail(w, FC_ERR_NOMEM);
+
+    for (size_t col = 0; col < w->column_count; col++) reset_column(&w->columns[col]);
+    w->rows = 0;
+    w->string_bytes = 0;
+}
+
+static void write_dictionary(fc_arrow_writer *w, size_t col, block *where) {
+    const dictionary *d = w->columns[col].dict;
+    field_node node = { (int64_t)d->count, 0 };
+    body_buffer buffers[3] = {
+        { 0, 0 },
+        { 0, (int64_t)d->offsets.len },
+        { (int64_t)padded(d->offsets.len), (int64_t)d->data.len },
+    };
+    const buffer *bodies[3] = { NULL, &d->offsets, &d->data };
+
+    fb_init(&w->fb);
+    size_t data = build_record_batch(&w->fb, d->count, &node, 1, buffers, 3);
+    fb_start(&w->fb);
+    fb_add_i64(&w->fb, 0, (int64_t)col);
+    fb_add_offset(&w->fb, 1, data);
+    size_t header = fb_end(&w->fb);
+    write_message(w, HEADER_DICTIONARY, header, buffers, bodies, 3, where);
+}
+
+// The writer
+
+static void free_writer(fc_arrow_writer *w) {
+    for (size_t col = 0; w->columns && col < w->column_count; col++) {
+        column *c = &w->columns[col];
+        free(c->validity.data);
+        free(c->values.data);
+        free(c->data.data);
+        dict_free(c->dict);
+    }
+    free(w->columns);
+    free(w->names);
+    free(w->name_offs);
+    free(w->name_lens);
+    free(w->batches.data);
+    free(w->fb.buf);
+    free(w->nodes);
+    free(w->buffers);
+    free(w->bodies);
+    free(w);
+}
+
+fc_arrow_writer *fc_arrow_writer_new(FILE *out, const char *const *names, const size_t *name_lens,
+                                     const fc_arrow_type *types, size_t columns) {
+    fc_arrow_writer *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    w->out = out;
+    w->column_count = columns;
+    size_t total = 0;
+    for (size_t col = 0; col < columns; col++) total += name_lens[col];
+    size_t count = columns ? columns : 1;
+    w->names = malloc(total ? total : 1);
+    w->name_offs = malloc(count * sizeof(*w->name_offs));
+    w->name_lens = malloc(count * sizeof(*w->name_lens));
+    w->columns = calloc(count, sizeof(*w->columns));
+    w->nodes = malloc(count * sizeof(*w->nodes));
+    w->buffers = malloc(3 * count * sizeof(*w->buffers));
+    w->bodies = malloc(3 * count * sizeof(*w->bodies));
+    if (!w->names || !w->name_offs || !w->name_lens || !w->columns || !w->nodes || !w->buffers || !w->bodies) {
+        free_writer(w);
+        return NULL;
+    }
+
+    total = 0;
+    for (size_t col = 0; col < columns; col++) {
+        column *c = &w->columns[col];
+        memcpy(w->names + total, names[col], name_lens[col]);
+        w->name_offs[col] = total;
+        w->name_lens[col] = name_lens[col];
+        total += name_lens[col];
+
+        // Bitmaps are sized for a full batch up front; values grow
+        c->type = types[col];
+        size_t bits = FC_ARROW_BATCH_ROWS / 8;
+        if (reserve(&c->validity, bits) != 0 ||
+            (c->type == FC_ARROW_BOOL && reserve(&c->values, bits) != 0) ||
+            (c->type == FC_ARROW_UTF8 && reserve(&c->values, 4) != 0) ||
+            (c->type == FC_ARROW_DICT_UTF8 && !(c->dict = dict_new()))) {
+            free_writer(w);
+            return NULL;
+        }
+        reset_column(c);
+    }
+
+    static const char magic[8] = "ARROW1";
+    emit(w, magic, sizeof(magic));
+    fb_init(&w->fb);
+    write_message(w, HEADER_SCHEMA, build_schema(&w->fb, w), NULL, NULL, 0, NULL);
+    return w;
+}
+
+static column *value_column(fc_arrow_writer *w, size_t col, size_t size) {
+    column *c = &w->columns[col];
+    if (w->status != FC_OK) return NULL;
+    if (reserve(&c->values, size) != 0) {
+        fail(w, FC_ERR_NOMEM);
+        return NULL;
+    }
+    c->set = 1;
+    set_bit(&c->validity, w->rows);
+    return c;
+}
+
+void fc_arrow_set_int64(fc_arrow_writer *w, size_t col, long long value) {
+    column *c = value_column(w, col, 8);
+    int64_t v = value;
+    if (c) append(&c->values, &v, 8);
+}
+
+void fc_arrow_set_double(fc_arrow_writer *w, size_t col, double value) {
+    column *c = value_column(w, col, 8);
+    if (c) append(&c->values, &value, 8);
+}
+
+void fc_arrow_set_bool(fc_arrow_writer *w, size_t col, int value) {
+    column *c = value_column(w, col, 0);
+    if (c && value) set_bit(&c->values, w->rows);
+}
+
+void fc_arrow_set_string(fc_arrow_writer *w, size_t col, const char *s, size_t len) {
+    column *c = value_column(w, col, 4);
+    if (!c) return;
+    int32_t index;
+    if (c->type == FC_ARROW_DICT_UTF8) {
+        long found = dict_index(c->dict, (const uint8_t *)s, len);
+        if (found < 0) {
+            fail(w, found == -2 ? FC_ERR_LIMIT : FC_ERR_NOMEM);
+            return;
+        }
+        index = (int32_t)found;
+    } else {
+        if (c->data.len + len > STRING_MAX) {
+            fail(w, FC_ERR_LIMIT);
+            return;
+        }
+        if (append(&c->data, s, len) != 0) {
+            fail(w, FC_ERR_NOMEM);
+            return;
+        }
+        w->string_bytes += len;
+        index = (int32_t)c->data.len;
+    }
+    append(&c->values, &index, 4);
+}
+
+fc_status fc_arrow_end_row(fc_arrow_writer *w) {
+    if (w->status != FC_OK) return w->status;
+    static const uint8_t zeros[8];
+    for (size_t col = 0; col < w->column_count; col++) {
+        column *c = &w->columns[col];
+        if (c->set) {
+            c->set = 0;
+            continue;
+        }
+        // Null: a zero value, or for strings an empty one
+        int32_t end = (int32_t)c->data.len;
+        int rc = 0;
+        switch (c->type) {
+            case FC_ARROW_INT64:
+            case FC_ARROW_DOUBLE:     rc = append(&c->values, zeros, 8); break;
+            case FC_ARROW_BOOL:       break;
+            case FC_ARROW_UTF8:       rc = append_i32(&c->values, end); break;
+            case FC_ARROW_DICT_UTF8:  rc = append_i32(&c->values, 0); break;
+        }
+        if (rc != 0) fail(w, FC_ERR_NOMEM);
+        c->null_count++;
+    }
+    if (++w->rows == FC_ARROW_BATCH_ROWS || w->string_bytes >= BATCH_BYTES) write_batch(w);
+    return w->status;
+}
+
+fc_status fc_arrow_writer_finish(fc_arrow_writer *w, int abandon) {
+    if (!w) return FC_ERR_NOMEM;
+    if (abandon) {
+        free_writer(w);
+        return FC_OK;
+    }
+    if (w->rows) write_batch(w);
+
+    // Dictionaries go last: the footer tells readers where they are
+    size_t dict_count = 0;
+    block *dicts = malloc((w->column_count ? w->column_count : 1) * sizeof(*dicts));
+    if (!dicts) fail(w, FC_ERR_NOMEM);
+    for (size_t col = 0; dicts && col < w->column_count; col++) {
+        if (w->columns[col].type == FC_ARROW_DICT_UTF8) write_dictionary(w, col, &dicts[dict_count++]);
+    }
+    static const int32_t end_of_stream[2] = { -1, 0 };
+    emit(w, end_of_stream, sizeof(end_of_stream));
+
+    fb_builder *fb = &w->fb;
+    fb_init(fb);
+    size_t batches = fb_struct_vector(fb, w->batches.data, sizeof(block), w->batches.len / sizeof(block));
+    size_t dictionaries = fb_struct_vector(fb, dicts, sizeof(block), dict_count);
+    size_t schema = build_schema(fb, w);
+    fb_start(fb);
+    fb_add_offset(fb, 1, schema);
+    fb_add_offset(fb, 2, dictionaries);
+    fb_add_offset(fb, 3, batches);
+    fb_add_i16(fb, 0, METADATA_VERSION);
+    size_t size;
+    const uint8_t *footer = fb_finish(fb, fb_end(fb), &size);
+    if (!footer) fail(w, FC_ERR_NOMEM);
+    emit(w, footer, size);
+    int32_t footer_size = (int32_t)size;
+    emit(w, &footer_size, 4);
+    emit(w, "ARROW1", 6);
+    free(dicts);
+
+    fc_status status = w->status;
+    free_writer(w);
+    return status;
+}
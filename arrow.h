@@ -0,0 +1,55 @@
+#ifndef ARROW_H
+#define ARROW_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "converter.h"
+
+// Apache Arrow IPC file writer ("Feather v2", .arrow), written from the
+// format specification with no dependency on the Arrow libraries. The file
+// is a schema, a run of record batches and a footer indexing them, every
+// buffer 8-byte aligned: readers map it and use the columns in place.
+//
+// Values are appended a row at a time into per-column buffers holding one
+// batch (FC_ARROW_BATCH_ROWS rows, fewer if the strings grow large), which
+// is written out column by column when full. Dictionary columns keep their
+// distinct values across the whole file and write them once at the end,
+// which the file format allows. They are held in memory until then, so a
+// column that turns out to be high-cardinality costs memory but still
+// converts; only past 2 GB of distinct text (int32 offsets) does the write
+// fail, with FC_ERR_LIMIT.
+
+#define FC_ARROW_BATCH_ROWS 16384
+
+typedef enum {
+    FC_ARROW_INT64,
+    FC_ARROW_DOUBLE,
+    FC_ARROW_BOOL,
+    FC_ARROW_UTF8,
+    FC_ARROW_DICT_UTF8      // utf8 values, int32 indices into a dictionary
+} fc_arrow_type;
+
+typedef struct fc_arrow_writer fc_arrow_writer;
+
+// Start a file on out with the given columns (all nullable) and write the
+// schema. names[i] is names_len[i] bytes of UTF-8. NULL if out of memory.
+fc_arrow_writer *fc_arrow_writer_new(FILE *out, const char *const *names, const size_t *name_lens,
+                                     const fc_arrow_type *types, size_t columns);
+
+// Set the current row's value in column col; columns not set are null.
+// Each call must match the column's type (strings for both UTF8 kinds).
+void fc_arrow_set_int64(fc_arrow_writer *w, size_t col, long long value);
+void fc_arrow_set_double(fc_arrow_writer *w, size_t col, double value);
+void fc_arrow_set_bool(fc_arrow_writer *w, size_t col, int value);
+void fc_arrow_set_string(fc_arrow_writer *w, size_t col, const char *s, size_t len);
+
+// Finish the current row. Returns the writer's status: once a write or an
+// allocation fails every later call keeps returning that error.
+fc_status fc_arrow_end_row(fc_arrow_writer *w);
+
+// Write the last batch, the dictionaries and the footer, then free w.
+// With abandon set, just free it.
+fc_status fc_arrow_writer_finish(fc_arrow_writer *w, int abandon);
+
+#endif
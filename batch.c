@@ -0,0 +1,768 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "batch.h"
+#include "threadpool.h"
+#include "scheduler.h"
+#include "budget.h"
+#include "trace.h"
+#include "tool.h"
+
+#define BATCH_DEFAULT_DEPTH 64
+#define BATCH_DIRECT_SIZE (64L << 20)  // larger inputs stream file-to-file instead
+#define BATCH_ADMIT_MIN (1L << 20)     // budget left below which no new file starts
+
+typedef enum {
+    STAGE_OPEN_IN,
+    STAGE_STAT_IN,
+    STAGE_READ,
+    STAGE_CLOSE_IN,
+    STAGE_READ_DONE,
+    STAGE_TRANSFORMED,
+    STAGE_OPEN_OUT,
+    STAGE_WRITE,
+    STAGE_CLOSE_OUT,
+    STAGE_WRITE_DONE
+} file_stage;
+
+typedef struct batch batch;
+
+typedef struct batch_file {
+    batch *owner;
+    fc_batch_item *item;
+    file_stage stage;
+    fc_status status;
+    int fd;
+    fc_conversion type;
+    int direct;             // convert file-to-file in the transform stage
+    uint64_t reserved;      // memory budget held for data and out
+
+    char *data;             // whole input
+    size_t size, done;
+    char *out;              // whole output
+    size_t out_len, out_done;
+
+#ifdef __linux__
+    struct statx stx;
+#endif
+    struct batch_file *next;
+} batch_file;
+
+// An I/O backend moves files from "opened" to STAGE_READ_DONE and from
+// STAGE_TRANSFORMED to STAGE_WRITE_DONE, then hands them to push_ready().
+typedef struct {
+    const char *name;
+    int (*start_read)(batch *b, batch_file *f);
+    int (*start_write)(batch *b, batch_file *f);
+    void (*wait)(batch *b);     // block until push_ready() has been called
+    void (*destroy)(batch *b);
+} io_ops;
+
+typedef struct uring uring;
+
+struct batch {
+    const io_ops *ops;
+    int event_fd;               // signalled whenever the ready list grows
+
+    pthread_mutex_t lock;
+    batch_file *ready;
+
+    fc_sched *transform;        // bulk jobs, cheapest first
+    fc_context *settings;       // as the transform workers' contexts are set up
+    fc_tool_pool *tool_pools[FC_CONVERSION_LAST + 1];   // helpers for tools configured to take batches
+    fc_pool *io_pool;           // thread backend
+    uring *ring;                // io_uring backend
+};
+
+static uint64_t path_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+// Reserve memory for converting a file of size bytes in memory: the input,
+// plus an output about as large unless the conversion rewrites the input in
+// place. Never waits, since the caller keeps other files moving; if the
+// budget is short the file is converted file-to-file instead.
+static int reserve_memory(batch_file *f, uint64_t size) {
+    const fc_converter_info *info = fc_converter(f->type);
+    uint64_t need = size + 1;
+    if (!info || !(info->caps & FC_CAP_IN_PLACE)) need += size;
+    if (size > BATCH_DIRECT_SIZE || fc_budget_try_acquire(need) != 0) return -1;
+    f->reserved = need;
+    return 0;
+}
+
+static void push_ready(batch *b, batch_file *f) {
+    pthread_mutex_lock(&b->lock);
+    f->next = b->ready;
+    b->ready = f;
+    pthread_mutex_unlock(&b->lock);
+
+    uint64_t one = 1;
+    if (write(b->event_fd, &one, sizeof(one)) < 0) {
+        // the counter cannot overflow with one increment per file stage
+    }
+}
+
+static batch_file *take_ready(batch *b) {
+    pthread_mutex_lock(&b->lock);
+    batch_file *list = b->ready;
+    b->ready = NULL;
+    pthread_mutex_unlock(&b->lock);
+    return list;
+}
+
+// Thread-pool backend: blocking I/O on a pool of I/O threads
+
+static void thread_read_job(fc_context *ctx, void *arg) {
+    batch_file *f = arg;
+    (void)ctx;
+
+    fc_trace_span span;
+    fc_trace_begin(&span, "read file");
+    int fd = open(f->item->input, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        f->status = FC_ERR_INPUT;
+    } else if (reserve_memory(f, st.st_size) != 0) {
+        f->direct = 1;
+    } else if (!(f->data = malloc(st.st_size + 1))) {
+        f->status = FC_ERR_NOMEM;
+    } else {
+        f->size = st.st_size;
+        while (f->done < f->size) {
+            ssize_t n = read(fd, f->data + f->done, f->size - f->done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                f->status = FC_ERR_IO;
+                break;
+            }
+            if (n == 0) {
+                f->size = f->done;  // file shrank under us
+                break;
+            }
+            f->done += n;
+        }
+    }
+    if (fd >= 0) close(fd);
+    fc_trace_end(&span, f->done);
+
+    f->stage = STAGE_READ_DONE;
+    push_ready(f->owner, f);
+}
+
+static void thread_write_job(fc_context *ctx, void *arg) {
+    batch_file *f = arg;
+    (void)ctx;
+
+    fc_trace_span span;
+    fc_trace_begin(&span, "write file");
+    int fd = open(f->item->output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        f->status = FC_ERR_OUTPUT;
+    } else {
+        while (f->out_done < f->out_len) {
+            ssize_t n = write(fd, f->out + f->out_done, f->out_len - f->out_done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                f->status = FC_ERR_IO;
+                break;
+            }
+            f->out_done += n;
+        }
+        if (close(fd) != 0 && f->status == FC_OK) f->status = FC_ERR_IO;
+    }
+    fc_trace_end(&span, f->out_done);
+
+    f->stage = STAGE_WRITE_DONE;
+    push_ready(f->owner, f);
+}
+
+static int thread_start_read(batch *b, batch_file *f) {
+    return fc_pool_submit(b->io_pool, thread_read_job, f);
+}
+
+static int thread_start_write(batch *b, batch_file *f) {
+    return fc_pool_submit(b->io_pool, thread_write_job, f);
+}
+
+static void eventfd_wait(batch *b) {
+    uint64_t value;
+    fc_trace_span span;
+    fc_trace_begin(&span, "wait");
+    while (read(b->event_fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+    }
+    fc_trace_end(&span, 0);
+}
+
+static void thread_destroy(batch *b) {
+    fc_pool_free(b->io_pool);
+    b->io_pool = NULL;
+}
+
+static const io_ops thread_ops = {
+    "threads", thread_start_read, thread_start_write, eventfd_wait, thread_destroy
+};
+
+static int thread_init(batch *b, int depth) {
+    int threads = depth / 4;
+    if (threads < 4) threads = 4;
+    if (threads > 32) threads = 32;
+
+    b->io_pool = fc_pool_new(threads, depth);
+    if (!b->io_pool) return -1;
+    b->ops = &thread_ops;
+    return 0;
+}
+
+// io_uring backend: every open/statx/read/write/close is an SQE, so one
+// thread keeps queue_depth files in flight without blocking on any of them.
+
+#ifdef __linux__
+
+struct uring {
+    int fd;
+    unsigned sq_entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_local_tail, sq_submitted;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+
+    uint64_t event_value;       // landing spot for the eventfd read
+};
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_supported(int fd) {
+    static const int needed[] = {
+        IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE
+    };
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, len);
+    int ok = 0;
+
+    if (probe && syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        ok = 1;
+        for (size_t i = 0; i < sizeof(needed) / sizeof(needed[0]); i++) {
+            if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) ok = 0;
+        }
+    }
+    free(probe);
+    return ok;
+}
+
+static void uring_free(uring *r) {
+    if (r->sqes && r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_size);
+    if (r->cq_ring && r->cq_ring != MAP_FAILED && r->cq_ring != r->sq_ring) munmap(r->cq_ring, r->cq_ring_size);
+    if (r->sq_ring && r->sq_ring != MAP_FAILED) munmap(r->sq_ring, r->sq_ring_size);
+    if (r->fd >= 0) close(r->fd);
+    free(r);
+}
+
+static uring *uring_new(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    uring *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0 || !uring_supported(r->fd)) {
+        uring_free(r);
+        return NULL;
+    }
+
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_ring_size > r->sq_ring_size) r->sq_ring_size = r->cq_ring_size;
+        r->cq_ring_size = r->sq_ring_size;
+    }
+
+    r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED) {
+        uring_free(r);
+        return NULL;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ring = r->sq_ring;
+    } else {
+        r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ring == MAP_FAILED) {
+            uring_free(r);
+            return NULL;
+        }
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        uring_free(r);
+        return NULL;
+    }
+
+    char *sq = r->sq_ring, *cq = r->cq_ring;
+    r->sq_entries = p.sq_entries;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    r->sq_local_tail = r->sq_submitted = *r->sq_tail;
+    return r;
+}
+
+static int uring_submit(uring *r, unsigned wait_for) {
+    __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = r->sq_local_tail - r->sq_submitted;
+    int ret;
+    do {
+        ret = uring_enter(r->fd, to_submit, wait_for, wait_for ? IORING_ENTER_GETEVENTS : 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret >= 0) r->sq_submitted = r->sq_local_tail;
+    return ret;
+}
+
+static struct io_uring_sqe *uring_sqe(uring *r, int opcode, int fd, const void *addr,
+                                      unsigned len, uint64_t off, uint64_t user_data) {
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if (r->sq_local_tail - head >= r->sq_entries) {
+        uring_submit(r, 0);
+        head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        if (r->sq_local_tail - head >= r->sq_entries) return NULL;
+    }
+
+    unsigned idx = r->sq_local_tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->user_data = user_data;
+    r->sq_array[idx] = idx;
+    r->sq_local_tail++;
+    return sqe;
+}
+
+static int uring_arm_eventfd(batch *b) {
+    uring *r = b->ring;
+    return uring_sqe(r, IORING_OP_READ, b->event_fd, &r->event_value, sizeof(r->event_value), 0, 0) ? 0 : -1;
+}
+
+// Queue the next operation for f according to its stage
+static int uring_queue(batch *b, batch_file *f) {
+    uring *r = b->ring;
+    uint64_t tag = (uint64_t)(uintptr_t)f;
+    struct io_uring_sqe *sqe = NULL;
+
+    switch (f->stage) {
+        case STAGE_OPEN_IN:
+            sqe = uring_sqe(r, IORING_OP_OPENAT, AT_FDCWD, f->item->input, 0, 0, tag);
+            if (sqe) sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            break;
+        case STAGE_STAT_IN:
+            sqe = uring_sqe(r, IORING_OP_STATX, f->fd, "", STATX_SIZE, (uint64_t)(uintptr_t)&f->stx, tag);
+            if (sqe) sqe->statx_flags = AT_EMPTY_PATH;
+            break;
+        case STAGE_READ:
+            sqe = uring_sqe(r, IORING_OP_READ, f->fd, f->data + f->done, f->size - f->done, f->done, tag);
+            break;
+        case STAGE_OPEN_OUT:
+            sqe = uring_sqe(r, IORING_OP_OPENAT, AT_FDCWD, f->item->output, 0666, 0, tag);
+            if (sqe) sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+            break;
+        case STAGE_WRITE:
+            sqe = uring_sqe(r, IORING_OP_WRITE, f->fd, f->out + f->out_done, f->out_len - f->out_done, f->out_done, tag);
+            break;
+        case STAGE_CLOSE_IN:
+        case STAGE_CLOSE_OUT:
+            sqe = uring_sqe(r, IORING_OP_CLOSE, f->fd, NULL, 0, 0, tag);
+            break;
+        default:
+            break;
+    }
+    return sqe ? 0 : -1;
+}
+
+static void uring_fail(batch_file *f, fc_status status) {
+    if (f->status == FC_OK) f->status = status;
+}
+
+// Advance f after its current operation completed with result res
+static void uring_complete(batch *b, batch_file *f, int res) {
+    switch (f->stage) {
+        case STAGE_OPEN_IN:
+            if (res < 0) {
+                uring_fail(f, FC_ERR_INPUT);
+                f->stage = STAGE_READ_DONE;
+                push_ready(b, f);
+                return;
+            }
+            f->fd = res;
+            f->stage = STAGE_STAT_IN;
+            break;
+
+        case STAGE_STAT_IN:
+            if (res < 0) {
+                uring_fail(f, FC_ERR_INPUT);
+                f->stage = STAGE_CLOSE_IN;
+            } else if (reserve_memory(f, f->stx.stx_size) != 0) {
+                f->direct = 1;
+                f->stage = STAGE_CLOSE_IN;
+            } else if (!(f->data = malloc(f->stx.stx_size + 1))) {
+                uring_fail(f, FC_ERR_NOMEM);
+                f->stage = STAGE_CLOSE_IN;
+            } else {
+                f->size = f->stx.stx_size;
+                f->stage = f->size ? STAGE_READ : STAGE_CLOSE_IN;
+            }
+            break;
+
+        case STAGE_READ:
+            if (res < 0) {
+                uring_fail(f, FC_ERR_IO);
+                f->stage = STAGE_CLOSE_IN;
+            } else if (res == 0) {
+                f->size = f->done;  // file shrank under us
+                f->stage = STAGE_CLOSE_IN;
+            } else {
+                f->done += res;
+                if (f->done == f->size) f->stage = STAGE_CLOSE_IN;
+            }
+            break;
+
+        case STAGE_CLOSE_IN:
+            f->fd = -1;
+            f->stage = STAGE_READ_DONE;
+            push_ready(b, f);
+            return;
+
+        case STAGE_OPEN_OUT:
+            if (res < 0) {
+                uring_fail(f, FC_ERR_OUTPUT);
+                f->stage = STAGE_WRITE_DONE;
+                push_ready(b, f);
+                return;
+            }
+            f->fd = res;
+            f->stage = f->out_len ? STAGE_WRITE : STAGE_CLOSE_OUT;
+            break;
+
+        case STAGE_WRITE:
+            if (res <= 0) {
+                uring_fail(f, FC_ERR_IO);
+                f->stage = STAGE_CLOSE_OUT;
+            } else {
+                f->out_done += res;
+                if (f->out_done == f->out_len) f->stage = STAGE_CLOSE_OUT;
+            }
+            break;
+
+        case STAGE_CLOSE_OUT:
+            if (res < 0) uring_fail(f, FC_ERR_IO);
+            f->fd = -1;
+            f->stage = STAGE_WRITE_DONE;
+            push_ready(b, f);
+            return;
+
+        default:
+            return;
+    }
+
+    if (uring_queue(b, f) != 0) {
+        // Ring full even after submitting: give up on this file
+        uring_fail(f, FC_ERR_IO);
+        if (f->fd >= 0) close(f->fd);
+        f->fd = -1;
+        f->stage = f->stage <= STAGE_READ_DONE ? STAGE_READ_DONE : STAGE_WRITE_DONE;
+        push_ready(b, f);
+    }
+}
+
+static int uring_start_read(batch *b, batch_file *f) {
+    f->stage = STAGE_OPEN_IN;
+    return uring_queue(b, f);
+}
+
+static int uring_start_write(batch *b, batch_file *f) {
+    f->stage = STAGE_OPEN_OUT;
+    return uring_queue(b, f);
+}
+
+static void uring_wait(batch *b) {
+    uring *r = b->ring;
+
+    fc_trace_span span;
+    fc_trace_begin(&span, "io_uring wait");
+    int submitted = uring_submit(r, 1);
+    fc_trace_end(&span, 0);
+    if (submitted < 0) {
+        // Submission failed outright; fall back to waiting for the transform stage
+        eventfd_wait(b);
+        return;
+    }
+
+    unsigned head = *r->cq_head;
+    while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        uint64_t tag = cqe->user_data;
+        int res = cqe->res;
+        head++;
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+        if (tag == 0) {
+            // The transform stage signalled the eventfd; keep listening
+            uring_arm_eventfd(b);
+        } else {
+            uring_complete(b, (batch_file *)(uintptr_t)tag, res);
+        }
+    }
+}
+
+static void uring_destroy(batch *b) {
+    uring_free(b->ring);
+    b->ring = NULL;
+}
+
+static const io_ops uring_ops = {
+    "io_uring", uring_start_read, uring_start_write, uring_wait, uring_destroy
+};
+
+static int uring_init(batch *b, int depth) {
+    unsigned entries = 1;
+    while (entries < (unsigned)(depth + 1) * 2) entries <<= 1;
+
+    b->ring = uring_new(entries);
+    if (!b->ring) return -1;
+    b->ops = &uring_ops;
+    if (uring_arm_eventfd(b) != 0) {
+        uring_destroy(b);
+        return -1;
+    }
+    return 0;
+}
+
+#else
+
+static int uring_init(batch *b, int depth) {
+    (void)b;
+    (void)depth;
+    return -1;
+}
+
+#endif
+
+// Transform stage
+
+static void transform_job(fc_context *ctx, void *arg) {
+    batch_file *f = arg;
+    batch *b = f->owner;
+
+    if (f->direct) {
+        fc_set_tool_pool(ctx, f->type, b->tool_pools[f->type]);
+        f->status = fc_convert_file(ctx, f->type, f->item->input, f->item->output);
+        fc_set_tool_pool(ctx, f->type, NULL);
+        f->item->bytes_in = path_size(f->item->input);
+        f->item->bytes_out = path_size(f->item->output);
+    } else {
+        // Byte-wise conversions rewrite the input buffer, which then is the
+        // output; the rest (and non-UTF-8 input) convert into a new one
+        f->status = fc_convert_in_place(ctx, f->type, f->data, f->size, &f->out_len);
+        if (f->status == FC_OK) {
+            f->out = f->data;
+        } else {
+            f->status = fc_convert_buffer(ctx, f->type, f->data, f->size, &f->out, &f->out_len);
+            free(f->data);
+        }
+        f->item->bytes_in = f->size;
+        f->data = NULL;
+    }
+
+    f->stage = STAGE_TRANSFORMED;
+    push_ready(b, f);
+}
+
+static void split_done(const fc_sched_result *result, void *arg) {
+    batch_file *f = arg;
+    f->status = result->status;
+    f->item->bytes_in = path_size(f->item->input);
+    f->item->bytes_out = path_size(f->item->output);
+    f->stage = STAGE_TRANSFORMED;
+    push_ready(f->owner, f);
+}
+
+// Queue f for conversion, costed by its size. Large inputs of conversions
+// that can be cut at line breaks go to the scheduler as files, to be split
+// across the transform threads.
+static int start_transform(batch *b, batch_file *f) {
+    if (!f->direct) {
+        return fc_sched_submit(b->transform, FC_PRIORITY_BULK, fc_sched_cost(f->type, f->size), transform_job, f);
+    }
+    const fc_converter_info *info = fc_converter(f->type);
+    if (info && (info->caps & FC_CAP_PARALLEL)) {
+        return fc_sched_convert_file(b->transform, FC_PRIORITY_BULK, f->type, f->item->input, f->item->output,
+                                     split_done, f);
+    }
+    uint64_t size = path_size(f->item->input);
+    return fc_sched_submit(b->transform, FC_PRIORITY_BULK, fc_sched_cost(f->type, size), transform_job, f);
+}
+
+// Conversions the library does not stream in-process (external tools, PDF
+// rendering) are run file-to-file, as are outputs to be compressed or split
+// into HTML pages (compressed inputs are handled in memory)
+static int needs_direct(const batch *b, fc_conversion type, const char *output) {
+    const fc_converter_info *info = fc_converter(type);
+    if (!info || !(info->caps & FC_CAP_STREAMING)) return 1;
+    if (type == FC_TXT_TO_HTML && fc_html_page_lines(b->settings) > 0) return 1;
+    return fc_output_compression(b->settings, output) != FC_COMPRESS_NONE;
+}
+
+fc_io_backend fc_io_backend_parse(const char *name) {
+    if (!name) return FC_IO_AUTO;
+    if (strcasecmp(name, "uring") == 0 || strcasecmp(name, "io_uring") == 0) return FC_IO_URING;
+    if (strcasecmp(name, "threads") == 0) return FC_IO_THREADS;
+    return FC_IO_AUTO;
+}
+
+int fc_batch_convert(fc_conversion type, fc_batch_item *items, int count,
+                     const fc_batch_options *opts, const char **backend_used) {
+    fc_batch_options defaults = { FC_IO_AUTO, BATCH_DEFAULT_DEPTH, 0 };
+    if (!opts) opts = &defaults;
+    int depth = opts->queue_depth > 0 ? opts->queue_depth : BATCH_DEFAULT_DEPTH;
+
+    batch b;
+    memset(&b, 0, sizeof(b));
+    pthread_mutex_init(&b.lock, NULL);
+
+    b.event_fd = eventfd(0, EFD_CLOEXEC);
+    if (b.event_fd < 0) return -1;
+
+    int ready = -1;
+    if (opts->backend != FC_IO_THREADS) ready = uring_init(&b, depth);
+    if (ready != 0 && opts->backend != FC_IO_URING) ready = thread_init(&b, depth);
+
+    b.transform = ready == 0 ? fc_sched_new(opts->transform_threads, 0, depth) : NULL;
+    if (!b.transform) {
+        if (ready == 0) b.ops->destroy(&b);
+        close(b.event_fd);
+        pthread_mutex_destroy(&b.lock);
+        return -1;
+    }
+    if (backend_used) *backend_used = b.ops->name;
+    b.settings = fc_worker_context_new();
+
+    // One helper per transform thread, spawned on first use
+    for (int t = FC_CONVERSION_FIRST; t <= FC_CONVERSION_LAST; t++) {
+        const char *tool = fc_converter(t)->tool;
+        if (tool) b.tool_pools[t] = fc_tool_pool_from_env(tool, fc_sched_threads(b.transform));
+    }
+
+    int next = 0, in_flight = 0, failed = 0;
+
+    while (next < count || in_flight > 0) {
+        // Keep the pipeline full, short of exhausting the memory budget:
+        // then wait for files in flight to finish and give memory back
+        while (next < count && in_flight < depth &&
+               (in_flight == 0 || fc_budget_available() >= BATCH_ADMIT_MIN)) {
+            batch_file *f = calloc(1, sizeof(*f));
+            fc_batch_item *item = &items[next++];
+            item->status = FC_OK;
+            item->bytes_in = item->bytes_out = 0;
+            if (!f) {
+                item->status = FC_ERR_NOMEM;
+                failed++;
+                continue;
+            }
+            f->owner = &b;
+            f->item = item;
+            f->type = item->type ? item->type : type;
+            f->fd = -1;
+            in_flight++;
+
+            if (needs_direct(&b, f->type, item->output)) {
+                f->direct = 1;
+                f->stage = STAGE_READ_DONE;
+                push_ready(&b, f);
+            } else if (b.ops->start_read(&b, f) != 0) {
+                f->status = FC_ERR_IO;
+                f->stage = STAGE_READ_DONE;
+                push_ready(&b, f);
+            }
+        }
+
+        batch_file *list = take_ready(&b);
+        if (!list) {
+            b.ops->wait(&b);
+            continue;
+        }
+
+        while (list) {
+            batch_file *f = list;
+            list = list->next;
+            int finished = 0;
+
+            switch (f->stage) {
+                case STAGE_READ_DONE:
+                    if (f->status != FC_OK || start_transform(&b, f) != 0) finished = 1;
+                    break;
+                case STAGE_TRANSFORMED:
+                    if (f->status != FC_OK || f->direct) {
+                        finished = 1;
+                    } else if (b.ops->start_write(&b, f) != 0) {
+                        f->status = FC_ERR_IO;
+                        finished = 1;
+                    }
+                    break;
+                default:
+                    finished = 1;
+                    break;
+            }
+
+            if (finished) {
+                f->item->status = f->status;
+                if (!f->direct && f->status == FC_OK) f->item->bytes_out = f->out_len;
+                if (f->status != FC_OK) failed++;
+                free(f->data);
+                free(f->out);
+                fc_budget_release(f->reserved);
+                free(f);
+                in_flight--;
+            }
+        }
+    }
+
+    fc_sched_free(b.transform);
+    fc_context_free(b.settings);
+    for (int t = FC_CONVERSION_FIRST; t <= FC_CONVERSION_LAST; t++) fc_tool_pool_free(b.tool_pools[t]);
+    b.ops->destroy(&b);
+    close(b.event_fd);
+    pthread_mutex_destroy(&b.lock);
+    return failed;
+}
@@ -0,0 +1,60 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include "converter.h"
+
+// Batch conversion pipeline for many (mostly small) files.
+//
+// Opens, reads, writes and closes are kept in flight together by an I/O
+// backend, completed reads are handed to transform threads that convert in
+// memory, and the results are queued back to the backend for writing. The
+// transform stage does not know which backend is running. Its queue is a
+// scheduler (scheduler.h): the cheapest conversion waiting runs first, and large
+// inputs of conversions that can be cut at line breaks are split across
+// the transform threads.
+//
+// Files read into memory are reserved against the memory budget
+// (budget.h). A file the budget cannot take is converted file-to-file, and
+// no new files are started while the budget is nearly exhausted.
+//
+// Backends: io_uring (raw syscalls, no liburing needed) and a portable
+// thread-pool backend doing blocking I/O. FC_IO_AUTO uses io_uring when the
+// kernel supports the required operations and falls back otherwise.
+
+typedef enum {
+    FC_IO_AUTO = 0,
+    FC_IO_URING,
+    FC_IO_THREADS
+} fc_io_backend;
+
+typedef struct {
+    const char *input;
+    const char *output;
+    fc_conversion type;     // 0 for the batch's type
+    fc_status status;       // filled in by fc_batch_convert
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+} fc_batch_item;
+
+typedef struct {
+    fc_io_backend backend;
+    int queue_depth;        // files in flight in the I/O stage, default 64
+    int transform_threads;  // default one per CPU
+} fc_batch_options;
+
+// Convert every item, each with its own type or else type, so one batch can
+// cover a folder of mixed formats (see fc_detect_conversion()). Each file
+// goes the fastest way its converter allows: in place in the read buffer,
+// into a new buffer, or file-to-file for tool-based conversions, which go
+// to a pool of long-lived helpers if FC_<TOOL>_HELPER names one (tool.h).
+// opts may be NULL for defaults. Returns the number of items that failed, or
+// -1 if the pipeline could not start. If backend_used is not NULL it
+// receives "io_uring" or "threads".
+int fc_batch_convert(fc_conversion type, fc_batch_item *items, int count,
+                     const fc_batch_options *opts, const char **backend_used);
+
+// Parse "auto", "uring"/"io_uring" or "threads". Returns FC_IO_AUTO if unknown.
+fc_io_backend fc_io_backend_parse(const char *name);
+
+#endif
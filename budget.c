@@ -0,0 +1,281 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "budget.h"
+
+#define SPILL_MIN_CAPACITY 65536
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t released = PTHREAD_COND_INITIALIZER;
+static fc_budget_stats stats;
+
+static int fits(uint64_t bytes) {
+    return stats.limit == 0 || (stats.reserved <= stats.limit && bytes <= stats.limit - stats.reserved);
+}
+
+static void take(uint64_t bytes) {
+    stats.reserved += bytes;
+    if (stats.reserved > stats.peak) stats.peak = stats.reserved;
+}
+
+void fc_budget_set(uint64_t bytes) {
+    pthread_mutex_lock(&lock);
+    stats.limit = bytes;
+    pthread_cond_broadcast(&released);
+    pthread_mutex_unlock(&lock);
+}
+
+int fc_budget_set_env(void) {
+    const char *value = getenv("FC_MAX_MEMORY");
+    if (!value || !*value) return 0;
+    uint64_t bytes = fc_parse_size(value);
+    if (!bytes) return -1;
+    fc_budget_set(bytes);
+    return 0;
+}
+
+uint64_t fc_budget_limit(void) {
+    pthread_mutex_lock(&lock);
+    uint64_t limit = stats.limit;
+    pthread_mutex_unlock(&lock);
+    return limit;
+}
+
+uint64_t fc_budget_available(void) {
+    pthread_mutex_lock(&lock);
+    uint64_t available = stats.limit == 0 ? UINT64_MAX
+                       : stats.reserved < stats.limit ? stats.limit - stats.reserved : 0;
+    pthread_mutex_unlock(&lock);
+    return available;
+}
+
+static int stopped(const int *stop) {
+    return stop && __atomic_load_n(stop, __ATOMIC_ACQUIRE);
+}
+
+int fc_budget_acquire(uint64_t bytes) {
+    return fc_budget_acquire_or_stop(bytes, NULL);
+}
+
+int fc_budget_acquire_or_stop(uint64_t bytes, const int *stop) {
+    pthread_mutex_lock(&lock);
+    if (stats.limit && bytes > stats.limit) {
+        stats.denials++;
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+    if (!fits(bytes)) {
+        struct timespec start, now;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        stats.waits++;
+        while (!fits(bytes)) {
+            // The budget may have been lowered below bytes meanwhile
+            if (stopped(stop) || (stats.limit && bytes > stats.limit)) {
+                stats.denials++;
+                pthread_mutex_unlock(&lock);
+                return -1;
+            }
+            pthread_cond_wait(&released, &lock);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        stats.wait_ns += (uint64_t)(now.tv_sec - start.tv_sec) * 1000000000ull + (now.tv_nsec - start.tv_nsec);
+    }
+    take(bytes);
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+int fc_budget_try_acquire(uint64_t bytes) {
+    pthread_mutex_lock(&lock);
+    int ok = fits(bytes);
+    if (ok) take(bytes);
+    else stats.denials++;
+    pthread_mutex_unlock(&lock);
+    return ok ? 0 : -1;
+}
+
+void fc_budget_release(uint64_t bytes) {
+    if (bytes == 0) return;
+    pthread_mutex_lock(&lock);
+    stats.reserved = bytes < stats.reserved ? stats.reserved - bytes : 0;
+    pthread_cond_broadcast(&released);
+    pthread_mutex_unlock(&lock);
+}
+
+void fc_budget_wake(void) {
+    pthread_mutex_lock(&lock);
+    pthread_cond_broadcast(&released);
+    pthread_mutex_unlock(&lock);
+}
+
+void fc_budget_get_stats(fc_budget_stats *out) {
+    pthread_mutex_lock(&lock);
+    *out = stats;
+    pthread_mutex_unlock(&lock);
+}
+
+static void count_spill(int moved, uint64_t bytes) {
+    pthread_mutex_lock(&lock);
+    stats.spills += moved;
+    stats.spill_bytes += bytes;
+    pthread_mutex_unlock(&lock);
+}
+
+uint64_t fc_parse_size(const char *s) {
+    if (!s) return 0;
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(s, &end, 10);
+    if (end == s || errno) return 0;
+    int shift = 0;
+    switch (*end) {
+        case 'k': case 'K': shift = 10; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'g': case 'G': shift = 30; end++; break;
+        case 't': case 'T': shift = 40; end++; break;
+    }
+    if (shift && (*end == 'b' || *end == 'B')) end++;
+    if (*end || value > (UINT64_MAX >> shift)) return 0;
+    return (uint64_t)value << shift;
+}
+
+// Spill streams
+
+typedef struct {
+    char *mem;              // contents while in memory
+    size_t cap;             // bytes of mem, all reserved
+    size_t memory_max;
+    int fd;                 // temporary file once spilled, else -1
+    off_t pos, size;
+} spill;
+
+static int spill_tempfile(void) {
+    const char *dir = getenv("TMPDIR");
+    if (!dir || !*dir) dir = "/tmp";
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0) return fd;
+    // Filesystems without O_TMPFILE
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/fc_spill.XXXXXX", dir);
+    fd = mkostemp(path, O_CLOEXEC);
+    if (fd >= 0) unlink(path);
+    return fd;
+}
+
+static int write_at(int fd, const char *buf, size_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+// Move the contents to a temporary file and give their memory back
+static int spill_to_file(spill *s) {
+    int fd = spill_tempfile();
+    if (fd < 0) return -1;
+    if (s->size && write_at(fd, s->mem, s->size, 0) != 0) {
+        close(fd);
+        return -1;
+    }
+    count_spill(1, s->size);
+    free(s->mem);
+    fc_budget_release(s->cap);
+    s->mem = NULL;
+    s->cap = 0;
+    s->fd = fd;
+    return 0;
+}
+
+// Make room in memory for size bytes, if the limit and the budget allow
+static int spill_grow(spill *s, size_t size) {
+    if (size > s->memory_max) return -1;
+    size_t cap = s->cap ? s->cap : SPILL_MIN_CAPACITY;
+    while (cap < size) cap *= 2;
+    if (cap > s->memory_max) cap = s->memory_max;
+    if (fc_budget_try_acquire(cap - s->cap) != 0) return -1;
+    char *grown = realloc(s->mem, cap);
+    if (!grown) {
+        fc_budget_release(cap - s->cap);
+        return -1;
+    }
+    s->mem = grown;
+    s->cap = cap;
+    return 0;
+}
+
+static ssize_t spill_write(void *cookie, const char *buf, size_t size) {
+    spill *s = cookie;
+    size_t end = (size_t)s->pos + size;
+    if (s->fd < 0 && end > s->cap && spill_grow(s, end) != 0 && spill_to_file(s) != 0) {
+        errno = ENOSPC;
+        return 0;
+    }
+    if (s->fd < 0) {
+        memcpy(s->mem + s->pos, buf, size);
+    } else {
+        if (write_at(s->fd, buf, size, s->pos) != 0) return 0;
+        count_spill(0, size);
+    }
+    s->pos += size;
+    if (s->pos > s->size) s->size = s->pos;
+    return size;
+}
+
+static ssize_t spill_read(void *cookie, char *buf, size_t size) {
+    spill *s = cookie;
+    if ((off_t)size > s->size - s->pos) size = s->size - s->pos;
+    if (size == 0) return 0;
+    ssize_t n;
+    if (s->fd < 0) {
+        memcpy(buf, s->mem + s->pos, size);
+        n = size;
+    } else {
+        do {
+            n = pread(s->fd, buf, size, s->pos);
+        } while (n < 0 && errno == EINTR);
+    }
+    if (n > 0) s->pos += n;
+    return n;
+}
+
+static int spill_seek(void *cookie, off64_t *offset, int whence) {
+    spill *s = cookie;
+    off_t pos = whence == SEEK_SET ? *offset : whence == SEEK_CUR ? s->pos + *offset : s->size + *offset;
+    if (pos < 0 || pos > s->size) return -1;
+    s->pos = pos;
+    *offset = pos;
+    return 0;
+}
+
+static int spill_close(void *cookie) {
+    spill *s = cookie;
+    int rc = 0;
+    if (s->fd >= 0) rc = close(s->fd);
+    free(s->mem);
+    fc_budget_release(s->cap);
+    free(s);
+    return rc;
+}
+
+FILE *fc_spill_open(size_t memory_max) {
+    spill *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->fd = -1;
+    s->memory_max = memory_max;
+    cookie_io_functions_t io = { spill_read, spill_write, spill_seek, spill_close };
+    FILE *f = fopencookie(s, "w+", io);
+    if (!f) free(s);
+    return f;
+}
@@ -0,0 +1,71 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Process-wide memory budget.
+//
+// Buffers whose size follows the input (whole files read for batch
+// conversion, inline daemon jobs, search results, the GUI's views) are
+// reserved here before they are allocated and released once freed. Fixed
+// costs (contexts, stream blocks, thread stacks) are not counted, so leave
+// some headroom below the real limit.
+//
+// Without a budget set every reservation succeeds; they are still counted
+// so the peak shows up in the metrics.
+
+// Set the budget. 0 removes the limit. Waiting callers are woken.
+void fc_budget_set(uint64_t bytes);
+
+// Set the budget from FC_MAX_MEMORY ("2G", "512M"). Returns -1 if the
+// variable is set but not a valid size.
+int fc_budget_set_env(void);
+
+uint64_t fc_budget_limit(void);         // 0 if unlimited
+
+// Bytes that can still be reserved; UINT64_MAX if unlimited.
+uint64_t fc_budget_available(void);
+
+// Reserve bytes, blocking until enough has been released. Returns -1
+// without waiting if bytes is larger than the whole budget.
+int fc_budget_acquire(uint64_t bytes);
+
+// As fc_budget_acquire, but also give up with -1 once *stop is nonzero.
+// Whoever sets *stop calls fc_budget_wake() afterwards.
+int fc_budget_acquire_or_stop(uint64_t bytes, const int *stop);
+
+// Wake blocked acquires to check their stop flags.
+void fc_budget_wake(void);
+
+// Reserve bytes if they are available now. 0 on success, -1 otherwise.
+int fc_budget_try_acquire(uint64_t bytes);
+
+void fc_budget_release(uint64_t bytes);
+
+typedef struct {
+    uint64_t limit;
+    uint64_t reserved;
+    uint64_t peak;          // highest reserved so far
+    uint64_t waits;         // acquires that had to block
+    uint64_t wait_ns;       // time spent blocked in them
+    uint64_t denials;       // try_acquires refused
+    uint64_t spills;        // spill streams moved to disk
+    uint64_t spill_bytes;   // bytes written to spill files
+} fc_budget_stats;
+
+void fc_budget_get_stats(fc_budget_stats *stats);
+
+// Parse "2G", "512M", "64K" or a plain number of bytes. Returns 0 if s is
+// not a valid size.
+uint64_t fc_parse_size(const char *s);
+
+// Temporary read/write stream for results of unknown size. Data is kept in
+// memory, reserved against the budget, up to memory_max bytes; past that or
+// once the budget refuses more it moves to an unlinked file under TMPDIR
+// (default /tmp). rewind() it to read back what was written. Writes fail
+// if the move does. NULL if out of memory.
+FILE *fc_spill_open(size_t memory_max);
+
+#endif
@@ -0,0 +1,443 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+#include "cache.h"
+#include "budget.h"
+#include "metrics.h"
+#include "trace.h"
+
+#define DEFAULT_MAX_BYTES (256ull << 20)
+#define COPY_BUFFER_SIZE 65536
+#define STALE_TMP_SECONDS 3600
+
+// Bump when the key or the stored format changes so old entries stop matching.
+#define CACHE_FORMAT 4
+#ifdef FC_HAVE_CAIRO
+#define CACHE_VARIANT 1     // TXT to PDF rendered in-process
+#else
+#define CACHE_VARIANT 0     // TXT to PDF rendered by txt2pdf
+#endif
+#define CACHE_SEED ((uint64_t)CACHE_FORMAT << 8 | CACHE_VARIANT)
+
+struct fc_cache {
+    char *dir;
+    int dir_fd;
+    uint64_t max_bytes;
+    int flags;
+    pthread_mutex_t lock;
+    fc_cache_stats stats;
+};
+
+typedef struct {
+    char name[NAME_MAX + 1];
+    uint64_t size;
+    struct timespec mtime;
+} cache_entry;
+
+// XXH64, written out here so the cache needs no extra library. It hashes
+// well over 10GB/s, far faster than any of the conversions.
+#define PRIME64_1 0x9E3779B185EBCA87ull
+#define PRIME64_2 0xC2B2AE3D27D4EB4Full
+#define PRIME64_3 0x165667B19E3779F9ull
+#define PRIME64_4 0x85EBCA77C2B2AE63ull
+#define PRIME64_5 0x27D4EB2F165667C5ull
+
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t xxh64_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh64_round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+static uint64_t xxh64(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *p = data;
+    const unsigned char *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        const unsigned char *limit = end - 32;
+        do {
+            v1 = xxh64_round(v1, read64(p));
+            v2 = xxh64_round(v2, read64(p + 8));
+            v3 = xxh64_round(v3, read64(p + 16));
+            v4 = xxh64_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+    h += len;
+
+    while (p + 8 <= end) {
+        h ^= xxh64_round(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= *p++ * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64_t ns_since(const struct timespec *from) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - from->tv_sec) * 1000000000ull + (now.tv_nsec - from->tv_nsec);
+}
+
+// Hash an open regular file through a read-only mapping.
+static int hash_fd(int fd, uint64_t size, uint64_t *hash) {
+    if (size == 0) {
+        *hash = xxh64(NULL, 0, CACHE_SEED);
+        return 0;
+    }
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return -1;
+    madvise(map, size, MADV_SEQUENTIAL);
+    *hash = xxh64(map, size, CACHE_SEED);
+    munmap(map, size);
+    return 0;
+}
+
+int fc_cache_hash_file(const char *path, uint64_t *hash, uint64_t *size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    int rc = -1;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && hash_fd(fd, st.st_size, hash) == 0) {
+        if (size) *size = st.st_size;
+        rc = 0;
+    }
+    close(fd);
+    return rc;
+}
+
+// Copy everything from src to dst: a reflink if the filesystem can share
+// extents, otherwise copy_file_range, otherwise read/write.
+static int copy_fd(int src, int dst) {
+    if (ioctl(dst, FICLONE, src) == 0) return 0;
+
+    ssize_t n;
+    while ((n = copy_file_range(src, NULL, dst, NULL, 1 << 30, 0)) > 0) {}
+    if (n == 0) return 0;
+    if (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP) return -1;
+
+    char buffer[COPY_BUFFER_SIZE];
+    if (lseek(src, 0, SEEK_SET) < 0 || ftruncate(dst, 0) != 0 || lseek(dst, 0, SEEK_SET) < 0) return -1;
+    while ((n = read(src, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = write(dst, buffer + done, n - done);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return -1;
+            done += w;
+        }
+    }
+    return n == 0 ? 0 : -1;
+}
+
+static int entry_cmp(const void *a, const void *b) {
+    const cache_entry *x = a, *y = b;
+    if (x->mtime.tv_sec != y->mtime.tv_sec) return x->mtime.tv_sec < y->mtime.tv_sec ? -1 : 1;
+    if (x->mtime.tv_nsec != y->mtime.tv_nsec) return x->mtime.tv_nsec < y->mtime.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+// Recount the directory and, if evict is set and it is over the cap, remove
+// the least recently used entries until it is back under 90% of the cap.
+// Leftover temporary files from crashed writers are cleaned up on the way.
+// Called with the lock held.
+static void scan_entries(fc_cache *cache, int evict) {
+    int fd = openat(cache->dir_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dir = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!dir) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+
+    cache_entry *entries = NULL;
+    size_t count = 0, capacity = 0;
+    uint64_t total = 0;
+    time_t now = time(NULL);
+    struct dirent *de;
+
+    while ((de = readdir(dir)) != NULL) {
+        struct stat st;
+        if (fstatat(cache->dir_fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) continue;
+        if (de->d_name[0] == '.') {
+            if (now - st.st_mtime > STALE_TMP_SECONDS) unlinkat(cache->dir_fd, de->d_name, 0);
+            continue;
+        }
+        total += st.st_size;
+        if (!evict) continue;
+        if (count == capacity) {
+            size_t grown = capacity ? capacity * 2 : 256;
+            cache_entry *bigger = realloc(entries, grown * sizeof(*entries));
+            if (!bigger) break;
+            entries = bigger;
+            capacity = grown;
+        }
+        snprintf(entries[count].name, sizeof(entries[count].name), "%s", de->d_name);
+        entries[count].size = st.st_size;
+        entries[count].mtime = st.st_mtim;
+        count++;
+    }
+    closedir(dir);
+
+    if (evict && total > cache->max_bytes) {
+        uint64_t target = cache->max_bytes / 10 * 9;
+        qsort(entries, count, sizeof(*entries), entry_cmp);
+        for (size_t i = 0; i < count && total > target; i++) {
+            if (unlinkat(cache->dir_fd, entries[i].name, 0) == 0) {
+                total -= entries[i].size;
+                cache->stats.evictions++;
+            }
+        }
+    }
+    cache->stats.bytes = total;
+    free(entries);
+}
+
+fc_cache *fc_cache_open(const char *dir, uint64_t max_bytes, int flags) {
+    if (!dir || !*dir) return NULL;
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) return NULL;
+
+    fc_cache *cache = calloc(1, sizeof(*cache));
+    if (!cache) return NULL;
+    cache->dir = strdup(dir);
+    cache->dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (!cache->dir || cache->dir_fd < 0) {
+        if (cache->dir_fd >= 0) close(cache->dir_fd);
+        free(cache->dir);
+        free(cache);
+        return NULL;
+    }
+    cache->max_bytes = max_bytes ? max_bytes : DEFAULT_MAX_BYTES;
+    cache->flags = flags;
+    pthread_mutex_init(&cache->lock, NULL);
+    scan_entries(cache, 1);
+    return cache;
+}
+
+fc_cache *fc_cache_open_env(void) {
+    const char *dir = getenv("FC_CACHE_DIR");
+    if (!dir || !*dir) return NULL;
+
+    uint64_t max_bytes = 0;
+    const char *max = getenv("FC_CACHE_MAX");
+    if (max && *max) max_bytes = fc_parse_size(max);
+    const char *link = getenv("FC_CACHE_LINK");
+    int flags = link && strcmp(link, "hard") == 0 ? FC_CACHE_HARDLINK : 0;
+    return fc_cache_open(dir, max_bytes, flags);
+}
+
+void fc_cache_close(fc_cache *cache) {
+    if (!cache) return;
+    close(cache->dir_fd);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->dir);
+    free(cache);
+}
+
+void fc_cache_get_stats(fc_cache *cache, fc_cache_stats *stats) {
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Produce output_file from a stored entry. Returns 0 on success, -1 if the
+// entry is gone (evicted meanwhile) and -2 if the output cannot be written.
+static int place_output(fc_cache *cache, const char *name, const char *output_file) {
+    int src = openat(cache->dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (src < 0) return -1;
+
+    // Stored entries are read-only, so a hard-linked output cannot be edited
+    // in place and corrupt the cache for everyone else.
+    if (cache->flags & FC_CACHE_HARDLINK) {
+        unlink(output_file);
+        if (linkat(cache->dir_fd, name, AT_FDCWD, output_file, 0) == 0) {
+            close(src);
+            return 0;
+        }
+    }
+
+    int dst = open(output_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (dst < 0) {
+        close(src);
+        return -2;
+    }
+    int rc = copy_fd(src, dst);
+    if (close(dst) != 0) rc = -1;
+    close(src);
+    return rc == 0 ? 0 : -2;
+}
+
+// Store a finished output under name. Failures only cost the cache entry.
+static void store_output(fc_cache *cache, const char *name, const char *output_file) {
+    int src = open(output_file, O_RDONLY | O_CLOEXEC);
+    if (src < 0) return;
+
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s/.tmp.XXXXXX", cache->dir);
+    int dst = mkostemp(tmp, O_CLOEXEC);
+    if (dst < 0) {
+        close(src);
+        return;
+    }
+
+    struct stat st;
+    int ok = copy_fd(src, dst) == 0 && fchmod(dst, 0444) == 0 && fstat(dst, &st) == 0;
+    ok = close(dst) == 0 && ok;
+    close(src);
+    if (!ok || renameat(AT_FDCWD, tmp, cache->dir_fd, name) != 0) {
+        unlink(tmp);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    cache->stats.stores++;
+    cache->stats.bytes += st.st_size;
+    if (cache->stats.bytes > cache->max_bytes) scan_entries(cache, 1);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static fc_status cache_convert_file(fc_cache *cache, fc_context *ctx, fc_conversion type,
+                                    const char *input_file, const char *output_file, int *hit) {
+    // Paged HTML is several files; an entry holds one
+    if (!cache || !fc_conversion_name(type) || (type == FC_TXT_TO_HTML && fc_html_page_lines(ctx))) {
+        return fc_convert_file(ctx, type, input_file, output_file);
+    }
+
+    // Anything that cannot be hashed (missing, not a regular file) goes
+    // straight to the converter, which reports the error as usual.
+    int fd = open(input_file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return fc_convert_file(ctx, type, input_file, output_file);
+
+    struct stat before;
+    uint64_t hash;
+    struct timespec start;
+    fc_trace_span span;
+    fc_trace_begin(&span, "hash");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (fstat(fd, &before) != 0 || !S_ISREG(before.st_mode) || hash_fd(fd, before.st_size, &hash) != 0) {
+        close(fd);
+        fc_trace_end(&span, 0);
+        return fc_convert_file(ctx, type, input_file, output_file);
+    }
+    uint64_t hash_ns = ns_since(&start);
+    fc_trace_end(&span, before.st_size);
+
+    char name[NAME_MAX + 1];
+    snprintf(name, sizeof(name), "%016llx-%llx-%d-%d",
+             (unsigned long long)hash, (unsigned long long)before.st_size, (int)type,
+             (int)fc_output_compression(ctx, output_file));
+
+    fc_trace_begin(&span, "cache lookup");
+    int placed = place_output(cache, name, output_file);
+    fc_trace_end(&span, 0);
+    if (placed == 0) {
+        utimensat(cache->dir_fd, name, NULL, 0);   // mark as recently used
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    cache->stats.hash_ns += hash_ns;
+    if (placed == 0) cache->stats.hits++;
+    else if (placed == -1) cache->stats.misses++;
+    pthread_mutex_unlock(&cache->lock);
+
+    if (placed != -1) {
+        close(fd);
+        if (placed == 0 && hit) *hit = 1;
+        return placed == 0 ? FC_OK : FC_ERR_OUTPUT;
+    }
+
+    fc_status status = fc_convert_file(ctx, type, input_file, output_file);
+
+    // Only store the output if the input did not change while it was being
+    // converted, otherwise it would not match the hash it is filed under.
+    struct stat after;
+    if (status == FC_OK && fstat(fd, &after) == 0 && after.st_size == before.st_size &&
+        after.st_mtim.tv_sec == before.st_mtim.tv_sec && after.st_mtim.tv_nsec == before.st_mtim.tv_nsec) {
+        fc_trace_begin(&span, "cache store");
+        store_output(cache, name, output_file);
+        fc_trace_end(&span, 0);
+    }
+    close(fd);
+    return status;
+}
+
+// A hit is recorded as a conversion like any other; a miss is recorded once,
+// not again by the fc_convert_file() it falls back to
+fc_status fc_cache_convert_file(fc_cache *cache, fc_context *ctx, fc_conversion type,
+                                const char *input_file, const char *output_file, int *hit) {
+    fc_metrics_scope scope;
+    struct stat st;
+    int cached = 0;
+
+    fc_metrics_begin(&scope, type);
+    fc_trace_span span;
+    fc_trace_begin(&span, "cached conversion");
+    fc_status status = cache_convert_file(cache, ctx, type, input_file, output_file, &cached);
+    fc_trace_end(&span, 0);
+    if (hit) *hit = cached;
+
+    if (scope.active) {
+        if (input_file && stat(input_file, &st) == 0) scope.bytes_in = st.st_size;
+        if (output_file && stat(output_file, &st) == 0) scope.bytes_out = st.st_size;
+    }
+    fc_metrics_end(&scope, status);
+    return status;
+}
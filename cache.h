@@ -0,0 +1,52 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include "converter.h"
+
+// Content-addressed conversion cache.
+//
+// Outputs are stored under a cache directory keyed by a hash of the input
+// bytes, the input size, the conversion type and the output compression, so
+// converting an unchanged input again only costs hashing it (over mmap) plus
+// producing the output from the stored copy: a reflink where the filesystem
+// supports it, otherwise a plain copy, or a hard link with FC_CACHE_HARDLINK.
+//
+// The directory is capped at max_bytes; least recently used entries (by
+// mtime, which is refreshed on every hit) are evicted first. Several
+// processes may share one directory. A cache handle is thread-safe.
+
+#define FC_CACHE_HARDLINK 0x1   // hard link outputs to the stored entry
+
+typedef struct fc_cache fc_cache;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t evictions;
+    uint64_t bytes;         // size of the cache directory as last seen
+    uint64_t hash_ns;       // total time spent hashing inputs
+} fc_cache_stats;
+
+// Open (creating if needed) a cache in dir. max_bytes == 0 uses 256MB.
+// Returns NULL if the directory cannot be used.
+fc_cache *fc_cache_open(const char *dir, uint64_t max_bytes, int flags);
+
+// Open the cache configured by FC_CACHE_DIR, FC_CACHE_MAX ("512M", "2G")
+// and FC_CACHE_LINK ("hard"). Returns NULL if FC_CACHE_DIR is not set.
+fc_cache *fc_cache_open_env(void);
+
+void fc_cache_close(fc_cache *cache);
+
+// Like fc_convert_file(), but served from the cache when the same input was
+// converted before. *hit, if not NULL, is set to 1 for a cache hit.
+fc_status fc_cache_convert_file(fc_cache *cache, fc_context *ctx, fc_conversion type,
+                                const char *input_file, const char *output_file, int *hit);
+
+void fc_cache_get_stats(fc_cache *cache, fc_cache_stats *stats);
+
+// Hash a file's contents the way the cache keys it. Returns 0 on success.
+int fc_cache_hash_file(const char *path, uint64_t *hash, uint64_t *size);
+
+#endif
@@ -0,0 +1,437 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifdef FC_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FC_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compress.h"
+#include "metrics.h"
+#include "trace.h"
+
+#define CHUNK_SIZE 65536
+#define CHANNEL_SLOTS 4     // chunks in flight between the caller and the codec thread
+#define GZIP_LEVEL 6
+#define ZSTD_LEVEL 3
+
+typedef struct {
+    char data[CHUNK_SIZE];
+    size_t len;
+} chunk;
+
+// One compressed stream. The producer fills chunks and the consumer drains
+// them: when reading, the codec thread produces and the caller consumes;
+// when writing, it is the other way round.
+typedef struct {
+    FILE *raw;
+    fc_compression compression;
+    int writing;
+    pthread_t thread;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    chunk slots[CHANNEL_SLOTS];
+    int head, count;
+    int done;               // producer has finished
+    int closed;             // consumer has gone away
+    int error;              // codec or raw I/O failure
+
+    chunk *filling;         // writer: chunk being filled by the caller
+    size_t pos;             // reader: bytes of the head chunk already returned
+    int frame_complete;     // decoder stopped at the end of a frame
+    uint64_t cpu_ns;        // codec thread CPU time, reported on close
+
+#ifdef FC_HAVE_ZLIB
+    z_stream z;
+#endif
+#ifdef FC_HAVE_ZSTD
+    ZSTD_DStream *zstd_in;
+    ZSTD_CCtx *zstd_out;
+#endif
+} pipe_stream;
+
+fc_compression fc_detect_compression(FILE *raw) {
+    unsigned char magic[4];
+    long start = ftell(raw);
+    size_t n = fread(magic, 1, sizeof(magic), raw);
+    if (start < 0 || fseek(raw, start, SEEK_SET) != 0) return FC_COMPRESS_NONE;
+    clearerr(raw);
+
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) return FC_COMPRESS_GZIP;
+    if (n >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) return FC_COMPRESS_ZSTD;
+    return FC_COMPRESS_NONE;
+}
+
+// Channel
+
+static chunk *channel_reserve(pipe_stream *ps) {
+    pthread_mutex_lock(&ps->lock);
+    while (ps->count == CHANNEL_SLOTS && !ps->closed) pthread_cond_wait(&ps->changed, &ps->lock);
+    chunk *c = ps->closed ? NULL : &ps->slots[(ps->head + ps->count) % CHANNEL_SLOTS];
+    pthread_mutex_unlock(&ps->lock);
+    if (c) c->len = 0;
+    return c;
+}
+
+static void channel_commit(pipe_stream *ps) {
+    pthread_mutex_lock(&ps->lock);
+    ps->count++;
+    pthread_cond_broadcast(&ps->changed);
+    pthread_mutex_unlock(&ps->lock);
+}
+
+// NULL once the producer is done and every chunk has been consumed
+static chunk *channel_peek(pipe_stream *ps) {
+    pthread_mutex_lock(&ps->lock);
+    while (ps->count == 0 && !ps->done) pthread_cond_wait(&ps->changed, &ps->lock);
+    chunk *c = ps->count ? &ps->slots[ps->head] : NULL;
+    pthread_mutex_unlock(&ps->lock);
+    return c;
+}
+
+static void channel_release(pipe_stream *ps) {
+    pthread_mutex_lock(&ps->lock);
+    ps->head = (ps->head + 1) % CHANNEL_SLOTS;
+    ps->count--;
+    pthread_cond_broadcast(&ps->changed);
+    pthread_mutex_unlock(&ps->lock);
+}
+
+static void channel_finish(pipe_stream *ps, int producer, int failed) {
+    pthread_mutex_lock(&ps->lock);
+    if (producer) ps->done = 1;
+    else ps->closed = 1;
+    if (failed) ps->error = 1;
+    pthread_cond_broadcast(&ps->changed);
+    pthread_mutex_unlock(&ps->lock);
+}
+
+// Codecs
+
+static int codec_init(pipe_stream *ps) {
+    switch (ps->compression) {
+#ifdef FC_HAVE_ZLIB
+        case FC_COMPRESS_GZIP:
+            memset(&ps->z, 0, sizeof(ps->z));
+            if (ps->writing) return deflateInit2(&ps->z, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK ? 0 : -1;
+            return inflateInit2(&ps->z, 15 + 32) == Z_OK ? 0 : -1;
+#endif
+#ifdef FC_HAVE_ZSTD
+        case FC_COMPRESS_ZSTD:
+            if (ps->writing) {
+                ps->zstd_out = ZSTD_createCCtx();
+                if (!ps->zstd_out) return -1;
+                ZSTD_CCtx_setParameter(ps->zstd_out, ZSTD_c_compressionLevel, ZSTD_LEVEL);
+                return 0;
+            }
+            ps->zstd_in = ZSTD_createDStream();
+            return ps->zstd_in && !ZSTD_isError(ZSTD_initDStream(ps->zstd_in)) ? 0 : -1;
+#endif
+        default:
+            errno = ENOTSUP;
+            return -1;
+    }
+}
+
+static void codec_end(pipe_stream *ps) {
+    switch (ps->compression) {
+#ifdef FC_HAVE_ZLIB
+        case FC_COMPRESS_GZIP:
+            if (ps->writing) deflateEnd(&ps->z);
+            else inflateEnd(&ps->z);
+            break;
+#endif
+#ifdef FC_HAVE_ZSTD
+        case FC_COMPRESS_ZSTD:
+            ZSTD_freeCCtx(ps->zstd_out);
+            ZSTD_freeDStream(ps->zstd_in);
+            break;
+#endif
+        default:
+            break;
+    }
+}
+
+// Run the codec over in, writing at most out_cap bytes to out. *used and
+// *made report the progress. With finish set the encoder flushes the end of
+// the stream and *ended is set once it is all out. Returns -1 on error.
+static int codec_step(pipe_stream *ps, const char *in, size_t in_len, size_t *used,
+                      char *out, size_t out_cap, size_t *made, int finish, int *ended) {
+    *used = *made = 0;
+    switch (ps->compression) {
+#ifdef FC_HAVE_ZLIB
+        case FC_COMPRESS_GZIP: {
+            ps->z.next_in = (Bytef *)in;
+            ps->z.avail_in = in_len;
+            ps->z.next_out = (Bytef *)out;
+            ps->z.avail_out = out_cap;
+            int rc = ps->writing ? deflate(&ps->z, finish ? Z_FINISH : Z_NO_FLUSH) : inflate(&ps->z, Z_NO_FLUSH);
+            *used = in_len - ps->z.avail_in;
+            *made = out_cap - ps->z.avail_out;
+            if (rc == Z_STREAM_END) {
+                if (ps->writing) {
+                    *ended = 1;
+                } else {
+                    // Concatenated members (as `cat a.gz b.gz` makes) decode as one
+                    ps->frame_complete = 1;
+                    inflateReset(&ps->z);
+                }
+                return 0;
+            }
+            if (rc == Z_OK && !ps->writing && *used) ps->frame_complete = 0;
+            return rc == Z_OK || rc == Z_BUF_ERROR ? 0 : -1;
+        }
+#endif
+#ifdef FC_HAVE_ZSTD
+        case FC_COMPRESS_ZSTD: {
+            ZSTD_inBuffer ib = { in, in_len, 0 };
+            ZSTD_outBuffer ob = { out, out_cap, 0 };
+            size_t rc = ps->writing ? ZSTD_compressStream2(ps->zstd_out, &ob, &ib, finish ? ZSTD_e_end : ZSTD_e_continue)
+                                    : ZSTD_decompressStream(ps->zstd_in, &ob, &ib);
+            if (ZSTD_isError(rc)) return -1;
+            *used = ib.pos;
+            *made = ob.pos;
+            if (ps->writing && finish && rc == 0) *ended = 1;
+            if (!ps->writing && (ib.pos || ob.pos)) ps->frame_complete = rc == 0;
+            return 0;
+        }
+#endif
+        default:
+            (void)in; (void)in_len; (void)out; (void)out_cap; (void)finish; (void)ended;
+            return -1;
+    }
+}
+
+// Codec threads
+
+// Buffers a stream holds: the channel, the codec thread's chunk and stdio's
+#define PIPE_BUFFER_BYTES (sizeof(pipe_stream) + 2 * CHUNK_SIZE)
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Traced per chunk: time blocked on the channel, raw reads or writes, and
+// the codec work itself
+static void *decompress_main(void *arg) {
+    pipe_stream *ps = arg;
+    char *in = malloc(CHUNK_SIZE);
+    size_t in_len = 0, in_pos = 0;
+    int raw_eof = 0, failed = !in, ended = 0;
+
+    fc_trace_thread_name(ps->compression == FC_COMPRESS_GZIP ? "gzip decoder" : "zstd decoder");
+    ps->frame_complete = 1;     // an empty input is a valid empty stream
+    while (!failed) {
+        fc_trace_span span, step;
+        fc_trace_begin(&span, "wait for reader");
+        chunk *c = channel_reserve(ps);
+        fc_trace_end(&span, 0);
+        if (!c) break;          // reader closed early
+
+        fc_trace_begin(&span, "decompress");
+        while (c->len < CHUNK_SIZE) {
+            if (in_pos == in_len && !raw_eof) {
+                fc_trace_begin(&step, "read raw");
+                in_len = fread(in, 1, CHUNK_SIZE, ps->raw);
+                fc_trace_end(&step, in_len);
+                in_pos = 0;
+                if (in_len == 0) {
+                    raw_eof = 1;
+                    if (ferror(ps->raw)) failed = 1;
+                }
+            }
+            size_t used, made;
+            if (failed || codec_step(ps, in + in_pos, in_len - in_pos, &used,
+                                     c->data + c->len, CHUNK_SIZE - c->len, &made, 0, &ended) != 0) {
+                failed = 1;
+                break;
+            }
+            in_pos += used;
+            c->len += made;
+            if (used == 0 && made == 0) {
+                if (in_pos < in_len) failed = 1;    // stuck on input it cannot decode
+                break;
+            }
+        }
+
+        fc_trace_end(&span, c->len);
+        int last = c->len == 0;
+        if (!last) channel_commit(ps);
+        if (last || (raw_eof && in_pos == in_len && c->len < CHUNK_SIZE)) break;
+    }
+
+    // A stream that stops in the middle of a frame was truncated
+    if (!ps->frame_complete) failed = 1;
+    free(in);
+    ps->cpu_ns = thread_cpu_ns();
+    channel_finish(ps, 1, failed);
+    return NULL;
+}
+
+static void *compress_main(void *arg) {
+    pipe_stream *ps = arg;
+    char *out = malloc(CHUNK_SIZE);
+    int failed = !out;
+
+    fc_trace_thread_name(ps->compression == FC_COMPRESS_GZIP ? "gzip encoder" : "zstd encoder");
+    while (!failed) {
+        fc_trace_span span, step;
+        fc_trace_begin(&span, "wait for writer");
+        chunk *c = channel_peek(ps);
+        fc_trace_end(&span, 0);
+        const char *data = c ? c->data : NULL;
+        size_t len = c ? c->len : 0;
+        int finish = c == NULL, ended = 0;
+
+        fc_trace_begin(&span, "compress");
+        do {
+            size_t used, made;
+            if (codec_step(ps, data, len, &used, out, CHUNK_SIZE, &made, finish, &ended) != 0) {
+                failed = 1;
+                break;
+            }
+            fc_trace_begin(&step, "write raw");
+            size_t written = fwrite(out, 1, made, ps->raw);
+            fc_trace_end(&step, written);
+            if (written != made) {
+                failed = 1;
+                break;
+            }
+            data += used;
+            len -= used;
+        } while (len > 0 || (finish && !ended));
+        fc_trace_end(&span, c ? c->len : 0);
+
+        if (c) channel_release(ps);
+        if (finish) break;
+    }
+
+    if (fflush(ps->raw) != 0) failed = 1;
+    free(out);
+    ps->cpu_ns = thread_cpu_ns();
+    channel_finish(ps, 0, failed);
+    return NULL;
+}
+
+// stdio cookie functions
+
+static ssize_t pipe_read(void *cookie, char *buf, size_t size) {
+    pipe_stream *ps = cookie;
+    chunk *c = channel_peek(ps);
+    if (!c) return ps->error ? -1 : 0;
+
+    size_t n = c->len - ps->pos < size ? c->len - ps->pos : size;
+    memcpy(buf, c->data + ps->pos, n);
+    ps->pos += n;
+    if (ps->pos == c->len) {
+        ps->pos = 0;
+        channel_release(ps);
+    }
+    return n;
+}
+
+static ssize_t pipe_write(void *cookie, const char *buf, size_t size) {
+    pipe_stream *ps = cookie;
+    size_t done = 0;
+    while (done < size) {
+        if (!ps->filling) {
+            ps->filling = channel_reserve(ps);
+            if (!ps->filling) return -1;    // the codec thread failed
+        }
+        chunk *c = ps->filling;
+        size_t n = CHUNK_SIZE - c->len < size - done ? CHUNK_SIZE - c->len : size - done;
+        memcpy(c->data + c->len, buf + done, n);
+        c->len += n;
+        done += n;
+        if (c->len == CHUNK_SIZE) {
+            ps->filling = NULL;
+            channel_commit(ps);
+        }
+    }
+    return done;
+}
+
+static int pipe_close(void *cookie) {
+    pipe_stream *ps = cookie;
+    if (ps->writing) {
+        if (ps->filling && ps->filling->len) channel_commit(ps);
+        channel_finish(ps, 1, 0);
+    } else {
+        channel_finish(ps, 0, 0);
+    }
+    pthread_join(ps->thread, NULL);
+    fc_metrics_add_cpu(ps->cpu_ns);
+    fc_metrics_buffer_free(PIPE_BUFFER_BYTES);
+
+    int rc = ps->writing && ps->error ? -1 : 0;
+    if (fclose(ps->raw) != 0) rc = -1;
+    codec_end(ps);
+    pthread_cond_destroy(&ps->changed);
+    pthread_mutex_destroy(&ps->lock);
+    free(ps);
+    return rc;
+}
+
+static FILE *open_pipe(FILE *raw, fc_compression compression, int writing) {
+    pipe_stream *ps = calloc(1, sizeof(*ps));
+    if (!ps) {
+        fclose(raw);
+        return NULL;
+    }
+    ps->raw = raw;
+    ps->compression = compression;
+    ps->writing = writing;
+    if (codec_init(ps) != 0) {
+        int saved = errno;
+        fclose(raw);
+        free(ps);
+        errno = saved;
+        return NULL;
+    }
+    pthread_mutex_init(&ps->lock, NULL);
+    pthread_cond_init(&ps->changed, NULL);
+
+    if (pthread_create(&ps->thread, NULL, writing ? compress_main : decompress_main, ps) != 0) {
+        codec_end(ps);
+        pthread_cond_destroy(&ps->changed);
+        pthread_mutex_destroy(&ps->lock);
+        fclose(raw);
+        free(ps);
+        return NULL;
+    }
+    fc_metrics_buffer_alloc(PIPE_BUFFER_BYTES);
+
+    cookie_io_functions_t io = {
+        .read = writing ? NULL : pipe_read,
+        .write = writing ? pipe_write : NULL,
+        .seek = NULL,
+        .close = pipe_close,
+    };
+    FILE *f = fopencookie(ps, writing ? "w" : "r", io);
+    if (!f) {
+        pipe_close(ps);     // stops the thread and closes raw
+        errno = ENOMEM;
+        return NULL;
+    }
+    setvbuf(f, NULL, _IOFBF, CHUNK_SIZE);
+    return f;
+}
+
+FILE *fc_decompressing_stream(FILE *raw, fc_compression compression) {
+    return raw ? open_pipe(raw, compression, 0) : NULL;
+}
+
+FILE *fc_compressing_stream(FILE *raw, fc_compression compression) {
+    return raw ? open_pipe(raw, compression, 1) : NULL;
+}
@@ -0,0 +1,31 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdio.h>
+#include "converter.h"
+
+// Compressed stream wrappers used by the converter's file I/O.
+//
+// Each wrapper is a stdio FILE (fopencookie) backed by a codec thread, so
+// decompressing or compressing runs on its own thread alongside the engine
+// that reads or writes the FILE. The two are connected by a small bounded
+// queue of 64K chunks, which keeps memory flat however large the file is.
+//
+// gzip needs FC_HAVE_ZLIB (link -lz) and zstd needs FC_HAVE_ZSTD (link
+// -lzstd); without them the wrappers fail with errno ENOTSUP.
+
+// Identify a compressed stream by its magic bytes. The stream must be
+// seekable; its position is left where it was.
+fc_compression fc_detect_compression(FILE *raw);
+
+// Wrap raw so reads return decompressed data. Takes ownership of raw in all
+// cases: closing the returned FILE closes raw, and raw is closed on failure.
+// A truncated or corrupt stream shows up as a read error.
+FILE *fc_decompressing_stream(FILE *raw, fc_compression compression);
+
+// Wrap raw so writes are compressed into it. Takes ownership of raw in all
+// cases. fclose() on the returned FILE finishes the stream and fails if any
+// compressed data could not be written.
+FILE *fc_compressing_stream(FILE *raw, fc_compression compression);
+
+#endif
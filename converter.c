@@ -0,0 +1,2003 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#ifdef FC_HAVE_CAIRO
+#include <cairo.h>
+#include <cairo-pdf.h>
+#include <pango/pangocairo.h>
+#endif
+
+#include "converter.h"
+#include "compress.h"
+#include "encoding.h"
+#include "arena.h"
+#include "metrics.h"
+#include "trace.h"
+#include "tool.h"
+#include "html.h"
+#include "table.h"
+#include "iopolicy.h"
+
+#define SPOOL_NAME_SIZE 256
+#define KERNEL_COPY_MIN 65536    // shorter unchanged spans are cheaper to buffer
+#define FC_BLOCK_SIZE 65536
+#define FC_STATE_SUFFIX ".fcstate"
+#define FC_PARTIAL_SUFFIX ".partial"
+#define FC_CHECKPOINT_SUFFIX ".fccheckpoint"
+#define RESUME_CHECK_BYTES 4096    // input bytes before the resume point that must not change
+#define FC_TOOL_TIMEOUT 300        // seconds an external tool may run by default
+
+struct fc_context {
+    char *line;          // getline buffer, grown as needed and kept between jobs
+    size_t line_cap;
+    char *block;         // FC_BLOCK_SIZE scratch for block-wise engines
+    fc_arena *arena;     // per-call scratch (stream buffers, results), from this thread's pool
+    fc_arena_mark arena_base;   // where each call's scratch starts; the block lives below
+    fc_compression output_compression;
+    int in_call;         // a public call is running; nested ones share its scratch and metrics
+    int tool_timeout;    // seconds, 0 for none
+    long html_page_lines;                               // split TXT to HTML files into pages, 0 for one file
+    long long checkpoint_bytes;                         // input between checkpoints, 0 for the default
+    fc_tool_pool *tool_pools[FC_CONVERSION_LAST + 1];   // helpers to run each type's tool, if any
+    char tool_errors[FC_TOOL_ERROR_SIZE];               // from the last tool that failed
+};
+
+// Engines come in two shapes. A stream engine converts in to out; a block
+// transform rewrites a block in place and returns its new length, with
+// *state carrying whatever spans blocks (being inside a tag). Conversions
+// with a block transform are the in-place capable ones.
+typedef fc_status (*stream_engine)(fc_context *ctx, FILE *in, FILE *out);
+typedef size_t (*block_transform)(char *data, size_t len, int *state);
+
+static size_t spaces_to_commas(char *data, size_t len, int *state);
+static size_t commas_to_spaces(char *data, size_t len, int *state);
+static size_t strip_tags(char *data, size_t len, int *inside_tag);
+static size_t keep_bytes(char *data, size_t len, int *state);
+static fc_status txt_to_html(fc_context *ctx, FILE *in, FILE *out);
+static fc_status json_to_txt(fc_context *ctx, FILE *in, FILE *out);
+static fc_status txt_to_json(fc_context *ctx, FILE *in, FILE *out);
+static fc_status csv_to_json(fc_context *ctx, FILE *in, FILE *out);
+static fc_status json_to_csv(fc_context *ctx, FILE *in, FILE *out);
+static fc_status csv_to_arrow(fc_context *ctx, FILE *in, FILE *out);
+static fc_status txt_to_arrow(fc_context *ctx, FILE *in, FILE *out);
+#ifdef FC_HAVE_ZLIB
+static fc_status csv_to_xlsx(fc_context *ctx, FILE *in, FILE *out);
+#define CSV_TO_XLSX_ENGINE csv_to_xlsx
+#else
+#define CSV_TO_XLSX_ENGINE NULL
+#endif
+#ifdef FC_HAVE_CAIRO
+static fc_status txt_to_pdf(fc_context *ctx, FILE *in, FILE *out);
+#define TXT_TO_PDF_TOOL NULL
+#define TXT_TO_PDF_ENGINE txt_to_pdf
+#else
+#define TXT_TO_PDF_TOOL "txt2pdf"
+#define TXT_TO_PDF_ENGINE NULL
+#endif
+
+#define CAP_BLOCKWISE (FC_CAP_STREAMING | FC_CAP_IN_PLACE)
+
+#define HTML_HEADER "<html><body><pre>\n"
+#define HTML_FOOTER "</pre></body></html>\n"
+
+// The registry. A stream engine is used when there is one, else the block
+// transform; tool conversions have neither. FC_CAP_PASSTHROUGH conversions
+// also give the fixed text around the input and, if they escape anything,
+// how far it runs unchanged and what the byte after that becomes.
+typedef struct {
+    fc_converter_info info;
+    stream_engine engine;
+    block_transform transform;
+    const char *header, *footer;
+    size_t (*plain_prefix)(const char *s, size_t len);
+    const char *(*escape)(char c);
+} converter;
+
+static const converter conversions[] = {
+    [FC_TXT_TO_CSV]  = { { FC_TXT_TO_CSV,  "TXT to CSV",  "TXT",  "CSV",  NULL, CAP_BLOCKWISE | FC_CAP_PARALLEL },
+                         NULL, spaces_to_commas },
+    [FC_CSV_TO_TXT]  = { { FC_CSV_TO_TXT,  "CSV to TXT",  "CSV",  "TXT",  NULL, CAP_BLOCKWISE | FC_CAP_PARALLEL },
+                         NULL, commas_to_spaces },
+    [FC_PDF_TO_TXT]  = { { FC_PDF_TO_TXT,  "PDF to TXT",  "PDF",  "TXT",  "pdftotext", 0 },
+                         NULL, NULL },
+    [FC_TXT_TO_PDF]  = { { FC_TXT_TO_PDF,  "TXT to PDF",  "TXT",  "PDF",  TXT_TO_PDF_TOOL, 0 },
+                         TXT_TO_PDF_ENGINE, NULL },
+    [FC_TXT_TO_HTML] = { { FC_TXT_TO_HTML, "TXT to HTML", "TXT",  "HTML", NULL, FC_CAP_STREAMING | FC_CAP_PASSTHROUGH },
+                         txt_to_html, NULL, HTML_HEADER, HTML_FOOTER, fc_html_plain_prefix, fc_html_entity },
+    [FC_HTML_TO_TXT] = { { FC_HTML_TO_TXT, "HTML to TXT", "HTML", "TXT",  NULL, CAP_BLOCKWISE },
+                         NULL, strip_tags },
+    [FC_JSON_TO_TXT] = { { FC_JSON_TO_TXT, "JSON to TXT", "JSON", "TXT",  NULL,
+                           CAP_BLOCKWISE | FC_CAP_PARALLEL | FC_CAP_PASSTHROUGH },
+                         json_to_txt, keep_bytes, "", "" },
+    [FC_TXT_TO_JSON] = { { FC_TXT_TO_JSON, "TXT to JSON", "TXT",  "JSON", NULL, FC_CAP_STREAMING },
+                         txt_to_json, NULL },
+    [FC_CSV_TO_JSON] = { { FC_CSV_TO_JSON, "CSV to JSON", "CSV",  "JSON", NULL, 0 },
+                         csv_to_json, NULL },
+    [FC_JSON_TO_CSV] = { { FC_JSON_TO_CSV, "JSON to CSV", "JSON", "CSV",  NULL, 0 },
+                         json_to_csv, NULL },
+    [FC_CSV_TO_ARROW] = { { FC_CSV_TO_ARROW, "CSV to Arrow", "CSV", "ARROW", NULL, 0 },
+                          csv_to_arrow, NULL },
+    [FC_TXT_TO_ARROW] = { { FC_TXT_TO_ARROW, "TXT to Arrow", "TXT", "ARROW", NULL, 0 },
+                          txt_to_arrow, NULL },
+    [FC_CSV_TO_XLSX]  = { { FC_CSV_TO_XLSX,  "CSV to XLSX",  "CSV", "XLSX",  NULL, 0 },
+                          CSV_TO_XLSX_ENGINE, NULL },
+};
+
+static int valid_type(fc_conversion type) {
+    return type >= FC_CONVERSION_FIRST && type <= FC_CONVERSION_LAST;
+}
+
+const fc_converter_info *fc_converter(fc_conversion type) {
+    return valid_type(type) ? &conversions[type].info : NULL;
+}
+
+const char *fc_conversion_name(fc_conversion type) {
+    return valid_type(type) ? conversions[type].info.name : NULL;
+}
+
+const char *fc_source_format(fc_conversion type) {
+    return valid_type(type) ? conversions[type].info.source : NULL;
+}
+
+const char *fc_target_format(fc_conversion type) {
+    return valid_type(type) ? conversions[type].info.target : NULL;
+}
+
+fc_conversion fc_find_conversion(const char *source, const char *target) {
+    if (!source || !target) return 0;
+    for (int type = FC_CONVERSION_FIRST; type <= FC_CONVERSION_LAST; type++) {
+        if (strcasecmp(conversions[type].info.source, source) == 0 &&
+            strcasecmp(conversions[type].info.target, target) == 0) {
+            return (fc_conversion)type;
+        }
+    }
+    return 0;
+}
+
+fc_conversion fc_conversion_parse(const char *spec) {
+    if (!spec || !*spec) return 0;
+
+    if (isdigit((unsigned char)spec[0])) {
+        char *end;
+        long n = strtol(spec, &end, 10);
+        return (*end == '\0' && valid_type((fc_conversion)n)) ? (fc_conversion)n : 0;
+    }
+
+    // Split into source and target at ':', "-to-" or " to "
+    const char *sep = strchr(spec, ':');
+    size_t sep_len = 1;
+    if (!sep) {
+        sep = strcasestr(spec, "-to-");
+        if (!sep) sep = strcasestr(spec, " to ");
+        sep_len = 4;
+    }
+    if (!sep) return 0;
+
+    char source[16];
+    size_t source_len = sep - spec;
+    if (source_len >= sizeof(source)) return 0;
+    memcpy(source, spec, source_len);
+    source[source_len] = '\0';
+    return fc_find_conversion(source, sep + sep_len);
+}
+
+const char *fc_status_message(fc_status status) {
+    switch (status) {
+        case FC_OK:              return "Success.";
+        case FC_ERR_INPUT:       return "Cannot open input file.";
+        case FC_ERR_OUTPUT:      return "Cannot open output file.";
+        case FC_ERR_IO:          return "Read or write error.";
+        case FC_ERR_NOMEM:       return "Memory allocation failed.";
+        case FC_ERR_TOOL:        return "External tool failed.";
+        case FC_ERR_UNSUPPORTED: return "Conversion not supported in this build.";
+        case FC_ERR_INVALID:     return "Invalid argument.";
+        case FC_ERR_FORMAT:      return "Input is not in the expected format.";
+        case FC_ERR_LIMIT:       return "Input exceeds a limit of the output format.";
+    }
+    return "Unknown error.";
+}
+
+void fc_set_output_compression(fc_context *ctx, fc_compression compression) {
+    if (ctx) ctx->output_compression = compression;
+}
+
+void fc_set_tool_timeout(fc_context *ctx, int seconds) {
+    if (ctx) ctx->tool_timeout = seconds > 0 ? seconds : 0;
+}
+
+void fc_set_tool_pool(fc_context *ctx, fc_conversion type, fc_tool_pool *pool) {
+    if (ctx && valid_type(type)) ctx->tool_pools[type] = pool;
+}
+
+const char *fc_tool_errors(const fc_context *ctx) {
+    return ctx ? ctx->tool_errors : "";
+}
+
+void fc_set_html_page_lines(fc_context *ctx, long lines) {
+    if (ctx) ctx->html_page_lines = lines > 0 ? lines : 0;
+}
+
+long fc_html_page_lines(const fc_context *ctx) {
+    return ctx ? ctx->html_page_lines : 0;
+}
+
+void fc_set_checkpoint_interval(fc_context *ctx, long long bytes) {
+    if (ctx) ctx->checkpoint_bytes = bytes > 0 ? bytes : 0;
+}
+
+fc_compression fc_compression_for_path(const char *path) {
+    const char *ext = path ? strrchr(path, '.') : NULL;
+    if (ext && strcasecmp(ext, ".gz") == 0) return FC_COMPRESS_GZIP;
+    if (ext && strcasecmp(ext, ".zst") == 0) return FC_COMPRESS_ZSTD;
+    return FC_COMPRESS_NONE;
+}
+
+fc_compression fc_output_compression(const fc_context *ctx, const char *output_file) {
+    if (ctx && ctx->output_compression != FC_COMPRESS_AUTO) return ctx->output_compression;
+    return fc_compression_for_path(output_file);
+}
+
+fc_compression fc_compression_parse(const char *name) {
+    if (!name) return FC_COMPRESS_AUTO;
+    if (strcasecmp(name, "gzip") == 0 || strcasecmp(name, "gz") == 0) return FC_COMPRESS_GZIP;
+    if (strcasecmp(name, "zstd") == 0 || strcasecmp(name, "zst") == 0) return FC_COMPRESS_ZSTD;
+    if (strcasecmp(name, "none") == 0) return FC_COMPRESS_NONE;
+    return FC_COMPRESS_AUTO;
+}
+
+void fc_free(void *ptr) {
+    free(ptr);
+}
+
+// A context made for one job and freed after it takes a warm arena from
+// the thread's pool, so short-lived contexts cost no large mallocs
+fc_context *fc_context_new(void) {
+    fc_context *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) return NULL;
+
+    ctx->arena = fc_arena_acquire();
+    ctx->block = ctx->arena ? fc_arena_alloc(ctx->arena, FC_BLOCK_SIZE) : NULL;
+    if (!ctx->block) {
+        fc_arena_release(ctx->arena);
+        free(ctx);
+        return NULL;
+    }
+    ctx->arena_base = fc_arena_save(ctx->arena);
+    ctx->tool_timeout = FC_TOOL_TIMEOUT;
+    return ctx;
+}
+
+void fc_context_free(fc_context *ctx) {
+    if (!ctx) return;
+    free(ctx->line);
+    fc_arena_release(ctx->arena);
+    free(ctx);
+}
+
+// Finish a stream conversion: a read or write error anywhere is reported as IO
+static fc_status stream_status(FILE *in, FILE *out) {
+    if (ferror(in) || ferror(out)) return FC_ERR_IO;
+    return FC_OK;
+}
+
+// Engines
+
+// Block engines trace each read, transform and write
+static size_t read_block(fc_context *ctx, FILE *in) {
+    fc_trace_span span;
+    fc_trace_begin(&span, "read");
+    size_t n = fread(ctx->block, 1, FC_BLOCK_SIZE, in);
+    fc_trace_end(&span, n);
+    return n;
+}
+
+static int write_block(const char *data, size_t len, FILE *out) {
+    fc_trace_span span;
+    fc_trace_begin(&span, "write");
+    size_t written = fwrite(data, 1, len, out);
+    fc_trace_end(&span, written);
+    return written == len ? 0 : -1;
+}
+
+// Run a block transform over the whole stream
+static fc_status transform_blocks(fc_context *ctx, FILE *in, FILE *out,
+                                  block_transform transform, int *state) {
+    size_t n;
+    while ((n = read_block(ctx, in)) > 0) {
+        fc_trace_span span;
+        fc_trace_begin(&span, "transform");
+        size_t len = transform(ctx->block, n, state);
+        fc_trace_end(&span, n);
+        if (len && write_block(ctx->block, len, out) != 0) return FC_ERR_IO;
+    }
+    return stream_status(in, out);
+}
+
+static size_t replace_char(char *data, size_t len, char from, char to) {
+    char *p = data, *end = data + len;
+    while ((p = memchr(p, from, end - p)) != NULL) {
+        *p++ = to;
+    }
+    return len;
+}
+
+static size_t spaces_to_commas(char *data, size_t len, int *state) {
+    (void)state;
+    return replace_char(data, len, ' ', ',');
+}
+
+static size_t commas_to_spaces(char *data, size_t len, int *state) {
+    (void)state;
+    return replace_char(data, len, ',', ' ');
+}
+
+static size_t keep_bytes(char *data, size_t len, int *state) {
+    (void)data;
+    (void)state;
+    return len;
+}
+
+static fc_status copy_stream(fc_context *ctx, FILE *in, FILE *out) {
+    size_t n;
+    while ((n = read_block(ctx, in)) > 0) {
+        if (write_block(ctx->block, n, out) != 0) return FC_ERR_IO;
+    }
+    return stream_status(in, out);
+}
+
+static fc_status escape_stream(fc_context *ctx, FILE *in, FILE *out) {
+    size_t n;
+    while ((n = read_block(ctx, in)) > 0) {
+        fc_trace_span span;
+        fc_trace_begin(&span, "write");
+        int rc = fc_html_write_escaped(out, ctx->block, n);
+        fc_trace_end(&span, n);
+        if (rc != 0) return FC_ERR_IO;
+    }
+    return stream_status(in, out);
+}
+
+static fc_status txt_to_html(fc_context *ctx, FILE *in, FILE *out) {
+    fputs(HTML_HEADER, out);
+    fc_status status = escape_stream(ctx, in, out);
+    if (status != FC_OK) return status;
+    fputs(HTML_FOOTER, out);
+    return stream_status(in, out);
+}
+
+// Strip tags. *inside_tag carries the parser state across blocks (and
+// across calls, so an incremental run can pick up in the middle of a tag).
+static size_t strip_tags(char *data, size_t len, int *inside_tag_state) {
+    int inside_tag = *inside_tag_state;
+    char *src = data, *end = data + len, *dst = data;
+    for (; src < end; src++) {
+        if (*src == '<') {
+            inside_tag = 1;
+        } else if (*src == '>') {
+            inside_tag = 0;
+        } else if (!inside_tag) {
+            *dst++ = *src;
+        }
+    }
+    *inside_tag_state = inside_tag;
+    return dst - data;
+}
+
+static fc_status json_to_txt(fc_context *ctx, FILE *in, FILE *out) {
+    return copy_stream(ctx, in, out);
+}
+
+// Where an incremental run can resume: input and output offsets just past
+// the last complete input line, plus the engine state at that point.
+typedef struct {
+    long input_offset;
+    long output_offset;
+    int json_first;
+    int inside_tag;
+} resume_point;
+
+// Write s as a JSON string: quotes, backslashes and control characters are
+// escaped, everything else (already UTF-8) is copied in runs.
+static void write_json_string(FILE *out, const char *s) {
+    static const char hex[] = "0123456789abcdef";
+    putc('"', out);
+    for (;;) {
+        size_t run = 0;
+        while ((unsigned char)s[run] >= 0x20 && s[run] != '"' && s[run] != '\\') run++;
+        fwrite(s, 1, run, out);
+        s += run;
+        if (!*s) break;
+        putc('\\', out);
+        switch (*s) {
+            case '"':  putc('"', out); break;
+            case '\\': putc('\\', out); break;
+            case '\b': putc('b', out); break;
+            case '\f': putc('f', out); break;
+            case '\n': putc('n', out); break;
+            case '\r': putc('r', out); break;
+            case '\t': putc('t', out); break;
+            default:
+                fprintf(out, "u00%c%c", hex[(unsigned char)*s >> 4], hex[*s & 0xF]);
+        }
+        s++;
+    }
+    putc('"', out);
+}
+
+// Write one JSON array entry per input line. If commit is not NULL it is
+// advanced past every line that ended in a newline; a last line without one
+// is still written but left uncommitted, since a writer may still be
+// appending to it.
+static fc_status json_entries(fc_context *ctx, FILE *in, FILE *out, int *first, resume_point *commit) {
+    fc_trace_span span;
+    fc_trace_begin(&span, "transform lines");
+    ssize_t len;
+    while ((len = getline(&ctx->line, &ctx->line_cap, in)) != -1) {
+        int complete = len > 0 && ctx->line[len - 1] == '\n';
+        ctx->line[strcspn(ctx->line, "\n")] = 0;
+        if (!*first) fprintf(out, ",\n");
+        fputs("  ", out);
+        write_json_string(out, ctx->line);
+        *first = 0;
+        if (commit && complete) {
+            commit->input_offset = ftell(in);
+            commit->output_offset = ftell(out);
+            commit->json_first = 0;
+        }
+    }
+    fc_trace_end(&span, 0);
+    return stream_status(in, out);
+}
+
+static fc_status txt_to_json(fc_context *ctx, FILE *in, FILE *out) {
+    int first = 1;
+
+    fprintf(out, "[\n");
+    fc_status status = json_entries(ctx, in, out, &first, NULL);
+    if (status != FC_OK) return status;
+    fprintf(out, "\n]\n");
+    return stream_status(in, out);
+}
+
+// Tabular engines (table.c), row by row through the block buffer. They are
+// not resumable: the header row and column types come from the top.
+static fc_status csv_to_json(fc_context *ctx, FILE *in, FILE *out) {
+    fc_trace_span span;
+    fc_trace_begin(&span, "transform rows");
+    fc_status status = fc_csv_to_json(in, out, ctx->block, FC_BLOCK_SIZE);
+    fc_trace_end(&span, 0);
+    return status != FC_OK ? status : stream_status(in, out);
+}
+
+static fc_status json_to_csv(fc_context *ctx, FILE *in, FILE *out) {
+    fc_trace_span span;
+    fc_trace_begin(&span, "transform rows");
+    fc_status status = fc_json_to_csv(in, out, ctx->block, FC_BLOCK_SIZE);
+    fc_trace_end(&span, 0);
+    return status != FC_OK ? status : stream_status(in, out);
+}
+
+// Arrow output; TXT is read as TXT to CSV would split it, on spaces
+static fc_status table_to_arrow(fc_context *ctx, FILE *in, FILE *out, char delimiter) {
+    fc_trace_span span;
+    fc_trace_begin(&span, "transform rows");
+    fc_status status = fc_csv_to_arrow(in, out, delimiter, ctx->block, FC_BLOCK_SIZE);
+    fc_trace_end(&span, 0);
+    return status != FC_OK ? status : stream_status(in, out);
+}
+
+static fc_status csv_to_arrow(fc_context *ctx, FILE *in, FILE *out) {
+    return table_to_arrow(ctx, in, out, ',');
+}
+
+static fc_status txt_to_arrow(fc_context *ctx, FILE *in, FILE *out) {
+    return table_to_arrow(ctx, in, out, ' ');
+}
+
+#ifdef FC_HAVE_ZLIB
+static fc_status csv_to_xlsx(fc_context *ctx, FILE *in, FILE *out) {
+    fc_trace_span span;
+    fc_trace_begin(&span, "transform rows");
+    fc_status status = fc_csv_to_xlsx(in, out, ctx->block, FC_BLOCK_SIZE);
+    fc_trace_end(&span, 0);
+    return status != FC_OK ? status : stream_status(in, out);
+}
+#endif
+
+#ifdef FC_HAVE_CAIRO
+static cairo_status_t write_to_stream(void *closure, const unsigned char *data, unsigned int length) {
+    return fwrite(data, 1, length, (FILE *)closure) == length ? CAIRO_STATUS_SUCCESS : CAIRO_STATUS_WRITE_ERROR;
+}
+
+static fc_status txt_to_pdf(fc_context *ctx, FILE *in, FILE *out) {
+    cairo_surface_t *surface = cairo_pdf_surface_create_for_stream(write_to_stream, out, 595, 842); // A4
+    cairo_t *cr = cairo_create(surface);
+
+    PangoLayout *layout = pango_cairo_create_layout(cr);
+    PangoFontDescription *font = pango_font_description_from_string("Monospace 12");
+    pango_layout_set_font_description(layout, font);
+
+    fc_trace_span span;
+    fc_trace_begin(&span, "render");
+    int y = 20;
+    while (getline(&ctx->line, &ctx->line_cap, in) != -1) {
+        cairo_move_to(cr, 40, y);
+        pango_layout_set_text(layout, ctx->line, -1);
+        pango_cairo_show_layout(cr, layout);
+        y += 18;
+
+        if (y > 800) {
+            cairo_show_page(cr);
+            y = 20;
+        }
+    }
+
+    fc_trace_end(&span, 0);
+    pango_font_description_free(font);
+    g_object_unref(layout);
+    cairo_destroy(cr);
+    cairo_surface_finish(surface);
+    cairo_status_t surface_status = cairo_surface_status(surface);
+    cairo_surface_destroy(surface);
+
+    if (surface_status != CAIRO_STATUS_SUCCESS) return FC_ERR_IO;
+    return stream_status(in, out);
+}
+#endif
+
+// External tools work on paths, not streams. A helper pool set for the
+// type takes the job if it can; otherwise the tool is spawned for it.
+static fc_status run_tool(fc_context *ctx, fc_conversion type, const char *input_file, const char *output_file) {
+    const char *tool = conversions[type].info.tool;
+    int timeout_ms = ctx->tool_timeout * 1000;
+    fc_trace_span span;
+    fc_trace_begin(&span, tool);
+
+    fc_status status = FC_ERR_UNSUPPORTED;
+    fc_tool_pool *pool = ctx->tool_pools[type];
+    if (pool && strcmp(fc_tool_pool_tool(pool), tool) == 0) {
+        status = fc_tool_pool_run(pool, input_file, output_file, timeout_ms,
+                                  ctx->tool_errors, sizeof(ctx->tool_errors));
+    }
+    if (status == FC_ERR_UNSUPPORTED) {
+        char *const pdftotext[] = { (char *)tool, (char *)input_file, (char *)output_file, NULL };
+        char *const txt2pdf[] = { (char *)tool, (char *)input_file, "-o", (char *)output_file, NULL };
+        status = fc_tool_run(type == FC_PDF_TO_TXT ? pdftotext : txt2pdf, timeout_ms,
+                             ctx->tool_errors, sizeof(ctx->tool_errors));
+    }
+    fc_trace_end(&span, 0);
+    return status;
+}
+
+// Run a tool-based conversion on streams by spooling through temp files
+static fc_status run_tool_on_streams(fc_context *ctx, fc_conversion type, FILE *in, FILE *out) {
+    const char *tmpdir = getenv("TMPDIR");
+    char in_name[SPOOL_NAME_SIZE], out_name[SPOOL_NAME_SIZE];
+    if (!tmpdir || !*tmpdir) tmpdir = "/tmp";
+    snprintf(in_name, sizeof(in_name), "%s/fc_in.XXXXXX", tmpdir);
+    snprintf(out_name, sizeof(out_name), "%s/fc_out.XXXXXX", tmpdir);
+
+    int in_fd = mkstemp(in_name);
+    if (in_fd < 0) return FC_ERR_IO;
+    int out_fd = mkstemp(out_name);
+    if (out_fd < 0) {
+        close(in_fd);
+        unlink(in_name);
+        return FC_ERR_IO;
+    }
+    close(out_fd);
+
+    fc_trace_span span;
+    fc_trace_begin(&span, "spool");
+    FILE *spool = fdopen(in_fd, "w");
+    fc_status status = spool ? copy_stream(ctx, in, spool) : FC_ERR_IO;
+    if (spool && fclose(spool) != 0 && status == FC_OK) status = FC_ERR_IO;
+    if (!spool) close(in_fd);
+    fc_trace_end(&span, 0);
+
+    if (status == FC_OK) status = run_tool(ctx, type, in_name, out_name);
+
+    if (status == FC_OK) {
+        fc_trace_begin(&span, "copy result");
+        FILE *result = fopen(out_name, "r");
+        status = result ? copy_stream(ctx, result, out) : FC_ERR_TOOL;
+        if (result) fclose(result);
+        fc_trace_end(&span, 0);
+    }
+
+    unlink(in_name);
+    unlink(out_name);
+    return status;
+}
+
+static fc_status convert_text(fc_context *ctx, fc_conversion type, FILE *in, FILE *out) {
+    const converter *c = &conversions[type];
+    if (c->info.tool) return run_tool_on_streams(ctx, type, in, out);
+    if (c->engine) return c->engine(ctx, in, out);
+    if (!c->transform) return FC_ERR_UNSUPPORTED;
+    int state = 0;
+    return transform_blocks(ctx, in, out, c->transform, &state);
+}
+
+static fc_status convert_stream(fc_context *ctx, fc_conversion type, FILE *in, FILE *out) {
+    if (!ctx || !in || !out || !valid_type(type)) return FC_ERR_INVALID;
+
+    if (type == FC_PDF_TO_TXT) return run_tool_on_streams(ctx, type, in, out);
+
+    // Text inputs go through the encoding stage so every engine sees UTF-8
+    FILE *text = fc_text_stream_arena(in, 0, ctx->arena);
+    if (!text) return FC_ERR_NOMEM;
+    fc_status status = convert_text(ctx, type, text, out);
+    if (status == FC_OK && ferror(text)) status = FC_ERR_IO;
+    fclose(text);
+    return status;
+}
+
+// Swap *in for a decompressing stream if it holds gzip or zstd data
+static fc_status wrap_input(FILE **in) {
+    fc_compression compression = fc_detect_compression(*in);
+    if (compression == FC_COMPRESS_NONE) return FC_OK;
+    *in = fc_decompressing_stream(*in, compression);
+    if (*in) return FC_OK;
+    return errno == ENOTSUP ? FC_ERR_UNSUPPORTED : FC_ERR_NOMEM;
+}
+
+static fc_status open_input(const char *input_file, FILE **in) {
+    *in = fopen(input_file, "r");
+    if (!*in) return FC_ERR_INPUT;
+    return wrap_input(in);
+}
+
+// Inputs read once, front to back, go through the I/O policy
+static fc_status open_scan(const char *input_file, FILE **in) {
+    *in = fc_io_open_read(input_file);
+    if (!*in) return FC_ERR_INPUT;
+    return wrap_input(in);
+}
+
+static fc_status open_output(const fc_context *ctx, const char *output_file, FILE **out) {
+    fc_compression compression = fc_output_compression(ctx, output_file);
+    if (compression != FC_COMPRESS_NONE) {
+#ifndef FC_HAVE_ZLIB
+        if (compression == FC_COMPRESS_GZIP) return FC_ERR_UNSUPPORTED;
+#endif
+#ifndef FC_HAVE_ZSTD
+        if (compression == FC_COMPRESS_ZSTD) return FC_ERR_UNSUPPORTED;
+#endif
+    }
+    *out = fc_io_open_write(output_file);
+    if (!*out) return FC_ERR_OUTPUT;
+    if (compression == FC_COMPRESS_NONE) return FC_OK;
+    *out = fc_compressing_stream(*out, compression);
+    return *out ? FC_OK : FC_ERR_NOMEM;
+}
+
+static int is_compressed(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    int compressed = fc_detect_compression(f) != FC_COMPRESS_NONE;
+    fclose(f);
+    return compressed;
+}
+
+// Passthrough. The body of a passthrough conversion is the input byte for
+// byte, bar escapes, when the encoding stage would leave it alone, i.e. when
+// it is plain UTF-8. Such files are checked through a mapping and their long
+// unchanged spans copied by the kernel: copy_file_range (which can share
+// extents on reflink filesystems), else sendfile, else through the block
+// buffer.
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Copy len bytes of in_fd from offset to out_fd's file position
+static fc_status copy_span(fc_context *ctx, int in_fd, off_t offset, size_t len, int out_fd) {
+    int method = 0;     // 0 copy_file_range, 1 sendfile, 2 read/write
+    while (len) {
+        ssize_t n;
+        size_t want = len < (1u << 30) ? len : (1u << 30);
+#ifdef __linux__
+        if (method == 0) {
+            n = copy_file_range(in_fd, &offset, out_fd, NULL, want, 0);
+        } else if (method == 1) {
+            n = sendfile(out_fd, in_fd, &offset, want);
+        } else
+#endif
+        {
+            method = 2;
+            n = pread(in_fd, ctx->block, want < FC_BLOCK_SIZE ? want : FC_BLOCK_SIZE, offset);
+            if (n > 0 && write_all(out_fd, ctx->block, n) != 0) return FC_ERR_IO;
+            if (n > 0) offset += n;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && method < 2 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+                                    errno == EOPNOTSUPP || errno == ETXTBSY || errno == EBADF)) {
+            method++;   // nothing was copied; try the next way
+            continue;
+        }
+        if (n < 0) return FC_ERR_IO;
+        if (n == 0) break;  // the input shrank under us
+        len -= n;
+    }
+    return FC_OK;
+}
+
+// Buffered output to a file descriptor, for the short pieces between spans
+typedef struct {
+    int fd;
+    char *buf;
+    size_t len;
+    off_t pos;              // bytes written to fd
+    fc_io_writeback wb;
+} fd_writer;
+
+static int fd_write(fd_writer *w, const char *data, size_t len) {
+    if (write_all(w->fd, data, len) != 0) return -1;
+    w->pos += len;
+    fc_io_writeback_advance(&w->wb, w->pos);
+    return 0;
+}
+
+static int fd_flush(fd_writer *w) {
+    int rc = fd_write(w, w->buf, w->len);
+    w->len = 0;
+    return rc;
+}
+
+static int fd_put(fd_writer *w, const char *data, size_t len) {
+    if (w->len + len > FC_BLOCK_SIZE && fd_flush(w) != 0) return -1;
+    if (len > FC_BLOCK_SIZE) return fd_write(w, data, len);
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+    return 0;
+}
+
+// The body: unchanged spans of at least KERNEL_COPY_MIN bytes go to the
+// kernel, a window at a time so the I/O policy can follow, everything else
+// (short spans, escapes) through the buffer
+static fc_status write_body(fc_context *ctx, const converter *c, const char *map, size_t len,
+                            int in_fd, fd_writer *w) {
+    size_t pos = 0;
+    while (pos < len) {
+        size_t plain = c->plain_prefix ? c->plain_prefix(map + pos, len - pos) : len - pos;
+        if (plain >= KERNEL_COPY_MIN) {
+            if (fd_flush(w) != 0) return FC_ERR_IO;
+            for (size_t done = 0; done < plain;) {
+                size_t step = plain - done < FC_IO_WINDOW ? plain - done : FC_IO_WINDOW;
+                fc_status status = copy_span(ctx, in_fd, pos + done, step, w->fd);
+                if (status != FC_OK) return status;
+                done += step;
+                w->pos += step;
+                fc_io_writeback_advance(&w->wb, w->pos);
+            }
+        } else if (fd_put(w, map + pos, plain) != 0) {
+            return FC_ERR_IO;
+        }
+        pos += plain;
+        if (pos < len) {
+            const char *escape = c->escape(map[pos++]);
+            if (fd_put(w, escape, strlen(escape)) != 0) return FC_ERR_IO;
+        }
+    }
+    return FC_OK;
+}
+
+// FC_ERR_UNSUPPORTED (nothing written) if the input needs converting after all
+static fc_status passthrough_file(fc_context *ctx, fc_conversion type,
+                                  const char *input_file, const char *output_file) {
+    const converter *c = &conversions[type];
+    int in_fd = open(input_file, O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) return FC_ERR_INPUT;
+    struct stat st;
+    if (fstat(in_fd, &st) != 0 || !S_ISREG(st.st_mode) || is_compressed(input_file)) {
+        close(in_fd);
+        return FC_ERR_UNSUPPORTED;
+    }
+
+    fc_trace_span span;
+    fc_trace_begin(&span, "validate");
+    size_t len = st.st_size;
+    char *map = NULL;
+    if (len) {
+        map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, in_fd, 0);
+        if (map == MAP_FAILED) map = NULL;
+        if (map) madvise(map, len, MADV_SEQUENTIAL);
+    }
+    int plain = !len || (map && fc_utf8_valid_prefix(map, len) == len);
+    fc_trace_end(&span, len);
+
+    int out_fd = plain ? open(output_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666) : -1;
+    if (out_fd < 0) {
+        if (map) munmap(map, len);
+        close(in_fd);
+        return plain ? FC_ERR_OUTPUT : FC_ERR_UNSUPPORTED;
+    }
+    fc_trace_begin(&span, "copy");
+    fd_writer w = { .fd = out_fd, .buf = ctx->block };
+    fc_io_writeback_begin(&w.wb, out_fd);
+    fc_status status = fd_put(&w, c->header, strlen(c->header)) == 0 ? FC_OK : FC_ERR_IO;
+    if (status == FC_OK) status = write_body(ctx, c, map, len, in_fd, &w);
+    if (status == FC_OK && (fd_put(&w, c->footer, strlen(c->footer)) != 0 || fd_flush(&w) != 0)) {
+        status = FC_ERR_IO;
+    }
+    fc_trace_end(&span, len);
+
+    // The input was read through the mapping, whose pages can only be
+    // dropped once it is gone
+    if (map) munmap(map, len);
+    int io = fc_io_policy();
+    if (((io & FC_IO_DROP_BEHIND) && len >= FC_IO_DROP_MIN) || ((io & FC_IO_DIRECT) && len >= FC_IO_DIRECT_MIN)) {
+        fc_io_drop(in_fd, 0, len);
+    }
+    fc_io_writeback_end(&w.wb);
+    close(in_fd);
+    if (close(out_fd) != 0 && status == FC_OK) status = FC_ERR_IO;
+    return status;
+}
+
+// Paged TXT to HTML. Pages are written as the input streams in, each one
+// closed only once the next line shows there is a next page to link to;
+// the index goes into the output file at the end.
+
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+// Page 3 of "out.html.gz" is "out-3.html.gz", next to it
+static int page_path(const char *output_file, long page, char *buf, size_t size) {
+    const char *base = base_name(output_file);
+    const char *dot = strchr(base + (*base == '.'), '.');
+    int stem = dot ? (int)(dot - output_file) : (int)strlen(output_file);
+    int n = snprintf(buf, size, "%.*s-%ld%s", stem, output_file, page, dot ? dot : "");
+    return n >= 0 && (size_t)n < size ? 0 : -1;
+}
+
+static void page_link(FILE *out, const char *path, const char *label) {
+    fputs("<a href=\"", out);
+    fc_html_write_href(out, base_name(path));
+    fprintf(out, "\">%s</a>", label);
+}
+
+static void page_nav(FILE *out, const char *output_file, long page, int next) {
+    char path[PATH_MAX];
+    fputs("<p>", out);
+    if (page > 1 && page_path(output_file, page - 1, path, sizeof(path)) == 0) {
+        page_link(out, path, "Previous");
+        fputs(" | ", out);
+    }
+    page_link(out, output_file, "Index");
+    if (next && page_path(output_file, page + 1, path, sizeof(path)) == 0) {
+        fputs(" | ", out);
+        page_link(out, path, "Next");
+    }
+    fputs("</p>\n", out);
+}
+
+static fc_status open_page(fc_context *ctx, const char *output_file, long page, FILE **out) {
+    char path[PATH_MAX];
+    if (page_path(output_file, page, path, sizeof(path)) != 0) return FC_ERR_OUTPUT;
+    fc_status status = open_output(ctx, path, out);
+    if (status != FC_OK) return status;
+    fputs("<html><body>\n", *out);
+    page_nav(*out, output_file, page, 0);
+    fputs("<pre>\n", *out);
+    return ferror(*out) ? FC_ERR_IO : FC_OK;
+}
+
+static fc_status close_page(FILE *out, const char *output_file, long page, int next) {
+    fputs("</pre>\n", out);
+    page_nav(out, output_file, page, next);
+    fputs("</body></html>\n", out);
+    int failed = ferror(out);
+    return fclose(out) != 0 || failed ? FC_ERR_IO : FC_OK;
+}
+
+static fc_status write_index(FILE *out, const char *input_file, const char *output_file,
+                             long pages, long page_lines, long lines) {
+    char path[PATH_MAX];
+    fputs("<html><body>\n<h1>", out);
+    fc_html_write_escaped(out, base_name(input_file), strlen(base_name(input_file)));
+    fprintf(out, "</h1>\n<p>%ld lines, %ld page%s</p>\n<ul>\n", lines, pages, pages == 1 ? "" : "s");
+    for (long page = 1; page <= pages; page++) {
+        if (page_path(output_file, page, path, sizeof(path)) != 0) return FC_ERR_OUTPUT;
+        long first = (page - 1) * page_lines + 1, last = page * page_lines < lines ? page * page_lines : lines;
+        fputs("<li>", out);
+        char label[32];
+        snprintf(label, sizeof(label), "Page %ld", page);
+        page_link(out, path, label);
+        if (last >= first) fprintf(out, ": lines %ld-%ld", first, last);
+        fputs("</li>\n", out);
+    }
+    fputs("</ul>\n</body></html>\n", out);
+    return ferror(out) ? FC_ERR_IO : FC_OK;
+}
+
+static fc_status html_pages(fc_context *ctx, const char *input_file, const char *output_file) {
+    char path[PATH_MAX];
+    if (page_path(output_file, 1, path, sizeof(path)) != 0) return FC_ERR_OUTPUT;
+
+    FILE *raw, *index, *page = NULL;
+    fc_status status = open_scan(input_file, &raw);
+    if (status != FC_OK) return status;
+    status = open_output(ctx, output_file, &index);
+    if (status != FC_OK) {
+        fclose(raw);
+        return status;
+    }
+    FILE *in = fc_text_stream_arena(raw, 0, ctx->arena);
+    if (!in) status = FC_ERR_NOMEM;
+
+    long page_lines = ctx->html_page_lines, pages = 0, lines = 0, on_page = 0;
+    int partial = 0;    // the text so far ends inside a line
+    size_t n;
+    while (status == FC_OK && (n = read_block(ctx, in)) > 0) {
+        const char *p = ctx->block, *end = p + n;
+        fc_trace_span span;
+        fc_trace_begin(&span, "write");
+        while (status == FC_OK && p < end) {
+            if (page && on_page == page_lines) {
+                status = close_page(page, output_file, pages, 1);
+                page = NULL;
+            }
+            if (!page && status == FC_OK) {
+                on_page = 0;
+                status = open_page(ctx, output_file, ++pages, &page);
+                if (status != FC_OK) break;
+            }
+            const char *newline = memchr(p, '\n', end - p);
+            const char *stop = newline ? newline + 1 : end;
+            if (fc_html_write_escaped(page, p, stop - p) != 0) status = FC_ERR_IO;
+            if (newline) {
+                on_page++;
+                lines++;
+            }
+            partial = !newline;
+            p = stop;
+        }
+        fc_trace_end(&span, n);
+    }
+    if (in && status == FC_OK && ferror(in)) status = FC_ERR_IO;
+
+    // An empty input still gets its (empty) page
+    if (status == FC_OK && !pages) status = open_page(ctx, output_file, ++pages, &page);
+    if (page) {
+        fc_status closed = close_page(page, output_file, pages, 0);
+        if (status == FC_OK) status = closed;
+    }
+    if (status == FC_OK) status = write_index(index, input_file, output_file, pages, page_lines, lines + partial);
+
+    // Pages left over from a longer earlier run would link back to this index
+    for (long stale = pages + 1; status == FC_OK; stale++) {
+        if (page_path(output_file, stale, path, sizeof(path)) != 0 || unlink(path) != 0) break;
+    }
+
+    if (in) fclose(in);
+    fclose(raw);
+    if (fclose(index) != 0 && status == FC_OK) status = FC_ERR_IO;
+    return status;
+}
+
+static fc_status convert_file(fc_context *ctx, fc_conversion type,
+                              const char *input_file, const char *output_file) {
+    if (!ctx || !input_file || !output_file || !valid_type(type)) return FC_ERR_INVALID;
+
+    if (type == FC_TXT_TO_HTML && ctx->html_page_lines > 0) return html_pages(ctx, input_file, output_file);
+
+    if ((conversions[type].info.caps & FC_CAP_PASSTHROUGH) &&
+        fc_output_compression(ctx, output_file) == FC_COMPRESS_NONE) {
+        fc_status status = passthrough_file(ctx, type, input_file, output_file);
+        if (status != FC_ERR_UNSUPPORTED) return status;
+    }
+
+    // pdftotext reads and writes paths directly unless something needs
+    // (de)compressing; text for txt2pdf is normalized through a spool file
+    if (type == FC_PDF_TO_TXT && fc_output_compression(ctx, output_file) == FC_COMPRESS_NONE &&
+        !is_compressed(input_file)) {
+        return run_tool(ctx, type, input_file, output_file);
+    }
+
+    FILE *in, *out;
+    fc_trace_span span;
+    fc_trace_begin(&span, "open");
+    fc_status status = open_scan(input_file, &in);
+    if (status == FC_OK) {
+        status = open_output(ctx, output_file, &out);
+        if (status != FC_OK) fclose(in);
+    }
+    fc_trace_end(&span, 0);
+    if (status != FC_OK) return status;
+
+    status = convert_stream(ctx, type, in, out);
+
+    // Closing flushes the last of the output (and finishes compression)
+    fc_trace_begin(&span, "close");
+    fclose(in);
+    if (fclose(out) != 0 && status == FC_OK) status = FC_ERR_IO;
+    fc_trace_end(&span, 0);
+
+    // A failed conversion leaves no half-written file behind (a truncated
+    // Arrow or XLSX file would not even open); devices are left alone
+    struct stat st;
+    if (status != FC_OK && stat(output_file, &st) == 0 && S_ISREG(st.st_mode)) unlink(output_file);
+    return status;
+}
+
+// Format detection
+
+#define SNIFF_BYTES 4096
+#define SNIFF_JSON_TOKENS 64    // enough to tell JSON from "[INFO] ..." text
+#define SNIFF_CSV_LINES 20
+
+static const char *json_skip_space(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    return p;
+}
+
+// Scan one JSON scalar at p. Returns the end of it, end if the head was cut
+// off inside it, or NULL if it is not a JSON scalar.
+static const char *json_scalar(const char *p, const char *end) {
+    if (*p == '"') {
+        for (p++; p < end; p++) {
+            if (*p == '\\') p++;
+            else if (*p == '"') return p + 1;
+            else if ((unsigned char)*p < 0x20) return NULL;
+        }
+        return end;
+    }
+    static const char *const literals[] = { "true", "false", "null" };
+    for (size_t i = 0; i < sizeof(literals) / sizeof(literals[0]); i++) {
+        size_t n = strlen(literals[i]), have = end - p < (ptrdiff_t)n ? (size_t)(end - p) : n;
+        if (memcmp(p, literals[i], have) == 0) return p + have;
+    }
+    const char *start = p;
+    if (p < end && *p == '-') p++;
+    if (p == end) return end;
+    if (!isdigit((unsigned char)*p)) return NULL;
+    while (p < end && (isdigit((unsigned char)*p) || *p == '.' || *p == 'e' || *p == 'E' ||
+                       ((*p == '+' || *p == '-') && (p[-1] == 'e' || p[-1] == 'E')))) p++;
+    return p > start ? p : NULL;
+}
+
+// Does head start with something that parses as JSON, at least as far as
+// the first SNIFF_JSON_TOKENS tokens or the end of the head?
+static int looks_like_json(const char *p, const char *end) {
+    enum { VALUE, KEY, COLON, NEXT } expect = VALUE;
+    char stack[SNIFF_JSON_TOKENS];
+    int depth = 0, just_opened = 0;
+
+    p = json_skip_space(p, end);
+    if (p == end || (*p != '{' && *p != '[')) return 0;
+    for (int tokens = 0; tokens < SNIFF_JSON_TOKENS; tokens++) {
+        p = json_skip_space(p, end);
+        if (p == end) return 1;
+        char c = *p;
+        int opened = just_opened;
+        just_opened = 0;
+        if ((c == '}' || c == ']') && depth > 0 && stack[depth - 1] == (c == '}' ? '{' : '[') &&
+            (expect == NEXT || opened)) {
+            depth--;
+            p = json_skip_space(p + 1, end);
+            // One document, or the first of several (JSON Lines)
+            if (depth == 0) return p == end || *p == '{' || *p == '[';
+            expect = NEXT;
+        } else if (expect == NEXT && c == ',' && depth > 0) {
+            expect = stack[depth - 1] == '{' ? KEY : VALUE;
+            p++;
+        } else if (expect == COLON && c == ':') {
+            expect = VALUE;
+            p++;
+        } else if (expect == VALUE && (c == '{' || c == '[')) {
+            stack[depth++] = c;
+            expect = c == '{' ? KEY : VALUE;
+            just_opened = 1;
+            p++;
+            if (depth == SNIFF_JSON_TOKENS) return 1;
+        } else if (expect == VALUE || (expect == KEY && c == '"')) {
+            p = json_scalar(p, end);
+            if (!p) return 0;
+            expect = expect == KEY ? COLON : NEXT;
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int contains_nocase(const char *head, size_t len, const char *needle) {
+    size_t n = strlen(needle);
+    for (size_t i = 0; i + n <= len; i++) {
+        if (strncasecmp(head + i, needle, n) == 0) return 1;
+    }
+    return 0;
+}
+
+// Comma-separated rows: every complete line seen has the same number of
+// commas, at least one, and there are at least two such lines
+static int looks_like_csv(const char *p, const char *end) {
+    int lines = 0, fields = -1;
+    while (lines < SNIFF_CSV_LINES) {
+        const char *nl = memchr(p, '\n', end - p);
+        if (!nl) break;
+        int commas = 0;
+        for (const char *q = p; q < nl; q++) commas += *q == ',';
+        if (nl > p && !(nl - p == 1 && *p == '\r')) {
+            if (commas == 0 || (fields >= 0 && commas != fields)) return 0;
+            fields = commas;
+            lines++;
+        }
+        p = nl + 1;
+    }
+    return lines >= 2;
+}
+
+const char *fc_sniff_format(const char *head, size_t len) {
+    if (!head) return NULL;
+    if (len >= 5 && memcmp(head, "%PDF-", 5) == 0) return "PDF";
+
+    // UTF-16 is text for the encoding stage; other NUL bytes mean binary
+    if (len >= 2 && ((unsigned char)head[0] == 0xFF && (unsigned char)head[1] == 0xFE)) return "TXT";
+    if (len >= 2 && ((unsigned char)head[0] == 0xFE && (unsigned char)head[1] == 0xFF)) return "TXT";
+    if (memchr(head, 0, len)) return NULL;
+
+    const char *p = head, *end = head + len;
+    if (len >= 3 && memcmp(head, "\xEF\xBB\xBF", 3) == 0) p += 3;
+    if (looks_like_json(p, end)) return "JSON";
+    if (contains_nocase(p, end - p, "<!doctype html") || contains_nocase(p, end - p, "<html") ||
+        contains_nocase(p, end - p, "<body")) return "HTML";
+    if (looks_like_csv(p, end)) return "CSV";
+    return "TXT";
+}
+
+const char *fc_format_for_path(const char *path) {
+    if (!path) return NULL;
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    size_t len = strlen(base);
+
+    // Look through a compression suffix: "data.json.gz" is JSON
+    const char *dot = strrchr(base, '.');
+    if (dot && fc_compression_for_path(dot) != FC_COMPRESS_NONE) {
+        len = dot - base;
+        dot = memrchr(base, '.', len);
+    }
+    if (!dot || dot == base) return NULL;
+    const char *ext = dot + 1;
+    size_t ext_len = base + len - ext;
+
+    if (ext_len == 3 && strncasecmp(ext, "htm", 3) == 0) return "HTML";
+    if (ext_len == 7 && strncasecmp(ext, "feather", 7) == 0) return "ARROW";
+    for (int type = FC_CONVERSION_FIRST; type <= FC_CONVERSION_LAST; type++) {
+        const char *formats[] = { conversions[type].info.source, conversions[type].info.target };
+        for (int i = 0; i < 2; i++) {
+            if (strlen(formats[i]) == ext_len && strncasecmp(formats[i], ext, ext_len) == 0) return formats[i];
+        }
+    }
+    return NULL;
+}
+
+const char *fc_detect_format(const char *path) {
+    if (!path) return NULL;
+    FILE *in;
+    if (open_input(path, &in) != FC_OK) return NULL;
+    char head[SNIFF_BYTES];
+    size_t n = fread(head, 1, sizeof(head), in);
+    fclose(in);
+
+    const char *sniffed = fc_sniff_format(head, n);
+    const char *by_name = fc_format_for_path(path);
+    if (sniffed && strcmp(sniffed, "PDF") == 0) return sniffed;
+    return by_name ? by_name : sniffed;
+}
+
+fc_conversion fc_detect_conversion(const char *input_file, const char *target) {
+    return fc_find_conversion(fc_detect_format(input_file), target);
+}
+
+// Incremental conversion
+
+typedef struct {
+    int type;
+    unsigned long long input_dev, input_ino;
+    unsigned long long input_check;
+    long long output_size;
+    long long output_mtime_sec, output_mtime_nsec;
+    resume_point point;
+} resume_state;
+
+static unsigned long long fnv1a(const char *data, size_t len) {
+    unsigned long long h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Fingerprint the input bytes just before offset, so a file that was
+// truncated and rewritten is not mistaken for one that only grew.
+static int input_check(fc_context *ctx, FILE *in, long offset, unsigned long long *check) {
+    long start = offset > RESUME_CHECK_BYTES ? offset - RESUME_CHECK_BYTES : 0;
+    size_t len = offset - start;
+    if (fseek(in, start, SEEK_SET) != 0 || fread(ctx->block, 1, len, in) != len) return -1;
+    *check = fnv1a(ctx->block, len);
+    return 0;
+}
+
+static int load_state(const char *path, resume_state *st) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    int n = fscanf(f, "fc-incremental 1 type %d input %llu %llu %llx output %lld %lld.%lld "
+                      "resume %ld %ld json_first %d inside_tag %d",
+                   &st->type, &st->input_dev, &st->input_ino, &st->input_check,
+                   &st->output_size, &st->output_mtime_sec, &st->output_mtime_nsec,
+                   &st->point.input_offset, &st->point.output_offset,
+                   &st->point.json_first, &st->point.inside_tag);
+    fclose(f);
+    return n == 11 ? 0 : -1;
+}
+
+static int save_state(const char *path, const resume_state *st) {
+    char tmp[PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return -1;
+    fprintf(f, "fc-incremental 1\ntype %d\ninput %llu %llu %016llx\noutput %lld %lld.%09lld\n"
+               "resume %ld %ld\njson_first %d\ninside_tag %d\n",
+            st->type, st->input_dev, st->input_ino, st->input_check,
+            st->output_size, st->output_mtime_sec, st->output_mtime_nsec,
+            st->point.input_offset, st->point.output_offset,
+            st->point.json_first, st->point.inside_tag);
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// Convert from the resume point to the end of the input, advance the point
+// past what will not change on the next run, then write the trailer.
+static fc_status convert_tail(fc_context *ctx, fc_conversion type, FILE *in, FILE *out,
+                              resume_point *point, int fresh) {
+    const converter *c = &conversions[type];
+    fc_status status;
+
+    switch (type) {
+        case FC_TXT_TO_HTML:
+            if (fresh) fputs(HTML_HEADER, out);
+            status = escape_stream(ctx, in, out);
+            break;
+        case FC_TXT_TO_JSON: {
+            if (fresh) {
+                fputs("[\n", out);
+                point->output_offset = ftell(out);
+            }
+            int first = point->json_first;
+            return json_entries(ctx, in, out, &first, point) == FC_OK && fputs("\n]\n", out) >= 0
+                       ? stream_status(in, out) : FC_ERR_IO;
+        }
+        default:
+            // Block transforms carry their state in the resume point
+            if (!c->transform) return FC_ERR_UNSUPPORTED;
+            status = transform_blocks(ctx, in, out, c->transform, &point->inside_tag);
+            break;
+    }
+    if (status != FC_OK) return status;
+
+    point->input_offset = ftell(in);
+    point->output_offset = ftell(out);
+    if (type == FC_TXT_TO_HTML) fputs(HTML_FOOTER, out);
+    return stream_status(in, out);
+}
+
+// Is everything from offset to the end of the input complete UTF-8? Only
+// then can the tail skip the encoding stage and be converted as raw bytes.
+static int tail_is_utf8(fc_context *ctx, FILE *in, long offset) {
+    if (fseek(in, offset, SEEK_SET) != 0) return 0;
+    size_t have = 0;
+    for (;;) {
+        size_t got = fread(ctx->block + have, 1, FC_BLOCK_SIZE - have, in);
+        size_t n = have + got;
+        size_t valid = fc_utf8_valid_prefix(ctx->block, n);
+        if (got < FC_BLOCK_SIZE - have) return !ferror(in) && valid == n;
+        if (n - valid > 3) return 0;
+        memmove(ctx->block, ctx->block + valid, n - valid);
+        have = n - valid;
+    }
+}
+
+static fc_status convert_whole(fc_context *ctx, fc_conversion type,
+                               const char *input_file, const char *output_file,
+                               unsigned long long *bytes_converted) {
+    fc_status status = convert_file(ctx, type, input_file, output_file);
+    if (status == FC_OK && bytes_converted) {
+        struct stat st;
+        *bytes_converted = stat(input_file, &st) == 0 ? (unsigned long long)st.st_size : 0;
+    }
+    return status;
+}
+
+static fc_status convert_incremental(fc_context *ctx, fc_conversion type,
+                                     const char *input_file, const char *output_file,
+                                     unsigned long long *bytes_converted) {
+    if (!ctx || !input_file || !output_file || !valid_type(type)) return FC_ERR_INVALID;
+
+    // Only streaming engines can resume (PDF has no append-friendly
+    // structure, paged HTML rewrites its index) and compressed streams
+    // cannot be patched in place; convert those whole
+    if (!(conversions[type].info.caps & FC_CAP_STREAMING) || (type == FC_TXT_TO_HTML && ctx->html_page_lines) ||
+        fc_output_compression(ctx, output_file) != FC_COMPRESS_NONE || is_compressed(input_file)) {
+        return convert_whole(ctx, type, input_file, output_file, bytes_converted);
+    }
+
+    char state_path[PATH_MAX];
+    if (snprintf(state_path, sizeof(state_path), "%s%s", output_file, FC_STATE_SUFFIX) >= (int)sizeof(state_path)) {
+        return FC_ERR_INVALID;
+    }
+
+    FILE *in = fopen(input_file, "r");
+    if (!in) return FC_ERR_INPUT;
+    struct stat in_st, out_st;
+    if (fstat(fileno(in), &in_st) != 0) {
+        fclose(in);
+        return FC_ERR_INPUT;
+    }
+
+    // Resume only if the state matches both files exactly: same input file,
+    // grown but unchanged before the resume point, and an output nobody else
+    // has touched since the last run.
+    resume_state st;
+    unsigned long long check;
+    int resume = load_state(state_path, &st) == 0 && st.type == (int)type &&
+                 st.input_dev == (unsigned long long)in_st.st_dev &&
+                 st.input_ino == (unsigned long long)in_st.st_ino &&
+                 st.point.input_offset <= in_st.st_size &&
+                 input_check(ctx, in, st.point.input_offset, &check) == 0 && check == st.input_check &&
+                 stat(output_file, &out_st) == 0 && out_st.st_size == st.output_size &&
+                 out_st.st_mtim.tv_sec == st.output_mtime_sec && out_st.st_mtim.tv_nsec == st.output_mtime_nsec &&
+                 st.point.output_offset <= st.output_size;
+
+    // Anything that needs transcoding goes through the encoding stage, which
+    // only a whole conversion uses
+    fc_trace_span span;
+    fc_trace_begin(&span, "check tail");
+    int tail_ok = tail_is_utf8(ctx, in, resume ? st.point.input_offset : 0);
+    fc_trace_end(&span, 0);
+    if (!tail_ok) {
+        fclose(in);
+        unlink(state_path);
+        return convert_whole(ctx, type, input_file, output_file, bytes_converted);
+    }
+
+    FILE *out = NULL;
+    if (resume) {
+        out = fopen(output_file, "r+");
+        if (!out || ftruncate(fileno(out), st.point.output_offset) != 0 ||
+            fseek(out, st.point.output_offset, SEEK_SET) != 0 || fseek(in, st.point.input_offset, SEEK_SET) != 0) {
+            if (out) fclose(out);
+            out = NULL;
+            resume = 0;
+        }
+    }
+    if (!resume) {
+        memset(&st, 0, sizeof(st));
+        st.point.json_first = 1;
+        rewind(in);
+        out = fopen(output_file, "w");
+        if (!out) {
+            fclose(in);
+            return FC_ERR_OUTPUT;
+        }
+    }
+
+    long start = st.point.input_offset;
+    fc_status status = convert_tail(ctx, type, in, out, &st.point, !resume);
+    if (status == FC_OK && bytes_converted) *bytes_converted = ftell(in) - start;
+    if (status == FC_OK && input_check(ctx, in, st.point.input_offset, &st.input_check) != 0) status = FC_ERR_IO;
+
+    fclose(in);
+    if (fclose(out) != 0 && status == FC_OK) status = FC_ERR_IO;
+
+    // A missing or stale state only costs a full conversion next time
+    if (status == FC_OK && stat(output_file, &out_st) == 0) {
+        st.type = type;
+        st.input_dev = in_st.st_dev;
+        st.input_ino = in_st.st_ino;
+        st.output_size = out_st.st_size;
+        st.output_mtime_sec = out_st.st_mtim.tv_sec;
+        st.output_mtime_nsec = out_st.st_mtim.tv_nsec;
+        if (save_state(state_path, &st) != 0) unlink(state_path);
+    } else {
+        unlink(state_path);
+    }
+    return status;
+}
+
+// Checkpointed conversion
+
+typedef struct {
+    int type;
+    unsigned long long input_dev, input_ino;
+    long long input_size, input_mtime_sec, input_mtime_nsec;
+    unsigned long long input_check;
+    resume_point point;
+} checkpoint;
+
+static int load_checkpoint(const char *path, checkpoint *cp) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    int n = fscanf(f, "fc-checkpoint 1 type %d input %llu %llu %lld %lld.%lld %llx "
+                      "resume %ld %ld json_first %d inside_tag %d",
+                   &cp->type, &cp->input_dev, &cp->input_ino, &cp->input_size,
+                   &cp->input_mtime_sec, &cp->input_mtime_nsec, &cp->input_check,
+                   &cp->point.input_offset, &cp->point.output_offset,
+                   &cp->point.json_first, &cp->point.inside_tag);
+    fclose(f);
+    return n == 11 ? 0 : -1;
+}
+
+// Written to a temporary name, synced and renamed, so a crash leaves
+// either the previous checkpoint or this one
+static int save_checkpoint(const char *path, const checkpoint *cp) {
+    char tmp[PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return -1;
+    fprintf(f, "fc-checkpoint 1\ntype %d\ninput %llu %llu %lld %lld.%09lld %016llx\n"
+               "resume %ld %ld\njson_first %d\ninside_tag %d\n",
+            cp->type, cp->input_dev, cp->input_ino, cp->input_size,
+            cp->input_mtime_sec, cp->input_mtime_nsec, cp->input_check,
+            cp->point.input_offset, cp->point.output_offset,
+            cp->point.json_first, cp->point.inside_tag);
+    if (fflush(f) != 0 || fsync(fileno(f)) != 0 || fclose(f) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// Bytes [pos, end) of a file being scanned. Offsets are the file's.
+typedef struct {
+    fc_io_scan *scan;
+    off_t pos, end;
+} slice;
+
+static ssize_t slice_read(void *cookie, char *buf, size_t size) {
+    slice *s = cookie;
+    if ((off_t)size > s->end - s->pos) size = s->end - s->pos;
+    if (size == 0) return 0;
+    ssize_t n;
+    do {
+        n = pread(s->scan->fd, buf, size, s->pos);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) {
+        s->pos += n;
+        fc_io_scan_advance(s->scan, s->pos);
+    }
+    return n;
+}
+
+// Where the slice starting at start should end: after the first newline
+// at least interval bytes in, so no line (one JSON entry) is cut in two
+static off_t slice_end(fc_context *ctx, int fd, off_t start, off_t size, long long interval) {
+    off_t pos = start + interval;
+    while (pos < size) {
+        ssize_t n = pread(fd, ctx->block, FC_BLOCK_SIZE, pos);
+        if (n <= 0) break;
+        char *nl = memchr(ctx->block, '\n', n);
+        if (nl) return pos + (nl - ctx->block) + 1;
+        pos += n;
+    }
+    return size;
+}
+
+// Convert one slice of the input, carrying the engine state in *point.
+// Each slice goes through the encoding stage on its own; that gives what
+// a single pass would, since slices end at newlines.
+static fc_status convert_slice(fc_context *ctx, fc_conversion type, fc_io_scan *scan, off_t start, off_t end,
+                               FILE *out, resume_point *point) {
+    slice *s = fc_arena_alloc(ctx->arena, sizeof(*s));
+    if (!s) return FC_ERR_NOMEM;
+    s->scan = scan;
+    s->pos = start;
+    s->end = end;
+    cookie_io_functions_t io = { slice_read, NULL, NULL, NULL };
+    FILE *raw = fopencookie(s, "r", io);
+    FILE *in = raw ? fc_text_stream_arena(raw, 1, ctx->arena) : NULL;
+    if (!in) {
+        if (raw) fclose(raw);
+        return FC_ERR_NOMEM;
+    }
+
+    fc_status status;
+    switch (type) {
+        case FC_TXT_TO_HTML:
+            if (start == 0) fputs(HTML_HEADER, out);
+            status = escape_stream(ctx, in, out);
+            break;
+        case FC_TXT_TO_JSON:
+            if (start == 0) fputs("[\n", out);
+            status = json_entries(ctx, in, out, &point->json_first, NULL);
+            break;
+        default:
+            status = transform_blocks(ctx, in, out, conversions[type].transform, &point->inside_tag);
+            break;
+    }
+    fclose(in);
+    return status;
+}
+
+// Whole conversions, for what cannot be checkpointed, still go through the
+// partial file; compression is by the final name
+static fc_status convert_whole_to(fc_context *ctx, fc_conversion type, const char *input_file,
+                                  const char *partial, const char *output_file) {
+    fc_compression saved = ctx->output_compression;
+    ctx->output_compression = fc_output_compression(ctx, output_file);
+    fc_status status = convert_file(ctx, type, input_file, partial);
+    ctx->output_compression = saved;
+    return status;
+}
+
+static fc_status convert_checkpointed(fc_context *ctx, fc_conversion type,
+                                      const char *input_file, const char *output_file,
+                                      int resume, unsigned long long *resumed_from) {
+    if (!ctx || !input_file || !output_file || !valid_type(type)) return FC_ERR_INVALID;
+
+    char partial[PATH_MAX], state_path[PATH_MAX];
+    if (snprintf(partial, sizeof(partial), "%s%s", output_file, FC_PARTIAL_SUFFIX) >= (int)sizeof(partial) ||
+        snprintf(state_path, sizeof(state_path), "%s%s", output_file, FC_CHECKPOINT_SUFFIX) >= (int)sizeof(state_path)) {
+        return FC_ERR_INVALID;
+    }
+    if (resumed_from) *resumed_from = 0;
+
+    // Paged HTML names its pages after the output and writes them as it goes
+    if (type == FC_TXT_TO_HTML && ctx->html_page_lines) return convert_file(ctx, type, input_file, output_file);
+
+    int fd = open(input_file, O_RDONLY | O_CLOEXEC);
+    struct stat in_st;
+    if (fd < 0 || fstat(fd, &in_st) != 0) {
+        if (fd >= 0) close(fd);
+        return FC_ERR_INPUT;
+    }
+    FILE *in = fdopen(fd, "r");
+    if (!in) {
+        close(fd);
+        return FC_ERR_NOMEM;
+    }
+
+    // Only streaming engines on plain UTF-8 (or 8-bit) text in a regular
+    // file can stop and pick up again; PDF, tables, compressed streams and
+    // pipes run whole
+    unsigned char bom[2] = { 0, 0 };
+    size_t bom_len = fread(bom, 1, 2, in);
+    int utf16 = bom_len == 2 && ((bom[0] == 0xFF && bom[1] == 0xFE) || (bom[0] == 0xFE && bom[1] == 0xFF));
+    rewind(in);
+    int compressed = fc_detect_compression(in) != FC_COMPRESS_NONE;
+
+    fc_status status;
+    if (!(conversions[type].info.caps & FC_CAP_STREAMING) || !S_ISREG(in_st.st_mode) || utf16 || compressed ||
+        fc_output_compression(ctx, output_file) != FC_COMPRESS_NONE) {
+        fclose(in);
+        unlink(state_path);
+        status = convert_whole_to(ctx, type, input_file, partial, output_file);
+        if (status == FC_OK && rename(partial, output_file) != 0) status = FC_ERR_OUTPUT;
+        if (status != FC_OK) unlink(partial);
+        return status;
+    }
+
+    // Resume only from a checkpoint of this conversion of this very input,
+    // unchanged since, whose partial output has everything up to it
+    checkpoint cp;
+    unsigned long long check;
+    struct stat out_st;
+    FILE *out = NULL;
+    if (resume && load_checkpoint(state_path, &cp) == 0 && cp.type == (int)type &&
+        cp.input_dev == (unsigned long long)in_st.st_dev && cp.input_ino == (unsigned long long)in_st.st_ino &&
+        cp.input_size == in_st.st_size && cp.input_mtime_sec == in_st.st_mtim.tv_sec &&
+        cp.input_mtime_nsec == in_st.st_mtim.tv_nsec && cp.point.input_offset <= in_st.st_size &&
+        input_check(ctx, in, cp.point.input_offset, &check) == 0 && check == cp.input_check &&
+        stat(partial, &out_st) == 0 && out_st.st_size >= cp.point.output_offset) {
+        out = fopen(partial, "r+");
+        if (out && (ftruncate(fileno(out), cp.point.output_offset) != 0 ||
+                    fseek(out, cp.point.output_offset, SEEK_SET) != 0)) {
+            fclose(out);
+            out = NULL;
+        }
+    }
+    if (out) {
+        if (resumed_from) *resumed_from = cp.point.input_offset;
+    } else {
+        memset(&cp, 0, sizeof(cp));
+        cp.type = type;
+        cp.input_dev = in_st.st_dev;
+        cp.input_ino = in_st.st_ino;
+        cp.input_size = in_st.st_size;
+        cp.input_mtime_sec = in_st.st_mtim.tv_sec;
+        cp.input_mtime_nsec = in_st.st_mtim.tv_nsec;
+        cp.point.json_first = 1;
+        unlink(state_path);
+        out = fopen(partial, "w");
+        if (!out) {
+            fclose(in);
+            return FC_ERR_OUTPUT;
+        }
+    }
+
+    // A slice at a time; after each the output is synced and then the
+    // checkpoint written, so a checkpoint never points past durable output.
+    // Synced output is clean, so it can leave the page cache with the input.
+    long long interval = ctx->checkpoint_bytes > 0 ? ctx->checkpoint_bytes : FC_CHECKPOINT_BYTES;
+    off_t pos = cp.point.input_offset, out_dropped = cp.point.output_offset;
+    fc_io_scan scan;
+    fc_io_scan_begin(&scan, fd, &in_st);
+    fc_io_scan_advance(&scan, pos);
+    fc_arena_mark mark = fc_arena_save(ctx->arena);
+    status = FC_OK;
+    do {
+        off_t end = slice_end(ctx, fd, pos, in_st.st_size, interval);
+        fc_trace_span span;
+        fc_trace_begin(&span, "slice");
+        status = convert_slice(ctx, type, &scan, pos, end, out, &cp.point);
+        fc_trace_end(&span, end - pos);
+        fc_arena_rewind(ctx->arena, mark);
+        if (status != FC_OK) break;
+        pos = end;
+        if (pos == in_st.st_size) break;
+
+        fc_trace_begin(&span, "checkpoint");
+        cp.point.input_offset = pos;
+        cp.point.output_offset = ftello(out);
+        if (fflush(out) != 0 || fdatasync(fileno(out)) != 0 ||
+            input_check(ctx, in, pos, &cp.input_check) != 0) {
+            status = FC_ERR_IO;
+        } else if (save_checkpoint(state_path, &cp) != 0) {
+            unlink(state_path);     // costs a restart, not the output
+        }
+        if (status == FC_OK && scan.drop) {
+            fc_io_drop(fileno(out), out_dropped, cp.point.output_offset - out_dropped);
+            out_dropped = cp.point.output_offset;
+        }
+        fc_trace_end(&span, 0);
+    } while (status == FC_OK);
+
+    if (status == FC_OK) {
+        if (type == FC_TXT_TO_HTML) fputs(HTML_FOOTER, out);
+        else if (type == FC_TXT_TO_JSON) fputs("\n]\n", out);
+        if (fflush(out) != 0 || fsync(fileno(out)) != 0) status = FC_ERR_IO;
+        if (status == FC_OK && scan.drop) fc_io_drop(fileno(out), out_dropped, ftello(out) - out_dropped);
+    }
+    fc_io_scan_end(&scan);
+    fclose(in);
+    if (fclose(out) != 0 && status == FC_OK) status = FC_ERR_IO;
+
+    // Done: only now does the output appear under its name. A failed run
+    // keeps its partial output and checkpoint for the next resume.
+    if (status == FC_OK) {
+        if (rename(partial, output_file) != 0) return FC_ERR_OUTPUT;
+        unlink(state_path);
+    }
+    return status;
+}
+
+static fc_status convert_buffer(fc_context *ctx, fc_conversion type,
+                                const char *input, size_t input_len,
+                                char **output, size_t *output_len) {
+    if (!ctx || (!input && input_len) || !output || !output_len || !valid_type(type)) return FC_ERR_INVALID;
+
+    // fmemopen rejects zero-length buffers
+    FILE *in = input_len ? fmemopen((void *)input, input_len, "r") : fopen("/dev/null", "r");
+    if (!in) return FC_ERR_NOMEM;
+    fc_status status = wrap_input(&in);
+    if (status != FC_OK) return status;
+
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&buf, &len);
+    if (!out) {
+        fclose(in);
+        return FC_ERR_NOMEM;
+    }
+
+    status = convert_stream(ctx, type, in, out);
+
+    fclose(in);
+    if (fclose(out) != 0 && status == FC_OK) status = FC_ERR_NOMEM;
+
+    if (status != FC_OK) {
+        free(buf);
+        return status;
+    }
+    *output = buf;
+    *output_len = len;
+    return FC_OK;
+}
+
+// Can data be converted in place? Anything but plain UTF-8 needs the
+// decoding stages, which can make it longer; gzip and zstd magic is never
+// valid UTF-8.
+static fc_status check_in_place(fc_context *ctx, fc_conversion type,
+                                const char *data, size_t len, size_t *out_len) {
+    if (!ctx || (!data && len) || !out_len || !valid_type(type)) return FC_ERR_INVALID;
+    if (!(conversions[type].info.caps & FC_CAP_IN_PLACE) || fc_utf8_valid_prefix(data, len) != len) {
+        return FC_ERR_UNSUPPORTED;
+    }
+    return FC_OK;
+}
+
+static fc_status convert_in_place(fc_conversion type, char *data, size_t len, size_t *out_len) {
+    const converter *c = &conversions[type];
+    fc_trace_span span;
+    fc_trace_begin(&span, "transform");
+    int state = 0;
+    *out_len = len ? c->transform(data, len, &state) : 0;
+    fc_trace_end(&span, len);
+    return FC_OK;
+}
+
+static fc_status search_file(fc_context *ctx, const char *filename, const char *term,
+                             FILE *out, int *matches, size_t *written) {
+    if (!ctx || !filename || !term || !out) return FC_ERR_INVALID;
+
+    FILE *file;
+    fc_status status = open_scan(filename, &file);
+    if (status != FC_OK) return status;
+    FILE *raw = file;
+    file = fc_text_stream_arena(raw, 1, ctx->arena);
+    if (!file) {
+        fclose(raw);
+        return FC_ERR_NOMEM;
+    }
+
+    // Matches go straight to out, so memory does not depend on how many
+    // there are
+    fc_trace_span span;
+    fc_trace_begin(&span, "scan lines");
+    int line_number = 1, found = 0;
+    ssize_t line_len;
+    status = FC_OK;
+    while ((line_len = getline(&ctx->line, &ctx->line_cap, file)) != -1) {
+        if (strstr(ctx->line, term)) {
+            int prefix_len = fprintf(out, "Line %d: ", line_number);
+            if (prefix_len < 0 || fwrite(ctx->line, 1, line_len, out) != (size_t)line_len) {
+                status = FC_ERR_IO;
+                break;
+            }
+            *written += prefix_len + line_len;
+            found++;
+        }
+        line_number++;
+    }
+    fc_trace_end(&span, 0);
+
+    if (status == FC_OK && ferror(file)) status = FC_ERR_IO;
+    fclose(file);
+    if (status == FC_OK && fflush(out) != 0) status = FC_ERR_IO;
+    if (status == FC_OK && matches) *matches = found;
+    return status;
+}
+
+// Metrics and tracing. Each public call is a metrics scope and a trace span;
+// nested calls (a cached or incremental conversion falling back to a whole
+// one) are not counted twice, but do show up nested in the trace.
+
+static const char *trace_name(fc_conversion type) {
+    return valid_type(type) ? conversions[type].info.name : "convert";
+}
+
+static unsigned long long file_size(const char *path) {
+    struct stat st;
+    return path && stat(path, &st) == 0 ? (unsigned long long)st.st_size : 0;
+}
+
+static long long stream_offset(FILE *f) {
+    return f ? ftello(f) : -1;
+}
+
+// The outermost call on a context holds its buffers for the whole call
+// (counted once when calls nest; the line buffer may grow during it) and
+// releases its scratch in one step at the end
+static size_t begin_call(fc_context *ctx) {
+    if (!ctx || ctx->in_call) return 0;
+    ctx->in_call = 1;
+    ctx->tool_errors[0] = '\0';
+    size_t held = FC_BLOCK_SIZE + ctx->line_cap;
+    fc_metrics_buffer_alloc(held);
+    return held;
+}
+
+static void end_call(fc_context *ctx, size_t held) {
+    if (!held) return;
+    fc_metrics_buffer_in_use(FC_BLOCK_SIZE + ctx->line_cap - held);
+    fc_metrics_buffer_free(held);
+    fc_arena_rewind(ctx->arena, ctx->arena_base);
+    ctx->in_call = 0;
+}
+
+fc_status fc_convert_stream(fc_context *ctx, fc_conversion type, FILE *in, FILE *out) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, type);
+    size_t held = begin_call(ctx);
+    fc_trace_span span;
+    fc_trace_begin(&span, trace_name(type));
+    long long in_start = stream_offset(in), out_start = stream_offset(out);
+
+    fc_status status = convert_stream(ctx, type, in, out);
+
+    // Pipes and sockets have no offsets to measure by
+    long long in_end = stream_offset(in), out_end = stream_offset(out);
+    if (in_start >= 0 && in_end >= in_start) scope.bytes_in = in_end - in_start;
+    if (out_start >= 0 && out_end >= out_start) scope.bytes_out = out_end - out_start;
+    end_call(ctx, held);
+    fc_metrics_end(&scope, status);
+    fc_trace_end(&span, scope.bytes_in);
+    return status;
+}
+
+fc_status fc_convert_file(fc_context *ctx, fc_conversion type,
+                          const char *input_file, const char *output_file) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, type);
+    size_t held = begin_call(ctx);
+    fc_trace_span span;
+    fc_trace_begin(&span, trace_name(type));
+
+    fc_status status = convert_file(ctx, type, input_file, output_file);
+
+    if (scope.active) {
+        scope.bytes_in = file_size(input_file);
+        scope.bytes_out = file_size(output_file);
+    }
+    end_call(ctx, held);
+    fc_metrics_end(&scope, status);
+    fc_trace_end(&span, scope.bytes_in);
+    return status;
+}
+
+fc_status fc_convert_file_incremental(fc_context *ctx, fc_conversion type,
+                                      const char *input_file, const char *output_file,
+                                      unsigned long long *bytes_converted) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, type);
+    size_t held = begin_call(ctx);
+    fc_trace_span span;
+    fc_trace_begin(&span, trace_name(type));
+    unsigned long long converted = 0, before = scope.active ? file_size(output_file) : 0;
+
+    fc_status status = convert_incremental(ctx, type, input_file, output_file, &converted);
+    if (status == FC_OK && bytes_converted) *bytes_converted = converted;
+
+    // Only what this call converted; a resumed output grows by its tail
+    if (scope.active) {
+        unsigned long long after = file_size(output_file);
+        scope.bytes_in = converted;
+        scope.bytes_out = after >= before ? after - before : after;
+    }
+    end_call(ctx, held);
+    fc_metrics_end(&scope, status);
+    fc_trace_end(&span, scope.bytes_in);
+    return status;
+}
+
+fc_status fc_convert_file_checkpointed(fc_context *ctx, fc_conversion type,
+                                       const char *input_file, const char *output_file,
+                                       int resume, unsigned long long *resumed_from) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, type);
+    size_t held = begin_call(ctx);
+    fc_trace_span span;
+    fc_trace_begin(&span, trace_name(type));
+    unsigned long long from = 0;
+
+    fc_status status = convert_checkpointed(ctx, type, input_file, output_file, resume, &from);
+    if (resumed_from) *resumed_from = from;
+
+    // Input from where this call started
+    if (scope.active) {
+        unsigned long long size = file_size(input_file);
+        scope.bytes_in = size >= from ? size - from : 0;
+        scope.bytes_out = status == FC_OK ? file_size(output_file) : 0;
+    }
+    end_call(ctx, held);
+    fc_metrics_end(&scope, status);
+    fc_trace_end(&span, scope.bytes_in);
+    return status;
+}
+
+fc_status fc_convert_buffer(fc_context *ctx, fc_conversion type,
+                            const char *input, size_t input_len,
+                            char **output, size_t *output_len) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, type);
+    size_t held = begin_call(ctx);
+    fc_trace_span span;
+    fc_trace_begin(&span, trace_name(type));
+
+    fc_status status = convert_buffer(ctx, type, input, input_len, output, output_len);
+
+    scope.bytes_in = input_len;
+    if (status == FC_OK) scope.bytes_out = *output_len;
+    end_call(ctx, held);
+    fc_metrics_end(&scope, status);
+    fc_trace_end(&span, scope.bytes_in);
+    return status;
+}
+
+fc_status fc_convert_in_place(fc_context *ctx, fc_conversion type,
+                              char *data, size_t len, size_t *out_len) {
+    // Declining is not a failed conversion, so it is not measured
+    fc_status status = check_in_place(ctx, type, data, len, out_len);
+    if (status != FC_OK) return status;
+
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, type);
+    size_t held = begin_call(ctx);
+    fc_trace_span span;
+    fc_trace_begin(&span, trace_name(type));
+
+    status = convert_in_place(type, data, len, out_len);
+
+    scope.bytes_in = len;
+    if (status == FC_OK) scope.bytes_out = *out_len;
+    end_call(ctx, held);
+    fc_metrics_end(&scope, status);
+    fc_trace_end(&span, scope.bytes_in);
+    return status;
+}
+
+fc_status fc_search_file(fc_context *ctx, const char *filename, const char *term,
+                         char **results, size_t *results_len, int *matches) {
+    if (!results || !results_len) return FC_ERR_INVALID;
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&buf, &len);
+    if (!out) return FC_ERR_NOMEM;
+    fc_status status = fc_search_stream(ctx, filename, term, out, matches);
+    if (fclose(out) != 0 && status == FC_OK) status = FC_ERR_NOMEM;
+    if (status != FC_OK) {
+        free(buf);
+        return status;
+    }
+    *results = buf;
+    *results_len = len;
+    return FC_OK;
+}
+
+fc_status fc_search_stream(fc_context *ctx, const char *filename, const char *term,
+                           FILE *out, int *matches) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, FC_OP_SEARCH);
+    size_t held = begin_call(ctx);
+    fc_trace_span span;
+    fc_trace_begin(&span, "search");
+    size_t written = 0;
+
+    fc_status status = search_file(ctx, filename, term, out, matches, &written);
+
+    if (scope.active) scope.bytes_in = file_size(filename);
+    if (status == FC_OK) scope.bytes_out = written;
+    end_call(ctx, held);
+    fc_metrics_end(&scope, status);
+    fc_trace_end(&span, scope.bytes_in);
+    return status;
+}
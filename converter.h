@@ -0,0 +1,238 @@
+#ifndef CONVERTER_H
+#define CONVERTER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Headless conversion library shared by the CLI (main.c), the GTK front end
+// (file_converter_gui.c) and anything that wants to convert in-process.
+// Nothing in here touches GTK, the terminal or logs.txt: every call reports
+// an fc_status and the caller decides what to show or log.
+//
+// Build as part of a program
+// (gcc main.c converter.c compress.c encoding.c metrics.c trace.c arena.c tool.c html.c table.c
+//  number.c arrow.c xlsx.c budget.c iopolicy.c)
+// or as a library:
+//   gcc -O2 -fPIC -shared -o libfileconverter.so converter.c compress.c encoding.c metrics.c trace.c
+//       arena.c tool.c html.c table.c number.c arrow.c xlsx.c budget.c iopolicy.c -lpthread
+// Define FC_HAVE_CAIRO (and link pangocairo) to render TXT to PDF in-process;
+// without it TXT to PDF runs the external `txt2pdf` tool. CSV to XLSX
+// needs FC_HAVE_ZLIB (link -lz).
+
+#define FC_API_VERSION 1
+
+// Conversion types. The numbers match the CLI menu and the GUI buttons.
+typedef enum {
+    FC_TXT_TO_CSV = 1,
+    FC_CSV_TO_TXT = 2,
+    FC_PDF_TO_TXT = 3,
+    FC_TXT_TO_PDF = 4,
+    FC_TXT_TO_HTML = 5,
+    FC_HTML_TO_TXT = 6,
+    FC_JSON_TO_TXT = 7,
+    FC_TXT_TO_JSON = 8,
+    FC_CSV_TO_JSON = 9,
+    FC_JSON_TO_CSV = 10,
+    FC_CSV_TO_ARROW = 11,
+    FC_TXT_TO_ARROW = 12,
+    FC_CSV_TO_XLSX = 13
+} fc_conversion;
+
+#define FC_CONVERSION_FIRST FC_TXT_TO_CSV
+#define FC_CONVERSION_LAST  FC_CSV_TO_XLSX
+
+typedef enum {
+    FC_OK = 0,
+    FC_ERR_INPUT,        // input could not be opened or read
+    FC_ERR_OUTPUT,       // output could not be opened
+    FC_ERR_IO,           // read or write failed part way
+    FC_ERR_NOMEM,
+    FC_ERR_TOOL,         // external tool missing or failed
+    FC_ERR_UNSUPPORTED,  // conversion not available in this build
+    FC_ERR_INVALID,      // bad argument
+    FC_ERR_FORMAT,       // input is not in the source format (malformed JSON)
+    FC_ERR_LIMIT         // input exceeds a limit of the output format
+} fc_status;
+
+// A context holds scratch buffers that are reused from one job to the next.
+// Create one per thread and keep it around; contexts are not thread-safe.
+typedef struct fc_context fc_context;
+
+fc_context *fc_context_new(void);
+void fc_context_free(fc_context *ctx);
+
+// Convert input_file into output_file.
+fc_status fc_convert_file(fc_context *ctx, fc_conversion type,
+                          const char *input_file, const char *output_file);
+
+// Convert an input that only ever grows (a log, say) into output_file,
+// converting just the bytes appended since the last call. Progress is kept
+// in a sidecar "<output_file>.fcstate"; if the input was replaced or
+// rewritten, or the output was changed by someone else, the whole file is
+// converted again. The output is identical to what fc_convert_file() gives.
+// PDF and table conversions (CSV/JSON, Arrow, XLSX) are always done in full.
+// *bytes_converted, if not NULL, receives the number of input bytes read by
+// this call.
+fc_status fc_convert_file_incremental(fc_context *ctx, fc_conversion type,
+                                      const char *input_file, const char *output_file,
+                                      unsigned long long *bytes_converted);
+
+// Convert a very large input so that a run that is killed can be resumed.
+// The output is written to "<output_file>.partial" and renamed into place
+// only once complete. Every FC_CHECKPOINT_BYTES of input (see
+// fc_set_checkpoint_interval) the partial output is synced and a checkpoint
+// (input and output offsets plus the converter state: the JSON first-entry
+// flag, being inside an HTML tag) goes to "<output_file>.fccheckpoint".
+// With resume set, a checkpoint matching the unchanged input is picked up:
+// the partial output is cut back to it and conversion continues from its
+// input offset. Otherwise the conversion starts from the beginning.
+// *resumed_from, if not NULL, receives that input offset (0 for a fresh
+// start). Conversions that cannot stop and pick up again (PDF, tables,
+// compressed streams, UTF-16 input) run whole, still through the partial
+// file; paged HTML writes its pages directly.
+fc_status fc_convert_file_checkpointed(fc_context *ctx, fc_conversion type,
+                                       const char *input_file, const char *output_file,
+                                       int resume, unsigned long long *resumed_from);
+
+// Convert between open streams. Neither stream is closed. Text input (every
+// type but PDF to TXT) is read through the encoding stage in encoding.h, so
+// Latin-1, Windows-1252 and UTF-16 inputs convert to UTF-8 output; in may be
+// read past what the conversion consumed.
+fc_status fc_convert_stream(fc_context *ctx, fc_conversion type, FILE *in, FILE *out);
+
+// Convert an in-memory buffer. On FC_OK *output holds a malloc'd,
+// NUL-terminated buffer of *output_len bytes; release it with fc_free().
+fc_status fc_convert_buffer(fc_context *ctx, fc_conversion type,
+                            const char *input, size_t input_len,
+                            char **output, size_t *output_len);
+
+// Search filename for lines containing term. On FC_OK *results holds one
+// "Line N: text" entry per matching line (empty if none) and *matches the
+// number of matching lines; release *results with fc_free(). The file is
+// read as UTF-8 the same way conversions read text.
+fc_status fc_search_file(fc_context *ctx, const char *filename, const char *term,
+                         char **results, size_t *results_len, int *matches);
+
+// Like fc_search_file but writes the entries to out as they are found, so
+// memory does not grow with the number of matches. FC_ERR_IO if a write
+// to out fails.
+fc_status fc_search_stream(fc_context *ctx, const char *filename, const char *term,
+                           FILE *out, int *matches);
+
+// "TXT to CSV", "TXT", "CSV" etc. NULL for an unknown type.
+const char *fc_conversion_name(fc_conversion type);
+const char *fc_source_format(fc_conversion type);
+const char *fc_target_format(fc_conversion type);
+
+// Parse a conversion given as its menu number ("1"), as "txt:csv" or as
+// "txt-to-csv" / "TXT to CSV" (case-insensitive). Returns 0 if unknown.
+fc_conversion fc_conversion_parse(const char *spec);
+
+// Converter registry. Every conversion declares its formats, the external
+// tool it needs (if any) and what its engine can do; front ends build their
+// menus from it and batch jobs use it to pick how each file is converted.
+#define FC_CAP_STREAMING 0x1   // in-process, front to back in bounded memory; can resume incrementally
+#define FC_CAP_PARALLEL  0x2   // input can be split at line breaks and the pieces converted independently
+#define FC_CAP_IN_PLACE  0x4   // byte-wise, output never longer than input: fc_convert_in_place() works
+#define FC_CAP_PASSTHROUGH 0x8 // output is UTF-8 input apart from fixed text and escapes: files are copied by the kernel
+
+typedef struct {
+    fc_conversion type;
+    const char *name;       // "TXT to CSV"
+    const char *source;     // "TXT"
+    const char *target;     // "CSV"
+    const char *tool;       // external program it runs in this build, or NULL
+    unsigned caps;          // FC_CAP_*
+} fc_converter_info;
+
+// NULL for an unknown type. Iterate FC_CONVERSION_FIRST..FC_CONVERSION_LAST
+// for the whole registry.
+const fc_converter_info *fc_converter(fc_conversion type);
+
+// The conversion from source to target format ("html", "TXT"), or 0.
+fc_conversion fc_find_conversion(const char *source, const char *target);
+
+// Format detection. fc_sniff_format() guesses from the first bytes of a file
+// (a few KB are plenty): PDF magic, JSON that actually parses as JSON, HTML
+// markup, comma-separated rows, else TXT; NULL for binary data.
+// fc_detect_format() reads the head of path (through gzip/zstd if
+// compressed) and trusts a known extension unless the content is PDF.
+// Both return the registry's format names.
+const char *fc_sniff_format(const char *head, size_t len);
+const char *fc_detect_format(const char *path);
+
+// The format a file name's extension stands for ("out.htm.gz" is HTML),
+// or NULL. Front ends use it to take the target from the output name.
+const char *fc_format_for_path(const char *path);
+
+// The conversion that turns input_file, whatever its format, into target.
+// 0 if the format is unknown or has no converter to target.
+fc_conversion fc_detect_conversion(const char *input_file, const char *target);
+
+// Convert data[0..len) into itself for FC_CAP_IN_PLACE types, with no second
+// buffer; *out_len receives the converted length. Only for uncompressed
+// UTF-8 input: anything else gives FC_ERR_UNSUPPORTED (data untouched) and
+// should go through fc_convert_buffer() instead.
+fc_status fc_convert_in_place(fc_context *ctx, fc_conversion type,
+                              char *data, size_t len, size_t *out_len);
+
+const char *fc_status_message(fc_status status);
+
+// External tools (pdftotext, txt2pdf) are spawned directly, without a shell,
+// so any file name works; see tool.h. A tool still running after the
+// context's timeout (300 s by default, 0 for none) is killed. After a call
+// fails with FC_ERR_TOOL, fc_tool_errors() holds what the tool wrote to
+// stderr, or why it could not run, for the caller to show or log ("" if
+// nothing). Build tool.c along with converter.c.
+void fc_set_tool_timeout(fc_context *ctx, int seconds);
+const char *fc_tool_errors(const fc_context *ctx);
+
+// Run type's tool through pool's long-lived helpers (fc_tool_pool_new() in
+// tool.h) instead of spawning it per file; NULL to stop. The pool must
+// outlive its use by ctx and may be shared by several contexts.
+typedef struct fc_tool_pool fc_tool_pool;
+void fc_set_tool_pool(fc_context *ctx, fc_conversion type, fc_tool_pool *pool);
+
+// TXT to HTML escapes '<', '>' and '&'. With a page size set, file
+// conversions split the text into pages of that many lines written next to
+// the output ("out.html" gets "out-1.html", "out-2.html", ...) with
+// Previous/Index/Next links, and the output itself becomes an index of the
+// pages. Memory use stays the same whatever the input size. 0 (the default)
+// writes a single page; streams and buffers always do.
+void fc_set_html_page_lines(fc_context *ctx, long lines);
+long fc_html_page_lines(const fc_context *ctx);
+
+// Input bytes between checkpoints of fc_convert_file_checkpointed(). 0
+// restores the default.
+#define FC_CHECKPOINT_BYTES (64LL << 20)
+void fc_set_checkpoint_interval(fc_context *ctx, long long bytes);
+
+// Compressed files. Inputs compressed with gzip or zstd are recognised by
+// their magic bytes and decompressed on the fly by every file and buffer
+// call, search included. Outputs are compressed according to the context
+// setting, which by default (FC_COMPRESS_AUTO) goes by the output name:
+// ".gz" for gzip, ".zst" for zstd. gzip needs FC_HAVE_ZLIB (link -lz) and
+// zstd FC_HAVE_ZSTD (link -lzstd); otherwise such files give
+// FC_ERR_UNSUPPORTED. Build compress.c along with converter.c.
+typedef enum {
+    FC_COMPRESS_AUTO = 0,
+    FC_COMPRESS_NONE,
+    FC_COMPRESS_GZIP,
+    FC_COMPRESS_ZSTD
+} fc_compression;
+
+void fc_set_output_compression(fc_context *ctx, fc_compression compression);
+
+// The compression output_file would get from ctx (never FC_COMPRESS_AUTO).
+fc_compression fc_output_compression(const fc_context *ctx, const char *output_file);
+
+// Compression implied by a file name's extension.
+fc_compression fc_compression_for_path(const char *path);
+
+// Parse "gzip"/"gz", "zstd"/"zst", "none" or "auto". Returns
+// FC_COMPRESS_AUTO if unknown.
+fc_compression fc_compression_parse(const char *name);
+
+void fc_free(void *ptr);
+
+#endif
@@ -0,0 +1,554 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "daemon.h"
+#include "scheduler.h"
+#include "budget.h"
+#include "compress.h"
+#include "iopolicy.h"
+#include "trace.h"
+
+typedef struct daemon_job {
+    fc_job_header header;
+    char *input;            // path, or inline bytes
+    char *output_path;      // NULL to return the output inline
+    FILE *output;           // inline output, a spill stream
+    uint64_t reserved;      // inline input bytes held against the budget
+    fc_job_reply reply;
+    struct timespec queued;
+
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    int done;
+} daemon_job;
+
+#define INLINE_OUTPUT_MEMORY (4u << 20)    // per job; more spills to disk
+#define REPLY_CHUNK 65536
+
+typedef struct connection {
+    int fd;
+    struct connection *next;
+} connection;
+
+// Server state. There is one daemon per process.
+static fc_sched *sched;
+static void (*log_fn)(const char *message);
+static pthread_mutex_t connections_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t connections_gone = PTHREAD_COND_INITIALIZER;
+static connection *connections;
+static int stopping;            // set once shutdown begins
+
+static uint64_t ns_since(const struct timespec *from) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - from->tv_sec) * 1000000000ull + (now.tv_nsec - from->tv_nsec);
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static uint64_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+static void daemon_log(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void daemon_log(const char *fmt, ...) {
+    if (!log_fn) return;
+    char message[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(message, sizeof(message), fmt, ap);
+    va_end(ap);
+    log_fn(message);
+}
+
+// Worker side
+
+static void finish_job(daemon_job *job) {
+    const char *name = fc_conversion_name((fc_conversion)job->header.type);
+    if (job->reply.status == FC_OK) {
+        daemon_log("Daemon %s job completed (%llu bytes in, %llu bytes out, %.3f ms).",
+                   name, (unsigned long long)job->reply.bytes_in, (unsigned long long)job->reply.bytes_out,
+                   job->reply.run_ns / 1e6);
+    } else {
+        daemon_log("Daemon %s job failed: %s", name ? name : "unknown",
+                   fc_status_message((fc_status)job->reply.status));
+    }
+
+    pthread_mutex_lock(&job->lock);
+    job->done = 1;
+    pthread_cond_signal(&job->finished);
+    pthread_mutex_unlock(&job->lock);
+}
+
+// Plain file job: the scheduler picks the fastest path (tools included) and
+// splits large inputs
+static void file_job_done(const fc_sched_result *result, void *arg) {
+    daemon_job *job = arg;
+    job->reply.queue_ns = result->wait_ns;
+    job->reply.run_ns = result->run_ns;
+    job->reply.status = result->status;
+    job->reply.bytes_in = file_size(job->input);
+    job->reply.bytes_out = file_size(job->output_path);
+    finish_job(job);
+}
+
+// Inline input or output, through streams
+static void run_job(fc_context *ctx, void *arg) {
+    daemon_job *job = arg;
+    fc_conversion type = (fc_conversion)job->header.type;
+    int inline_input = job->header.flags & FC_JOB_INLINE_INPUT;
+    struct timespec start;
+    fc_status status;
+    off_t out_len = 0;
+    FILE *in, *out;
+
+    job->reply.queue_ns = ns_since(&job->queued);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (inline_input) {
+        in = job->header.input_len ? fmemopen(job->input, job->header.input_len, "r") : fopen("/dev/null", "r");
+    } else {
+        in = fc_io_open_read(job->input);
+    }
+    out = job->output_path ? fc_io_open_write(job->output_path) : fc_spill_open(INLINE_OUTPUT_MEMORY);
+
+    // Compressed input is unpacked here as it is for file jobs
+    fc_compression compression = in ? fc_detect_compression(in) : FC_COMPRESS_NONE;
+    if (compression != FC_COMPRESS_NONE) in = fc_decompressing_stream(in, compression);
+
+    if (!in) {
+        status = compression != FC_COMPRESS_NONE ? (errno == ENOTSUP ? FC_ERR_UNSUPPORTED : FC_ERR_NOMEM)
+               : inline_input ? FC_ERR_NOMEM : FC_ERR_INPUT;
+    } else if (!out) {
+        status = FC_ERR_OUTPUT;
+    } else {
+        status = fc_convert_stream(ctx, type, in, out);
+    }
+    if (in) fclose(in);
+    if (out && job->output_path) {
+        if (fclose(out) != 0 && status == FC_OK) status = FC_ERR_IO;
+        struct stat st;
+        if (status != FC_OK && stat(job->output_path, &st) == 0 && S_ISREG(st.st_mode)) unlink(job->output_path);
+    } else if (out) {
+        // Kept open for the reply
+        if (fflush(out) != 0 && status == FC_OK) status = FC_ERR_IO;
+        out_len = ftello(out);
+        job->output = out;
+    }
+
+    job->reply.bytes_in = inline_input ? job->header.input_len : file_size(job->input);
+    if (job->output_path) {
+        job->reply.bytes_out = file_size(job->output_path);
+    } else if (status == FC_OK && (out_len < 0 || out_len > FC_DAEMON_MAX_INLINE)) {
+        status = FC_ERR_NOMEM;
+    } else if (status == FC_OK) {
+        job->reply.bytes_out = out_len;
+        job->reply.output_len = out_len;
+    }
+
+    job->reply.run_ns = ns_since(&start);
+    job->reply.status = status;
+    finish_job(job);
+}
+
+static int queue_job(daemon_job *job) {
+    fc_conversion type = (fc_conversion)job->header.type;
+    fc_priority priority = job->header.flags & FC_JOB_INTERACTIVE ? FC_PRIORITY_INTERACTIVE
+                         : job->header.flags & FC_JOB_BULK ? FC_PRIORITY_BULK
+                         : FC_PRIORITY_NORMAL;
+
+    if (!(job->header.flags & FC_JOB_INLINE_INPUT) && job->output_path) {
+        return fc_sched_convert_file(sched, priority, type, job->input, job->output_path, file_job_done, job);
+    }
+    uint64_t size = job->header.flags & FC_JOB_INLINE_INPUT ? job->header.input_len : file_size(job->input);
+    return fc_sched_submit(sched, priority, fc_sched_cost(type, size), run_job, job);
+}
+
+// Connection side
+
+static daemon_job *read_job(int fd) {
+    fc_job_header header;
+    if (read_full(fd, &header, sizeof(header)) != 0) return NULL;
+
+    int inline_input = header.flags & FC_JOB_INLINE_INPUT;
+    if (header.magic != FC_JOB_MAGIC ||
+        header.input_len > (inline_input ? FC_DAEMON_MAX_INLINE : PATH_MAX - 1) ||
+        (!inline_input && header.input_len == 0) ||
+        header.output_len > PATH_MAX - 1) {
+        daemon_log("Daemon rejected malformed request.");
+        return NULL;
+    }
+    // Inline input is held from here until the reply is sent; wait for
+    // earlier jobs to give memory back rather than go over the budget
+    uint64_t reserved = inline_input ? header.input_len : 0;
+    if (fc_budget_acquire_or_stop(reserved, &stopping) != 0) {
+        if (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+            daemon_log("Daemon rejected inline job larger than the memory budget.");
+        return NULL;
+    }
+
+    daemon_job *job = calloc(1, sizeof(*job));
+    if (!job) {
+        fc_budget_release(reserved);
+        return NULL;
+    }
+    job->header = header;
+    job->reserved = reserved;
+    job->input = malloc(header.input_len + 1);
+    if (header.output_len) job->output_path = malloc(header.output_len + 1);
+
+    if (!job->input || (header.output_len && !job->output_path) ||
+        read_full(fd, job->input, header.input_len) != 0 ||
+        (header.output_len && read_full(fd, job->output_path, header.output_len) != 0)) {
+        free(job->input);
+        free(job->output_path);
+        free(job);
+        fc_budget_release(reserved);
+        return NULL;
+    }
+    job->input[header.input_len] = '\0';
+    if (job->output_path) job->output_path[header.output_len] = '\0';
+
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->finished, NULL);
+    job->reply.magic = FC_REPLY_MAGIC;
+    return job;
+}
+
+static void free_job(daemon_job *job) {
+    pthread_mutex_destroy(&job->lock);
+    pthread_cond_destroy(&job->finished);
+    free(job->input);
+    free(job->output_path);
+    if (job->output) fclose(job->output);
+    fc_budget_release(job->reserved);
+    free(job);
+}
+
+// Copy the inline output to the connection
+static int send_output(int fd, daemon_job *job) {
+    char buf[REPLY_CHUNK];
+    uint64_t left = job->reply.output_len;
+    rewind(job->output);
+    while (left > 0) {
+        size_t n = fread(buf, 1, left < sizeof(buf) ? left : sizeof(buf), job->output);
+        if (n == 0 || write_full(fd, buf, n) != 0) return -1;
+        left -= n;
+    }
+    return 0;
+}
+
+static void *connection_main(void *arg) {
+    connection *conn = arg;
+    daemon_job *job;
+
+    fc_trace_thread_name("connection");
+    while ((job = read_job(conn->fd)) != NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &job->queued);
+
+        if (queue_job(job) == 0) {
+            pthread_mutex_lock(&job->lock);
+            while (!job->done) pthread_cond_wait(&job->finished, &job->lock);
+            pthread_mutex_unlock(&job->lock);
+        } else {
+            job->reply.status = FC_ERR_UNSUPPORTED;   // shutting down
+        }
+
+        int failed = write_full(conn->fd, &job->reply, sizeof(job->reply)) != 0 ||
+                     (job->reply.output_len && send_output(conn->fd, job) != 0);
+        free_job(job);
+        if (failed) break;
+    }
+
+    pthread_mutex_lock(&connections_lock);
+    for (connection **p = &connections; *p; p = &(*p)->next) {
+        if (*p == conn) {
+            *p = conn->next;
+            break;
+        }
+    }
+    if (!connections) pthread_cond_broadcast(&connections_gone);
+    pthread_mutex_unlock(&connections_lock);
+
+    close(conn->fd);
+    free(conn);
+    return NULL;
+}
+
+static int open_listener(const char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    // Replace a stale socket, but never steal one a live daemon is serving
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        close(fd);
+        errno = EADDRINUSE;
+        return -1;
+    }
+    if (errno == ECONNREFUSED) unlink(socket_path);
+
+    mode_t old_mask = umask(0077);
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+
+    if (bound != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int fc_daemon_run(const char *socket_path, int threads, void (*log)(const char *message)) {
+    log_fn = log;
+    stopping = 0;
+
+    // Deliver SIGINT/SIGTERM through a signalfd so no worker thread sees them
+    sigset_t mask, old_mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+    int signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+
+    int listen_fd = open_listener(socket_path);
+    if (listen_fd < 0 || signal_fd < 0) {
+        int saved = errno;
+        if (listen_fd >= 0) close(listen_fd);
+        if (signal_fd >= 0) close(signal_fd);
+        pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+        errno = saved;
+        return -1;
+    }
+
+    sched = fc_sched_new(threads, -1, 0);
+    if (!sched) {
+        close(listen_fd);
+        close(signal_fd);
+        unlink(socket_path);
+        pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+        return -1;
+    }
+    daemon_log("Daemon listening on %s with %d workers and one for interactive jobs.",
+               socket_path, fc_sched_threads(sched));
+
+    struct pollfd fds[2] = {
+        { .fd = listen_fd, .events = POLLIN },
+        { .fd = signal_fd, .events = POLLIN },
+    };
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) {
+            // Consume the signal, or it is delivered once the mask is restored
+            struct signalfd_siginfo info;
+            if (read(signal_fd, &info, sizeof(info)) < 0) {}
+            break;
+        }
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        int client = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0) continue;
+
+        connection *conn = malloc(sizeof(*conn));
+        pthread_t thread;
+        pthread_attr_t attr;
+        if (!conn) {
+            close(client);
+            continue;
+        }
+        conn->fd = client;
+
+        pthread_mutex_lock(&connections_lock);
+        conn->next = connections;
+        connections = conn;
+        pthread_mutex_unlock(&connections_lock);
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, connection_main, conn) != 0) {
+            pthread_mutex_lock(&connections_lock);
+            connections = conn->next;
+            pthread_mutex_unlock(&connections_lock);
+            close(client);
+            free(conn);
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    daemon_log("Daemon shutting down.");
+    close(listen_fd);
+    unlink(socket_path);
+
+    // Wake idle connections and those waiting for memory; busy ones finish
+    // their current job first
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    fc_budget_wake();
+    pthread_mutex_lock(&connections_lock);
+    for (connection *c = connections; c; c = c->next) shutdown(c->fd, SHUT_RD);
+    while (connections) pthread_cond_wait(&connections_gone, &connections_lock);
+    pthread_mutex_unlock(&connections_lock);
+
+    fc_sched_free(sched);
+    sched = NULL;
+    close(signal_fd);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    return 0;
+}
+
+// Client side
+
+static int connect_daemon(const char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_request(int fd, fc_conversion type, uint32_t flags,
+                        const char *input, size_t input_len, const char *output_path,
+                        fc_job_reply *reply, char **output) {
+    fc_job_header header = {
+        .magic = FC_JOB_MAGIC,
+        .type = type,
+        .flags = flags,
+        .input_len = (uint32_t)input_len,
+        .output_len = output_path ? (uint32_t)strlen(output_path) : 0,
+    };
+
+    if (write_full(fd, &header, sizeof(header)) != 0 ||
+        (input_len && write_full(fd, input, input_len) != 0) ||
+        (header.output_len && write_full(fd, output_path, header.output_len) != 0) ||
+        read_full(fd, reply, sizeof(*reply)) != 0 ||
+        reply->magic != FC_REPLY_MAGIC ||
+        reply->output_len > FC_DAEMON_MAX_INLINE) {
+        return -1;
+    }
+
+    if (reply->output_len == 0) {
+        if (output) *output = calloc(1, 1);
+        return output && !*output ? -1 : 0;
+    }
+
+    char *buf = malloc(reply->output_len + 1);
+    if (!buf || read_full(fd, buf, reply->output_len) != 0) {
+        free(buf);
+        return -1;
+    }
+    buf[reply->output_len] = '\0';
+    if (output) {
+        *output = buf;
+    } else {
+        free(buf);
+    }
+    return 0;
+}
+
+// The daemon has its own working directory, so send absolute paths
+static char *absolute_path(const char *path) {
+    if (path[0] == '/') return strdup(path);
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) return NULL;
+    size_t len = strlen(cwd) + strlen(path) + 2;
+    char *result = malloc(len);
+    if (result) snprintf(result, len, "%s/%s", cwd, path);
+    return result;
+}
+
+static uint32_t priority_flags(fc_priority priority) {
+    return priority == FC_PRIORITY_INTERACTIVE ? FC_JOB_INTERACTIVE
+         : priority == FC_PRIORITY_BULK ? FC_JOB_BULK
+         : 0;
+}
+
+int fc_daemon_submit(const char *socket_path, fc_conversion type, fc_priority priority,
+                     const char *input_file, const char *output_file, fc_job_reply *reply) {
+    char *input = absolute_path(input_file);
+    char *output = absolute_path(output_file);
+    int result = -1;
+
+    if (input && output && strlen(input) < PATH_MAX && strlen(output) < PATH_MAX) {
+        int fd = connect_daemon(socket_path);
+        if (fd >= 0) {
+            result = send_request(fd, type, priority_flags(priority), input, strlen(input), output, reply, NULL);
+            close(fd);
+        }
+    }
+
+    free(input);
+    free(output);
+    return result;
+}
+
+int fc_daemon_submit_buffer(const char *socket_path, fc_conversion type, fc_priority priority,
+                            const char *input, size_t input_len,
+                            char **output, fc_job_reply *reply) {
+    if (input_len > FC_DAEMON_MAX_INLINE) return -1;
+
+    int fd = connect_daemon(socket_path);
+    if (fd < 0) return -1;
+
+    int result = send_request(fd, type, FC_JOB_INLINE_INPUT | priority_flags(priority),
+                              input, input_len, NULL, reply, output);
+    close(fd);
+    return result;
+}
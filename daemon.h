@@ -0,0 +1,71 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "converter.h"
+#include "scheduler.h"
+
+// Converter daemon: loads once, listens on a Unix domain socket and runs
+// conversion jobs on a scheduler (scheduler.h), so small files do not pay
+// process startup for every conversion. Each request carries its priority
+// class: interactive jobs have a worker of their own, and large file jobs
+// are split where the conversion allows it.
+//
+// Inline inputs are reserved against the memory budget (budget.h) while
+// their job is in the daemon; a connection waits for memory before reading
+// one in, or until shutdown. Inline outputs past a few MB spill to a
+// temporary file. gzip and zstd inputs are unpacked in every mode.
+//
+// Wire format (host byte order, the socket is local). A client may send any
+// number of requests on one connection; each gets exactly one reply.
+//
+//   request:  fc_job_header, then input_len bytes of input (a path, or the
+//             input itself with FC_JOB_INLINE_INPUT), then output_len bytes
+//             of output path. output_len == 0 returns the output inline.
+//   reply:    fc_job_reply, then output_len bytes of inline output.
+
+#define FC_JOB_MAGIC   0x314A4346u   // "FCJ1"
+#define FC_REPLY_MAGIC 0x31524346u   // "FCR1"
+
+#define FC_JOB_INLINE_INPUT 0x1
+#define FC_JOB_INTERACTIVE  0x2     // FC_PRIORITY_INTERACTIVE
+#define FC_JOB_BULK         0x4     // FC_PRIORITY_BULK; neither is FC_PRIORITY_NORMAL
+
+#define FC_DAEMON_MAX_INLINE (64u << 20)   // largest inline input or output
+
+typedef struct {
+    uint32_t magic;
+    uint32_t type;          // fc_conversion
+    uint32_t flags;
+    uint32_t input_len;
+    uint32_t output_len;
+} fc_job_header;
+
+typedef struct {
+    uint32_t magic;
+    int32_t status;         // fc_status
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t queue_ns;      // time spent waiting for a worker
+    uint64_t run_ns;        // time spent converting
+    uint64_t output_len;    // inline output bytes that follow
+} fc_job_reply;
+
+// Serve until SIGINT or SIGTERM. threads <= 0 uses one worker per CPU, and
+// one more is kept for interactive jobs. log, if not NULL, receives one line per job and per lifecycle event.
+int fc_daemon_run(const char *socket_path, int threads, void (*log)(const char *message));
+
+// Submit a file-to-file job. Relative paths are resolved against the
+// caller's working directory. Returns -1 if the daemon cannot be reached,
+// otherwise 0 with the job result in *reply.
+int fc_daemon_submit(const char *socket_path, fc_conversion type, fc_priority priority,
+                     const char *input_file, const char *output_file, fc_job_reply *reply);
+
+// Submit an in-memory job. On success with reply->status == FC_OK, *output
+// holds reply->output_len bytes (NUL-terminated); release it with fc_free().
+int fc_daemon_submit_buffer(const char *socket_path, fc_conversion type, fc_priority priority,
+                            const char *input, size_t input_len,
+                            char **output, fc_job_reply *reply);
+
+#endif
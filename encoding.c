@@ -0,0 +1,453 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_SSSE3_PATH 1
+#endif
+
+#include "encoding.h"
+#include "arena.h"
+#include "metrics.h"
+#include "trace.h"
+
+#define SCRATCH_SIZE 65536
+#define STREAM_BUFFER_SIZE 65536
+
+// Windows-1252 0x80-0x9F. The five undefined bytes map to the C1 controls,
+// as Latin-1 does. 0xA0-0xFF are the same code points in both.
+static const uint16_t cp1252_high[32] = {
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178
+};
+
+// Validation
+
+static size_t utf8_scalar_prefix(const unsigned char *s, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        if (i + 8 <= len) {
+            uint64_t v;
+            memcpy(&v, s + i, 8);
+            if (!(v & 0x8080808080808080ull)) {
+                i += 8;
+                continue;
+            }
+        }
+        unsigned char c = s[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+
+        // Second-byte bounds rule out overlongs, surrogates and > U+10FFFF
+        size_t need;
+        unsigned char lo = 0x80, hi = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            need = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            need = 2;
+            if (c == 0xE0) lo = 0xA0;
+            if (c == 0xED) hi = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            need = 3;
+            if (c == 0xF0) lo = 0x90;
+            if (c == 0xF4) hi = 0x8F;
+        } else {
+            return i;
+        }
+        if (i + need >= len) return i;
+        if (s[i + 1] < lo || s[i + 1] > hi) return i;
+        for (size_t k = 2; k <= need; k++) {
+            if ((s[i + k] & 0xC0) != 0x80) return i;
+        }
+        i += need + 1;
+    }
+    return i;
+}
+
+#ifdef HAVE_SSSE3_PATH
+// The lookup-table validator from Keiser & Lemire, "Validating UTF-8 In Less
+// Than One Instruction Per Byte": three 16-entry shuffles classify every
+// byte pair, and a shifted compare checks 3- and 4-byte sequence lengths.
+#define TOO_SHORT      (1 << 0)
+#define TOO_LONG       (1 << 1)
+#define OVERLONG_3     (1 << 2)
+#define TOO_LARGE      (1 << 3)
+#define SURROGATE      (1 << 4)
+#define OVERLONG_2     (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4     (1 << 6)
+#define TWO_CONTS      (1 << 7)
+#define CARRY          (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+__attribute__((target("ssse3")))
+static __m128i high_nibbles(__m128i v) {
+    return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+}
+
+__attribute__((target("ssse3")))
+static __m128i check_block(__m128i input, __m128i prev_input) {
+    const __m128i byte_1_high_table = _mm_setr_epi8(
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2,
+        TOO_SHORT,
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const __m128i byte_1_low_table = _mm_setr_epi8(
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        CARRY | OVERLONG_2,
+        CARRY,
+        CARRY,
+        CARRY | TOO_LARGE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000);
+    const __m128i byte_2_high_table = _mm_setr_epi8(
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+    __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+    __m128i special = _mm_and_si128(
+        _mm_and_si128(_mm_shuffle_epi8(byte_1_high_table, high_nibbles(prev1)),
+                      _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(prev1, _mm_set1_epi8(0x0F)))),
+        _mm_shuffle_epi8(byte_2_high_table, high_nibbles(input)));
+
+    // Bytes two and three after a 3- or 4-byte lead must be continuations
+    __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+    __m128i must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80))),
+                                  _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80))));
+    return _mm_xor_si128(_mm_and_si128(must23, _mm_set1_epi8((char)0x80)), special);
+}
+
+// Nonzero in the last three lanes if the block ends inside a sequence
+__attribute__((target("ssse3")))
+static __m128i incomplete_tail(__m128i input) {
+    const __m128i max_value = _mm_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    return _mm_subs_epu8(input, max_value);
+}
+
+// Validate whole 16-byte blocks until one holds (or inherits) an error and
+// return a character boundary at or before it. Everything before the
+// returned offset is valid UTF-8.
+__attribute__((target("ssse3")))
+static size_t utf8_simd_prefix(const unsigned char *s, size_t len) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i prev_input = zero, prev_incomplete = zero;
+    size_t i = 0;
+
+    while (i + 16 <= len) {
+        __m128i input = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i error;
+        if (_mm_movemask_epi8(input) == 0) {
+            error = prev_incomplete;
+            prev_incomplete = zero;
+        } else {
+            error = check_block(input, prev_input);
+            prev_incomplete = incomplete_tail(input);
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) != 0xFFFF) break;
+        prev_input = input;
+        i += 16;
+    }
+
+    // Step back over a sequence that straddles the block boundary
+    for (size_t k = 1; k <= 3 && k <= i; k++) {
+        unsigned char b = s[i - k];
+        if (b < 0x80) break;
+        if (b >= 0xC0) {
+            size_t seq = b >= 0xF0 ? 4 : b >= 0xE0 ? 3 : 2;
+            if (k < seq) i -= k;
+            break;
+        }
+    }
+    return i;
+}
+#endif
+
+size_t fc_utf8_valid_prefix(const char *buf, size_t len) {
+    const unsigned char *s = (const unsigned char *)buf;
+    size_t i = 0;
+#ifdef HAVE_SSSE3_PATH
+    static int have_ssse3 = -1;
+    if (have_ssse3 < 0) have_ssse3 = __builtin_cpu_supports("ssse3");
+    if (have_ssse3) i = utf8_simd_prefix(s, len);
+#endif
+    return i + utf8_scalar_prefix(s + i, len - i);
+}
+
+// Transcoding
+
+static size_t put_utf8(char *out, uint32_t cp) {
+    unsigned char *o = (unsigned char *)out;
+    if (cp < 0x80) {
+        o[0] = cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        o[0] = 0xC0 | (cp >> 6);
+        o[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+    if (cp < 0x10000) {
+        o[0] = 0xE0 | (cp >> 12);
+        o[1] = 0x80 | ((cp >> 6) & 0x3F);
+        o[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    o[0] = 0xF0 | (cp >> 18);
+    o[1] = 0x80 | ((cp >> 12) & 0x3F);
+    o[2] = 0x80 | ((cp >> 6) & 0x3F);
+    o[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+static size_t put_cp1252(char *out, unsigned char byte) {
+    return put_utf8(out, byte >= 0x80 && byte < 0xA0 ? cp1252_high[byte - 0x80] : byte);
+}
+
+// Could s[0..len) be the start of a valid sequence that continues later?
+static int incomplete_sequence(const unsigned char *s, size_t len) {
+    if (len == 0 || len > 3) return 0;
+    unsigned char c = s[0];
+    size_t need = c >= 0xC2 && c <= 0xDF ? 2 : c >= 0xE0 && c <= 0xEF ? 3 : c >= 0xF0 && c <= 0xF4 ? 4 : 0;
+    if (need <= len) return 0;
+    if (len >= 2) {
+        unsigned char lo = c == 0xE0 ? 0xA0 : c == 0xF0 ? 0x90 : 0x80;
+        unsigned char hi = c == 0xED ? 0x9F : c == 0xF4 ? 0x8F : 0xBF;
+        if (s[1] < lo || s[1] > hi) return 0;
+    }
+    return len < 3 || (s[2] & 0xC0) == 0x80;
+}
+
+enum { MODE_START, MODE_UTF8, MODE_UTF16LE, MODE_UTF16BE };
+
+typedef struct {
+    FILE *raw;
+    int own_raw;
+    fc_arena *arena;            // buffers come from here if set, else malloc
+    int mode;
+    int eof;
+
+    unsigned char carry[4];     // UTF-8: incomplete sequence from the last read
+    size_t carry_len;
+
+    char *pending;              // decoded output not yet returned
+    size_t pending_pos, pending_len, pending_cap;
+
+    unsigned char *scratch;     // UTF-16: raw input not yet decoded
+    size_t scratch_len;
+    uint32_t high_surrogate;    // UTF-16: waiting for its low half
+} text_stream;
+
+static void *stream_alloc(text_stream *ts, size_t size) {
+    return ts->arena ? fc_arena_alloc(ts->arena, size) : malloc(size);
+}
+
+// Decode s[0..len) as UTF-8 with Windows-1252 for stray bytes. An incomplete
+// sequence at the end is kept for the next read unless at end of input.
+static size_t decode_mixed(text_stream *ts, const unsigned char *s, size_t len, char *out) {
+    size_t p = 0, o = 0;
+    while (p < len) {
+        size_t v = fc_utf8_valid_prefix((const char *)s + p, len - p);
+        memcpy(out + o, s + p, v);
+        o += v;
+        p += v;
+        if (p == len) break;
+        if (!ts->eof && incomplete_sequence(s + p, len - p)) {
+            memcpy(ts->carry, s + p, len - p);
+            ts->carry_len = len - p;
+            break;
+        }
+        o += put_cp1252(out + o, s[p++]);
+    }
+    return o;
+}
+
+// Decode whole UTF-16 units; unpaired surrogates become U+FFFD
+static size_t decode_utf16(text_stream *ts, const unsigned char *s, size_t len, char *out) {
+    size_t o = 0;
+    for (size_t p = 0; p + 2 <= len; p += 2) {
+        uint32_t unit = ts->mode == MODE_UTF16LE ? (uint32_t)(s[p] | s[p + 1] << 8)
+                                                 : (uint32_t)(s[p] << 8 | s[p + 1]);
+        if (ts->high_surrogate) {
+            uint32_t high = ts->high_surrogate;
+            ts->high_surrogate = 0;
+            if (unit >= 0xDC00 && unit <= 0xDFFF) {
+                o += put_utf8(out + o, 0x10000 + ((high - 0xD800) << 10) + (unit - 0xDC00));
+                continue;
+            }
+            o += put_utf8(out + o, 0xFFFD);
+        }
+        if (unit >= 0xD800 && unit <= 0xDBFF) ts->high_surrogate = unit;
+        else if (unit >= 0xDC00 && unit <= 0xDFFF) o += put_utf8(out + o, 0xFFFD);
+        else o += put_utf8(out + o, unit);
+    }
+    return o;
+}
+
+static ssize_t serve_pending(text_stream *ts, char *buf, size_t size) {
+    size_t n = ts->pending_len - ts->pending_pos;
+    if (n > size) n = size;
+    memcpy(buf, ts->pending + ts->pending_pos, n);
+    ts->pending_pos += n;
+    return n;
+}
+
+static ssize_t read_utf16(text_stream *ts, char *buf, size_t size) {
+    // A unit becomes at most 3 bytes (a surrogate pair 4 for two units), so
+    // decoding half the caller's space in raw bytes always fits
+    size_t want = size / 2 < SCRATCH_SIZE ? size / 2 : SCRATCH_SIZE;
+    for (;;) {
+        fc_trace_span span;
+        if (!ts->eof && ts->scratch_len < want) {
+            fc_trace_begin(&span, "read raw");
+            size_t got = fread(ts->scratch + ts->scratch_len, 1, want - ts->scratch_len, ts->raw);
+            fc_trace_end(&span, got);
+            if (got < want - ts->scratch_len) {
+                if (ferror(ts->raw)) return -1;
+                ts->eof = 1;
+            }
+            ts->scratch_len += got;
+        }
+        size_t take = (ts->scratch_len < want ? ts->scratch_len : want) & ~(size_t)1;
+        fc_trace_begin(&span, "decode");
+        size_t o = decode_utf16(ts, ts->scratch, take, buf);
+        fc_trace_end(&span, take);
+        memmove(ts->scratch, ts->scratch + take, ts->scratch_len - take);
+        ts->scratch_len -= take;
+        if (ts->eof && ts->scratch_len < 2) {
+            if (ts->scratch_len || ts->high_surrogate) o += put_utf8(buf + o, 0xFFFD);
+            ts->scratch_len = 0;
+            ts->high_surrogate = 0;
+            return o;
+        }
+        if (o > 0) return o;
+    }
+}
+
+// stdio always asks for at least a full buffer, so the caller's space can
+// hold carried bytes plus new input.
+static ssize_t text_read(void *cookie, char *buf, size_t size) {
+    text_stream *ts = cookie;
+    if (ts->pending_pos < ts->pending_len) return serve_pending(ts, buf, size);
+    if (ts->mode == MODE_UTF16LE || ts->mode == MODE_UTF16BE) return read_utf16(ts, buf, size);
+
+    for (;;) {
+        // Read straight into the caller's buffer behind any carried bytes
+        size_t n = ts->carry_len;
+        memcpy(buf, ts->carry, n);
+        ts->carry_len = 0;
+        if (!ts->eof) {
+            size_t want = ts->mode == MODE_START && size > SCRATCH_SIZE ? SCRATCH_SIZE : size;
+            fc_trace_span span;
+            fc_trace_begin(&span, "read raw");
+            size_t got = fread(buf + n, 1, want - n, ts->raw);
+            fc_trace_end(&span, got);
+            if (got < want - n) {
+                if (ferror(ts->raw)) return -1;
+                ts->eof = 1;
+            }
+            n += got;
+        }
+
+        if (ts->mode == MODE_START) {
+            unsigned char *b = (unsigned char *)buf;
+            ts->mode = MODE_UTF8;
+            if (n >= 2 && ((b[0] == 0xFF && b[1] == 0xFE) || (b[0] == 0xFE && b[1] == 0xFF))) {
+                ts->mode = b[0] == 0xFF ? MODE_UTF16LE : MODE_UTF16BE;
+                ts->scratch = stream_alloc(ts, SCRATCH_SIZE);
+                if (!ts->scratch) return -1;
+                fc_metrics_buffer_alloc(SCRATCH_SIZE);
+                memcpy(ts->scratch, b + 2, n - 2);
+                ts->scratch_len = n - 2;
+                return read_utf16(ts, buf, size);
+            }
+        }
+        if (n == 0) return 0;
+
+        // Fast path: the whole read is valid UTF-8 and is returned as is
+        fc_trace_span span;
+        fc_trace_begin(&span, "validate");
+        size_t v = fc_utf8_valid_prefix(buf, n);
+        fc_trace_end(&span, n);
+        if (v == n) return n;
+
+        // Move the rest out of the caller's buffer, decoding it on the way
+        if ((n - v) * 3 > ts->pending_cap) {
+            char *bigger = ts->arena ? fc_arena_grow(ts->arena, ts->pending, ts->pending_cap, (n - v) * 3)
+                                     : realloc(ts->pending, (n - v) * 3);
+            if (!bigger) return -1;
+            fc_metrics_buffer_alloc((n - v) * 3 - ts->pending_cap);
+            ts->pending = bigger;
+            ts->pending_cap = (n - v) * 3;
+        }
+        ts->pending_pos = 0;
+        fc_trace_begin(&span, "decode");
+        ts->pending_len = decode_mixed(ts, (unsigned char *)buf + v, n - v, ts->pending);
+        fc_trace_end(&span, n - v);
+        if (v > 0) return v;
+        if (ts->pending_len > 0) return serve_pending(ts, buf, size);
+    }
+}
+
+static int text_close(void *cookie) {
+    text_stream *ts = cookie;
+    int rc = 0;
+    if (ts->own_raw && fclose(ts->raw) != 0) rc = -1;
+    fc_metrics_buffer_free(STREAM_BUFFER_SIZE + ts->pending_cap + (ts->scratch ? SCRATCH_SIZE : 0));
+    if (!ts->arena) {
+        free(ts->pending);
+        free(ts->scratch);
+        free(ts);
+    }
+    return rc;
+}
+
+FILE *fc_text_stream_arena(FILE *raw, int own_raw, fc_arena *arena) {
+    text_stream *ts = arena ? fc_arena_alloc(arena, sizeof(*ts)) : malloc(sizeof(*ts));
+    char *buffer = arena ? fc_arena_alloc(arena, STREAM_BUFFER_SIZE) : NULL;
+    if (!ts || (arena && !buffer)) {
+        if (!arena) free(ts);
+        return NULL;
+    }
+    memset(ts, 0, sizeof(*ts));
+    ts->raw = raw;
+    ts->own_raw = own_raw;
+    ts->arena = arena;
+
+    cookie_io_functions_t io = { .read = text_read, .write = NULL, .seek = NULL, .close = text_close };
+    FILE *f = fopencookie(ts, "r", io);
+    if (!f) {
+        if (!arena) free(ts);
+        return NULL;
+    }
+    setvbuf(f, buffer, _IOFBF, STREAM_BUFFER_SIZE);
+    fc_metrics_buffer_alloc(STREAM_BUFFER_SIZE);
+    return f;
+}
+
+FILE *fc_text_stream(FILE *raw, int own_raw) {
+    return fc_text_stream_arena(raw, own_raw, NULL);
+}
@@ -0,0 +1,32 @@
+#ifndef ENCODING_H
+#define ENCODING_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "arena.h"
+
+// Text encoding stage. Every conversion that reads text (everything except
+// PDF to TXT) and search read their input through it, so engines, Pango and
+// the GUI only ever see valid UTF-8.
+//
+// Valid UTF-8 passes through unchanged; it is checked with a SIMD
+// (SSSE3 lookup-table) validator where the CPU has it and a scalar one
+// otherwise. Input starting with a UTF-16 byte order mark is transcoded from
+// UTF-16LE/BE. Any other byte that is not part of a valid UTF-8 sequence is
+// taken as Windows-1252 (a superset of printable Latin-1), so legacy and
+// mixed files come out as the characters they were meant to be.
+
+// Length of the longest prefix of buf made of complete, valid UTF-8
+// characters. Equal to len when the whole buffer is valid.
+size_t fc_utf8_valid_prefix(const char *buf, size_t len);
+
+// Wrap raw so reads return UTF-8. If own_raw is set, closing the returned
+// FILE also closes raw; otherwise raw is left open (its read position is then
+// wherever the stage stopped reading). Returns NULL if out of memory.
+FILE *fc_text_stream(FILE *raw, int own_raw);
+
+// The same, with the stream's buffers taken from arena instead of malloc.
+// The arena must not be rewound past them until the stream is closed.
+FILE *fc_text_stream_arena(FILE *raw, int own_raw, fc_arena *arena);
+
+#endif
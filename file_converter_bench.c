@@ -0,0 +1,785 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "converter.h"
+#include "batch.h"
+#include "cache.h"
+#include "arena.h"
+#include "iopolicy.h"
+
+#define MAX 256
+#define DEFAULT_SIZES "16K,1M,8M"
+#define DEFAULT_FILES 5
+#define SEARCH_WORD "needle"
+
+// Benchmark for the file converter.
+//
+// Generates a deterministic synthetic corpus (same seed -> same bytes) for
+// every input format at several sizes, runs each conversion and search path
+// over it and prints a JSON report with MB/s, per-file p50/p99 latency,
+// peak RSS and scratch-arena allocation counts that can be diffed between
+// versions.
+//
+// By default every job runs in-process through the converter library with one
+// reused fc_context, the way an embedding service calls it. With --cli PATH
+// each file is handed to the CLI binary through its menu instead, so the
+// numbers include process startup.
+//
+// With --check the run exits 1 if a path regresses on the arena: a warm
+// job (any after the first) that mallocs a new chunk, or that makes more
+// arena allocations than the first job did (library mode only); or if a
+// conversion known to have lost data on some input loses it again.
+//
+// For conversions, hash_ms is the time the conversion cache spends hashing
+// the input to look it up, which has to stay well below the conversion time.
+//
+// cached_in_pct and cached_out_pct are the parts of the inputs and outputs
+// still in the page cache after their jobs (by mincore), i.e. the footprint
+// a conversion leaves for other programs. Compare --io-policy cache with
+// the default drop to see what the I/O policy saves. The corpus is synced
+// to disk once written so its pages can be dropped.
+
+typedef enum {
+    CORPUS_TXT,
+    CORPUS_CSV,
+    CORPUS_JSON,
+    CORPUS_HTML,
+    CORPUS_PDF_TEXT,
+    CORPUS_PDF,
+    CORPUS_TABLE,       // typed CSV: ints, decimals, booleans, text
+    CORPUS_NDJSON       // one nested record per line
+} corpus_kind;
+
+#define CORPUS_LAST CORPUS_NDJSON
+
+static const char *corpus_ext[] = { "txt", "csv", "json", "html", "page.txt", "pdf", "table.csv", "ndjson" };
+
+typedef struct {
+    const char *name;
+    fc_conversion type;     // 0 for search
+    const char *menu;       // menu input that selects the path in the CLI
+    corpus_kind input;
+    const char *output_ext; // NULL for search
+} bench_path;
+
+static const bench_path bench_paths[] = {
+    { "txt_to_csv",  FC_TXT_TO_CSV,  "1\n1\n", CORPUS_TXT,      "csv"  },
+    { "csv_to_txt",  FC_CSV_TO_TXT,  "1\n2\n", CORPUS_CSV,      "txt"  },
+    { "pdf_to_txt",  FC_PDF_TO_TXT,  "1\n3\n", CORPUS_PDF,      "txt"  },
+    { "txt_to_pdf",  FC_TXT_TO_PDF,  "1\n4\n", CORPUS_PDF_TEXT, "pdf"  },
+    { "txt_to_html", FC_TXT_TO_HTML, "1\n5\n", CORPUS_TXT,      "html" },
+    { "html_to_txt", FC_HTML_TO_TXT, "1\n6\n", CORPUS_HTML,     "txt"  },
+    { "json_to_txt", FC_JSON_TO_TXT, "1\n7\n", CORPUS_JSON,     "txt"  },
+    { "txt_to_json", FC_TXT_TO_JSON, "1\n8\n", CORPUS_TXT,      "json" },
+    { "csv_to_json", FC_CSV_TO_JSON, "1\n9\n", CORPUS_TABLE,    "json" },
+    { "json_to_csv", FC_JSON_TO_CSV, "1\n10\n", CORPUS_NDJSON,  "csv"  },
+    { "csv_to_arrow", FC_CSV_TO_ARROW, "1\n11\n", CORPUS_TABLE, "arrow" },
+    { "csv_to_xlsx", FC_CSV_TO_XLSX, "1\n13\n", CORPUS_TABLE,  "xlsx" },
+    { "search",      0,              "9\n",    CORPUS_TXT,      NULL   },
+};
+
+#define PATH_COUNT (sizeof(bench_paths) / sizeof(bench_paths[0]))
+
+// Deterministic generator (splitmix64)
+static unsigned long long rng_state;
+
+static unsigned long long rng_next(void) {
+    unsigned long long z = (rng_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static unsigned rng_range(unsigned n) {
+    return (unsigned)(rng_next() % n);
+}
+
+static const char *words[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+    "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+    "quebec", "romeo", "sierra", "tango", "uniform", "victor", "whiskey",
+    "xray", "yankee", "zulu", "log", "error", "warning", "request", "latency",
+};
+
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+static const char *random_word(void) {
+    // Roughly one word in 500 is the search needle
+    if (rng_range(500) == 0) return SEARCH_WORD;
+    return words[rng_range(WORD_COUNT)];
+}
+
+// Line lengths follow a skewed distribution: mostly short lines with
+// occasional very long ones (longer than the CLI's MAX line buffer).
+static int random_line_length(void) {
+    unsigned r = rng_range(100);
+    if (r < 10) return 0;
+    if (r < 70) return 10 + rng_range(60);
+    if (r < 95) return 70 + rng_range(180);
+    return 250 + rng_range(2000);
+}
+
+static long write_words(FILE *f, int length, char sep) {
+    long written = 0;
+    while (written < length) {
+        const char *w = random_word();
+        if (written > 0) {
+            fputc(sep, f);
+            written++;
+        }
+        fputs(w, f);
+        written += strlen(w);
+    }
+    return written;
+}
+
+static void gen_txt(FILE *f, long size) {
+    long written = 0;
+    while (written < size) {
+        written += write_words(f, random_line_length(), ' ');
+        fputc('\n', f);
+        written++;
+    }
+}
+
+static void gen_page_text(FILE *f, long size) {
+    long written = 0;
+    while (written < size) {
+        written += write_words(f, 60 + rng_range(20), ' ');
+        fputc('\n', f);
+        written++;
+    }
+}
+
+static void gen_csv(FILE *f, long size) {
+    long written = fprintf(f, "id,name,comment,amount\n");
+    for (long row = 1; written < size; row++) {
+        written += fprintf(f, "%ld,%s,", row, random_word());
+        switch (rng_range(3)) {
+            case 0:  // quoted field with embedded comma and doubled quote
+                written += fprintf(f, "\"%s, \"\"%s\"\" %s\"", random_word(), random_word(), random_word());
+                break;
+            case 1:
+                written += fprintf(f, "\"%s %s\"", random_word(), random_word());
+                break;
+            default:
+                written += fprintf(f, "%s", random_word());
+        }
+        written += fprintf(f, ",%u.%02u\n", rng_range(100000), rng_range(100));
+    }
+}
+
+static void gen_table(FILE *f, long size) {
+    long written = fprintf(f, "id,user,amount,ratio,qty,active,note\n");
+    for (long row = 1; written < size; row++) {
+        written += fprintf(f, "%ld,%s_%u,%u.%02u,%u.%ue-%u,%u,%s,", row, random_word(), rng_range(10000),
+                           rng_range(100000), rng_range(100), 1 + rng_range(9), rng_range(1000000),
+                           1 + rng_range(12), rng_range(500), rng_range(2) ? "true" : "false");
+        if (rng_range(4) == 0) written += fprintf(f, "\"%s, %s\"", random_word(), random_word());
+        else if (rng_range(3)) written += fprintf(f, "%s", random_word());
+        fputc('\n', f);
+        written++;
+    }
+}
+
+static void gen_ndjson(FILE *f, long size) {
+    long written = 0;
+    for (long row = 1; written < size; row++) {
+        written += fprintf(f, "{\"id\": %ld, \"user\": {\"name\": \"%s\", \"tags\": [\"%s\", \"%s\"]}, "
+                              "\"amount\": %u.%02u, \"score\": %u.%ue%u, \"ok\": %s, \"note\": ",
+                           row, random_word(), random_word(), random_word(), rng_range(100000), rng_range(100),
+                           1 + rng_range(9), rng_range(100000), rng_range(30), rng_range(2) ? "true" : "false");
+        if (rng_range(3) == 0) written += fprintf(f, "null}\n");
+        else written += fprintf(f, "\"%s \\\"%s\\\", %s\"}\n", random_word(), random_word(), random_word());
+    }
+}
+
+static long gen_json_value(FILE *f, int depth) {
+    unsigned kind = depth >= 4 ? 2 + rng_range(2) : rng_range(4);
+    long written = 0;
+
+    if (kind == 0) {
+        int n = 1 + rng_range(4);
+        written += fprintf(f, "{");
+        for (int i = 0; i < n; i++) {
+            written += fprintf(f, "%s\"%s\": ", i ? ", " : "", random_word());
+            written += gen_json_value(f, depth + 1);
+        }
+        written += fprintf(f, "}");
+    } else if (kind == 1) {
+        int n = 1 + rng_range(4);
+        written += fprintf(f, "[");
+        for (int i = 0; i < n; i++) {
+            if (i) written += fprintf(f, ", ");
+            written += gen_json_value(f, depth + 1);
+        }
+        written += fprintf(f, "]");
+    } else if (kind == 2) {
+        written += fprintf(f, "\"%s \\\"%s\\\"\"", random_word(), random_word());
+    } else {
+        written += fprintf(f, "%u.%u", rng_range(1000000), rng_range(1000));
+    }
+    return written;
+}
+
+static void gen_json(FILE *f, long size) {
+    long written = fprintf(f, "[\n");
+    int first = 1;
+    while (written < size) {
+        written += fprintf(f, "%s  ", first ? "" : ",\n");
+        written += gen_json_value(f, 0);
+        first = 0;
+    }
+    fprintf(f, "\n]\n");
+}
+
+static void gen_html(FILE *f, long size) {
+    static const char *tags[] = { "div", "span", "p", "a", "b", "i", "li", "td" };
+    long written = fprintf(f, "<!DOCTYPE html>\n<html><head><title>bench</title></head><body>\n");
+    while (written < size) {
+        const char *tag = tags[rng_range(8)];
+        written += fprintf(f, "<%s class=\"c%u\" id=\"e%u\">", tag, rng_range(50), rng_range(100000));
+        written += write_words(f, rng_range(40), ' ');
+        written += fprintf(f, "</%s>", tag);
+        if (rng_range(4) == 0) {
+            fputc('\n', f);
+            written++;
+        }
+    }
+    fprintf(f, "\n</body></html>\n");
+}
+
+// Minimal multi-page PDF with plain Helvetica text, enough for pdftotext
+static void gen_pdf(FILE *f, long size) {
+    int pages = (int)(size / 4000) + 1;
+    long *offsets = calloc(3 + 2 * pages + 1, sizeof(long));
+    int obj = 1;
+
+    fprintf(f, "%%PDF-1.4\n");
+    offsets[obj] = ftell(f);
+    fprintf(f, "%d 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n", obj++);
+    offsets[obj] = ftell(f);
+    fprintf(f, "%d 0 obj\n<< /Type /Pages /Count %d /Kids [", obj++, pages);
+    for (int p = 0; p < pages; p++) fprintf(f, " %d 0 R", 4 + 2 * p);
+    fprintf(f, " ] >>\nendobj\n");
+    offsets[obj] = ftell(f);
+    fprintf(f, "%d 0 obj\n<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>\nendobj\n", obj++);
+
+    for (int p = 0; p < pages; p++) {
+        char stream[8192];
+        int len = snprintf(stream, sizeof(stream), "BT /F1 10 Tf 12 TL 40 800 Td\n");
+        for (int line = 0; line < 60 && len < (int)sizeof(stream) - 128; line++) {
+            len += snprintf(stream + len, sizeof(stream) - len, "(");
+            for (int w = 0; w < 8; w++) {
+                len += snprintf(stream + len, sizeof(stream) - len, "%s%s", w ? " " : "", random_word());
+            }
+            len += snprintf(stream + len, sizeof(stream) - len, ") '\n");
+        }
+        len += snprintf(stream + len, sizeof(stream) - len, "ET\n");
+
+        offsets[obj] = ftell(f);
+        fprintf(f, "%d 0 obj\n<< /Type /Page /Parent 2 0 R /MediaBox [0 0 595 842] "
+                   "/Resources << /Font << /F1 3 0 R >> >> /Contents %d 0 R >>\nendobj\n", obj, obj + 1);
+        obj++;
+        offsets[obj] = ftell(f);
+        fprintf(f, "%d 0 obj\n<< /Length %d >>\nstream\n%sendstream\nendobj\n", obj, len, stream);
+        obj++;
+    }
+
+    long xref = ftell(f);
+    fprintf(f, "xref\n0 %d\n0000000000 65535 f \n", obj);
+    for (int i = 1; i < obj; i++) fprintf(f, "%010ld 00000 n \n", offsets[i]);
+    fprintf(f, "trailer\n<< /Size %d /Root 1 0 R >>\nstartxref\n%ld\n%%%%EOF\n", obj, xref);
+    free(offsets);
+}
+
+static int generate_file(const char *path, corpus_kind kind, long size, unsigned long long seed) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    rng_state = seed;
+    switch (kind) {
+        case CORPUS_TXT:       gen_txt(f, size); break;
+        case CORPUS_CSV:       gen_csv(f, size); break;
+        case CORPUS_JSON:      gen_json(f, size); break;
+        case CORPUS_HTML:      gen_html(f, size); break;
+        case CORPUS_PDF_TEXT:  gen_page_text(f, size); break;
+        case CORPUS_PDF:       gen_pdf(f, size); break;
+        case CORPUS_TABLE:     gen_table(f, size); break;
+        case CORPUS_NDJSON:    gen_ndjson(f, size); break;
+    }
+    if (fflush(f) != 0 || fsync(fileno(f)) != 0) {
+        fclose(f);
+        return -1;
+    }
+    return fclose(f);
+}
+
+static long parse_size(const char *s) {
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (*end == 'K' || *end == 'k') v <<= 10;
+    else if (*end == 'M' || *end == 'm') v <<= 20;
+    else if (*end == 'G' || *end == 'g') v <<= 30;
+    return v;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+// Bytes of path in the page cache. Mapping the file does not read it.
+static long resident_bytes(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    struct stat st;
+    long resident = 0;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        long page = sysconf(_SC_PAGESIZE);
+        size_t pages = (st.st_size + page - 1) / page;
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        unsigned char *vec = malloc(pages);
+        if (map != MAP_FAILED && vec && mincore(map, st.st_size, vec) == 0) {
+            for (size_t i = 0; i < pages; i++) resident += (vec[i] & 1) * page;
+            if (resident > st.st_size) resident = st.st_size;
+        }
+        free(vec);
+        if (map != MAP_FAILED) munmap(map, st.st_size);
+    }
+    close(fd);
+    return resident;
+}
+
+// Feed one job to the CLI through its menu and wait for it.
+// Returns the wall time, or a negative value if the child failed.
+static double run_cli(const char *cli, const char *workdir, const char *script, long *max_rss_kb) {
+    int pipefd[2];
+    if (pipe(pipefd) != 0) return -1;
+
+    fflush(NULL);
+    double start = now_seconds();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+
+    if (pid == 0) {
+        dup2(pipefd[0], STDIN_FILENO);
+        close(pipefd[0]);
+        close(pipefd[1]);
+        freopen("/dev/null", "w", stdout);
+        freopen("/dev/null", "w", stderr);
+        if (chdir(workdir) != 0) _exit(127);
+        execl(cli, cli, (char *)NULL);
+        _exit(127);
+    }
+
+    close(pipefd[0]);
+    size_t len = strlen(script);
+    if (write(pipefd[1], script, len) != (ssize_t)len) {
+        // the child reports the failure through its exit status
+    }
+    close(pipefd[1]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) return -1;
+    double elapsed = now_seconds() - start;
+
+    if (usage.ru_maxrss > *max_rss_kb) *max_rss_kb = usage.ru_maxrss;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+    return elapsed;
+}
+
+// Conversions --check verifies the output of, from inputs that once lost
+// data while the conversion reported success. Each returns 0 if the output
+// is right.
+
+// JSON to CSV with a key first seen after thousands of records
+static int check_json_late_key(fc_context *ctx) {
+    enum { RECORDS = 5000 };
+    static const char late[] = "{\"a\": 1, \"late\": \"DATA\"}\n";
+    static const char header[] = "a,late\n0,\n", tail[] = "4999,\n1,DATA\n";
+    size_t cap = RECORDS * 16 + sizeof(late), len = 0;
+    char *input = malloc(cap), *output = NULL;
+    size_t output_len = 0;
+    if (!input) return -1;
+    for (int i = 0; i < RECORDS; i++) len += snprintf(input + len, cap - len, "{\"a\": %d}\n", i);
+    memcpy(input + len, late, sizeof(late) - 1);
+    len += sizeof(late) - 1;
+
+    fc_status status = fc_convert_buffer(ctx, FC_JSON_TO_CSV, input, len, &output, &output_len);
+    int ok = status == FC_OK && output_len > sizeof(header) + sizeof(tail) &&
+             memcmp(output, header, sizeof(header) - 1) == 0 &&
+             memcmp(output + output_len - (sizeof(tail) - 1), tail, sizeof(tail) - 1) == 0;
+    if (!ok) fprintf(stderr, "json_to_csv: a key first seen in record %d is lost (%s)\n", RECORDS + 1,
+                     fc_status_message(status));
+    if (status == FC_OK) fc_free(output);
+    free(input);
+    return ok ? 0 : -1;
+}
+
+// Run one job in-process. Returns the wall time, or a negative value on failure.
+static double run_library(fc_context *ctx, const bench_path *bp, const char *in_path, const char *out_path) {
+    double start = now_seconds();
+    fc_status status;
+
+    if (bp->output_ext) {
+        status = fc_convert_file(ctx, bp->type, in_path, out_path);
+    } else {
+        char *results;
+        size_t len;
+        status = fc_search_file(ctx, in_path, SEARCH_WORD, &results, &len, NULL);
+        if (status == FC_OK) fc_free(results);
+    }
+
+    double elapsed = now_seconds() - start;
+    return status == FC_OK ? elapsed : -1;
+}
+
+// In library mode each path's peak RSS is this process's high-water mark
+// (VmHWM) since the path started: writing 5 to clear_refs resets it to the
+// current RSS. Where that is not available it falls back to the peak of the
+// whole run, which only grows.
+static void reset_peak_rss(void) {
+    int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    if (write(fd, "5", 1) != 1) {}
+    close(fd);
+}
+
+static long self_peak_rss_kb(void) {
+    char line[MAX];
+    long kb = -1;
+    FILE *status = fopen("/proc/self/status", "r");
+    while (status && fgets(line, sizeof(line), status)) {
+        if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) break;
+    }
+    if (status) fclose(status);
+    if (kb >= 0) return kb;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(double *sorted, int n, double p) {
+    if (n == 0) return 0;
+    int idx = (int)(p * (n - 1) + 0.5);
+    return sorted[idx];
+}
+
+// Time the batch pipeline (TXT to CSV) over many files with each I/O backend
+static void bench_batch(FILE *report, int *first_result, const char *workdir, long size, int count,
+                        unsigned long long seed) {
+    static const fc_io_backend backends[] = { FC_IO_URING, FC_IO_THREADS };
+    fc_batch_item *items = calloc(count, sizeof(fc_batch_item));
+    char (*paths)[2][PATH_MAX] = calloc(count, sizeof(*paths));
+    if (!items || !paths) {
+        free(items);
+        free(paths);
+        return;
+    }
+
+    long bytes_in = 0;
+    for (int i = 0; i < count; i++) {
+        if (snprintf(paths[i][0], PATH_MAX, "%s/batch_%ld_%d.txt", workdir, size, i) >= PATH_MAX ||
+            snprintf(paths[i][1], PATH_MAX, "%s/batch_%ld_%d.csv", workdir, size, i) >= PATH_MAX) {
+            fprintf(stderr, "Work directory path too long for batch files: '%s'.\n", workdir);
+            free(items);
+            free(paths);
+            return;
+        }
+        generate_file(paths[i][0], CORPUS_TXT, size, seed * 7777ULL + i);
+        bytes_in += file_size(paths[i][0]);
+        items[i].input = paths[i][0];
+        items[i].output = paths[i][1];
+    }
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        fc_batch_options options = { backends[b], 0, 0 };
+        const char *backend = NULL;
+        reset_peak_rss();
+        double start = now_seconds();
+        int failed = fc_batch_convert(FC_TXT_TO_CSV, items, count, &options, &backend);
+        double elapsed = now_seconds() - start;
+        if (failed < 0) continue;   // backend not available on this kernel
+
+        fprintf(report, "%s\n    {\"path\": \"batch_txt_to_csv\", \"backend\": \"%s\", \"size\": %ld, "
+                        "\"files\": %d, \"failed\": %d, \"bytes_in\": %ld, \"mb_per_s\": %.3f, "
+                        "\"files_per_s\": %.1f, \"peak_rss_kb\": %ld}",
+                *first_result ? "" : ",", backend, size, count, failed, bytes_in,
+                elapsed > 0 ? (bytes_in / 1048576.0) / elapsed : 0, elapsed > 0 ? count / elapsed : 0,
+                self_peak_rss_kb());
+        *first_result = 0;
+        fflush(report);
+    }
+
+    for (int i = 0; i < count; i++) {
+        unlink(paths[i][0]);
+        unlink(paths[i][1]);
+    }
+    free(items);
+    free(paths);
+}
+
+static int remove_tree(const char *dir) {
+    char command[PATH_MAX + 16];
+    snprintf(command, sizeof(command), "rm -rf '%s'", dir);
+    return system(command);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--cli PATH] [--sizes 16K,1M,8M] [--files N] [--seed N]\n"
+            "          [--workdir DIR] [--keep] [--only PATH] [--output FILE]\n"
+            "          [--batch N]   also time the batch pipeline over N files per size\n"
+            "          [--check]     exit 1 if a warm job mallocs arena chunks or allocates\n"
+            "                        more than the first (library mode)\n"
+            "          [--io-policy cache|drop|direct|drop,direct]   page cache use (default drop)\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *cli_arg = NULL;
+    const char *sizes_arg = DEFAULT_SIZES;
+    const char *workdir_arg = NULL;
+    const char *only = NULL;
+    const char *output = NULL;
+    int files = DEFAULT_FILES;
+    unsigned long long seed = 42;
+    int keep = 0;
+    int check = 0, regressions = 0;
+    int batch_files = 0;
+    const char *io_policy = "drop";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--cli") == 0 && i + 1 < argc) cli_arg = argv[++i];
+        else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) sizes_arg = argv[++i];
+        else if (strcmp(argv[i], "--files") == 0 && i + 1 < argc) files = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--workdir") == 0 && i + 1 < argc) workdir_arg = argv[++i];
+        else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) only = argv[++i];
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) output = argv[++i];
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) batch_files = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--io-policy") == 0 && i + 1 < argc) io_policy = argv[++i];
+        else if (strcmp(argv[i], "--keep") == 0) keep = 1;
+        else if (strcmp(argv[i], "--check") == 0) check = 1;
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (files < 1) files = 1;
+    int io_flags = fc_io_policy_parse(io_policy);
+    if (io_flags < 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    fc_io_set_policy(io_flags);
+    setenv("FC_IO_POLICY", io_policy, 1);  // for the CLI
+
+    char cli[PATH_MAX];
+    if (cli_arg && !realpath(cli_arg, cli)) {
+        fprintf(stderr, "Cannot find CLI binary '%s'.\n", cli_arg);
+        return 1;
+    }
+
+    fc_context *ctx = fc_context_new();
+    if (!ctx) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        return 1;
+    }
+    if (check && check_json_late_key(ctx) != 0) regressions++;
+
+    char workdir[PATH_MAX];
+    if (workdir_arg) {
+        mkdir(workdir_arg, 0755);
+        if (!realpath(workdir_arg, workdir)) {
+            fprintf(stderr, "Cannot use work directory '%s'.\n", workdir_arg);
+            return 1;
+        }
+    } else {
+        snprintf(workdir, sizeof(workdir), "/tmp/file_converter_bench.XXXXXX");
+        if (!mkdtemp(workdir)) {
+            fprintf(stderr, "Cannot create work directory.\n");
+            return 1;
+        }
+    }
+
+    long sizes[16];
+    int size_count = 0;
+    char sizes_copy[MAX];
+    snprintf(sizes_copy, sizeof(sizes_copy), "%s", sizes_arg);
+    for (char *tok = strtok(sizes_copy, ","); tok && size_count < 16; tok = strtok(NULL, ",")) {
+        sizes[size_count++] = parse_size(tok);
+    }
+
+    FILE *report = output ? fopen(output, "w") : stdout;
+    if (!report) {
+        fprintf(stderr, "Cannot open report file '%s'.\n", output);
+        return 1;
+    }
+
+    fprintf(report, "{\n  \"benchmark\": \"file_converter\",\n  \"mode\": \"%s\",\n  \"io_policy\": \"%s\",\n",
+            cli_arg ? "cli" : "library", io_policy);
+    fprintf(report, "  \"seed\": %llu,\n  \"files_per_size\": %d,\n  \"results\": [", seed, files);
+
+    double *latencies = malloc(sizeof(double) * files);
+    double *hash_latencies = malloc(sizeof(double) * files);
+    int first_result = 1;
+
+    for (int s = 0; s < size_count; s++) {
+        // Generate the corpus for this size once and reuse it for every path,
+        // skipping formats no selected path reads (GB-sized runs with --only)
+        int needed[CORPUS_LAST + 1] = { 0 };
+        for (size_t p = 0; p < PATH_COUNT; p++) {
+            if (!only || strcmp(only, bench_paths[p].name) == 0) needed[bench_paths[p].input] = 1;
+        }
+        for (int kind = CORPUS_TXT; kind <= CORPUS_LAST; kind++) {
+            for (int i = 0; needed[kind] && i < files; i++) {
+                char path[PATH_MAX];
+                if (snprintf(path, sizeof(path), "%s/in_%ld_%d.%s", workdir, sizes[s], i, corpus_ext[kind]) >=
+                    (int)sizeof(path)) {
+                    fprintf(stderr, "Work directory path too long: '%s'.\n", workdir);
+                    return 1;
+                }
+                if (generate_file(path, kind, sizes[s], seed * 1000003ULL + kind * 7919ULL + i) != 0) {
+                    fprintf(stderr, "Cannot write corpus file '%s'.\n", path);
+                    return 1;
+                }
+            }
+        }
+
+        for (size_t p = 0; p < PATH_COUNT; p++) {
+            const bench_path *bp = &bench_paths[p];
+            if (only && strcmp(only, bp->name) != 0) continue;
+
+            long bytes_in = 0, bytes_out = 0, max_rss_kb = 0, cached_in = 0, cached_out = 0;
+            double total = 0;
+            int ok = 0, failed = 0, hashed = 0;
+
+            // Arena chunks taken after the first (warm-up) job; anything but
+            // zero means per-job scratch went back to malloc
+            fc_arena_stats arena_before, arena_after;
+            uint64_t arena_allocs = 0, warm_chunk_allocs = 0, first_allocs = 0, max_warm_allocs = 0;
+
+            if (!cli_arg) reset_peak_rss();
+            for (int i = 0; i < files; i++) {
+                char in_path[PATH_MAX], out_path[PATH_MAX], script[3 * PATH_MAX];
+                int in_len = snprintf(in_path, sizeof(in_path), "%s/in_%ld_%d.%s", workdir, sizes[s], i,
+                                      corpus_ext[bp->input]);
+                int out_len = snprintf(out_path, sizeof(out_path), "%s/out_%s_%ld_%d.%s", workdir, bp->name,
+                                       sizes[s], i, bp->output_ext ? bp->output_ext : "none");
+                if (in_len >= (int)sizeof(in_path) || out_len >= (int)sizeof(out_path)) {
+                    fprintf(stderr, "Work directory path too long: '%s'.\n", workdir);
+                    return 1;
+                }
+                unlink(out_path);
+
+                if (bp->output_ext) {
+                    snprintf(script, sizeof(script), "%s%s\n%s\n3\n", bp->menu, in_path, out_path);
+                } else {
+                    snprintf(script, sizeof(script), "%s%s\n%s\n3\n", bp->menu, in_path, SEARCH_WORD);
+                }
+
+                double elapsed;
+                if (cli_arg) {
+                    elapsed = run_cli(cli, workdir, script, &max_rss_kb);
+                } else {
+                    fc_arena_get_stats(&arena_before);
+                    elapsed = run_library(ctx, bp, in_path, out_path);
+                    fc_arena_get_stats(&arena_after);
+                    max_rss_kb = self_peak_rss_kb();
+                    uint64_t job_allocs = arena_after.allocations - arena_before.allocations;
+                    arena_allocs += job_allocs;
+                    if (i == 0) {
+                        first_allocs = job_allocs;
+                    } else {
+                        warm_chunk_allocs += arena_after.chunk_allocations - arena_before.chunk_allocations;
+                        if (job_allocs > max_warm_allocs) max_warm_allocs = job_allocs;
+                    }
+                }
+                long out_size = bp->output_ext ? file_size(out_path) : 0;
+                if (elapsed < 0 || out_size < 0 || (bp->output_ext && out_size == 0)) {
+                    failed++;
+                    continue;
+                }
+
+                latencies[ok++] = elapsed;
+                // Before hashing reads the input back in
+                cached_in += resident_bytes(in_path);
+                if (bp->output_ext) cached_out += resident_bytes(out_path);
+                if (bp->output_ext) {
+                    uint64_t hash;
+                    double hash_start = now_seconds();
+                    if (fc_cache_hash_file(in_path, &hash, NULL) == 0) {
+                        hash_latencies[hashed++] = now_seconds() - hash_start;
+                    }
+                }
+                total += elapsed;
+                bytes_in += file_size(in_path);
+                bytes_out += out_size;
+                if (!keep && bp->output_ext) unlink(out_path);
+            }
+
+            qsort(latencies, ok, sizeof(double), compare_double);
+            qsort(hash_latencies, hashed, sizeof(double), compare_double);
+            double mb_per_s = total > 0 ? (bytes_in / 1048576.0) / total : 0;
+
+            fprintf(report, "%s\n    {\"path\": \"%s\", \"size\": %ld, \"files\": %d, \"ok\": %d, \"failed\": %d, "
+                            "\"bytes_in\": %ld, \"bytes_out\": %ld, \"mb_per_s\": %.3f, "
+                            "\"p50_ms\": %.3f, \"p99_ms\": %.3f, \"hash_ms\": %.3f, \"peak_rss_kb\": %ld, "
+                            "\"arena_allocs_per_job\": %.1f, \"arena_warm_chunk_allocs\": %llu, "
+                            "\"cached_in_pct\": %.1f, \"cached_out_pct\": %.1f}",
+                    first_result ? "" : ",", bp->name, sizes[s], files, ok, failed,
+                    bytes_in, bytes_out, mb_per_s,
+                    percentile(latencies, ok, 0.50) * 1000.0, percentile(latencies, ok, 0.99) * 1000.0,
+                    percentile(hash_latencies, hashed, 0.50) * 1000.0, max_rss_kb,
+                    files > 0 ? (double)arena_allocs / files : 0, (unsigned long long)warm_chunk_allocs,
+                    bytes_in > 0 ? 100.0 * cached_in / bytes_in : 0, bytes_out > 0 ? 100.0 * cached_out / bytes_out : 0);
+            first_result = 0;
+            fflush(report);
+
+            if (check && !cli_arg && (warm_chunk_allocs > 0 || max_warm_allocs > first_allocs)) {
+                fprintf(stderr, "%s at %ld: %llu arena chunks malloc'd by warm jobs, "
+                                "up to %llu allocations per warm job against %llu for the first\n",
+                        bp->name, sizes[s], (unsigned long long)warm_chunk_allocs,
+                        (unsigned long long)max_warm_allocs, (unsigned long long)first_allocs);
+                regressions++;
+            }
+        }
+
+        if (batch_files > 0 && !cli_arg) {
+            bench_batch(report, &first_result, workdir, sizes[s], batch_files, seed);
+        }
+    }
+
+    fprintf(report, "\n  ]\n}\n");
+    if (report != stdout) fclose(report);
+    free(latencies);
+    free(hash_latencies);
+    fc_context_free(ctx);
+
+    if (!keep && !workdir_arg) remove_tree(workdir);
+    return regressions ? 1 : 0;
+}
@@ -4,13 +4,26 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <cairo.h>
-#include <cairo-pdf.h>
-#include <pango/pangocairo.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "converter.h"
+#include "encoding.h"
+#include "arena.h"
+#include "metrics.h"
+#include "trace.h"
+#include "cache.h"
+#include "pipeline.h"
+#include "daemon.h"
+#include "budget.h"
+#include "iopolicy.h"
+#include "threadpool.h"
 
-#define CMD_SIZE 1024
 #define MAX 256
+#define SAVE_SLICE_CHARS 16384     // characters per GtkTextBuffer slice when saving
+#define SAVE_BUFFER_SIZE 65536     // stdio buffer size for the save writer
+#define VIEW_MAX_BYTES (64L << 20) // most text loaded into one view
+#define VIEW_MIN_BYTES (1L << 20)
 
 // Global widgets
 GtkWidget *window;
@@ -20,16 +33,28 @@ GtkWidget *stack_switcher;
 GtkWidget *status_bar;
 GtkWidget *input_file_entry;
 GtkWidget *output_file_entry;
+GtkWidget *chain_entry;
 GtkWidget *content_text_view;
 GtkTextBuffer *content_buffer;
 GtkWidget *search_entry;
 GtkWidget *result_text_view;
 GtkTextBuffer *result_buffer;
 
+// Conversion scratch buffers, reused across button clicks
+fc_context *converter_ctx;
+// Conversion cache, enabled by setting FC_CACHE_DIR
+fc_cache *converter_cache;
+// Text read or found for one button click; reset once it is shown
+fc_arena *job_arena;
+// content_buffer holds only the start of a file, so must not be saved
+int content_partial;
+
 // Function declarations
 void write_log(const char *message);
 void show_message(const char *message);
+void configure_context(fc_context *ctx);
 void on_convert_button_clicked(GtkWidget *widget, gpointer data);
+void on_chain_button_clicked(GtkWidget *widget, gpointer data);
 void on_browse_input_clicked(GtkWidget *widget, gpointer data);
 void on_browse_output_clicked(GtkWidget *widget, gpointer data);
 void on_create_file_clicked(GtkWidget *widget, gpointer data);
@@ -39,33 +64,57 @@ void on_write_file_clicked(GtkWidget *widget, gpointer data);
 void on_modify_file_clicked(GtkWidget *widget, gpointer data);
 void on_search_file_clicked(GtkWidget *widget, gpointer data);
 void on_view_logs_clicked(GtkWidget *widget, gpointer data);
+void on_content_changed(GtkTextBuffer *buffer, gpointer data);
 
-// Conversion functions
-void convert_txt_to_csv(const char *input_file, const char *output_file);
-void convert_csv_to_txt(const char *input_file, const char *output_file);
-void convert_pdf_to_txt(const char *input_file, const char *output_file);
-void convert_txt_to_pdf(const char *input_file, const char *output_file);
-void convert_txt_to_html(const char *input_file, const char *output_file);
-void convert_html_to_txt(const char *input_file, const char *output_file);
-void convert_json_to_txt(const char *input_file, const char *output_file);
-void convert_txt_to_json(const char *input_file, const char *output_file);
+// Conversion
+void run_conversion(fc_conversion type, const char *input_file, const char *output_file);
+void run_chain(const fc_pipeline *pipeline, const char *input_file, const char *output_file);
 
 // File operations
-void create_file(const char *filename, const char *content);
+void create_file(const char *filename, GtkTextBuffer *buffer);
 void delete_file(const char *filename);
-char *read_file(const char *filename);
-void write_file(const char *filename, const char *content);
-void modify_file(const char *filename, const char *content);
+char *read_file(const char *filename, int *partial);
+void write_file(const char *filename, GtkTextBuffer *buffer);
+void modify_file(const char *filename, GtkTextBuffer *buffer);
+int save_text_buffer(const char *filename, GtkTextBuffer *buffer, int append);
 char *search_in_file(const char *filename, const char *search_term);
 // Implementation of file operation functions
 
-void create_file(const char *filename, const char *content) {
-    FILE *file = fopen(filename, "w");
-    if (file) {
-        if (content && strlen(content) > 0) {
-            fputs(content, file);
-        }
-        fclose(file);
+static unsigned long long file_size(const char *filename) {
+    struct stat st;
+    return stat(filename, &st) == 0 ? (unsigned long long)st.st_size : 0;
+}
+
+// A text view takes several times its text in memory, so at most a quarter
+// of what is left of the memory budget is loaded into one
+static size_t view_limit(void) {
+    uint64_t limit = fc_budget_available() / 4;
+    if (limit > VIEW_MAX_BYTES) return VIEW_MAX_BYTES;
+    return limit < VIEW_MIN_BYTES ? VIEW_MIN_BYTES : limit;
+}
+
+// Cut text shown in part after its last complete line, so a view never
+// gets half a UTF-8 sequence
+static size_t whole_lines(const char *text, size_t len) {
+    size_t end = len;
+    while (end > 0 && text[end - 1] != '\n') end--;
+    return end ? end : len;
+}
+
+static int refuse_partial(void) {
+    if (content_partial) show_message("Only the start of the file is loaded; not saving it.");
+    return content_partial;
+}
+
+// Each file operation is a metrics scope
+void create_file(const char *filename, GtkTextBuffer *buffer) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, FC_OP_CREATE_FILE);
+    int saved = save_text_buffer(filename, buffer, 0) == 0;
+    scope.bytes_out = saved ? file_size(filename) : 0;
+    fc_metrics_end(&scope, saved ? FC_OK : FC_ERR_OUTPUT);
+
+    if (saved) {
         char message[256];
         snprintf(message, sizeof(message), "File '%s' created.", filename);
         show_message(message);
@@ -77,7 +126,12 @@ void create_file(const char *filename, const char *content) {
 }
 
 void delete_file(const char *filename) {
-    if (remove(filename) == 0) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, FC_OP_DELETE_FILE);
+    int deleted = remove(filename) == 0;
+    fc_metrics_end(&scope, deleted ? FC_OK : FC_ERR_INPUT);
+
+    if (deleted) {
         char message[256];
         snprintf(message, sizeof(message), "File '%s' deleted.", filename);
         show_message(message);
@@ -88,51 +142,139 @@ void delete_file(const char *filename) {
     }
 }
 
-char *read_file(const char *filename) {
-    FILE *file = fopen(filename, "r");
+// Persist a rename, creation or removal in filename's directory
+static void sync_directory(const char *filename) {
+    gchar *dir_name = g_path_get_dirname(filename);
+    int dir_fd = open(dir_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    g_free(dir_name);
+}
+
+// An append first records the file's length in "FILE.fcappend" and removes
+// it once the new text is on disk. A journal still there means the append
+// never finished: cut the file back to that length.
+static gchar *append_journal_name(const char *filename) {
+    return g_strdup_printf("%s.fcappend", filename);
+}
+
+// Cut filename back to length, on disk. 0 on success.
+static int cut_back(const char *filename, off_t length) {
+    int fd = open(filename, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    int failed = ftruncate(fd, length) != 0 || fsync(fd) != 0;
+    close(fd);
+    return failed ? -1 : 0;
+}
+
+static void end_append(const char *filename) {
+    gchar *journal = append_journal_name(filename);
+    unlink(journal);
+    g_free(journal);
+    sync_directory(filename);
+}
+
+static void recover_append(const char *filename) {
+    gchar *journal = append_journal_name(filename);
+    FILE *in = fopen(journal, "r");
+    g_free(journal);
+    if (!in) return;
+
+    long long length;
+    struct stat st;
+    int cut = fscanf(in, "%lld", &length) == 1 && length >= 0 && stat(filename, &st) == 0 && st.st_size > length;
+    fclose(in);
+    // The journal stays until the file is cut back
+    if (!cut || cut_back(filename, length) == 0) end_append(filename);
+}
+
+// Read filename for display, up to view_limit() bytes of text; *partial
+// (if given) is set when there was more
+char *read_file(const char *filename, int *partial) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, FC_OP_READ_FILE);
+    fc_trace_span span, step;
+    fc_trace_begin(&span, "read_file");
+    fc_trace_begin(&step, "open");
+    recover_append(filename);
+    struct stat st;
+    FILE *file = stat(filename, &st) == 0 ? fc_io_open_read(filename) : NULL;
+    fc_trace_end(&step, 0);
     if (!file) {
+        fc_trace_end(&span, 0);
+        fc_metrics_end(&scope, FC_ERR_INPUT);
         show_message("Cannot open file for reading.");
         write_log("Failed to open file for reading.");
         return NULL;
     }
-    
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long fsize = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    // Allocate memory for file content
-    char *content = malloc(fsize + 1);
+    long fsize = S_ISREG(st.st_mode) ? (long)st.st_size : 0;
+    
+    // GtkTextBuffer only takes UTF-8, so read through the encoding stage;
+    // transcoded text can be longer than the file
+    FILE *text = fc_text_stream_arena(file, 1, job_arena);
+    size_t limit = view_limit();
+    size_t capacity = fsize > 0 ? (size_t)fsize + 1 : 4096;
+    if (capacity > limit + 1) capacity = limit + 1;
+    char *content = text ? fc_arena_alloc(job_arena, capacity) : NULL;
     if (!content) {
-        fclose(file);
+        if (text) fclose(text);
+        else fclose(file);
+        fc_trace_end(&span, 0);
+        fc_metrics_end(&scope, FC_ERR_NOMEM);
         show_message("Memory allocation failed.");
         write_log("Memory allocation failed during file read.");
         return NULL;
     }
     
     // Read file content
-    size_t bytes_read = fread(content, 1, fsize, file);
+    fc_trace_begin(&step, "read");
+    size_t bytes_read = 0, n;
+    while (bytes_read < limit && (n = fread(content + bytes_read, 1, capacity - 1 - bytes_read, text)) > 0) {
+        bytes_read += n;
+        if (bytes_read == capacity - 1 && bytes_read < limit) {
+            size_t size = capacity * 2 > limit + 1 ? limit + 1 : capacity * 2;
+            char *bigger = fc_arena_grow(job_arena, content, capacity, size);
+            if (!bigger) break;
+            content = bigger;
+            capacity = size;
+        }
+    }
+    int more = bytes_read == limit && fgetc(text) != EOF;
+    if (more) bytes_read = whole_lines(content, bytes_read);
+    if (partial) *partial = more;
     content[bytes_read] = '\0';  // Null terminate the string
+    fc_trace_end(&step, bytes_read);
     
-    fclose(file);
+    fclose(text);
+    scope.bytes_in = fsize > 0 ? fsize : 0;
+    scope.bytes_out = bytes_read;
+    fc_metrics_buffer_in_use(capacity);
+    fc_metrics_end(&scope, FC_OK);
+    fc_trace_end(&span, scope.bytes_in);
     
     char message[256];
-    snprintf(message, sizeof(message), "File '%s' read successfully.", filename);
+    if (more) {
+        snprintf(message, sizeof(message), "File '%s' is large: showing its first %zu MB, read-only.",
+                 filename, bytes_read >> 20);
+    } else {
+        snprintf(message, sizeof(message), "File '%s' read successfully.", filename);
+    }
     show_message(message);
     write_log(message);
     
     return content;
 }
 
-void write_file(const char *filename, const char *content) {
-    FILE *file = fopen(filename, "w");
-    if (!file) {
-        show_message("Cannot open file for writing.");
-        write_log("Failed to open file for writing.");
-        return;
-    }
-    
-    if (content && fputs(content, file) >= 0) {
+void write_file(const char *filename, GtkTextBuffer *buffer) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, FC_OP_WRITE_FILE);
+    int saved = save_text_buffer(filename, buffer, 0) == 0;
+    scope.bytes_out = saved ? file_size(filename) : 0;
+    fc_metrics_end(&scope, saved ? FC_OK : FC_ERR_OUTPUT);
+
+    if (saved) {
         char message[256];
         snprintf(message, sizeof(message), "Content written to '%s'.", filename);
         show_message(message);
@@ -141,19 +283,16 @@ void write_file(const char *filename, const char *content) {
         show_message("Error writing to file.");
         write_log("Error writing to file.");
     }
-    
-    fclose(file);
 }
 
-void modify_file(const char *filename, const char *content) {
-    FILE *file = fopen(filename, "a");
-    if (!file) {
-        show_message("Cannot open file for appending.");
-        write_log("Failed to open file for appending.");
-        return;
-    }
-    
-    if (content && fputs(content, file) >= 0) {
+void modify_file(const char *filename, GtkTextBuffer *buffer) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, FC_OP_APPEND_FILE);
+    int saved = save_text_buffer(filename, buffer, 1) == 0;
+    scope.bytes_out = saved ? file_size(filename) : 0;
+    fc_metrics_end(&scope, saved ? FC_OK : FC_ERR_OUTPUT);
+
+    if (saved) {
         char message[256];
         snprintf(message, sizeof(message), "Content appended to '%s'.", filename);
         show_message(message);
@@ -162,86 +301,247 @@ void modify_file(const char *filename, const char *content) {
         show_message("Error appending to file.");
         write_log("Error appending to file.");
     }
-    
-    fclose(file);
 }
 
-char *search_in_file(const char *filename, const char *search_term) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        show_message("Cannot open file for searching.");
-        write_log("Failed to open file for searching.");
-        return NULL;
+// Write the buffer to out in SAVE_SLICE_CHARS slices, so it is never copied
+// into one big string. 0 on success.
+static int write_buffer_slices(FILE *out, GtkTextBuffer *buffer, size_t *written) {
+    GtkTextIter iter, next, end;
+    gtk_text_buffer_get_bounds(buffer, &iter, &end);
+    *written = 0;
+    while (gtk_text_iter_compare(&iter, &end) < 0) {
+        next = iter;
+        gtk_text_iter_forward_chars(&next, SAVE_SLICE_CHARS);
+
+        gchar *slice = gtk_text_buffer_get_text(buffer, &iter, &next, FALSE);
+        size_t len = strlen(slice);
+        int failed = fwrite(slice, 1, len, out) != len;
+        *written += len;
+        g_free(slice);
+        if (failed) return -1;
+
+        iter = next;
     }
-    
-    // Allocate buffer for results
-    char *results = malloc(4096);  // Start with 4KB buffer
+    return fflush(out);
+}
+
+// Record length in filename's append journal, on disk before the append
+static int begin_append(const char *filename, off_t length) {
+    gchar *journal = append_journal_name(filename);
+    int fd = open(journal, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    g_free(journal);
+    if (fd < 0) return -1;
+    char text[32];
+    int len = snprintf(text, sizeof(text), "%lld\n", (long long)length);
+    int failed = write(fd, text, len) != len || fsync(fd) != 0;
+    if (close(fd) != 0) failed = 1;
+    sync_directory(filename);
+    return failed ? -1 : 0;
+}
+
+// Append in place: the file keeps its inode, links and everything already
+// in it, and costs only what is added (--incremental picks up from there).
+// The append journal makes it all or nothing: a failed write is cut back
+// at once, one cut short by a crash the next time the file is read or
+// saved.
+static int append_text_buffer(const char *filename, GtkTextBuffer *buffer) {
+    recover_append(filename);
+
+    fc_trace_span span;
+    fc_trace_begin(&span, "open");
+    struct stat st;
+    int fd = open(filename, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+    if (fd >= 0 && (fstat(fd, &st) != 0 || begin_append(filename, st.st_size) != 0)) {
+        close(fd);
+        end_append(filename);
+        fd = -1;
+    }
+    FILE *out = fd >= 0 ? fdopen(fd, "a") : NULL;
+    fc_trace_end(&span, 0);
+    if (!out) {
+        if (fd >= 0) {
+            close(fd);
+            end_append(filename);
+        }
+        return -1;
+    }
+    setvbuf(out, NULL, _IOFBF, SAVE_BUFFER_SIZE);
+    fc_metrics_buffer_in_use(SAVE_BUFFER_SIZE);
+
+    fc_trace_begin(&span, "write");
+    size_t written;
+    int failed = write_buffer_slices(out, buffer, &written) != 0;
+    fc_trace_end(&span, written);
+
+    fc_trace_begin(&span, "fsync");
+    if (fflush(out) != 0 || fsync(fd) != 0) failed = 1;
+    if (fclose(out) != 0) failed = 1;
+    fc_trace_end(&span, 0);
+
+    // Cut a failed append back once nothing more can be flushed
+    if (!failed || cut_back(filename, st.st_size) == 0) end_append(filename);
+    return failed ? -1 : 0;
+}
+
+// Save the contents of a text buffer. A new file or a rewrite goes through a
+// temporary file next to the target, which is fsync'd and renamed over it,
+// so a crash mid-save leaves either the old file or the new one. Appends
+// are written to the file itself.
+int save_text_buffer(const char *filename, GtkTextBuffer *buffer, int append) {
+    if (append) return append_text_buffer(filename, buffer);
+    recover_append(filename);
+
+    fc_trace_span span;
+    fc_trace_begin(&span, "open");
+    gchar *tmp_name = g_strdup_printf("%s.XXXXXX", filename);
+    int fd = mkstemp(tmp_name);
+    if (fd < 0) {
+        g_free(tmp_name);
+        return -1;
+    }
+
+    // mkstemp creates the file 0600; keep the mode the target would have had
+    struct stat st;
+    if (stat(filename, &st) == 0) {
+        fchmod(fd, st.st_mode & 07777);
+    } else {
+        mode_t mask = umask(0);
+        umask(mask);
+        fchmod(fd, 0666 & ~mask);
+    }
+
+    FILE *out = fdopen(fd, "w");
+    if (!out) {
+        close(fd);
+        unlink(tmp_name);
+        g_free(tmp_name);
+        return -1;
+    }
+
+    fc_trace_end(&span, 0);
+    setvbuf(out, NULL, _IOFBF, SAVE_BUFFER_SIZE);
+    fc_metrics_buffer_in_use(SAVE_BUFFER_SIZE);
+
+    fc_trace_begin(&span, "write");
+    size_t written;
+    int failed = write_buffer_slices(out, buffer, &written) != 0;
+    fc_trace_end(&span, written);
+
+    fc_trace_begin(&span, "fsync");
+    if (fsync(fileno(out)) != 0) failed = 1;
+    if (fclose(out) != 0) failed = 1;
+    fc_trace_end(&span, 0);
+
+    fc_trace_begin(&span, "rename");
+    if (!failed && rename(tmp_name, filename) != 0) failed = 1;
+    fc_trace_end(&span, 0);
+
+    if (failed) {
+        unlink(tmp_name);
+        g_free(tmp_name);
+        return -1;
+    }
+    g_free(tmp_name);
+
+    // Persist the rename itself
+    fc_trace_begin(&span, "fsync directory");
+    sync_directory(filename);
+    fc_trace_end(&span, 0);
+
+    return 0;
+}
+
+char *search_in_file(const char *filename, const char *search_term) {
+    int found = 0;
+
+    // Matches go to a spill stream, which moves to a temporary file once
+    // they outgrow what a view can show; the view gets their start
+    size_t limit = view_limit();
+    FILE *results = fc_spill_open(limit);
     if (!results) {
-        fclose(file);
         show_message("Memory allocation failed.");
-        write_log("Memory allocation failed during search.");
         return NULL;
     }
-    
-    // Initialize results
-    results[0] = '\0';
-    size_t results_size = 4096;
-    size_t results_len = 0;
-    
-    char line[MAX];
-    int line_number = 1;
-    int found = 0;
-    
-    // Buffer for storing a single result line
-    char result_line[MAX + 64];  // Line plus some extra for the line number prefix
-    
-    while (fgets(line, MAX, file)) {
-        if (strstr(line, search_term)) {
-            found = 1;
-            
-            // Format the result line
-            snprintf(result_line, sizeof(result_line), "Line %d: %s", line_number, line);
-            size_t line_len = strlen(result_line);
-            
-            // Ensure buffer is large enough
-            if (results_len + line_len + 1 > results_size) {
-                results_size *= 2;
-                char *new_results = realloc(results, results_size);
-                if (!new_results) {
-                    free(results);
-                    fclose(file);
-                    show_message("Memory allocation failed.");
-                    write_log("Memory reallocation failed during search.");
-                    return NULL;
-                }
-                results = new_results;
-            }
-            
-            // Append the line to results
-            strcat(results + results_len, result_line);
-            results_len += line_len;
-        }
-        line_number++;
+
+    fc_trace_span span;
+    fc_trace_begin(&span, "search_in_file");
+    fc_status status = fc_search_stream(converter_ctx, filename, search_term, results, &found);
+    off_t results_len = ftello(results);
+    fc_trace_end(&span, status == FC_OK ? results_len : 0);
+    if (status == FC_ERR_INPUT) {
+        fclose(results);
+        show_message("Cannot open file for searching.");
+        write_log("Failed to open file for searching.");
+        return NULL;
+    } else if (status != FC_OK) {
+        fclose(results);
+        show_message(fc_status_message(status));
+        write_log("Search failed.");
+        return NULL;
     }
-    
-    fclose(file);
-    
+
+    // Either way the text shown is kept in the click's arena
+    char *text;
     if (!found) {
-        snprintf(results, results_size, "'%s' not found in the file.", search_term);
+        size_t size = strlen(search_term) + 32;
+        text = fc_arena_alloc(job_arena, size);
+        if (text) snprintf(text, size, "'%s' not found in the file.", search_term);
         write_log("Search term not found in file.");
     } else {
+        static const char more[] = "\n[More matches not shown]\n";
+        size_t shown = results_len > (off_t)limit ? limit : (size_t)results_len;
+        text = fc_arena_alloc(job_arena, shown + sizeof(more));
+        if (text) {
+            rewind(results);
+            shown = fread(text, 1, shown, results);
+            if ((off_t)shown < results_len) {
+                shown = whole_lines(text, shown);
+                memcpy(text + shown, more, sizeof(more));
+            } else {
+                text[shown] = '\0';
+            }
+        }
         char message[256];
-        snprintf(message, sizeof(message), "Search completed, found matches for '%s'.", search_term);
+        snprintf(message, sizeof(message), "Search completed, found %d matches for '%s'.", found, search_term);
         show_message(message);
         write_log(message);
     }
-    
-    return results;
+    fclose(results);
+
+    return text;
+}
+
+// Settings from the environment, for converter_ctx and the contexts of
+// pipeline stages and other workers
+void configure_context(fc_context *ctx) {
+    // FC_COMPRESS=gzip|zstd compresses the output whatever its name
+    fc_set_output_compression(ctx, fc_compression_parse(getenv("FC_COMPRESS")));
+    // FC_TOOL_TIMEOUT=SECONDS limits how long pdftotext or txt2pdf may run
+    const char *tool_timeout = getenv("FC_TOOL_TIMEOUT");
+    if (tool_timeout) fc_set_tool_timeout(ctx, atoi(tool_timeout));
+    // FC_HTML_PAGE_LINES=N splits TXT to HTML output into pages of N lines
+    const char *page_lines = getenv("FC_HTML_PAGE_LINES");
+    if (page_lines) fc_set_html_page_lines(ctx, atol(page_lines));
 }
 
 int main(int argc, char *argv[]) {
     // Initialize GTK
     gtk_init(&argc, &argv);
+
+    converter_ctx = fc_context_new();
+    job_arena = fc_arena_acquire();
+    if (!converter_ctx || !job_arena) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        return 1;
+    }
+    configure_context(converter_ctx);
+    fc_set_worker_setup(configure_context);
+    converter_cache = fc_cache_open_env();
+    fc_metrics_start_export_env();
+    fc_trace_start_env();      // FC_TRACE=trace.json records a Chrome trace
+    // FC_MAX_MEMORY=2G caps file views and search results
+    if (fc_budget_set_env() != 0) fprintf(stderr, "Ignoring invalid FC_MAX_MEMORY.\n");
+    if (fc_io_set_policy_env() != 0) fprintf(stderr, "Ignoring invalid FC_IO_POLICY.\n");
     
     // Create the main window
     window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
@@ -315,38 +615,34 @@ int main(int argc, char *argv[]) {
     gtk_grid_set_column_spacing(GTK_GRID(conversion_grid), 10);
     gtk_container_add(GTK_CONTAINER(conversion_frame), conversion_grid);
     
-    // Conversion buttons
-    GtkWidget *txt_to_csv = gtk_button_new_with_label("TXT to CSV");
-    g_signal_connect(txt_to_csv, "clicked", G_CALLBACK(on_convert_button_clicked), (gpointer)1);
-    gtk_grid_attach(GTK_GRID(conversion_grid), txt_to_csv, 0, 0, 1, 1);
-    
-    GtkWidget *csv_to_txt = gtk_button_new_with_label("CSV to TXT");
-    g_signal_connect(csv_to_txt, "clicked", G_CALLBACK(on_convert_button_clicked), (gpointer)2);
-    gtk_grid_attach(GTK_GRID(conversion_grid), csv_to_txt, 1, 0, 1, 1);
-    
-    GtkWidget *pdf_to_txt = gtk_button_new_with_label("PDF to TXT");
-    g_signal_connect(pdf_to_txt, "clicked", G_CALLBACK(on_convert_button_clicked), (gpointer)3);
-    gtk_grid_attach(GTK_GRID(conversion_grid), pdf_to_txt, 2, 0, 1, 1);
-    
-    GtkWidget *txt_to_pdf = gtk_button_new_with_label("TXT to PDF");
-    g_signal_connect(txt_to_pdf, "clicked", G_CALLBACK(on_convert_button_clicked), (gpointer)4);
-    gtk_grid_attach(GTK_GRID(conversion_grid), txt_to_pdf, 3, 0, 1, 1);
-    
-    GtkWidget *txt_to_html = gtk_button_new_with_label("TXT to HTML");
-    g_signal_connect(txt_to_html, "clicked", G_CALLBACK(on_convert_button_clicked), (gpointer)5);
-    gtk_grid_attach(GTK_GRID(conversion_grid), txt_to_html, 0, 1, 1, 1);
-    
-    GtkWidget *html_to_txt = gtk_button_new_with_label("HTML to TXT");
-    g_signal_connect(html_to_txt, "clicked", G_CALLBACK(on_convert_button_clicked), (gpointer)6);
-    gtk_grid_attach(GTK_GRID(conversion_grid), html_to_txt, 1, 1, 1, 1);
-    
-    GtkWidget *json_to_txt = gtk_button_new_with_label("JSON to TXT");
-    g_signal_connect(json_to_txt, "clicked", G_CALLBACK(on_convert_button_clicked), (gpointer)7);
-    gtk_grid_attach(GTK_GRID(conversion_grid), json_to_txt, 2, 1, 1, 1);
-    
-    GtkWidget *txt_to_json = gtk_button_new_with_label("TXT to JSON");
-    g_signal_connect(txt_to_json, "clicked", G_CALLBACK(on_convert_button_clicked), (gpointer)8);
-    gtk_grid_attach(GTK_GRID(conversion_grid), txt_to_json, 3, 1, 1, 1);
+    // Conversion buttons, one per registered converter, four to a row
+    for (int type = FC_CONVERSION_FIRST; type <= FC_CONVERSION_LAST; type++) {
+        const fc_converter_info *info = fc_converter((fc_conversion)type);
+        int index = type - FC_CONVERSION_FIRST;
+        GtkWidget *button = gtk_button_new_with_label(info->name);
+        if (info->tool) {
+            char tip[64];
+            snprintf(tip, sizeof(tip), "Requires %s", info->tool);
+            gtk_widget_set_tooltip_text(button, tip);
+        }
+        g_signal_connect(button, "clicked", G_CALLBACK(on_convert_button_clicked), GINT_TO_POINTER(type));
+        gtk_grid_attach(GTK_GRID(conversion_grid), button, index % 4, index / 4, 1, 1);
+    }
+
+    // Auto-detect: source from the input's content, target from the output's name
+    int auto_row = (FC_CONVERSION_LAST - FC_CONVERSION_FIRST) / 4 + 1;
+    GtkWidget *auto_detect = gtk_button_new_with_label("Auto-detect");
+    gtk_widget_set_tooltip_text(auto_detect, "Convert by the input's content and the output's extension");
+    g_signal_connect(auto_detect, "clicked", G_CALLBACK(on_convert_button_clicked), GINT_TO_POINTER(0));
+    gtk_grid_attach(GTK_GRID(conversion_grid), auto_detect, 0, auto_row, 4, 1);
+
+    // Chains such as html:txt:json run stage by stage with no intermediate file
+    chain_entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(chain_entry), "Chain, e.g. html:txt:json");
+    gtk_grid_attach(GTK_GRID(conversion_grid), chain_entry, 0, auto_row + 1, 3, 1);
+    GtkWidget *chain_button = gtk_button_new_with_label("Run Chain");
+    g_signal_connect(chain_button, "clicked", G_CALLBACK(on_chain_button_clicked), NULL);
+    gtk_grid_attach(GTK_GRID(conversion_grid), chain_button, 3, auto_row + 1, 1, 1);
     
     // 2. File Operations Page
     GtkWidget *file_page = gtk_box_new(GTK_ORIENTATION_VERTICAL, 10);
@@ -387,6 +683,7 @@ int main(int argc, char *argv[]) {
     
     content_text_view = gtk_text_view_new();
     content_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(content_text_view));
+    g_signal_connect(content_buffer, "changed", G_CALLBACK(on_content_changed), NULL);
     gtk_container_add(GTK_CONTAINER(text_scroll), content_text_view);
     
     // 3. Search Page
@@ -444,6 +741,7 @@ int main(int argc, char *argv[]) {
     
     GtkWidget *logs_view = gtk_text_view_new();
     gtk_text_view_set_editable(GTK_TEXT_VIEW(logs_view), FALSE);
+    gtk_text_view_set_monospace(GTK_TEXT_VIEW(logs_view), TRUE);   // keeps the metrics table aligned
     GtkTextBuffer *logs_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(logs_view));
     gtk_container_add(GTK_CONTAINER(logs_scroll), logs_view);
     
@@ -456,6 +754,11 @@ int main(int argc, char *argv[]) {
     // Start the GTK main loop
     gtk_main();
     
+    fc_metrics_stop_export();
+    fc_trace_stop();
+    fc_cache_close(converter_cache);
+    fc_arena_release(job_arena);
+    fc_context_free(converter_ctx);
     return 0;
 }
 
@@ -523,7 +826,7 @@ void on_browse_output_clicked(GtkWidget *widget, gpointer data) {
 
 // Handle conversion button clicks
 void on_convert_button_clicked(GtkWidget *widget, gpointer data) {
-    int conversion_type = (int)(long)data;
+    int conversion_type = GPOINTER_TO_INT(data);
     const char *input_file = gtk_entry_get_text(GTK_ENTRY(input_file_entry));
     const char *output_file = gtk_entry_get_text(GTK_ENTRY(output_file_entry));
     
@@ -532,34 +835,45 @@ void on_convert_button_clicked(GtkWidget *widget, gpointer data) {
         return;
     }
     
-    switch (conversion_type) {
-        case 1: // TXT to CSV
-            convert_txt_to_csv(input_file, output_file);
-            break;
-        case 2: // CSV to TXT
-            convert_csv_to_txt(input_file, output_file);
-            break;
-        case 3: // PDF to TXT
-            convert_pdf_to_txt(input_file, output_file);
-            break;
-        case 4: // TXT to PDF
-            convert_txt_to_pdf(input_file, output_file);
-            break;
-        case 5: // TXT to HTML
-            convert_txt_to_html(input_file, output_file);
-            break;
-        case 6: // HTML to TXT
-            convert_html_to_txt(input_file, output_file);
-            break;
-        case 7: // JSON to TXT
-            convert_json_to_txt(input_file, output_file);
-            break;
-        case 8: // TXT to JSON
-            convert_txt_to_json(input_file, output_file);
-            break;
-        default:
-            show_message("Invalid conversion type");
+    if (conversion_type == 0) {
+        const char *source = fc_detect_format(input_file);
+        const char *target = fc_format_for_path(output_file);
+        conversion_type = fc_find_conversion(source, target);
+        if (!conversion_type) {
+            char message[256];
+            snprintf(message, sizeof(message), "Cannot convert %s to %s",
+                     source ? source : "this input", target ? target : "this output");
+            show_message(message);
+            return;
+        }
+    }
+    
+    if (conversion_type < FC_CONVERSION_FIRST || conversion_type > FC_CONVERSION_LAST) {
+        show_message("Invalid conversion type");
+        return;
     }
+    
+    run_conversion((fc_conversion)conversion_type, input_file, output_file);
+}
+
+// Handle the chain button: run the chain in the entry on the selected files
+void on_chain_button_clicked(GtkWidget *widget, gpointer data) {
+    const char *chain_spec = gtk_entry_get_text(GTK_ENTRY(chain_entry));
+    const char *input_file = gtk_entry_get_text(GTK_ENTRY(input_file_entry));
+    const char *output_file = gtk_entry_get_text(GTK_ENTRY(output_file_entry));
+    fc_pipeline pipeline;
+    
+    if (strlen(input_file) == 0 || strlen(output_file) == 0) {
+        show_message("Please select both input and output files");
+        return;
+    }
+    
+    if (fc_pipeline_parse(chain_spec, &pipeline) != 0) {
+        show_message("Invalid conversion chain");
+        return;
+    }
+    
+    run_chain(&pipeline, input_file, output_file);
 }
 
 // Create file button handler
@@ -571,12 +885,8 @@ void on_create_file_clicked(GtkWidget *widget, gpointer data) {
         return;
     }
     
-    GtkTextIter start, end;
-    gtk_text_buffer_get_bounds(content_buffer, &start, &end);
-    char *content = gtk_text_buffer_get_text(content_buffer, &start, &end, FALSE);
-    
-    create_file(filename, content);
-    g_free(content);
+    if (refuse_partial()) return;
+    create_file(filename, content_buffer);
 }
 
 // Delete file button handler
@@ -600,11 +910,13 @@ void on_read_file_clicked(GtkWidget *widget, gpointer data) {
         return;
     }
     
-    char *content = read_file(filename);
+    int partial = 0;
+    char *content = read_file(filename, &partial);
     if (content) {
         gtk_text_buffer_set_text(content_buffer, content, -1);
-        free(content);
+        content_partial = partial;
     }
+    fc_arena_reset(job_arena);
 }
 
 // Write file button handler
@@ -616,12 +928,8 @@ void on_write_file_clicked(GtkWidget *widget, gpointer data) {
         return;
     }
     
-    GtkTextIter start, end;
-    gtk_text_buffer_get_bounds(content_buffer, &start, &end);
-    char *content = gtk_text_buffer_get_text(content_buffer, &start, &end, FALSE);
-    
-    write_file(filename, content);
-    g_free(content);
+    if (refuse_partial()) return;
+    write_file(filename, content_buffer);
 }
 
 // Modify file button handler
@@ -633,12 +941,8 @@ void on_modify_file_clicked(GtkWidget *widget, gpointer data) {
         return;
     }
     
-    GtkTextIter start, end;
-    gtk_text_buffer_get_bounds(content_buffer, &start, &end);
-    char *content = gtk_text_buffer_get_text(content_buffer, &start, &end, FALSE);
-    
-    modify_file(filename, content);
-    g_free(content);
+    if (refuse_partial()) return;
+    modify_file(filename, content_buffer);
 }
 
 // Search in file button handler
@@ -655,10 +959,15 @@ void on_search_file_clicked(GtkWidget *widget, gpointer data) {
     char *results = search_in_file(filename, search_term);
     if (results) {
         gtk_text_buffer_set_text(result_buffer, results, -1);
-        free(results);
     } else {
         gtk_text_buffer_set_text(result_buffer, "No matches found or error reading file", -1);
     }
+    fc_arena_reset(job_arena);
+}
+
+// Once the user clears a partly loaded file the buffer is theirs again
+void on_content_changed(GtkTextBuffer *buffer, gpointer data) {
+    if (gtk_text_buffer_get_char_count(buffer) == 0) content_partial = 0;
 }
 
 // View logs button handler
@@ -675,18 +984,24 @@ void on_view_logs_clicked(GtkWidget *widget, gpointer data) {
         logs_buffer = GTK_TEXT_BUFFER(data);
     }
     
-    // Read logs file and display contents
-    char *logs_content = read_file("logs.txt");
-    if (logs_content) {
-        gtk_text_buffer_set_text(logs_buffer, logs_content, -1);
-        free(logs_content);
-    } else {
-        gtk_text_buffer_set_text(logs_buffer, "No logs found", -1);
-    }
+    // Metrics summary for this session, then the logs file
+    char *summary = fc_metrics_summary();
+    gtk_text_buffer_set_text(logs_buffer, summary ? summary : "No operations recorded yet.\n", -1);
+    free(summary);
+
+    GtkTextIter end;
+    gtk_text_buffer_get_end_iter(logs_buffer, &end);
+    gtk_text_buffer_insert(logs_buffer, &end, "\n", -1);
+
+    char *logs_content = read_file("logs.txt", NULL);
+    gtk_text_buffer_insert(logs_buffer, &end, logs_content ? logs_content : "No logs found", -1);
+    fc_arena_reset(job_arena);
 }
 
 // Helper function to write to log
 void write_log(const char *message) {
+    fc_trace_span span;
+    fc_trace_begin(&span, "log");
     FILE *log = fopen("logs.txt", "a");
     if (log) {
         time_t now = time(NULL);
@@ -695,6 +1010,7 @@ void write_log(const char *message) {
         fprintf(log, "[%s] %s\n", timestamp, message);
         fclose(log);
     }
+    fc_trace_end(&span, 0);
 }
 
 // Helper function to show message in status bar
@@ -705,217 +1021,78 @@ void show_message(const char *message) {
     write_log(message);
 }
 
-// Implementation of conversion functions
-
-void convert_txt_to_csv(const char *input_file, const char *output_file) {
-    FILE *in, *out;
-    char buffer[MAX];
-    
-    in = fopen(input_file, "r");
-    out = fopen(output_file, "w");
-    
-    if (!in || !out) {
-        show_message("File error. Check paths.");
-        write_log("Error in TXT to CSV conversion.");
-        return;
-    }
-    
-    while (fgets(buffer, MAX, in)) {
-        for (int i = 0; buffer[i]; i++) {
-            if (buffer[i] == ' ') buffer[i] = ',';
-        }
-        fprintf(out, "%s", buffer);
-    }
-    
-    fclose(in);
-    fclose(out);
-    show_message("TXT to CSV conversion complete.");
-    write_log("TXT to CSV conversion successful.");
-}
-
-void convert_csv_to_txt(const char *input_file, const char *output_file) {
-    FILE *in, *out;
-    char buffer[MAX];
-    
-    in = fopen(input_file, "r");
-    out = fopen(output_file, "w");
-    
-    if (!in || !out) {
-        show_message("File error. Check paths.");
-        write_log("Error in CSV to TXT conversion.");
-        return;
-    }
-    
-    while (fgets(buffer, MAX, in)) {
-        for (int i = 0; buffer[i]; i++) {
-            if (buffer[i] == ',') buffer[i] = ' ';
-        }
-        fprintf(out, "%s", buffer);
-    }
-    
-    fclose(in);
-    fclose(out);
-    show_message("CSV to TXT conversion complete.");
-    write_log("CSV to TXT conversion successful.");
-}
+// Run a conversion through the converter library and report the result
+void run_conversion(fc_conversion type, const char *input_file, const char *output_file) {
+    const char *name = fc_conversion_name(type);
+    char message[256];
+    int cache_hit = 0, remote = 0;
+    fc_status status;
+    fc_job_reply reply;
 
-void convert_pdf_to_txt(const char *input_file, const char *output_file) {
-    char command[CMD_SIZE];
-    
-    snprintf(command, sizeof(command), "pdftotext \"%s\" \"%s\"", input_file, output_file);
-    
-    if (system(command) == 0) {
-        show_message("PDF to TXT conversion successful.");
-        write_log("PDF to TXT conversion successful.");
+    // Hand the job to a running daemon if one is configured and reachable.
+    // A button click is interactive: it can run on the daemon's reserved
+    // worker instead of queueing behind bulk submissions.
+    // FC_INCREMENTAL=1 converts only what was appended since the last run
+    const char *socket_path = getenv("FC_DAEMON_SOCKET");
+    const char *incremental = getenv("FC_INCREMENTAL");
+    if (socket_path &&
+        fc_daemon_submit(socket_path, type, FC_PRIORITY_INTERACTIVE, input_file, output_file, &reply) == 0) {
+        status = (fc_status)reply.status;
+        remote = 1;
+    } else if (incremental && strcmp(incremental, "1") == 0) {
+        status = fc_convert_file_incremental(converter_ctx, type, input_file, output_file, NULL);
     } else {
-        show_message("Conversion failed. Make sure `pdftotext` is installed.");
-        write_log("PDF to TXT conversion failed.");
-    }
-}
-
-void convert_txt_to_pdf(const char *input_file, const char *output_file) {
-    FILE *file = fopen(input_file, "r");
-    if (!file) {
-        show_message("Failed to open input file.");
-        write_log("TXT to PDF conversion failed: Input file not found.");
-        return;
+        status = fc_cache_convert_file(converter_cache, converter_ctx, type, input_file, output_file, &cache_hit);
     }
 
-    cairo_surface_t *surface = cairo_pdf_surface_create(output_file, 595, 842); // A4
-    cairo_t *cr = cairo_create(surface);
-
-    PangoLayout *layout = pango_cairo_create_layout(cr);
-    PangoFontDescription *font = pango_font_description_from_string("Monospace 12");
-    pango_layout_set_font_description(layout, font);
-
-    char line[1024];
-    int y = 20;
-
-    while (fgets(line, sizeof(line), file)) {
-        cairo_move_to(cr, 40, y);
-        pango_layout_set_text(layout, line, -1);
-        pango_cairo_show_layout(cr, layout);
-        y += 18;
-
-        if (y > 800) {
-            cairo_show_page(cr);
-            y = 20;
+    if (status == FC_OK) {
+        snprintf(message, sizeof(message), "%s conversion complete%s.", name, cache_hit ? " (cached)" : "");
+        show_message(message);
+        snprintf(message, sizeof(message), "%s conversion successful.", name);
+        write_log(message);
+        if (converter_cache) {
+            fc_cache_stats stats;
+            fc_cache_get_stats(converter_cache, &stats);
+            snprintf(message, sizeof(message), "Cache %s for %s conversion (hits: %llu, misses: %llu).",
+                     cache_hit ? "hit" : "miss", name,
+                     (unsigned long long)stats.hits, (unsigned long long)stats.misses);
+            write_log(message);
+        }
+    } else if (status == FC_ERR_TOOL) {
+        const char *errors = remote ? "" : fc_tool_errors(converter_ctx);
+        if (errors[0]) {
+            snprintf(message, sizeof(message), "Conversion failed: %s", errors);
+        } else {
+            snprintf(message, sizeof(message), "Conversion failed. Make sure `%s` is installed.",
+                     fc_converter(type)->tool);
         }
+        show_message(message);
+        snprintf(message, sizeof(message), "%s conversion failed%s%s", name, errors[0] ? ": " : ".", errors);
+        write_log(message);
+    } else {
+        show_message(status == FC_ERR_INPUT || status == FC_ERR_OUTPUT ? "File error. Check paths."
+                                                                       : fc_status_message(status));
+        snprintf(message, sizeof(message), "Error in %s conversion.", name);
+        write_log(message);
     }
-
-    fclose(file);
-    pango_font_description_free(font);
-    g_object_unref(layout);
-    cairo_destroy(cr);
-    cairo_surface_destroy(surface);
-
-    show_message("TXT to PDF conversion successful.");
-    write_log("TXT to PDF conversion successful.");
 }
 
-void convert_txt_to_html(const char *input_file, const char *output_file) {
-    FILE *in, *out;
-    char buffer[MAX];
-    
-    in = fopen(input_file, "r");
-    out = fopen(output_file, "w");
-    
-    if (!in || !out) {
-        show_message("File error. Check paths.");
-        write_log("Error in TXT to HTML conversion.");
-        return;
-    }
-    
-    fprintf(out, "<html><body><pre>\n");
-    while (fgets(buffer, MAX, in)) {
-        fprintf(out, "%s", buffer);
-    }
-    fprintf(out, "</pre></body></html>\n");
-    
-    fclose(in);
-    fclose(out);
-    show_message("TXT to HTML conversion complete.");
-    write_log("TXT to HTML conversion successful.");
-}
+// Run a conversion chain through the pipeline and report the result
+void run_chain(const fc_pipeline *pipeline, const char *input_file, const char *output_file) {
+    char name[128], message[256];
+    fc_pipeline_name(pipeline, name, sizeof(name));
 
-void convert_html_to_txt(const char *input_file, const char *output_file) {
-    FILE *in, *out;
-    int ch;
-    int insideTag = 0;
-    
-    in = fopen(input_file, "r");
-    out = fopen(output_file, "w");
-    
-    if (!in || !out) {
-        show_message("File error. Check paths.");
-        write_log("Error in HTML to TXT conversion.");
-        return;
-    }
-    
-    while ((ch = fgetc(in)) != EOF) {
-        if (ch == '<') {
-            insideTag = 1;
-        } else if (ch == '>') {
-            insideTag = 0;
-        } else if (!insideTag) {
-            fputc(ch, out);
-        }
-    }
-    
-    fclose(in);
-    fclose(out);
-    show_message("HTML to TXT conversion complete.");
-    write_log("HTML to TXT conversion successful.");
-}
+    fc_status status = fc_pipeline_file(converter_ctx, pipeline, input_file, output_file);
 
-void convert_json_to_txt(const char *input_file, const char *output_file) {
-    FILE *in, *out;
-    char buffer[MAX];
-    
-    in = fopen(input_file, "r");
-    out = fopen(output_file, "w");
-    
-    if (!in || !out) {
-        show_message("File error. Check paths.");
-        write_log("Error in JSON to TXT conversion.");
-        return;
-    }
-    
-    while (fgets(buffer, MAX, in)) {
-        fprintf(out, "%s", buffer);
+    if (status == FC_OK) {
+        snprintf(message, sizeof(message), "%s conversion complete.", name);
+        show_message(message);
+        snprintf(message, sizeof(message), "%s conversion successful.", name);
+        write_log(message);
+    } else {
+        show_message(status == FC_ERR_INPUT || status == FC_ERR_OUTPUT ? "File error. Check paths."
+                                                                       : fc_status_message(status));
+        snprintf(message, sizeof(message), "Error in %s conversion.", name);
+        write_log(message);
     }
-    
-    fclose(in);
-    fclose(out);
-    show_message("JSON to TXT conversion complete.");
-    write_log("JSON to TXT conversion successful.");
 }
-
-void convert_txt_to_json(const char *input_file, const char *output_file) {
-    FILE *in, *out;
-    char buffer[MAX];
-    
-    in = fopen(input_file, "r");
-    out = fopen(output_file, "w");
-    
-    if (!in || !out) {
-        show_message("File error. Check paths.");
-        write_log("Error in TXT to JSON conversion.");
-        return;
-    }
-    
-    fprintf(out, "[\n");
-    int first = 1;
-    while (fgets(buffer, MAX, in)) {
-        buffer[strcspn(buffer, "\n")] = 0;
-        if (!first) fprintf(out, ",\n");
-        fprintf(out, "  \"%s\"", buffer);
-        first = 0;
-    }
-    fprintf(out, "\n]\n");
-    
-    fclose(in);
-    fclose(out);
-    show_message("TXT to JSON conversion complete.");
-    write_log("TXT to JSON conversion successful.");
-}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_SSE2_PATH 1
+#endif
+
+#include "html.h"
+
+const char *fc_html_entity(char c) {
+    switch (c) {
+        case '<': return "&lt;";
+        case '>': return "&gt;";
+        case '&': return "&amp;";
+        default:  return NULL;
+    }
+}
+
+static size_t plain_scalar_prefix(const char *s, size_t len) {
+    size_t i = 0;
+    while (i < len && s[i] != '<' && s[i] != '>' && s[i] != '&') i++;
+    return i;
+}
+
+#ifdef HAVE_SSE2_PATH
+__attribute__((target("sse2")))
+static size_t plain_simd_prefix(const char *s, size_t len) {
+    const __m128i lt = _mm_set1_epi8('<'), gt = _mm_set1_epi8('>'), amp = _mm_set1_epi8('&');
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, gt)),
+                                   _mm_cmpeq_epi8(v, amp));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i;
+}
+#endif
+
+size_t fc_html_plain_prefix(const char *s, size_t len) {
+    size_t i = 0;
+#ifdef HAVE_SSE2_PATH
+    static int have_sse2 = -1;
+    if (have_sse2 < 0) have_sse2 = __builtin_cpu_supports("sse2");
+    if (have_sse2) {
+        i = plain_simd_prefix(s, len);
+        if (i + 16 <= len) return i;
+    }
+#endif
+    return i + plain_scalar_prefix(s + i, len - i);
+}
+
+int fc_html_write_escaped(FILE *out, const char *s, size_t len) {
+    while (len) {
+        size_t plain = fc_html_plain_prefix(s, len);
+        if (plain && fwrite(s, 1, plain, out) != plain) return -1;
+        if (plain == len) break;
+        if (fputs(fc_html_entity(s[plain]), out) < 0) return -1;
+        s += plain + 1;
+        len -= plain + 1;
+    }
+    return 0;
+}
+
+int fc_html_write_href(FILE *out, const char *s) {
+    for (; *s; s++) {
+        unsigned char c = *s;
+        int keep = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                   strchr("-._~/", c) != NULL;
+        if ((keep ? fputc(c, out) : fprintf(out, "%%%02X", c)) < 0) return -1;
+    }
+    return 0;
+}
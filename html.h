@@ -0,0 +1,25 @@
+#ifndef HTML_H
+#define HTML_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// HTML escaping for TXT to HTML. Only '<', '>' and '&' change inside <pre>;
+// runs of text without them, the bulk of any log, are found 16 bytes at a
+// time (SSE2 where the CPU has it) and written out as they are.
+
+// Length of the longest prefix of s with nothing to escape. Equal to len
+// when s is clean throughout.
+size_t fc_html_plain_prefix(const char *s, size_t len);
+
+// "&lt;" for '<' and so on; NULL for a byte that stays as it is.
+const char *fc_html_entity(char c);
+
+// Write s to out, escaped. Returns 0, or -1 if a write failed.
+int fc_html_write_escaped(FILE *out, const char *s, size_t len);
+
+// Write s escaped for a double-quoted href: percent-encoded except for
+// unreserved characters and '/'.
+int fc_html_write_href(FILE *out, const char *s);
+
+#endif
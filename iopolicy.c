@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "iopolicy.h"
+
+#define IO_ALIGN 4096                   // O_DIRECT offsets, lengths and buffers
+#define IO_MIN_BUFFER 65536
+#define IO_LARGE_BUFFER (1 << 20)
+#define IO_DIRECT_BUFFER (4 << 20)
+
+static int policy = FC_IO_DROP_BEHIND;
+static fc_io_stats stats;
+
+static void count(uint64_t *counter, uint64_t n) {
+    __atomic_add_fetch(counter, n, __ATOMIC_RELAXED);
+}
+
+void fc_io_set_policy(int flags) {
+    __atomic_store_n(&policy, flags, __ATOMIC_RELAXED);
+}
+
+int fc_io_policy(void) {
+    return __atomic_load_n(&policy, __ATOMIC_RELAXED);
+}
+
+int fc_io_policy_parse(const char *name) {
+    if (!name || !*name) return -1;
+    if (strcmp(name, "cache") == 0) return 0;
+    int flags = 0;
+    const char *p = name;
+    while (*p) {
+        size_t len = strcspn(p, ",");
+        if (len == 4 && strncmp(p, "drop", 4) == 0) flags |= FC_IO_DROP_BEHIND;
+        else if (len == 6 && strncmp(p, "direct", 6) == 0) flags |= FC_IO_DIRECT;
+        else return -1;
+        p += len;
+        if (*p == ',') p++;
+    }
+    return flags;
+}
+
+int fc_io_set_policy_env(void) {
+    const char *value = getenv("FC_IO_POLICY");
+    if (!value || !*value) return 0;
+    int flags = fc_io_policy_parse(value);
+    if (flags < 0) return -1;
+    fc_io_set_policy(flags);
+    return 0;
+}
+
+void fc_io_get_stats(fc_io_stats *out) {
+    out->readahead_bytes = __atomic_load_n(&stats.readahead_bytes, __ATOMIC_RELAXED);
+    out->dropped_bytes = __atomic_load_n(&stats.dropped_bytes, __ATOMIC_RELAXED);
+    out->direct_bytes = __atomic_load_n(&stats.direct_bytes, __ATOMIC_RELAXED);
+}
+
+size_t fc_io_buffer_size(const struct stat *st) {
+    size_t block = st && st->st_blksize > 0 ? (size_t)st->st_blksize : IO_ALIGN;
+    int regular = st && S_ISREG(st->st_mode);
+    size_t want = regular && st->st_size >= FC_IO_DROP_MIN ? IO_LARGE_BUFFER : IO_MIN_BUFFER;
+    if (regular && st->st_size > 0 && (unsigned long long)st->st_size < want) want = st->st_size;
+    return (want + block - 1) / block * block;
+}
+
+static void drop_range(int fd, off_t offset, off_t len) {
+    if (len <= 0) return;
+    if (posix_fadvise(fd, offset, len, POSIX_FADV_DONTNEED) == 0) count(&stats.dropped_bytes, len);
+}
+
+void fc_io_drop(int fd, off_t offset, off_t len) {
+    if (fc_io_policy()) drop_range(fd, offset, len);
+}
+
+// Scans
+
+void fc_io_scan_begin(fc_io_scan *scan, int fd, const struct stat *st) {
+    memset(scan, 0, sizeof(*scan));
+    scan->fd = fd;
+    scan->size = st->st_size;
+    scan->advise = S_ISREG(st->st_mode) && st->st_size > 0;
+    scan->drop = scan->advise && (fc_io_policy() & FC_IO_DROP_BEHIND) && st->st_size >= FC_IO_DROP_MIN;
+    // Doubles the kernel's own readahead for this file
+    if (scan->advise) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+void fc_io_scan_advance(fc_io_scan *scan, off_t pos) {
+    if (pos > scan->high) scan->high = pos;
+
+    // Keep the next window on its way once half of the current one is read
+    if (scan->advise && scan->advised < scan->size && pos + FC_IO_WINDOW / 2 >= scan->advised) {
+        off_t from = pos > scan->advised ? pos : scan->advised;
+        off_t len = scan->size - from < FC_IO_WINDOW ? scan->size - from : FC_IO_WINDOW;
+#ifdef __linux__
+        int rc = readahead(scan->fd, from, len);
+#else
+        int rc = posix_fadvise(scan->fd, from, len, POSIX_FADV_WILLNEED);
+#endif
+        if (rc == 0) count(&stats.readahead_bytes, len);
+        scan->advised = from + len;
+    }
+
+    if (scan->drop && pos - scan->dropped >= FC_IO_WINDOW) {
+        off_t end = pos & ~(off_t)(IO_ALIGN - 1);
+        drop_range(scan->fd, scan->dropped, end - scan->dropped);
+        scan->dropped = end;
+    }
+}
+
+// Drops what was read, and what was read ahead for a scan that stopped early
+void fc_io_scan_end(fc_io_scan *scan) {
+    if (!scan->drop) return;
+    off_t end = scan->high > scan->advised ? scan->high : scan->advised;
+    if (end > scan->size) end = scan->size;
+    drop_range(scan->fd, scan->dropped, end - scan->dropped);
+    scan->dropped = end;
+}
+
+// Writeback. Dirty pages cannot be dropped, so each window is written back
+// one window behind the writer and only then dropped: the wait is for I/O
+// started a window earlier, which has usually finished by then.
+
+void fc_io_writeback_begin(fc_io_writeback *wb, int fd) {
+    memset(wb, 0, sizeof(*wb));
+    wb->fd = fd;
+    struct stat st;
+    wb->drop = (fc_io_policy() & FC_IO_DROP_BEHIND) && fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+void fc_io_writeback_advance(fc_io_writeback *wb, off_t pos) {
+    if (pos > wb->written) wb->written = pos;
+    if (!wb->drop || pos < FC_IO_DROP_MIN || pos - wb->flushing < FC_IO_WINDOW) return;
+#ifdef __linux__
+    sync_file_range(wb->fd, wb->flushing, pos - wb->flushing, SYNC_FILE_RANGE_WRITE);
+    if (wb->flushed < wb->flushing) {
+        sync_file_range(wb->fd, wb->flushed, wb->flushing - wb->flushed,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        drop_range(wb->fd, wb->flushed, wb->flushing - wb->flushed);
+        wb->flushed = wb->flushing;
+    }
+#endif
+    wb->flushing = pos;
+}
+
+// Starts writeback of the rest without waiting for it; pages still dirty
+// after that are left to the kernel
+void fc_io_writeback_end(fc_io_writeback *wb) {
+    if (!wb->drop || wb->written < FC_IO_DROP_MIN) return;
+#ifdef __linux__
+    if (wb->flushing < wb->written) {
+        sync_file_range(wb->fd, wb->flushing, wb->written - wb->flushing, SYNC_FILE_RANGE_WRITE);
+    }
+#endif
+    drop_range(wb->fd, wb->flushed, wb->written - wb->flushed);
+    wb->flushed = wb->flushing = wb->written;
+}
+
+// Read streams
+
+typedef struct {
+    fc_io_scan scan;
+    off_t pos;
+    char *direct;           // aligned bounce buffer while reading with O_DIRECT
+    off_t direct_offset;    // file offset of its contents
+    size_t direct_len;
+} reader;
+
+static void start_direct(reader *r) {
+#ifdef O_DIRECT
+    int flags = fcntl(r->scan.fd, F_GETFL);
+    if (flags < 0 || posix_memalign((void **)&r->direct, IO_ALIGN, IO_DIRECT_BUFFER) != 0) {
+        r->direct = NULL;
+        return;
+    }
+    // Some filesystems (tmpfs) refuse O_DIRECT
+    if (fcntl(r->scan.fd, F_SETFL, flags | O_DIRECT) != 0) {
+        free(r->direct);
+        r->direct = NULL;
+        return;
+    }
+    r->scan.advise = r->scan.drop = 0;  // nothing goes through the cache
+#endif
+}
+
+// Back to reading through the page cache
+static void stop_direct(reader *r) {
+#ifdef O_DIRECT
+    int flags = fcntl(r->scan.fd, F_GETFL);
+    if (flags >= 0) fcntl(r->scan.fd, F_SETFL, flags & ~O_DIRECT);
+#endif
+    free(r->direct);
+    r->direct = NULL;
+    struct stat st;
+    if (fstat(r->scan.fd, &st) == 0) fc_io_scan_begin(&r->scan, r->scan.fd, &st);
+}
+
+// Whole aligned blocks into the bounce buffer, copied out from there
+static ssize_t direct_read(reader *r, char *buf, size_t size) {
+    if (r->pos < r->direct_offset || r->pos >= r->direct_offset + (off_t)r->direct_len) {
+        off_t offset = r->pos & ~(off_t)(IO_ALIGN - 1);
+        ssize_t n;
+        do {
+            n = pread(r->scan.fd, r->direct, IO_DIRECT_BUFFER, offset);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) return -1;
+        count(&stats.direct_bytes, n);
+        r->direct_offset = offset;
+        r->direct_len = n;
+        if (r->pos >= offset + n) return 0;
+    }
+    size_t available = r->direct_offset + r->direct_len - r->pos;
+    if (size > available) size = available;
+    memcpy(buf, r->direct + (r->pos - r->direct_offset), size);
+    r->pos += size;
+    return size;
+}
+
+static ssize_t reader_read(void *cookie, char *buf, size_t size) {
+    reader *r = cookie;
+    if (r->direct) {
+        ssize_t n = direct_read(r, buf, size);
+        if (n >= 0 || errno != EINVAL) return n;
+        stop_direct(r);
+    }
+    ssize_t n;
+    do {
+        n = pread(r->scan.fd, buf, size, r->pos);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) {
+        r->pos += n;
+        fc_io_scan_advance(&r->scan, r->pos);
+    }
+    return n;
+}
+
+static int reader_seek(void *cookie, off64_t *offset, int whence) {
+    reader *r = cookie;
+    off_t pos = whence == SEEK_SET ? *offset : whence == SEEK_CUR ? r->pos + *offset : r->scan.size + *offset;
+    if (pos < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    r->pos = pos;
+    *offset = pos;
+    return 0;
+}
+
+static int reader_close(void *cookie) {
+    reader *r = cookie;
+    fc_io_scan_end(&r->scan);
+    int rc = close(r->scan.fd);
+    free(r->direct);
+    free(r);
+    return rc;
+}
+
+FILE *fc_io_open_read(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    // Pipes and devices cannot be advised or read at an offset
+    FILE *f;
+    if (!S_ISREG(st.st_mode)) {
+        f = fdopen(fd, "r");
+        if (!f) close(fd);
+        return f;
+    }
+
+    reader *r = calloc(1, sizeof(*r));
+    if (!r) {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    fc_io_scan_begin(&r->scan, fd, &st);
+    if ((fc_io_policy() & FC_IO_DIRECT) && st.st_size >= FC_IO_DIRECT_MIN) start_direct(r);
+    if (!r->direct) fc_io_scan_advance(&r->scan, 0);
+
+    cookie_io_functions_t io = { reader_read, NULL, reader_seek, reader_close };
+    f = fopencookie(r, "r", io);
+    if (!f) {
+        close(fd);
+        free(r->direct);
+        free(r);
+        return NULL;
+    }
+    setvbuf(f, NULL, _IOFBF, fc_io_buffer_size(&st));
+    return f;
+}
+
+// Write streams
+
+typedef struct {
+    fc_io_writeback wb;
+    off_t pos;
+} writer;
+
+static ssize_t writer_write(void *cookie, const char *buf, size_t size) {
+    writer *w = cookie;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write(w->wb.fd, buf + done, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+    w->pos += done;
+    fc_io_writeback_advance(&w->wb, w->pos);
+    return done;
+}
+
+static int writer_seek(void *cookie, off64_t *offset, int whence) {
+    writer *w = cookie;
+    off_t pos = lseek(w->wb.fd, *offset, whence);
+    if (pos < 0) return -1;
+    w->pos = pos;
+    *offset = pos;
+    return 0;
+}
+
+static int writer_close(void *cookie) {
+    writer *w = cookie;
+    fc_io_writeback_end(&w->wb);
+    int rc = close(w->wb.fd);
+    free(w);
+    return rc;
+}
+
+FILE *fc_io_open_write(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) return NULL;
+    struct stat st;
+    FILE *f;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        f = fdopen(fd, "w");
+        if (!f) close(fd);
+        return f;
+    }
+
+    writer *w = calloc(1, sizeof(*w));
+    if (!w) {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    fc_io_writeback_begin(&w->wb, fd);
+    cookie_io_functions_t io = { NULL, writer_write, writer_seek, writer_close };
+    f = fopencookie(w, "w", io);
+    if (!f) {
+        close(fd);
+        free(w);
+        return NULL;
+    }
+    setvbuf(f, NULL, _IOFBF, fc_io_buffer_size(&st));
+    return f;
+}
@@ -0,0 +1,96 @@
+#ifndef IOPOLICY_H
+#define IOPOLICY_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// I/O policy for whole-file scans.
+//
+// A conversion reads its input once, front to back, and writes its output
+// once. Left to defaults both stay in the page cache afterwards and push out
+// pages other programs on the machine still need. Streams opened here tell
+// the kernel the access pattern instead: the input is read ahead a window at
+// a time and, for large files, the pages behind the cursor are dropped once
+// consumed; output pages are written back a window behind the writer and
+// then dropped too. Buffers are sized from the file's st_blksize and size.
+//
+// Files smaller than FC_IO_DROP_MIN keep their pages. Large inputs lose
+// theirs even if something else had them cached; use the cache policy where
+// that matters.
+
+#define FC_IO_DROP_BEHIND 0x1   // drop pages of large files once read or written
+#define FC_IO_DIRECT 0x2        // read files of FC_IO_DIRECT_MIN and up with O_DIRECT
+
+#define FC_IO_WINDOW (8 << 20)              // readahead and writeback step
+#define FC_IO_DROP_MIN (16 << 20)
+#define FC_IO_DIRECT_MIN (1LL << 30)
+
+// Set the process-wide policy (FC_IO_DROP_BEHIND by default). Streams
+// already open keep theirs.
+void fc_io_set_policy(int flags);
+int fc_io_policy(void);
+
+// "cache" (0), "drop", "direct" or "drop,direct". -1 if name is none of them.
+int fc_io_policy_parse(const char *name);
+
+// Set the policy from FC_IO_POLICY. Returns -1 if the variable is set but
+// not a valid policy.
+int fc_io_set_policy_env(void);
+
+// stdio buffer for a file: 64K, or 1 MB for files of FC_IO_DROP_MIN and
+// up, rounded up to st_blksize. A smaller file gets just enough for itself.
+size_t fc_io_buffer_size(const struct stat *st);
+
+// Sequential read stream for path. Seekable, so fc_detect_compression
+// works on it; pipes and devices get a plain stdio stream. NULL (errno set)
+// if the file cannot be opened.
+FILE *fc_io_open_read(const char *path);
+
+// Truncating write stream for path, like fopen(path, "w"). NULL (errno set)
+// if the file cannot be created.
+FILE *fc_io_open_write(const char *path);
+
+// The same for code that reads and writes descriptors itself: begin, then
+// advance to each new position, then end.
+typedef struct {
+    int fd;
+    int advise;         // a regular file, read ahead
+    int drop;           // and large enough to drop behind
+    off_t size;
+    off_t advised;      // read ahead up to here
+    off_t dropped;      // pages before here are dropped
+    off_t high;         // furthest position read
+} fc_io_scan;
+
+void fc_io_scan_begin(fc_io_scan *scan, int fd, const struct stat *st);
+void fc_io_scan_advance(fc_io_scan *scan, off_t pos);
+void fc_io_scan_end(fc_io_scan *scan);
+
+typedef struct {
+    int fd;
+    int drop;
+    off_t flushed;      // written back and dropped up to here
+    off_t flushing;     // writeback started up to here
+    off_t written;
+} fc_io_writeback;
+
+void fc_io_writeback_begin(fc_io_writeback *wb, int fd);
+void fc_io_writeback_advance(fc_io_writeback *wb, off_t pos);
+void fc_io_writeback_end(fc_io_writeback *wb);
+
+// Drop the cached pages of [offset, offset + len) of fd, unless the policy
+// is to cache. Dirty pages stay until written back.
+void fc_io_drop(int fd, off_t offset, off_t len);
+
+typedef struct {
+    uint64_t readahead_bytes;   // asked to be read ahead
+    uint64_t dropped_bytes;     // asked to be dropped from the page cache
+    uint64_t direct_bytes;      // read with O_DIRECT
+} fc_io_stats;
+
+void fc_io_get_stats(fc_io_stats *stats);
+
+#endif
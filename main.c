@@ -1,7 +1,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#include "converter.h"
+#include "daemon.h"
+#include "batch.h"
+#include "pipeline.h"
+#include "cache.h"
+#include "watch.h"
+#include "metrics.h"
+#include "budget.h"
+#include "iopolicy.h"
+#include "trace.h"
+#include "threadpool.h"
+#include <ctype.h>
+#include <time.h>
 #define CMD_SIZE 1024
 
 #define MAX 256
@@ -10,17 +24,23 @@
 // Function declarations
 void showMenu();
 void convertMenu();
-void convertTXTtoCSV();
-void convertCSVtoTXT();
-void convertPDFtoTXT();
-void convertTXTtoPDF();
-void convertTXTtoHTML();     
-void convertHTMLtoTXT();     
-void convertJSONtoTXT();    
-void convertTXTtoJSON();     
+void convertFile(fc_conversion type);
+void convertChain();
+fc_conversion resolveType(const char *typeSpec, const char *inputFile);
+int runDaemon(const char *socketPath, int threads);
+int submitJob(const char *socketPath, const char *typeSpec, const char *inputFile, const char *outputFile);
+int batchConvert(const char *typeSpec, const char *outputDir, int fileCount, char **files);
+int incrementalConvert(const char *typeSpec, const char *inputFile, const char *outputFile);
+int checkpointConvert(const char *typeSpec, const char *inputFile, const char *outputFile, int resume);
+int chainConvert(const char *chainSpec, const char *inputFile, const char *outputFile);
+int watchFolder(const char *inputDir, const char *outputDir, int ruleCount, char **ruleSpecs);
 
 void viewLogs();
 void writeLog(const char *message);
+void startMetrics();
+void startTracing();
+void configureContext(fc_context *ctx);
+void stopTracing();
 
 void createFile(const char *filename);
 void deleteFile(const char *filename);
@@ -29,10 +49,81 @@ void writeFile(const char *filename);
 void modifyFile(const char *filename);
 void searchInFile(const char *filename, const char *word);
 
-int main() {
+// Conversion cache, enabled by setting FC_CACHE_DIR
+fc_cache *conversionCache;
+
+int main(int argc, char *argv[]) {
     int choice;
     char filename[MAX], word[MAX];
 
+    // Memory budget from FC_MAX_MEMORY, or --max-memory ahead of the mode
+    if (fc_budget_set_env() != 0) {
+        printf("Ignoring invalid FC_MAX_MEMORY.\n");
+    }
+    if (argc >= 3 && strcmp(argv[1], "--max-memory") == 0) {
+        uint64_t budget = fc_parse_size(argv[2]);
+        if (!budget) {
+            printf("Invalid memory size '%s'.\n", argv[2]);
+            return 2;
+        }
+        fc_budget_set(budget);
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+
+    // Page cache use of large scans, FC_IO_POLICY=cache|drop|direct
+    if (fc_io_set_policy_env() != 0) {
+        printf("Ignoring invalid FC_IO_POLICY.\n");
+    }
+
+    // Daemon, batch and watch workers get the same settings as the contexts
+    // made here
+    fc_set_worker_setup(configureContext);
+
+    // A --submit client only talks to the daemon, which exports its own
+    if (!(argc == 6 && strcmp(argv[1], "--submit") == 0)) startMetrics();
+    startTracing();
+
+    // Non-interactive modes
+    if (argc >= 3 && strcmp(argv[1], "--daemon") == 0) {
+        return runDaemon(argv[2], argc >= 4 ? atoi(argv[3]) : 0);
+    }
+    if (argc == 6 && strcmp(argv[1], "--submit") == 0) {
+        return submitJob(argv[2], argv[3], argv[4], argv[5]);
+    }
+    if (argc >= 5 && strcmp(argv[1], "--batch") == 0) {
+        return batchConvert(argv[2], argv[3], argc - 4, argv + 4);
+    }
+    if (argc == 5 && strcmp(argv[1], "--incremental") == 0) {
+        return incrementalConvert(argv[2], argv[3], argv[4]);
+    }
+    if (argc == 5 && (strcmp(argv[1], "--checkpoint") == 0 || strcmp(argv[1], "--resume") == 0)) {
+        return checkpointConvert(argv[2], argv[3], argv[4], strcmp(argv[1], "--resume") == 0);
+    }
+    if (argc == 5 && strcmp(argv[1], "--chain") == 0) {
+        return chainConvert(argv[2], argv[3], argv[4]);
+    }
+    if (argc >= 4 && strcmp(argv[1], "--watch") == 0) {
+        return watchFolder(argv[2], argv[3], argc - 4, argv + 4);
+    }
+    if (argc > 1) {
+        printf("Usage: %s\n", argv[0]);
+        printf("       %s --daemon SOCKET [THREADS]\n", argv[0]);
+        printf("       %s --submit SOCKET TYPE INPUT OUTPUT   (TYPE: 1-13, e.g. txt:csv, or auto:txt)\n", argv[0]);
+        printf("       %s --batch TYPE OUTDIR FILE...          (FC_IO_BACKEND=auto|uring|threads)\n", argv[0]);
+        printf("       %s --incremental TYPE INPUT OUTPUT      (convert only what was appended)\n", argv[0]);
+        printf("       %s --checkpoint TYPE INPUT OUTPUT       (large files; FC_CHECKPOINT_INTERVAL=64M)\n", argv[0]);
+        printf("       %s --resume TYPE INPUT OUTPUT           (continue an interrupted --checkpoint run)\n", argv[0]);
+        printf("       %s --chain CHAIN INPUT OUTPUT          (CHAIN: e.g. html:txt:json, no intermediate files)\n", argv[0]);
+        printf("       %s --watch INDIR OUTDIR [TYPE...]       (default: html, json, csv, pdf to txt)\n", argv[0]);
+        printf("Any of these may start with --max-memory SIZE (e.g. 2G, or set FC_MAX_MEMORY).\n");
+        printf("FC_IO_POLICY=drop (default), cache, direct or drop,direct sets how large files use the page cache.\n");
+        return 2;
+    }
+
+    conversionCache = fc_cache_open_env();
+
     while (1) {
         showMenu();
         scanf("%d", &choice);
@@ -48,6 +139,7 @@ int main() {
             case 3:
                 printf("Exiting...\n");
                 writeLog("Program exited.");
+                fc_cache_close(conversionCache);
                 return 0;
             case 4:
                 printf("Enter filename to create: ");
@@ -109,318 +201,488 @@ void showMenu() {
     printf("Enter your choice: ");
 }
 
-// Conversion sub-menu
+// Conversion sub-menu, one entry per registered converter
 void convertMenu() {
     int opt;
     printf("\n-- File Conversion Options --\n");
-    printf("1. TXT to CSV\n");
-    printf("2. CSV to TXT\n");
-    printf("3. PDF to TXT (requires `pdftotext`)\n");
-    printf("4. TXT to PDF (requires `txt2pdf`)\n");
-    printf("5. TXT to HTML\n");
-    printf("6. HTML to TXT\n");
-    printf("7. JSON to TXT\n");
-    printf("8. TXT to JSON\n");
+    for (int type = FC_CONVERSION_FIRST; type <= FC_CONVERSION_LAST; type++) {
+        const fc_converter_info *info = fc_converter((fc_conversion)type);
+        if (info->tool) {
+            printf("%d. %s (requires `%s`)\n", type, info->name, info->tool);
+        } else {
+            printf("%d. %s\n", type, info->name);
+        }
+    }
+    printf("%d. Auto-detect (input format from its content, output from its name)\n", FC_CONVERSION_LAST + 1);
+    printf("%d. Chain of conversions (e.g. html:txt:json)\n", FC_CONVERSION_LAST + 2);
     printf("Enter your choice: ");
     scanf("%d", &opt);
     getchar();
 
-    switch (opt) {
-        case 1: convertTXTtoCSV(); break;
-        case 2: convertCSVtoTXT(); break;
-        case 3: convertPDFtoTXT(); break;
-        case 4: convertTXTtoPDF(); break;
-        case 5: convertTXTtoHTML(); break;
-        case 6: convertHTMLtoTXT(); break;
-        case 7: convertJSONtoTXT(); break;
-        case 8: convertTXTtoJSON(); break;
-        default: printf("Invalid conversion choice.\n");
+    if (opt >= FC_CONVERSION_FIRST && opt <= FC_CONVERSION_LAST) {
+        convertFile((fc_conversion)opt);
+    } else if (opt == FC_CONVERSION_LAST + 1) {
+        convertFile(0);
+    } else if (opt == FC_CONVERSION_LAST + 2) {
+        convertChain();
+    } else {
+        printf("Invalid conversion choice.\n");
     }
 }
 
 
-// 1. TXT to CSV
-void convertTXTtoCSV() {
-    char inputFile[MAX], outputFile[MAX], buffer[MAX];
-    FILE *in, *out;
+// Prompt for the input and output files and run the conversion. Type 0
+// picks the conversion from the input's content and the output's name.
+void convertFile(fc_conversion type) {
+    char inputFile[MAX], outputFile[MAX], message[MAX], toolErrors[MAX] = "";
 
-    printf("Enter input TXT file: ");
+    if (type) {
+        printf("Enter input %s file: ", fc_source_format(type));
+    } else {
+        printf("Enter input file: ");
+    }
     fgets(inputFile, MAX, stdin);
     inputFile[strcspn(inputFile, "\n")] = 0;
 
-    printf("Enter output CSV file: ");
+    if (type) {
+        printf("Enter output %s file: ", fc_target_format(type));
+    } else {
+        printf("Enter output file: ");
+    }
     fgets(outputFile, MAX, stdin);
     outputFile[strcspn(outputFile, "\n")] = 0;
 
-    in = fopen(inputFile, "r");
-    out = fopen(outputFile, "w");
-
-    if (!in || !out) {
-        printf("File error. Check paths.\n");
-        writeLog("Error in TXT to CSV conversion.");
-        return;
+    if (!type) {
+        const char *source = fc_detect_format(inputFile);
+        const char *target = fc_format_for_path(outputFile);
+        type = fc_find_conversion(source, target);
+        if (!type) {
+            printf("Cannot convert %s to %s.\n", source ? source : "this input", target ? target : "this output");
+            snprintf(message, sizeof(message), "Auto-detect found no conversion for %.200s.", inputFile);
+            writeLog(message);
+            return;
+        }
+        printf("Detected %s.\n", fc_conversion_name(type));
     }
-
-    while (fgets(buffer, MAX, in)) {
-        for (int i = 0; buffer[i]; i++) {
-            if (buffer[i] == ' ') buffer[i] = ',';
+    const char *name = fc_conversion_name(type);
+
+    // Hand the job to a running daemon if one is configured and reachable;
+    // someone is waiting at the menu, so it goes ahead of bulk work
+    fc_status status;
+    fc_job_reply reply;
+    int cacheHit = 0;
+    const char *socketPath = getenv("FC_DAEMON_SOCKET");
+    if (socketPath &&
+        fc_daemon_submit(socketPath, type, FC_PRIORITY_INTERACTIVE, inputFile, outputFile, &reply) == 0) {
+        status = (fc_status)reply.status;
+    } else {
+        fc_context *ctx = fc_context_new();
+        if (!ctx) {
+            printf("Memory allocation failed.\n");
+            return;
         }
-        fprintf(out, "%s", buffer);
+        configureContext(ctx);
+
+        // FC_INCREMENTAL=1 converts only what was appended since the last run
+        const char *incremental = getenv("FC_INCREMENTAL");
+        if (incremental && strcmp(incremental, "1") == 0) {
+            status = fc_convert_file_incremental(ctx, type, inputFile, outputFile, NULL);
+        } else {
+            status = fc_cache_convert_file(conversionCache, ctx, type, inputFile, outputFile, &cacheHit);
+        }
+        snprintf(toolErrors, sizeof(toolErrors), "%s", fc_tool_errors(ctx));
+        fc_context_free(ctx);
     }
 
-    fclose(in);
-    fclose(out);
-    printf("TXT to CSV conversion complete.\n");
-    writeLog("TXT to CSV conversion successful.");
-}
-
-// 2. CSV to TXT
-void convertCSVtoTXT() {
-    char inputFile[MAX], outputFile[MAX], buffer[MAX];
-    FILE *in, *out;
-
-    printf("Enter input CSV file: ");
-    fgets(inputFile, MAX, stdin);
-    inputFile[strcspn(inputFile, "\n")] = 0;
-
-    printf("Enter output TXT file: ");
-    fgets(outputFile, MAX, stdin);
-    outputFile[strcspn(outputFile, "\n")] = 0;
-
-    in = fopen(inputFile, "r");
-    out = fopen(outputFile, "w");
-
-    if (!in || !out) {
+    if (status == FC_OK) {
+        printf("%s conversion complete.\n", name);
+        snprintf(message, sizeof(message), "%s conversion successful.", name);
+    } else if (status == FC_ERR_TOOL && toolErrors[0]) {
+        printf("Conversion failed: %s\n", toolErrors);
+        snprintf(message, sizeof(message), "%s conversion failed: %.200s", name, toolErrors);
+    } else if (status == FC_ERR_TOOL) {
+        printf("Conversion failed. Make sure `%s` is installed.\n", fc_converter(type)->tool);
+        snprintf(message, sizeof(message), "%s conversion failed.", name);
+    } else if (status == FC_ERR_INPUT || status == FC_ERR_OUTPUT) {
         printf("File error. Check paths.\n");
-        writeLog("Error in CSV to TXT conversion.");
-        return;
+        snprintf(message, sizeof(message), "Error in %s conversion.", name);
+    } else {
+        printf("%s\n", fc_status_message(status));
+        snprintf(message, sizeof(message), "Error in %s conversion.", name);
     }
-
-    while (fgets(buffer, MAX, in)) {
-        for (int i = 0; buffer[i]; i++) {
-            if (buffer[i] == ',') buffer[i] = ' ';
-        }
-        fprintf(out, "%s", buffer);
+    writeLog(message);
+
+    if (conversionCache && status == FC_OK) {
+        fc_cache_stats stats;
+        fc_cache_get_stats(conversionCache, &stats);
+        snprintf(message, sizeof(message), "Cache %s for %s conversion (hits: %llu, misses: %llu).",
+                 cacheHit ? "hit" : "miss", name,
+                 (unsigned long long)stats.hits, (unsigned long long)stats.misses);
+        writeLog(message);
     }
-
-    fclose(in);
-    fclose(out);
-    printf("CSV to TXT conversion complete.\n");
-    writeLog("CSV to TXT conversion successful.");
 }
 
-// 3. PDF to TXT (requires `pdftotext`)
-void convertPDFtoTXT() {
-    char inputFile[MAX], outputFile[MAX], command[CMD_SIZE];
 
-    printf("Enter input PDF file: ");
-    fgets(inputFile, MAX, stdin);
-    inputFile[strcspn(inputFile, "\n")] = 0;
-
-    printf("Enter output TXT file: ");
-    fgets(outputFile, MAX, stdin);
-    outputFile[strcspn(outputFile, "\n")] = 0;
 
-    snprintf(command, sizeof(command), "pdftotext \"%s\" \"%s\"", inputFile, outputFile);
-
-    if (system(command) == 0) {
-        printf("PDF to TXT conversion successful.\n");
-        writeLog("PDF to TXT conversion successful.");
-    } else {
-        printf("Conversion failed. Make sure `pdftotext` is installed.\n");
-        writeLog("PDF to TXT conversion failed.");
-    }
-}
+// Prompt for a chain such as html:txt:json and run it stage by stage
+void convertChain() {
+    char chainSpec[MAX], inputFile[MAX], outputFile[MAX];
 
-// 4. TXT to PDF (requires `txt2pdf`)
-void convertTXTtoPDF() {
-    char inputFile[MAX], outputFile[MAX], command[CMD_SIZE];
+    printf("Enter chain of formats (e.g. html:txt:json): ");
+    fgets(chainSpec, MAX, stdin);
+    chainSpec[strcspn(chainSpec, "\n")] = 0;
 
-    printf("Enter input TXT file: ");
+    printf("Enter input file: ");
     fgets(inputFile, MAX, stdin);
     inputFile[strcspn(inputFile, "\n")] = 0;
 
-    printf("Enter output PDF file: ");
+    printf("Enter output file: ");
     fgets(outputFile, MAX, stdin);
     outputFile[strcspn(outputFile, "\n")] = 0;
 
-    snprintf(command, sizeof(command), "txt2pdf \"%s\" -o \"%s\"", inputFile, outputFile);
-
-    if (system(command) == 0) {
-        printf("TXT to PDF conversion successful.\n");
-        writeLog("TXT to PDF conversion successful.");
-    } else {
-        printf("Conversion failed. Ensure `txt2pdf` is installed.\n");
-        writeLog("TXT to PDF conversion failed.");
-    }
+    chainConvert(chainSpec, inputFile, outputFile);
 }
 
-void convertTXTtoHTML() {
-    char inputFile[MAX], outputFile[MAX], buffer[MAX];
-    FILE *in, *out;
-
-    printf("Enter input TXT file: ");
-    fgets(inputFile, MAX, stdin);
-    inputFile[strcspn(inputFile, "\n")] = 0;
+// A conversion given as a menu number, "txt:csv" or the like, or as
+// "auto:TARGET" to go by what inputFile turns out to be
+fc_conversion resolveType(const char *typeSpec, const char *inputFile) {
+    if (strncasecmp(typeSpec, "auto:", 5) == 0) return fc_detect_conversion(inputFile, typeSpec + 5);
+    return fc_conversion_parse(typeSpec);
+}
 
-    printf("Enter output HTML file: ");
-    fgets(outputFile, MAX, stdin);
-    outputFile[strcspn(outputFile, "\n")] = 0;
+// Daemon mode: serve conversion jobs on a Unix domain socket until stopped
+int runDaemon(const char *socketPath, int threads) {
+    if (fc_daemon_run(socketPath, threads, writeLog) != 0) {
+        perror("Cannot start daemon");
+        return 1;
+    }
+    return 0;
+}
 
-    in = fopen(inputFile, "r");
-    out = fopen(outputFile, "w");
+// Client mode: submit one job to a running daemon
+int submitJob(const char *socketPath, const char *typeSpec, const char *inputFile, const char *outputFile) {
+    fc_conversion type = resolveType(typeSpec, inputFile);
+    fc_job_reply reply;
 
-    if (!in || !out) {
-        printf("File error. Check paths.\n");
-        writeLog("Error in TXT to HTML conversion.");
-        return;
+    if (!type) {
+        printf("Unknown conversion type '%s'.\n", typeSpec);
+        return 2;
     }
-
-    fprintf(out, "<html><body><pre>\n");
-    while (fgets(buffer, MAX, in)) {
-        fprintf(out, "%s", buffer);
+    // FC_PRIORITY=interactive|normal|bulk picks the daemon's queue
+    fc_priority priority = fc_priority_parse(getenv("FC_PRIORITY"), FC_PRIORITY_NORMAL);
+    if (fc_daemon_submit(socketPath, type, priority, inputFile, outputFile, &reply) != 0) {
+        printf("Cannot reach daemon at '%s'.\n", socketPath);
+        return 3;
     }
-    fprintf(out, "</pre></body></html>\n");
-
-    fclose(in);
-    fclose(out);
-    printf("TXT to HTML conversion complete.\n");
-    writeLog("TXT to HTML conversion successful.");
+    if (reply.status != FC_OK) {
+        printf("%s conversion failed: %s\n", fc_conversion_name(type), fc_status_message((fc_status)reply.status));
+        return 1;
+    }
+    printf("%s conversion complete. (%llu bytes in, %llu bytes out, %.3f ms queued, %.3f ms run)\n",
+           fc_conversion_name(type), (unsigned long long)reply.bytes_in, (unsigned long long)reply.bytes_out,
+           reply.queue_ns / 1e6, reply.run_ns / 1e6);
+    return 0;
 }
 
-void convertHTMLtoTXT() {
-    char inputFile[MAX], outputFile[MAX], ch;
-    FILE *in, *out;
-    int insideTag = 0;
+// Incremental mode: convert only the part of INPUT appended since the last run
+int incrementalConvert(const char *typeSpec, const char *inputFile, const char *outputFile) {
+    fc_conversion type = resolveType(typeSpec, inputFile);
+    char message[MAX];
+    unsigned long long converted = 0;
 
-    printf("Enter input HTML file: ");
-    fgets(inputFile, MAX, stdin);
-    inputFile[strcspn(inputFile, "\n")] = 0;
-
-    printf("Enter output TXT file: ");
-    fgets(outputFile, MAX, stdin);
-    outputFile[strcspn(outputFile, "\n")] = 0;
+    if (!type) {
+        printf("Unknown conversion type '%s'.\n", typeSpec);
+        return 2;
+    }
+    fc_context *ctx = fc_context_new();
+    if (!ctx) {
+        printf("Memory allocation failed.\n");
+        return 1;
+    }
+    configureContext(ctx);
+    fc_status status = fc_convert_file_incremental(ctx, type, inputFile, outputFile, &converted);
+    fc_context_free(ctx);
+
+    if (status != FC_OK) {
+        printf("%s conversion failed: %s\n", fc_conversion_name(type), fc_status_message(status));
+        snprintf(message, sizeof(message), "Error in %s conversion.", fc_conversion_name(type));
+        writeLog(message);
+        return 1;
+    }
+    printf("%s conversion complete. (%llu new bytes converted)\n", fc_conversion_name(type), converted);
+    snprintf(message, sizeof(message), "%s incremental conversion successful (%llu bytes).",
+             fc_conversion_name(type), converted);
+    writeLog(message);
+    return 0;
+}
 
-    in = fopen(inputFile, "r");
-    out = fopen(outputFile, "w");
+// Checkpoint mode: convert through OUTPUT.partial with periodic checkpoints,
+// so that --resume can continue a run that was killed
+int checkpointConvert(const char *typeSpec, const char *inputFile, const char *outputFile, int resume) {
+    fc_conversion type = resolveType(typeSpec, inputFile);
+    char message[MAX];
+    unsigned long long resumedFrom = 0;
 
-    if (!in || !out) {
-        printf("File error. Check paths.\n");
-        writeLog("Error in HTML to TXT conversion.");
-        return;
+    if (!type) {
+        printf("Unknown conversion type '%s'.\n", typeSpec);
+        return 2;
     }
-
-    while ((ch = fgetc(in)) != EOF) {
-        if (ch == '<') {
-            insideTag = 1;
-        } else if (ch == '>') {
-            insideTag = 0;
-        } else if (!insideTag) {
-            fputc(ch, out);
-        }
+    fc_context *ctx = fc_context_new();
+    if (!ctx) {
+        printf("Memory allocation failed.\n");
+        return 1;
     }
-
-    fclose(in);
-    fclose(out);
-    printf("HTML to TXT conversion complete.\n");
-    writeLog("HTML to TXT conversion successful.");
+    configureContext(ctx);
+    const char *interval = getenv("FC_CHECKPOINT_INTERVAL");
+    if (interval) fc_set_checkpoint_interval(ctx, (long long)fc_parse_size(interval));
+    fc_status status = fc_convert_file_checkpointed(ctx, type, inputFile, outputFile, resume, &resumedFrom);
+    fc_context_free(ctx);
+
+    if (resume && resumedFrom == 0) printf("No usable checkpoint for '%s'; converted from the start.\n", outputFile);
+    if (status != FC_OK) {
+        printf("%s conversion failed: %s\n", fc_conversion_name(type), fc_status_message(status));
+        char checkpoint[MAX + 16];
+        snprintf(checkpoint, sizeof(checkpoint), "%s.fccheckpoint", outputFile);
+        if (access(checkpoint, F_OK) == 0) printf("Run again with --resume to continue from the last checkpoint.\n");
+        snprintf(message, sizeof(message), "Error in %s conversion.", fc_conversion_name(type));
+        writeLog(message);
+        return 1;
+    }
+    if (resumedFrom) {
+        printf("%s conversion complete. (resumed at byte %llu)\n", fc_conversion_name(type), resumedFrom);
+    } else {
+        printf("%s conversion complete.\n", fc_conversion_name(type));
+    }
+    snprintf(message, sizeof(message), "%s checkpointed conversion successful (resumed at byte %llu).",
+             fc_conversion_name(type), resumedFrom);
+    writeLog(message);
+    return 0;
 }
 
-void convertJSONtoTXT() {
-    char inputFile[MAX], outputFile[MAX], buffer[MAX];
-    FILE *in, *out;
+// Chain mode: run a multi-stage conversion with no intermediate files
+int chainConvert(const char *chainSpec, const char *inputFile, const char *outputFile) {
+    fc_pipeline pipeline;
+    char name[MAX], message[MAX];
 
-    printf("Enter input JSON file: ");
-    fgets(inputFile, MAX, stdin);
-    inputFile[strcspn(inputFile, "\n")] = 0;
+    if (fc_pipeline_parse(chainSpec, &pipeline) != 0) {
+        printf("Unknown conversion chain '%s'.\n", chainSpec);
+        return 2;
+    }
+    fc_pipeline_name(&pipeline, name, sizeof(name));
 
-    printf("Enter output TXT file: ");
-    fgets(outputFile, MAX, stdin);
-    outputFile[strcspn(outputFile, "\n")] = 0;
+    fc_context *ctx = fc_context_new();
+    if (!ctx) {
+        printf("Memory allocation failed.\n");
+        return 1;
+    }
+    configureContext(ctx);
+    fc_status status = fc_pipeline_file(ctx, &pipeline, inputFile, outputFile);
+    fc_context_free(ctx);
+
+    if (status != FC_OK) {
+        printf("%s conversion failed: %s\n", name, fc_status_message(status));
+        snprintf(message, sizeof(message), "Error in %.200s conversion.", name);
+        writeLog(message);
+        return 1;
+    }
+    printf("%s conversion complete.\n", name);
+    snprintf(message, sizeof(message), "%.200s conversion successful.", name);
+    writeLog(message);
+    return 0;
+}
 
-    in = fopen(inputFile, "r");
-    out = fopen(outputFile, "w");
+// Watch mode: convert every file dropped into inputDir until stopped
+int watchFolder(const char *inputDir, const char *outputDir, int ruleCount, char **ruleSpecs) {
+    fc_conversion rules[FC_CONVERSION_LAST];
 
-    if (!in || !out) {
-        printf("File error. Check paths.\n");
-        writeLog("Error in JSON to TXT conversion.");
-        return;
+    if (ruleCount > FC_CONVERSION_LAST) ruleCount = FC_CONVERSION_LAST;
+    for (int i = 0; i < ruleCount; i++) {
+        rules[i] = fc_conversion_parse(ruleSpecs[i]);
+        if (!rules[i]) {
+            printf("Unknown conversion type '%s'.\n", ruleSpecs[i]);
+            return 2;
+        }
     }
-
-    while (fgets(buffer, MAX, in)) {
-        fprintf(out, "%s", buffer);
+    if (fc_watch_run(inputDir, outputDir, ruleCount ? rules : NULL, ruleCount, 0, writeLog) != 0) {
+        perror("Watch failed");
+        return 1;
     }
-
-    fclose(in);
-    fclose(out);
-    printf("JSON to TXT conversion complete.\n");
-    writeLog("JSON to TXT conversion successful.");
+    return 0;
 }
 
-void convertTXTtoJSON() {
-    char inputFile[MAX], outputFile[MAX], buffer[MAX];
-    FILE *in, *out;
+// Batch mode: convert many files into outputDir through the batch I/O
+// pipeline. With "auto:TARGET" each file is converted from whatever format
+// its content shows, so one run covers a folder of mixed files.
+int batchConvert(const char *typeSpec, const char *outputDir, int fileCount, char **files) {
+    int detect = strncasecmp(typeSpec, "auto:", 5) == 0;
+    fc_conversion type = detect ? 0 : fc_conversion_parse(typeSpec);
+    const char *target = type ? fc_target_format(type) : NULL;
+    for (int t = FC_CONVERSION_FIRST; detect && !target && t <= FC_CONVERSION_LAST; t++) {
+        const char *format = fc_target_format((fc_conversion)t);
+        if (strcasecmp(format, typeSpec + 5) == 0) target = format;
+    }
+    if (!target) {
+        printf("Unknown conversion type '%s'.\n", typeSpec);
+        return 2;
+    }
+    char name[32];
+    if (type) {
+        snprintf(name, sizeof(name), "%s", fc_conversion_name(type));
+    } else {
+        snprintf(name, sizeof(name), "auto to %s", target);
+    }
 
-    printf("Enter input TXT file: ");
-    fgets(inputFile, MAX, stdin);
-    inputFile[strcspn(inputFile, "\n")] = 0;
+    // Output extension is the lower-cased target format
+    char extension[16];
+    size_t e = 0;
+    for (; target[e] && e < sizeof(extension) - 1; e++) extension[e] = tolower((unsigned char)target[e]);
+    extension[e] = 0;
+
+    fc_batch_item *items = calloc(fileCount, sizeof(fc_batch_item));
+    char **outputs = calloc(fileCount, sizeof(char *));
+    if (!items || !outputs) {
+        printf("Memory allocation failed.\n");
+        free(items);
+        free(outputs);
+        return 1;
+    }
 
-    printf("Enter output JSON file: ");
-    fgets(outputFile, MAX, stdin);
-    outputFile[strcspn(outputFile, "\n")] = 0;
+    // Files already in the target format are left alone; those with no
+    // converter to it count as failed
+    int itemCount = 0, skipped = 0, unconvertible = 0;
+    for (int f = 0; f < fileCount; f++) {
+        fc_conversion itemType = 0;
+        if (detect) {
+            const char *source = fc_detect_format(files[f]);
+            itemType = fc_find_conversion(source, target);
+            if (source && strcmp(source, target) == 0) {
+                printf("%s: already %s, skipped.\n", files[f], target);
+                skipped++;
+                continue;
+            }
+            if (!itemType) {
+                printf("%s: no conversion from %s to %s.\n", files[f], source ? source : "unknown format", target);
+                unconvertible++;
+                continue;
+            }
+        }
+        int i = itemCount++;
+        const char *base = strrchr(files[f], '/');
+        base = base ? base + 1 : files[f];
+        const char *dot = strrchr(base, '.');
+        int stem = dot && dot != base ? (int)(dot - base) : (int)strlen(base);
+
+        size_t len = strlen(outputDir) + stem + strlen(extension) + 3;
+        outputs[i] = malloc(len);
+        if (outputs[i]) snprintf(outputs[i], len, "%s/%.*s.%s", outputDir, stem, base, extension);
+        items[i].input = files[f];
+        items[i].output = outputs[i] ? outputs[i] : "";
+        items[i].type = itemType;
+    }
 
-    in = fopen(inputFile, "r");
-    out = fopen(outputFile, "w");
+    fc_batch_options options = { fc_io_backend_parse(getenv("FC_IO_BACKEND")), 0, 0 };
+    const char *backend = "none";
+    struct timespec start, end;
 
-    if (!in || !out) {
-        printf("File error. Check paths.\n");
-        writeLog("Error in TXT to JSON conversion.");
-        return;
-    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int failed = fc_batch_convert(type, items, itemCount, &options, &backend);
+    if (failed >= 0) failed += unconvertible;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
 
-    fprintf(out, "[\n");
-    int first = 1;
-    while (fgets(buffer, MAX, in)) {
-        buffer[strcspn(buffer, "\n")] = 0;
-        if (!first) fprintf(out, ",\n");
-        fprintf(out, "  \"%s\"", buffer);
-        first = 0;
+    char message[MAX];
+    if (failed < 0) {
+        printf("Cannot start batch pipeline.\n");
+        snprintf(message, sizeof(message), "Error in batch %s conversion.", name);
+    } else {
+        for (int i = 0; i < itemCount; i++) {
+            if (items[i].status != FC_OK) {
+                printf("%s: %s\n", items[i].input, fc_status_message(items[i].status));
+            }
+        }
+        printf("Batch %s: %d files, %d failed, %.3f s (%.1f files/s, %s backend).\n",
+               name, fileCount - skipped, failed, seconds,
+               seconds > 0 ? itemCount / seconds : 0.0, backend);
+        if (skipped) printf("%d files already %s.\n", skipped, target);
+        snprintf(message, sizeof(message), "Batch %s conversion: %d files, %d failed.",
+                 name, fileCount - skipped, failed);
     }
-    fprintf(out, "\n]\n");
+    writeLog(message);
 
-    fclose(in);
-    fclose(out);
-    printf("TXT to JSON conversion complete.\n");
-    writeLog("TXT to JSON conversion successful.");
+    for (int i = 0; i < itemCount; i++) free(outputs[i]);
+    free(outputs);
+    free(items);
+    return failed == 0 ? 0 : 1;
 }
 
-
-
 // Logs
 void viewLogs() {
     FILE *log = fopen("logs.txt", "r");
     char line[MAX];
     if (!log) {
         printf("No logs found.\n");
-        return;
+    } else {
+        printf("\n==== Logs ====\n");
+        while (fgets(line, sizeof(line), log)) {
+            printf("%s", line);
+        }
+        fclose(log);
     }
-    printf("\n==== Logs ====\n");
-    while (fgets(line, sizeof(line), log)) {
-        printf("%s", line);
+
+    char *summary = fc_metrics_summary();
+    if (summary) {
+        printf("\n==== Metrics (this session) ====\n%s", summary);
+        free(summary);
     }
-    fclose(log);
 }
 
 void writeLog(const char *message) {
+    fc_trace_span span;
+    fc_trace_begin(&span, "log");
     FILE *log = fopen("logs.txt", "a");
     if (log) {
         fprintf(log, "%s\n", message);
         fclose(log);
     }
+    fc_trace_end(&span, 0);
+}
+
+// Export metrics to FC_METRICS_FILE (Prometheus text format) every
+// FC_METRICS_INTERVAL seconds and once more on exit
+void startMetrics() {
+    if (fc_metrics_start_export_env() == 0) atexit(fc_metrics_stop_export);
+}
+
+// Record a Chrome trace (open it in ui.perfetto.dev) to FC_TRACE, written
+// on exit
+void stopTracing() {
+    if (fc_trace_stop() != 0) fprintf(stderr, "Could not write trace file.\n");
+}
+
+void startTracing() {
+    if (fc_trace_start_env() == 0) atexit(stopTracing);
+}
+
+// Settings from the environment, for every context a conversion runs in
+void configureContext(fc_context *ctx) {
+    // FC_COMPRESS=gzip|zstd compresses the output whatever its name
+    fc_set_output_compression(ctx, fc_compression_parse(getenv("FC_COMPRESS")));
+
+    // FC_TOOL_TIMEOUT=SECONDS limits how long pdftotext or txt2pdf may run
+    const char *toolTimeout = getenv("FC_TOOL_TIMEOUT");
+    if (toolTimeout) fc_set_tool_timeout(ctx, atoi(toolTimeout));
+
+    // FC_HTML_PAGE_LINES=N splits TXT to HTML output into pages of N lines
+    const char *pageLines = getenv("FC_HTML_PAGE_LINES");
+    if (pageLines) fc_set_html_page_lines(ctx, atol(pageLines));
 }
 
 // File Operations
+// Each file operation is a metrics scope. Writes take their content from
+// the terminal, so their duration includes typing it.
 void createFile(const char *filename) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, FC_OP_CREATE_FILE);
     FILE *file = fopen(filename, "w");
     if (file) {
         printf("File '%s' created.\n", filename);
@@ -429,87 +691,113 @@ void createFile(const char *filename) {
     } else {
         printf("Failed to create file.\n");
     }
+    fc_metrics_end(&scope, file ? FC_OK : FC_ERR_OUTPUT);
 }
 
 void deleteFile(const char *filename) {
-    if (remove(filename) == 0) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, FC_OP_DELETE_FILE);
+    int deleted = remove(filename) == 0;
+    if (deleted) {
         printf("File '%s' deleted.\n", filename);
         writeLog("File deleted.");
     } else {
         printf("Could not delete file.\n");
     }
+    fc_metrics_end(&scope, deleted ? FC_OK : FC_ERR_INPUT);
 }
 
 void readFile(const char *filename) {
-    FILE *file = fopen(filename, "r");
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, FC_OP_READ_FILE);
+    FILE *file = fc_io_open_read(filename);
     char line[MAX];
     if (!file) {
         printf("Cannot open file.\n");
+        fc_metrics_end(&scope, FC_ERR_INPUT);
         return;
     }
     printf("\n-- Content of %s --\n", filename);
+    fc_trace_span span;
+    fc_trace_begin(&span, "read file");
     while (fgets(line, MAX, file)) {
         printf("%s", line);
+        scope.bytes_in += strlen(line);
     }
+    fc_trace_end(&span, scope.bytes_in);
+    fc_status status = ferror(file) ? FC_ERR_IO : FC_OK;
     fclose(file);
+    fc_metrics_end(&scope, status);
 }
 
 void writeFile(const char *filename) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, FC_OP_WRITE_FILE);
     FILE *file = fopen(filename, "w");
     char content[MAX];
     if (!file) {
         printf("Cannot open file.\n");
+        fc_metrics_end(&scope, FC_ERR_OUTPUT);
         return;
     }
     printf("Enter content (end with '#'): \n");
     while (fgets(content, MAX, stdin)) {
         if (content[0] == '#') break;
         fputs(content, file);
+        scope.bytes_out += strlen(content);
     }
-    fclose(file);
+    fc_status status = fclose(file) == 0 ? FC_OK : FC_ERR_IO;
     printf("Content written.\n");
     writeLog("Data written to file.");
+    fc_metrics_end(&scope, status);
 }
 
 void modifyFile(const char *filename) {
+    fc_metrics_scope scope;
+    fc_metrics_begin(&scope, FC_OP_APPEND_FILE);
     FILE *file = fopen(filename, "a");
     char content[MAX];
     if (!file) {
         printf("Cannot open file.\n");
+        fc_metrics_end(&scope, FC_ERR_OUTPUT);
         return;
     }
     printf("Enter content to append (end with '#'): \n");
     while (fgets(content, MAX, stdin)) {
         if (content[0] == '#') break;
         fputs(content, file);
+        scope.bytes_out += strlen(content);
     }
-    fclose(file);
+    fc_status status = fclose(file) == 0 ? FC_OK : FC_ERR_IO;
     printf("Content appended.\n");
     writeLog("Data appended to file.");
+    fc_metrics_end(&scope, status);
 }
 
 void searchInFile(const char *filename, const char *word) {
-    FILE *file = fopen(filename, "r");
-    char line[MAX];
-    int found = 0, lineNumber = 1;
+    int found = 0;
 
-    if (!file) {
-        printf("Cannot open file.\n");
+    fc_context *ctx = fc_context_new();
+    if (!ctx) {
+        printf("Memory allocation failed.\n");
         return;
     }
+    configureContext(ctx);
+    // Matches are printed as they are found
+    fc_status status = fc_search_stream(ctx, filename, word, stdout, &found);
+    fc_context_free(ctx);
 
-    while (fgets(line, MAX, file)) {
-        if (strstr(line, word)) {
-            printf("Line %d: %s", lineNumber, line);
-            found = 1;
-        }
-        lineNumber++;
+    if (status == FC_ERR_INPUT) {
+        printf("Cannot open file.\n");
+        return;
+    } else if (status != FC_OK) {
+        printf("%s\n", fc_status_message(status));
+        return;
     }
 
-    fclose(file);
     if (!found) {
         printf("'%s' not found in the file.\n", word);
     } else {
         writeLog("Search term found in file.");
     }
-}
\ No newline at end of file
+}
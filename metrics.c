@@ -0,0 +1,519 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "metrics.h"
+#include "arena.h"
+#include "budget.h"
+#include "iopolicy.h"
+#include "scheduler.h"
+
+#define STATUS_COUNT (FC_ERR_LIMIT + 1)
+#define DEFAULT_EXPORT_INTERVAL 15
+
+static const double duration_bounds[] = { 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 30 };
+static const double size_bounds[] = { 1024, 16384, 262144, 4194304, 67108864, 1073741824 };
+static const double throughput_bounds[] = { 1e6, 1e7, 1e8, 1e9, 1e10 };
+
+#define DURATION_BUCKETS (sizeof(duration_bounds) / sizeof(duration_bounds[0]))
+#define SIZE_BUCKETS (sizeof(size_bounds) / sizeof(size_bounds[0]))
+#define THROUGHPUT_BUCKETS (sizeof(throughput_bounds) / sizeof(throughput_bounds[0]))
+
+typedef struct {
+    uint64_t count[STATUS_COUNT];
+    uint64_t bytes_in, bytes_out;
+    uint64_t wall_ns, cpu_ns, max_wall_ns;
+    uint64_t peak_buffer;
+
+    // Non-cumulative; the last slot is +Inf
+    uint64_t duration[DURATION_BUCKETS + 1];
+    uint64_t size[SIZE_BUCKETS + 1];
+    uint64_t throughput[THROUGHPUT_BUCKETS + 1];
+    uint64_t throughput_count;
+    double throughput_sum;
+} op_metrics;
+
+static op_metrics ops[FC_OP_LAST + 1];
+static pthread_mutex_t ops_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+    int64_t depth;
+    uint64_t jobs, wait_ns, max_wait_ns;
+    uint64_t wait[DURATION_BUCKETS + 1];
+} queue_metrics;
+
+static queue_metrics queues[FC_PRIORITY_LAST + 1];
+
+static __thread int scope_depth;
+static __thread uint64_t buffer_current, buffer_peak;
+static __thread uint64_t helper_cpu_ns;
+
+static const char *const op_labels[FC_OP_LAST + 1] = {
+    [FC_TXT_TO_CSV] = "txt_to_csv",   [FC_CSV_TO_TXT] = "csv_to_txt",
+    [FC_PDF_TO_TXT] = "pdf_to_txt",   [FC_TXT_TO_PDF] = "txt_to_pdf",
+    [FC_TXT_TO_HTML] = "txt_to_html", [FC_HTML_TO_TXT] = "html_to_txt",
+    [FC_JSON_TO_TXT] = "json_to_txt", [FC_TXT_TO_JSON] = "txt_to_json",
+    [FC_CSV_TO_JSON] = "csv_to_json", [FC_JSON_TO_CSV] = "json_to_csv",
+    [FC_CSV_TO_ARROW] = "csv_to_arrow", [FC_TXT_TO_ARROW] = "txt_to_arrow",
+    [FC_CSV_TO_XLSX] = "csv_to_xlsx",
+    [FC_OP_SEARCH] = "search",         [FC_OP_READ_FILE] = "read_file",
+    [FC_OP_WRITE_FILE] = "write_file", [FC_OP_APPEND_FILE] = "append_file",
+    [FC_OP_CREATE_FILE] = "create_file", [FC_OP_DELETE_FILE] = "delete_file",
+};
+
+static const char *const op_titles[FC_OP_LAST + 1 - FC_OP_SEARCH] = {
+    "Search", "Read file", "Write file", "Append file", "Create file", "Delete file"
+};
+
+static const char *const priority_labels[FC_PRIORITY_LAST + 1] = {
+    [FC_PRIORITY_INTERACTIVE] = "interactive", [FC_PRIORITY_NORMAL] = "normal", [FC_PRIORITY_BULK] = "bulk",
+};
+
+static const char *const status_labels[STATUS_COUNT] = {
+    [FC_OK] = "ok",                  [FC_ERR_INPUT] = "input_error",
+    [FC_ERR_OUTPUT] = "output_error", [FC_ERR_IO] = "io_error",
+    [FC_ERR_NOMEM] = "out_of_memory", [FC_ERR_TOOL] = "tool_error",
+    [FC_ERR_UNSUPPORTED] = "unsupported", [FC_ERR_INVALID] = "invalid",
+    [FC_ERR_FORMAT] = "format_error", [FC_ERR_LIMIT] = "limit_exceeded",
+};
+
+static uint64_t elapsed_ns(clockid_t clock, const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000ull + now.tv_nsec - start->tv_nsec;
+}
+
+static int bucket(const double *bounds, size_t count, double value) {
+    size_t i = 0;
+    while (i < count && value > bounds[i]) i++;
+    return i;
+}
+
+// Scopes
+
+void fc_metrics_begin(fc_metrics_scope *scope, int operation) {
+    scope->operation = operation;
+    scope->bytes_in = scope->bytes_out = 0;
+    scope->active = scope_depth++ == 0;
+    if (!scope->active) return;
+
+    clock_gettime(CLOCK_MONOTONIC, &scope->wall_start);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &scope->cpu_start);
+    scope->cpu_base = helper_cpu_ns;
+    scope->buffer_base = buffer_current;
+    buffer_peak = buffer_current;
+}
+
+void fc_metrics_end(fc_metrics_scope *scope, fc_status status) {
+    scope_depth--;
+    if (!scope->active || scope->operation < FC_CONVERSION_FIRST || scope->operation > FC_OP_LAST) return;
+
+    uint64_t wall = elapsed_ns(CLOCK_MONOTONIC, &scope->wall_start);
+    uint64_t cpu = elapsed_ns(CLOCK_THREAD_CPUTIME_ID, &scope->cpu_start) + helper_cpu_ns - scope->cpu_base;
+    uint64_t peak = buffer_peak - scope->buffer_base;
+    double seconds = wall / 1e9;
+    if ((unsigned)status >= STATUS_COUNT) status = FC_ERR_INVALID;
+
+    pthread_mutex_lock(&ops_lock);
+    op_metrics *m = &ops[scope->operation];
+    m->count[status]++;
+    m->bytes_in += scope->bytes_in;
+    m->bytes_out += scope->bytes_out;
+    m->wall_ns += wall;
+    m->cpu_ns += cpu;
+    if (wall > m->max_wall_ns) m->max_wall_ns = wall;
+    if (peak > m->peak_buffer) m->peak_buffer = peak;
+    m->duration[bucket(duration_bounds, DURATION_BUCKETS, seconds)]++;
+    m->size[bucket(size_bounds, SIZE_BUCKETS, scope->bytes_in)]++;
+    if (scope->bytes_in && wall) {
+        double rate = scope->bytes_in / seconds;
+        m->throughput[bucket(throughput_bounds, THROUGHPUT_BUCKETS, rate)]++;
+        m->throughput_count++;
+        m->throughput_sum += rate;
+    }
+    pthread_mutex_unlock(&ops_lock);
+}
+
+void fc_metrics_buffer_alloc(size_t bytes) {
+    buffer_current += bytes;
+    if (buffer_current > buffer_peak) buffer_peak = buffer_current;
+}
+
+void fc_metrics_buffer_free(size_t bytes) {
+    buffer_current = bytes < buffer_current ? buffer_current - bytes : 0;
+}
+
+void fc_metrics_buffer_in_use(size_t bytes) {
+    if (buffer_current + bytes > buffer_peak) buffer_peak = buffer_current + bytes;
+}
+
+void fc_metrics_add_cpu(uint64_t ns) {
+    helper_cpu_ns += ns;
+}
+
+// Queues
+
+void fc_metrics_queue_depth(int priority, int delta) {
+    if ((unsigned)priority > FC_PRIORITY_LAST) return;
+    pthread_mutex_lock(&ops_lock);
+    queues[priority].depth += delta;
+    pthread_mutex_unlock(&ops_lock);
+}
+
+void fc_metrics_queue_wait(int priority, uint64_t ns) {
+    if ((unsigned)priority > FC_PRIORITY_LAST) return;
+    pthread_mutex_lock(&ops_lock);
+    queue_metrics *q = &queues[priority];
+    q->jobs++;
+    q->wait_ns += ns;
+    if (ns > q->max_wait_ns) q->max_wait_ns = ns;
+    q->wait[bucket(duration_bounds, DURATION_BUCKETS, ns / 1e9)]++;
+    pthread_mutex_unlock(&ops_lock);
+}
+
+// Prometheus export
+
+static void snapshot(op_metrics *copy, queue_metrics *queue_copy) {
+    pthread_mutex_lock(&ops_lock);
+    memcpy(copy, ops, sizeof(ops));
+    if (queue_copy) memcpy(queue_copy, queues, sizeof(queues));
+    pthread_mutex_unlock(&ops_lock);
+}
+
+static uint64_t total_count(const op_metrics *m) {
+    uint64_t n = 0;
+    for (int s = 0; s < STATUS_COUNT; s++) n += m->count[s];
+    return n;
+}
+
+// One histogram series; label is "operation" or "priority" and op its value
+static void write_histogram(FILE *f, const char *name, const char *label, const char *op, const uint64_t *counts,
+                            const double *bounds, size_t bucket_count, double sum) {
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < bucket_count; i++) {
+        cumulative += counts[i];
+        fprintf(f, "%s_bucket{%s=\"%s\",le=\"%g\"} %llu\n", name, label, op, bounds[i],
+                (unsigned long long)cumulative);
+    }
+    cumulative += counts[bucket_count];
+    fprintf(f, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n", name, label, op, (unsigned long long)cumulative);
+    fprintf(f, "%s_sum{%s=\"%s\"} %.9g\n", name, label, op, sum);
+    fprintf(f, "%s_count{%s=\"%s\"} %llu\n", name, label, op, (unsigned long long)cumulative);
+}
+
+static void write_metrics(FILE *f, const op_metrics *all, const queue_metrics *queued) {
+    fprintf(f, "# HELP fc_operations_total Operations finished, by outcome.\n"
+               "# TYPE fc_operations_total counter\n");
+    for (int op = FC_CONVERSION_FIRST; op <= FC_OP_LAST; op++) {
+        for (int s = 0; s < STATUS_COUNT; s++) {
+            if (all[op].count[s]) {
+                fprintf(f, "fc_operations_total{operation=\"%s\",status=\"%s\"} %llu\n",
+                        op_labels[op], status_labels[s], (unsigned long long)all[op].count[s]);
+            }
+        }
+    }
+
+    static const struct { const char *name, *help, *type; } simple[] = {
+        { "fc_input_bytes_total", "Bytes read by operations.", "counter" },
+        { "fc_output_bytes_total", "Bytes written by operations.", "counter" },
+        { "fc_cpu_seconds_total", "CPU time spent in operations, helper threads included.", "counter" },
+        { "fc_peak_buffer_bytes", "Largest scratch-buffer footprint of a single operation.", "gauge" },
+    };
+    for (size_t k = 0; k < sizeof(simple) / sizeof(simple[0]); k++) {
+        fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", simple[k].name, simple[k].help, simple[k].name, simple[k].type);
+        for (int op = FC_CONVERSION_FIRST; op <= FC_OP_LAST; op++) {
+            const op_metrics *m = &all[op];
+            if (!total_count(m)) continue;
+            fprintf(f, "%s{operation=\"%s\"} ", simple[k].name, op_labels[op]);
+            if (k == 0) fprintf(f, "%llu\n", (unsigned long long)m->bytes_in);
+            else if (k == 1) fprintf(f, "%llu\n", (unsigned long long)m->bytes_out);
+            else if (k == 2) fprintf(f, "%.9g\n", m->cpu_ns / 1e9);
+            else fprintf(f, "%llu\n", (unsigned long long)m->peak_buffer);
+        }
+    }
+
+    fprintf(f, "# HELP fc_operation_duration_seconds Wall time per operation.\n"
+               "# TYPE fc_operation_duration_seconds histogram\n");
+    for (int op = FC_CONVERSION_FIRST; op <= FC_OP_LAST; op++) {
+        if (total_count(&all[op])) {
+            write_histogram(f, "fc_operation_duration_seconds", "operation", op_labels[op], all[op].duration,
+                            duration_bounds, DURATION_BUCKETS, all[op].wall_ns / 1e9);
+        }
+    }
+    fprintf(f, "# HELP fc_operation_input_size_bytes Input size per operation.\n"
+               "# TYPE fc_operation_input_size_bytes histogram\n");
+    for (int op = FC_CONVERSION_FIRST; op <= FC_OP_LAST; op++) {
+        if (total_count(&all[op])) {
+            write_histogram(f, "fc_operation_input_size_bytes", "operation", op_labels[op], all[op].size,
+                            size_bounds, SIZE_BUCKETS, all[op].bytes_in);
+        }
+    }
+    fprintf(f, "# HELP fc_operation_throughput_bytes_per_second Input bytes per wall second, per operation.\n"
+               "# TYPE fc_operation_throughput_bytes_per_second histogram\n");
+    for (int op = FC_CONVERSION_FIRST; op <= FC_OP_LAST; op++) {
+        if (all[op].throughput_count) {
+            write_histogram(f, "fc_operation_throughput_bytes_per_second", "operation", op_labels[op], all[op].throughput,
+                            throughput_bounds, THROUGHPUT_BUCKETS, all[op].throughput_sum);
+        }
+    }
+
+    // Scheduler queues, once a scheduler has run anything
+    int scheduled = 0;
+    for (int p = 0; p <= FC_PRIORITY_LAST; p++) scheduled |= queued[p].jobs || queued[p].depth;
+    if (scheduled) {
+        fprintf(f, "# HELP fc_queue_depth Jobs waiting for a worker, by priority class.\n"
+                   "# TYPE fc_queue_depth gauge\n");
+        for (int p = 0; p <= FC_PRIORITY_LAST; p++) {
+            fprintf(f, "fc_queue_depth{priority=\"%s\"} %lld\n", priority_labels[p], (long long)queued[p].depth);
+        }
+        fprintf(f, "# HELP fc_queue_wait_seconds Time jobs waited for a worker, by priority class.\n"
+                   "# TYPE fc_queue_wait_seconds histogram\n");
+        for (int p = 0; p <= FC_PRIORITY_LAST; p++) {
+            write_histogram(f, "fc_queue_wait_seconds", "priority", priority_labels[p], queued[p].wait,
+                            duration_bounds, DURATION_BUCKETS, queued[p].wait_ns / 1e9);
+        }
+    }
+
+    // Scratch arenas: chunk allocations should stay flat once pools are warm
+    fc_arena_stats arena;
+    fc_arena_get_stats(&arena);
+    fprintf(f, "# HELP fc_arena_allocations_total Scratch allocations served by arenas.\n"
+               "# TYPE fc_arena_allocations_total counter\n"
+               "fc_arena_allocations_total %llu\n"
+               "# HELP fc_arena_chunk_allocations_total Arena chunks taken from malloc.\n"
+               "# TYPE fc_arena_chunk_allocations_total counter\n"
+               "fc_arena_chunk_allocations_total %llu\n"
+               "# HELP fc_arena_chunk_bytes_total Bytes of arena chunks taken from malloc.\n"
+               "# TYPE fc_arena_chunk_bytes_total counter\n"
+               "fc_arena_chunk_bytes_total %llu\n"
+               "# HELP fc_arena_reuses_total Arenas handed out again from a thread's pool.\n"
+               "# TYPE fc_arena_reuses_total counter\n"
+               "fc_arena_reuses_total %llu\n",
+            (unsigned long long)arena.allocations, (unsigned long long)arena.chunk_allocations,
+            (unsigned long long)arena.chunk_bytes, (unsigned long long)arena.arenas_reused);
+
+    // Memory budget
+    fc_budget_stats budget;
+    fc_budget_get_stats(&budget);
+    fprintf(f, "# HELP fc_memory_budget_bytes Memory budget, 0 if unlimited.\n"
+               "# TYPE fc_memory_budget_bytes gauge\n"
+               "fc_memory_budget_bytes %llu\n"
+               "# HELP fc_memory_reserved_bytes Memory reserved against the budget.\n"
+               "# TYPE fc_memory_reserved_bytes gauge\n"
+               "fc_memory_reserved_bytes %llu\n"
+               "# HELP fc_memory_reserved_peak_bytes Most memory reserved at once.\n"
+               "# TYPE fc_memory_reserved_peak_bytes gauge\n"
+               "fc_memory_reserved_peak_bytes %llu\n"
+               "# HELP fc_memory_waits_total Reservations that waited for memory to be released.\n"
+               "# TYPE fc_memory_waits_total counter\n"
+               "fc_memory_waits_total %llu\n"
+               "# HELP fc_memory_wait_seconds_total Time spent waiting for memory.\n"
+               "# TYPE fc_memory_wait_seconds_total counter\n"
+               "fc_memory_wait_seconds_total %.9g\n"
+               "# HELP fc_memory_denials_total Reservations refused for lack of memory.\n"
+               "# TYPE fc_memory_denials_total counter\n"
+               "fc_memory_denials_total %llu\n"
+               "# HELP fc_spills_total Result streams moved from memory to temporary files.\n"
+               "# TYPE fc_spills_total counter\n"
+               "fc_spills_total %llu\n"
+               "# HELP fc_spill_bytes_total Bytes written to temporary spill files.\n"
+               "# TYPE fc_spill_bytes_total counter\n"
+               "fc_spill_bytes_total %llu\n",
+            (unsigned long long)budget.limit, (unsigned long long)budget.reserved,
+            (unsigned long long)budget.peak, (unsigned long long)budget.waits, budget.wait_ns / 1e9,
+            (unsigned long long)budget.denials, (unsigned long long)budget.spills,
+            (unsigned long long)budget.spill_bytes);
+
+    // I/O policy
+    fc_io_stats io;
+    fc_io_get_stats(&io);
+    fprintf(f, "# HELP fc_io_readahead_bytes_total Input bytes asked to be read ahead.\n"
+               "# TYPE fc_io_readahead_bytes_total counter\n"
+               "fc_io_readahead_bytes_total %llu\n"
+               "# HELP fc_io_dropped_bytes_total File bytes asked to be dropped from the page cache.\n"
+               "# TYPE fc_io_dropped_bytes_total counter\n"
+               "fc_io_dropped_bytes_total %llu\n"
+               "# HELP fc_io_direct_bytes_total Input bytes read with O_DIRECT.\n"
+               "# TYPE fc_io_direct_bytes_total counter\n"
+               "fc_io_direct_bytes_total %llu\n",
+            (unsigned long long)io.readahead_bytes, (unsigned long long)io.dropped_bytes,
+            (unsigned long long)io.direct_bytes);
+}
+
+int fc_metrics_write_textfile(const char *path) {
+    static op_metrics all[FC_OP_LAST + 1];
+    static queue_metrics queued[FC_PRIORITY_LAST + 1];
+    static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid()) >= (int)sizeof(tmp)) return -1;
+
+    pthread_mutex_lock(&write_lock);
+    snapshot(all, queued);
+    FILE *f = fopen(tmp, "w");
+    int rc = -1;
+    if (f) {
+        write_metrics(f, all, queued);
+        rc = ferror(f) ? -1 : 0;
+        if (fclose(f) != 0) rc = -1;
+        if (rc == 0 && rename(tmp, path) != 0) rc = -1;
+        if (rc != 0) unlink(tmp);
+    }
+    pthread_mutex_unlock(&write_lock);
+    return rc;
+}
+
+// Periodic export
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    char *path;
+    int interval;
+    int running;
+    int stopping;
+} exporter = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+static void *export_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&exporter.lock);
+    while (!exporter.stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += exporter.interval;
+        while (!exporter.stopping &&
+               pthread_cond_timedwait(&exporter.wake, &exporter.lock, &deadline) == 0) {
+        }
+        if (exporter.stopping) break;
+        pthread_mutex_unlock(&exporter.lock);
+        fc_metrics_write_textfile(exporter.path);
+        pthread_mutex_lock(&exporter.lock);
+    }
+    pthread_mutex_unlock(&exporter.lock);
+    return NULL;
+}
+
+int fc_metrics_start_export(const char *path, int interval_seconds) {
+    if (!path || !*path || exporter.running) return -1;
+    exporter.path = strdup(path);
+    if (!exporter.path) return -1;
+    exporter.interval = interval_seconds > 0 ? interval_seconds : DEFAULT_EXPORT_INTERVAL;
+    exporter.stopping = 0;
+
+    // Write once now so the file exists (and is checked) from the start
+    if (fc_metrics_write_textfile(path) != 0 ||
+        pthread_create(&exporter.thread, NULL, export_main, NULL) != 0) {
+        free(exporter.path);
+        exporter.path = NULL;
+        return -1;
+    }
+    exporter.running = 1;
+    return 0;
+}
+
+int fc_metrics_start_export_env(void) {
+    const char *interval = getenv("FC_METRICS_INTERVAL");
+    return fc_metrics_start_export(getenv("FC_METRICS_FILE"), interval ? atoi(interval) : 0);
+}
+
+void fc_metrics_stop_export(void) {
+    if (!exporter.running) return;
+    pthread_mutex_lock(&exporter.lock);
+    exporter.stopping = 1;
+    pthread_cond_signal(&exporter.wake);
+    pthread_mutex_unlock(&exporter.lock);
+    pthread_join(exporter.thread, NULL);
+
+    fc_metrics_write_textfile(exporter.path);
+    free(exporter.path);
+    exporter.path = NULL;
+    exporter.running = 0;
+}
+
+// Summary table
+
+static void format_bytes(char *buf, size_t size, double bytes) {
+    static const char *const units[] = { "B", "KB", "MB", "GB", "TB" };
+    int u = 0;
+    while (bytes >= 1024 && u < 4) {
+        bytes /= 1024;
+        u++;
+    }
+    snprintf(buf, size, u ? "%.1f %s" : "%.0f %s", bytes, units[u]);
+}
+
+char *fc_metrics_summary(void) {
+    static op_metrics all[FC_OP_LAST + 1];
+    static queue_metrics queued[FC_PRIORITY_LAST + 1];
+    static pthread_mutex_t summary_lock = PTHREAD_MUTEX_INITIALIZER;
+    char *buf = NULL;
+    size_t len = 0;
+    int rows = 0;
+
+    FILE *out = open_memstream(&buf, &len);
+    if (!out) return NULL;
+
+    pthread_mutex_lock(&summary_lock);
+    snapshot(all, queued);
+    fprintf(out, "%-12s %7s %7s %10s %10s %9s %9s %9s %9s %10s\n",
+            "Operation", "Count", "Errors", "Bytes in", "Bytes out",
+            "Mean ms", "Max ms", "CPU ms", "MB/s", "Peak buf");
+    for (int op = FC_CONVERSION_FIRST; op <= FC_OP_LAST; op++) {
+        const op_metrics *m = &all[op];
+        uint64_t count = total_count(m);
+        if (!count) continue;
+
+        char in[16], out_bytes[16], peak[16];
+        format_bytes(in, sizeof(in), m->bytes_in);
+        format_bytes(out_bytes, sizeof(out_bytes), m->bytes_out);
+        format_bytes(peak, sizeof(peak), m->peak_buffer);
+        double wall_seconds = m->wall_ns / 1e9;
+        fprintf(out, "%-12s %7llu %7llu %10s %10s %9.2f %9.2f %9.2f %9.1f %10s\n",
+                op <= FC_CONVERSION_LAST ? fc_conversion_name(op) : op_titles[op - FC_OP_SEARCH],
+                (unsigned long long)count, (unsigned long long)(count - m->count[FC_OK]),
+                in, out_bytes, m->wall_ns / 1e6 / count, m->max_wall_ns / 1e6, m->cpu_ns / 1e6 / count,
+                wall_seconds > 0 ? m->bytes_in / wall_seconds / 1e6 : 0.0, peak);
+        rows++;
+    }
+    for (int p = 0; p <= FC_PRIORITY_LAST; p++) {
+        const queue_metrics *q = &queued[p];
+        if (!q->jobs) continue;
+        fprintf(out, "Queue %-11s %llu jobs, mean wait %.2f ms, max wait %.2f ms\n", priority_labels[p],
+                (unsigned long long)q->jobs, q->wait_ns / 1e6 / q->jobs, q->max_wait_ns / 1e6);
+        rows++;
+    }
+    pthread_mutex_unlock(&summary_lock);
+
+    fc_budget_stats budget;
+    fc_budget_get_stats(&budget);
+    if (budget.limit || budget.spills) {
+        char limit[16], peak[16], spilled[16];
+        format_bytes(limit, sizeof(limit), budget.limit);
+        format_bytes(peak, sizeof(peak), budget.peak);
+        format_bytes(spilled, sizeof(spilled), budget.spill_bytes);
+        fprintf(out, "Memory budget %s, peak reserved %s, %llu waits (%.2f ms), %llu refused, %llu spills (%s)\n",
+                budget.limit ? limit : "unlimited", peak, (unsigned long long)budget.waits, budget.wait_ns / 1e6,
+                (unsigned long long)budget.denials, (unsigned long long)budget.spills, spilled);
+        rows++;
+    }
+
+    fc_io_stats io;
+    fc_io_get_stats(&io);
+    if (io.dropped_bytes || io.direct_bytes) {
+        char dropped[16], direct[16];
+        format_bytes(dropped, sizeof(dropped), io.dropped_bytes);
+        format_bytes(direct, sizeof(direct), io.direct_bytes);
+        fprintf(out, "Page cache %s dropped behind, %s read direct\n", dropped, direct);
+        rows++;
+    }
+
+    if (fclose(out) != 0 || !rows) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
@@ -0,0 +1,82 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "converter.h"
+
+// In-process metrics for conversions, searches and file operations.
+//
+// Every operation records bytes in and out, wall and CPU time, throughput
+// and peak scratch-buffer memory into per-operation counters and
+// histograms. They can be exported in Prometheus text format (for
+// node_exporter's textfile collector) and summarized as a table.
+//
+// The library records its own calls (fc_convert_*, fc_search_file and the
+// cache); front ends wrap their file operations in a scope. Scopes nest:
+// only the outermost one on a thread is recorded, so a cached conversion
+// that falls through to fc_convert_file() counts once.
+
+// Operations are the fc_conversion types followed by these
+typedef enum {
+    FC_OP_SEARCH = FC_CONVERSION_LAST + 1,
+    FC_OP_READ_FILE,
+    FC_OP_WRITE_FILE,
+    FC_OP_APPEND_FILE,
+    FC_OP_CREATE_FILE,
+    FC_OP_DELETE_FILE
+} fc_operation;
+
+#define FC_OP_LAST FC_OP_DELETE_FILE
+
+typedef struct {
+    int operation;
+    int active;                 // outermost scope on this thread
+    struct timespec wall_start, cpu_start;
+    uint64_t cpu_base;          // helper-thread CPU already reported
+    uint64_t buffer_base;
+
+    // Filled in by the caller before fc_metrics_end()
+    uint64_t bytes_in, bytes_out;
+} fc_metrics_scope;
+
+void fc_metrics_begin(fc_metrics_scope *scope, int operation);
+void fc_metrics_end(fc_metrics_scope *scope, fc_status status);
+
+// Scratch buffers allocated and freed on the calling thread, for the peak
+// buffer memory of the operation running on it
+void fc_metrics_buffer_alloc(size_t bytes);
+void fc_metrics_buffer_free(size_t bytes);
+
+// Long-lived buffers (a context's) that the current operation is using
+void fc_metrics_buffer_in_use(size_t bytes);
+
+// CPU time a helper thread spent for the current operation
+void fc_metrics_add_cpu(uint64_t ns);
+
+// Scheduler queues (scheduler.c), per priority class: jobs entering (+1) and
+// leaving (-1) the queue, and how long each waited for a worker
+void fc_metrics_queue_depth(int priority, int delta);
+void fc_metrics_queue_wait(int priority, uint64_t ns);
+
+// Write all metrics to path in Prometheus text format, atomically (a temp
+// file renamed over it). Returns 0 on success.
+int fc_metrics_write_textfile(const char *path);
+
+// Rewrite path every interval_seconds from a background thread, and once
+// more from fc_metrics_stop_export(). Returns 0 on success.
+int fc_metrics_start_export(const char *path, int interval_seconds);
+
+// Start exporting to FC_METRICS_FILE every FC_METRICS_INTERVAL seconds
+// (default 15). Returns 0 if started, -1 if not configured or failed.
+int fc_metrics_start_export_env(void);
+
+void fc_metrics_stop_export(void);
+
+// A table with one row per operation seen so far: count, errors, bytes,
+// mean and max duration, throughput and peak buffer memory. Returns a
+// malloc'd string, or NULL if nothing was recorded yet.
+char *fc_metrics_summary(void);
+
+#endif
@@ -0,0 +1,299 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <locale.h>
+#include <pthread.h>
+
+#include "number.h"
+
+#define POW5_MIN (-342)         // below this every double rounds to zero
+#define POW5_MAX 308            // above it to infinity
+#define POW5_COUNT (POW5_MAX - POW5_MIN + 1)
+#define MAX_DIGITS 19           // significant digits that fit the 64-bit mantissa
+#define SLOW_PATH_MAX 1024      // longest input handed to strtod
+
+// Decimal scanning
+
+typedef struct {
+    uint64_t w;                 // the first MAX_DIGITS significant digits
+    int64_t q;                  // value = w * 10^q, give or take the truncated digits
+    int negative;
+    int truncated;              // there were more significant digits than fit in w
+} decimal;
+
+static int scan_decimal(const char *s, size_t len, decimal *d) {
+    const char *p = s, *end = s + len;
+    memset(d, 0, sizeof(*d));
+    if (p < end && (*p == '-' || *p == '+')) d->negative = *p++ == '-';
+
+    int digits = 0, significant = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+        if (significant == 0 && *p == '0') continue;
+        if (significant < MAX_DIGITS) {
+            d->w = d->w * 10 + (*p - '0');
+        } else {
+            d->q++;
+            if (*p != '0') d->truncated = 1;
+        }
+        significant++;
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+            if (significant == 0 && *p == '0') {
+                d->q--;
+                continue;
+            }
+            if (significant < MAX_DIGITS) {
+                d->w = d->w * 10 + (*p - '0');
+                d->q--;
+            } else if (*p != '0') {
+                d->truncated = 1;
+            }
+            significant++;
+        }
+    }
+    if (digits == 0) return -1;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        int negative_exp = 0;
+        if (p < end && (*p == '-' || *p == '+')) negative_exp = *p++ == '-';
+        if (p == end || *p < '0' || *p > '9') return -1;
+        int64_t exp = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (exp < 1000000) exp = exp * 10 + (*p - '0');
+        }
+        d->q += negative_exp ? -exp : exp;
+    }
+    return p == end ? 0 : -1;
+}
+
+int fc_parse_int64(const char *s, size_t len, long long *value) {
+    const char *p = s, *end = s + len;
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    if (p == end) return -1;
+
+    uint64_t n = 0, limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    for (; p < end; p++) {
+        unsigned digit = (unsigned char)*p - '0';
+        if (digit > 9 || n > (limit - digit) / 10) return -1;
+        n = n * 10 + digit;
+    }
+    *value = negative ? (long long)(0 - n) : (long long)n;
+    return 0;
+}
+
+// Powers of five: the most significant 128 bits of 5^q for q >= 0 (truncated)
+// and of 2^b / 5^-q plus one for q < 0, as fast_float tabulates them. Built
+// once from exact big integers, high word first.
+
+static uint64_t pow5[2 * POW5_COUNT];
+static pthread_once_t pow5_once = PTHREAD_ONCE_INIT;
+
+#define BIG_LIMBS 72            // 2304 bits: room for 2^2048 and 5^342
+#define RECIPROCAL_BITS 2048
+
+typedef struct {
+    uint32_t limb[BIG_LIMBS];   // little-endian
+} big;
+
+static void big_mul_small(big *x, uint32_t m) {
+    uint64_t carry = 0;
+    for (int i = 0; i < BIG_LIMBS; i++) {
+        uint64_t t = (uint64_t)x->limb[i] * m + carry;
+        x->limb[i] = (uint32_t)t;
+        carry = t >> 32;
+    }
+}
+
+static void big_div_small(big *x, uint32_t d) {
+    uint64_t rem = 0;
+    for (int i = BIG_LIMBS - 1; i >= 0; i--) {
+        uint64_t t = rem << 32 | x->limb[i];
+        x->limb[i] = (uint32_t)(t / d);
+        rem = t % d;
+    }
+}
+
+static int big_bits(const big *x) {
+    for (int i = BIG_LIMBS - 1; i >= 0; i--) {
+        if (x->limb[i]) return i * 32 + 32 - __builtin_clz(x->limb[i]);
+    }
+    return 0;
+}
+
+static int big_bit(const big *x, int bit) {
+    return bit >= 0 && bit < BIG_LIMBS * 32 ? (x->limb[bit / 32] >> (bit % 32)) & 1 : 0;
+}
+
+// Bits [low, low + 128) of x, zero-filled below bit 0
+static void big_window(const big *x, int low, uint64_t *hi, uint64_t *lo) {
+    *hi = *lo = 0;
+    for (int i = 127; i >= 0; i--) {
+        int bit = big_bit(x, low + i);
+        if (i >= 64) *hi |= (uint64_t)bit << (i - 64);
+        else *lo |= (uint64_t)bit << i;
+    }
+}
+
+static void big_shift_right(big *x, int n) {
+    big r;
+    memset(&r, 0, sizeof(r));
+    for (int bit = n; bit < BIG_LIMBS * 32; bit++) {
+        if (big_bit(x, bit)) r.limb[(bit - n) / 32] |= 1u << ((bit - n) % 32);
+    }
+    *x = r;
+}
+
+static void big_add_one(big *x) {
+    for (int i = 0; i < BIG_LIMBS && ++x->limb[i] == 0; i++) {}
+}
+
+static void build_pow5(void) {
+    big power;
+    memset(&power, 0, sizeof(power));
+    power.limb[0] = 1;
+    for (int q = 0; q <= POW5_MAX; q++) {
+        int bits = big_bits(&power);
+        uint64_t *entry = &pow5[2 * (q - POW5_MIN)];
+        big_window(&power, bits - 128, &entry[0], &entry[1]);
+        big_mul_small(&power, 5);
+    }
+
+    // reciprocal = floor(2^RECIPROCAL_BITS / 5^k), exact at every step
+    big reciprocal;
+    memset(&reciprocal, 0, sizeof(reciprocal));
+    reciprocal.limb[RECIPROCAL_BITS / 32] = 1;
+    memset(&power, 0, sizeof(power));
+    power.limb[0] = 1;
+    for (int k = 1; k <= -POW5_MIN; k++) {
+        big_div_small(&reciprocal, 5);
+        big_mul_small(&power, 5);
+        int z = big_bits(&power);                   // 2^z > 5^k
+        int b = -k >= -27 ? z + 127 : 2 * z + 128;
+        big c = reciprocal;
+        big_shift_right(&c, RECIPROCAL_BITS - b);   // floor(2^b / 5^k)
+        big_add_one(&c);
+        int bits = big_bits(&c);
+        uint64_t *entry = &pow5[2 * (-k - POW5_MIN)];
+        big_window(&c, bits > 128 ? bits - 128 : 0, &entry[0], &entry[1]);
+    }
+}
+
+// Eisel-Lemire
+
+static void mul_64x64(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo) {
+    unsigned __int128 r = (unsigned __int128)a * b;
+    *hi = (uint64_t)(r >> 64);
+    *lo = (uint64_t)r;
+}
+
+// The bits of the double nearest w * 10^q, or -1 if this cannot tell
+static int eisel_lemire(uint64_t w, int64_t q, uint64_t *bits) {
+    const uint64_t infinity = 0x7FFull << 52;
+    if (w == 0 || q < POW5_MIN) {
+        *bits = 0;
+        return 0;
+    }
+    if (q > POW5_MAX) {
+        *bits = infinity;
+        return 0;
+    }
+
+    int lz = __builtin_clzll(w);
+    w <<= lz;
+    const uint64_t *entry = &pow5[2 * (q - POW5_MIN)];
+    uint64_t hi, lo;
+    mul_64x64(w, entry[0], &hi, &lo);
+    if ((hi & 0x1FF) == 0x1FF) {
+        // Not enough bits to round by: bring in the low half of the power
+        uint64_t hi2, lo2;
+        mul_64x64(w, entry[1], &hi2, &lo2);
+        lo += hi2;
+        if (hi2 > lo) hi++;
+        if (lo == UINT64_MAX && (q < -27 || q > 55)) return -1;
+    }
+
+    int upper = (int)(hi >> 63);
+    uint64_t mantissa = hi >> (upper + 9);
+    int64_t power2 = ((((152170 + 65536) * q) >> 16) + 63) + upper - lz + 1023;
+
+    if (power2 <= 0) {
+        // Subnormal, or zero
+        if (-power2 + 1 >= 64) {
+            *bits = 0;
+            return 0;
+        }
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        power2 = mantissa < (1ull << 52) ? 0 : 1;
+        *bits = mantissa | (uint64_t)power2 << 52;
+        return 0;
+    }
+
+    // Exactly halfway between two doubles: round to even
+    if (lo <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 && (mantissa << (upper + 9)) == hi) {
+        mantissa &= ~1ull;
+    }
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= 2ull << 52) {
+        mantissa = 1ull << 52;
+        power2++;
+    }
+    mantissa &= ~(1ull << 52);
+    *bits = power2 >= 0x7FF ? infinity : mantissa | (uint64_t)power2 << 52;
+    return 0;
+}
+
+static locale_t c_locale;
+static pthread_once_t c_locale_once = PTHREAD_ONCE_INIT;
+
+static void open_c_locale(void) {
+    c_locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+}
+
+static int slow_path(const char *s, size_t len, double *value) {
+    char buf[SLOW_PATH_MAX + 1];
+    if (len > SLOW_PATH_MAX) return -1;
+    pthread_once(&c_locale_once, open_c_locale);
+    if (!c_locale) return -1;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    *value = strtod_l(buf, NULL, c_locale);
+    return 0;
+}
+
+int fc_parse_double(const char *s, size_t len, double *value) {
+    static const double exact[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    decimal d;
+    if (scan_decimal(s, len, &d) != 0) return -1;
+
+    double v;
+    if (!d.truncated && d.q >= -22 && d.q <= 22 && d.w <= 1ull << 53) {
+        // Clinger: both operands are exact, so one rounding gives the answer
+        v = (double)d.w;
+        v = d.q < 0 ? v / exact[-d.q] : v * exact[d.q];
+    } else {
+        pthread_once(&pow5_once, build_pow5);
+        uint64_t bits, upper_bits;
+        int ok = eisel_lemire(d.w, d.q, &bits) == 0;
+        // With digits cut off the value lies between w and w + 1
+        if (ok && d.truncated) ok = eisel_lemire(d.w + 1, d.q, &upper_bits) == 0 && upper_bits == bits;
+        if (ok) {
+            memcpy(&v, &bits, sizeof(v));
+        } else if (slow_path(s, len, &v) != 0) {
+            return -1;
+        }
+        if (v < 0) v = -v;
+    }
+    if (v - v != 0) return -1;     // infinite
+    *value = d.negative ? -v : v;
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include <stddef.h>
+
+// Number parsing for typed CSV fields. Both functions take the whole of
+// s[0..len) (no surrounding blanks) and return 0 only if it is a number in
+// the accepted syntax: an optional sign, digits with an optional decimal
+// point, and for doubles an optional exponent. Hex, "inf" and "nan" are not
+// numbers here.
+//
+// fc_parse_double() is correctly rounded, like strtod(), but takes the
+// Clinger fast path for short exact values and the Eisel-Lemire algorithm
+// (one or two 64x128-bit multiplications against a table of powers of five)
+// for the rest, falling back to strtod() only for inputs of more than 19
+// significant digits that the truncated mantissa cannot decide (the point is
+// always '.', whatever the locale). Values too large for a double, and
+// numerals longer than 1024 characters, give -1.
+
+int fc_parse_int64(const char *s, size_t len, long long *value);
+int fc_parse_double(const char *s, size_t len, double *value);
+
+#endif
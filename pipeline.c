@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "pipeline.h"
+#include "threadpool.h"
+#include "compress.h"
+#include "iopolicy.h"
+#include "trace.h"
+
+#define CHUNK_SIZE 65536
+#define LINK_SLOTS 4        // chunks in flight between two stages
+
+typedef struct {
+    char data[CHUNK_SIZE];
+    size_t len;
+} chunk;
+
+// The queue between two stages. The upstream stage writes into it through
+// one FILE and the downstream stage reads from it through another; it is
+// freed once both are closed.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    chunk slots[LINK_SLOTS];
+    int head, count;
+    int done;               // writer closed
+    int failed;             // writer's stage failed: the reader sees an error, not EOF
+    int closed;             // reader closed: further writes fail
+    int refs;
+
+    chunk *filling;         // writer: chunk being filled
+    size_t pos;             // reader: bytes of the head chunk already returned
+} stage_link;
+
+typedef struct {
+    fc_conversion type;
+    FILE *in, *out;
+    stage_link *in_link, *out_link;     // NULL at the ends of the chain
+    fc_status status;
+    int downstream_gone;    // the next stage stopped reading before this one finished
+    pthread_t thread;
+    int started;
+} stage;
+
+// Link
+
+static void link_unref(stage_link *l) {
+    pthread_mutex_lock(&l->lock);
+    int last = --l->refs == 0;
+    pthread_mutex_unlock(&l->lock);
+    if (!last) return;
+    pthread_cond_destroy(&l->changed);
+    pthread_mutex_destroy(&l->lock);
+    free(l);
+}
+
+static ssize_t link_read(void *cookie, char *buf, size_t size) {
+    stage_link *l = cookie;
+    pthread_mutex_lock(&l->lock);
+    while (l->count == 0 && !l->done) pthread_cond_wait(&l->changed, &l->lock);
+    chunk *c = l->count ? &l->slots[l->head] : NULL;
+    int failed = l->failed;
+    pthread_mutex_unlock(&l->lock);
+    if (!c) {
+        if (failed) errno = EIO;
+        return failed ? -1 : 0;
+    }
+
+    size_t n = c->len - l->pos < size ? c->len - l->pos : size;
+    memcpy(buf, c->data + l->pos, n);
+    l->pos += n;
+    if (l->pos == c->len) {
+        l->pos = 0;
+        pthread_mutex_lock(&l->lock);
+        l->head = (l->head + 1) % LINK_SLOTS;
+        l->count--;
+        pthread_cond_broadcast(&l->changed);
+        pthread_mutex_unlock(&l->lock);
+    }
+    return n;
+}
+
+static ssize_t link_write(void *cookie, const char *buf, size_t size) {
+    stage_link *l = cookie;
+    size_t done = 0;
+    while (done < size) {
+        if (!l->filling) {
+            pthread_mutex_lock(&l->lock);
+            while (l->count == LINK_SLOTS && !l->closed) pthread_cond_wait(&l->changed, &l->lock);
+            if (!l->closed) l->filling = &l->slots[(l->head + l->count) % LINK_SLOTS];
+            pthread_mutex_unlock(&l->lock);
+            if (!l->filling) {
+                errno = EPIPE;
+                return -1;
+            }
+            l->filling->len = 0;
+        }
+        chunk *c = l->filling;
+        size_t n = CHUNK_SIZE - c->len < size - done ? CHUNK_SIZE - c->len : size - done;
+        memcpy(c->data + c->len, buf + done, n);
+        c->len += n;
+        done += n;
+        if (c->len == CHUNK_SIZE) {
+            l->filling = NULL;
+            pthread_mutex_lock(&l->lock);
+            l->count++;
+            pthread_cond_broadcast(&l->changed);
+            pthread_mutex_unlock(&l->lock);
+        }
+    }
+    return done;
+}
+
+static int link_close_writer(void *cookie) {
+    stage_link *l = cookie;
+    pthread_mutex_lock(&l->lock);
+    if (l->filling && l->filling->len && !l->closed) l->count++;
+    l->filling = NULL;
+    l->done = 1;
+    pthread_cond_broadcast(&l->changed);
+    pthread_mutex_unlock(&l->lock);
+    link_unref(l);
+    return 0;
+}
+
+static int link_close_reader(void *cookie) {
+    stage_link *l = cookie;
+    pthread_mutex_lock(&l->lock);
+    l->closed = 1;
+    pthread_cond_broadcast(&l->changed);
+    pthread_mutex_unlock(&l->lock);
+    link_unref(l);
+    return 0;
+}
+
+// A link and the FILEs for both of its ends
+static stage_link *link_new(FILE **writer, FILE **reader) {
+    stage_link *l = calloc(1, sizeof(*l));
+    if (!l) return NULL;
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_cond_init(&l->changed, NULL);
+    l->refs = 2;
+
+    cookie_io_functions_t write_io = { .write = link_write, .close = link_close_writer };
+    cookie_io_functions_t read_io = { .read = link_read, .close = link_close_reader };
+    *writer = fopencookie(l, "w", write_io);
+    *reader = *writer ? fopencookie(l, "r", read_io) : NULL;
+    if (!*reader) {
+        if (*writer) fclose(*writer);
+        else link_unref(l);
+        link_unref(l);
+        return NULL;
+    }
+    setvbuf(*writer, NULL, _IOFBF, CHUNK_SIZE);
+    setvbuf(*reader, NULL, _IOFBF, CHUNK_SIZE);
+    return l;
+}
+
+// Stages
+
+// Close the link ends a stage owns, telling the next stage if this one failed
+static void stage_finish(stage *s) {
+    if (s->out_link) {
+        pthread_mutex_lock(&s->out_link->lock);
+        s->downstream_gone = s->out_link->closed;
+        if (s->status != FC_OK) s->out_link->failed = 1;
+        pthread_mutex_unlock(&s->out_link->lock);
+        if (fclose(s->out) != 0 && s->status == FC_OK) s->status = FC_ERR_IO;
+    }
+    if (s->in_link) fclose(s->in);
+}
+
+static void *stage_main(void *arg) {
+    stage *s = arg;
+    char name[32];
+    snprintf(name, sizeof(name), "stage %s", fc_conversion_name(s->type));
+    fc_trace_thread_name(name);
+
+    fc_context *ctx = fc_worker_context_new();
+    s->status = ctx ? fc_convert_stream(ctx, s->type, s->in, s->out) : FC_ERR_NOMEM;
+    fc_context_free(ctx);
+    stage_finish(s);
+    return NULL;
+}
+
+int fc_pipeline_parse(const char *spec, fc_pipeline *pipeline) {
+    if (!spec || !pipeline) return -1;
+    pipeline->count = 0;
+
+    // A single conversion in any of the usual spellings
+    fc_conversion type = fc_conversion_parse(spec);
+    if (type) {
+        pipeline->stages[pipeline->count++] = type;
+        return 0;
+    }
+
+    char previous[16] = "";
+    for (const char *s = spec;;) {
+        const char *sep = strchr(s, ':');
+        size_t len = sep ? (size_t)(sep - s) : strlen(s);
+        char format[16];
+        if (len == 0 || len >= sizeof(format)) return -1;
+        memcpy(format, s, len);
+        format[len] = '\0';
+
+        if (previous[0]) {
+            fc_conversion step = fc_find_conversion(previous, format);
+            if (!step || pipeline->count == FC_PIPELINE_MAX) return -1;
+            pipeline->stages[pipeline->count++] = step;
+        }
+        memcpy(previous, format, len + 1);
+        if (!sep) break;
+        s = sep + 1;
+    }
+    return pipeline->count > 0 ? 0 : -1;
+}
+
+void fc_pipeline_name(const fc_pipeline *pipeline, char *buf, size_t size) {
+    if (!size) return;
+    buf[0] = '\0';
+    if (!pipeline || pipeline->count < 1) return;
+    size_t len = snprintf(buf, size, "%s", fc_source_format(pipeline->stages[0]));
+    for (int i = 0; i < pipeline->count && len < size; i++) {
+        len += snprintf(buf + len, size - len, " to %s", fc_target_format(pipeline->stages[i]));
+    }
+}
+
+fc_status fc_pipeline_stream(fc_context *ctx, const fc_pipeline *pipeline, FILE *in, FILE *out) {
+    if (!ctx || !pipeline || pipeline->count < 1 || pipeline->count > FC_PIPELINE_MAX || !in || !out) {
+        return FC_ERR_INVALID;
+    }
+    if (pipeline->count == 1) return fc_convert_stream(ctx, pipeline->stages[0], in, out);
+
+    int count = pipeline->count;
+    stage stages[FC_PIPELINE_MAX];
+    memset(stages, 0, sizeof(stages));
+
+    // Wire each stage's output to the next one's input
+    stages[0].in = in;
+    stages[count - 1].out = out;
+    for (int i = 0; i < count; i++) {
+        stages[i].type = pipeline->stages[i];
+        if (i == count - 1) break;
+        stages[i].out_link = link_new(&stages[i].out, &stages[i + 1].in);
+        if (!stages[i].out_link) {
+            for (int j = 0; j < i; j++) {
+                fclose(stages[j].out);
+                fclose(stages[j + 1].in);
+            }
+            return FC_ERR_NOMEM;
+        }
+        stages[i + 1].in_link = stages[i].out_link;
+    }
+
+    fc_trace_span span;
+    fc_trace_begin(&span, "pipeline");
+
+    // Every stage but the last gets a thread; the caller runs the last
+    for (int i = 0; i < count - 1; i++) {
+        if (pthread_create(&stages[i].thread, NULL, stage_main, &stages[i]) == 0) {
+            stages[i].started = 1;
+        } else {
+            stages[i].status = FC_ERR_NOMEM;
+            stage_finish(&stages[i]);
+        }
+    }
+    stage *last = &stages[count - 1];
+    last->status = fc_convert_stream(ctx, last->type, last->in, last->out);
+    stage_finish(last);
+    for (int i = 0; i < count - 1; i++) {
+        if (stages[i].started) pthread_join(stages[i].thread, NULL);
+    }
+    fc_trace_end(&span, 0);
+
+    for (int i = 0; i < count; i++) {
+        if (stages[i].status != FC_OK && !stages[i].downstream_gone) return stages[i].status;
+    }
+    for (int i = 0; i < count; i++) {
+        if (stages[i].status != FC_OK) return stages[i].status;
+    }
+    return FC_OK;
+}
+
+fc_status fc_pipeline_file(fc_context *ctx, const fc_pipeline *pipeline,
+                           const char *input_file, const char *output_file) {
+    if (!ctx || !pipeline || !input_file || !output_file) return FC_ERR_INVALID;
+    if (pipeline->count == 1) return fc_convert_file(ctx, pipeline->stages[0], input_file, output_file);
+
+    fc_compression compression = fc_output_compression(ctx, output_file);
+#ifndef FC_HAVE_ZLIB
+    if (compression == FC_COMPRESS_GZIP) return FC_ERR_UNSUPPORTED;
+#endif
+#ifndef FC_HAVE_ZSTD
+    if (compression == FC_COMPRESS_ZSTD) return FC_ERR_UNSUPPORTED;
+#endif
+
+    FILE *in = fc_io_open_read(input_file);
+    if (!in) return FC_ERR_INPUT;
+    fc_compression input_compression = fc_detect_compression(in);
+    if (input_compression != FC_COMPRESS_NONE) {
+        in = fc_decompressing_stream(in, input_compression);
+        if (!in) return errno == ENOTSUP ? FC_ERR_UNSUPPORTED : FC_ERR_NOMEM;
+    }
+
+    FILE *out = fc_io_open_write(output_file);
+    if (!out) {
+        fclose(in);
+        return FC_ERR_OUTPUT;
+    }
+    if (compression != FC_COMPRESS_NONE && !(out = fc_compressing_stream(out, compression))) {
+        fclose(in);
+        return FC_ERR_NOMEM;
+    }
+
+    fc_status status = fc_pipeline_stream(ctx, pipeline, in, out);
+    fclose(in);
+    if (fclose(out) != 0 && status == FC_OK) status = FC_ERR_IO;
+
+    // As for a single conversion, a failure leaves no partial output
+    struct stat st;
+    if (status != FC_OK && stat(output_file, &st) == 0 && S_ISREG(st.st_mode)) unlink(output_file);
+    return status;
+}
@@ -0,0 +1,43 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include "converter.h"
+
+// Multi-stage conversions such as HTML to TXT to JSON, without an
+// intermediate file.
+//
+// Every stage runs on its own thread and hands its output to the next stage
+// through a small bounded queue of 64K chunks, so the stages overlap across
+// cores and memory stays flat however large the input is. Nothing is
+// written to disk between stages (tool-based stages such as PDF to TXT
+// still spool for the tool itself).
+
+#define FC_PIPELINE_MAX 8   // stages
+
+typedef struct {
+    int count;
+    fc_conversion stages[FC_PIPELINE_MAX];
+} fc_pipeline;
+
+// Parse a chain of formats joined by ':' ("html:txt:json", case-insensitive)
+// where every step has a converter. A plain conversion spec ("1",
+// "txt:csv") parses as one stage. Returns 0, or -1 if the spec is unknown.
+int fc_pipeline_parse(const char *spec, fc_pipeline *pipeline);
+
+// "HTML to TXT to JSON"
+void fc_pipeline_name(const fc_pipeline *pipeline, char *buf, size_t size);
+
+// Run every stage from in to out. ctx runs the last stage; the others get
+// their own, set up as worker contexts are (see threadpool.h). Neither
+// stream is closed. On failure the status is that of the
+// stage that failed first in the chain (a stage that stopped only because a
+// later one gave up is not blamed).
+fc_status fc_pipeline_stream(fc_context *ctx, const fc_pipeline *pipeline, FILE *in, FILE *out);
+
+// The same between files, with compressed inputs and outputs handled as by
+// fc_convert_file().
+fc_status fc_pipeline_file(fc_context *ctx, const fc_pipeline *pipeline,
+                           const char *input_file, const char *output_file);
+
+#endif
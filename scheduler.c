@@ -0,0 +1,629 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "scheduler.h"
+#include "metrics.h"
+#include "trace.h"
+
+#define SPLIT_PIECE_MIN (16L << 20)     // smallest piece worth a worker of its own
+#define SPLIT_SCAN 65536
+#define JOIN_BUFFER 65536
+
+typedef struct {
+    fc_job_fn fn;
+    void *arg;
+    uint64_t deadline;          // submitted + estimated cost
+    uint64_t seq;               // FIFO among equal deadlines
+    uint64_t queued;
+} sched_job;
+
+// Binary min-heap on (deadline, seq)
+typedef struct {
+    sched_job *jobs;
+    int count, capacity;
+} job_heap;
+
+struct fc_sched {
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // any class queued: wakes general workers
+    pthread_cond_t urgent;      // interactive queued: wakes reserved workers
+    pthread_cond_t not_full;
+    pthread_cond_t idle;
+
+    job_heap queues[FC_PRIORITY_LAST + 1];
+    int limited;                // normal and bulk jobs queued
+    int queue_capacity;
+    int active;
+    int stopping;
+    uint64_t seq;
+
+    pthread_t *threads;
+    int general, reserved;      // workers started of each kind
+    fc_context *settings;       // as the workers' contexts are set up
+};
+
+// Estimated throughput of each conversion on one core, in MB/s, from
+// file_converter_bench; tools also pay for starting a process
+static const unsigned rate_mb[FC_CONVERSION_LAST + 1] = {
+    [FC_TXT_TO_CSV] = 1000,  [FC_CSV_TO_TXT] = 1000,
+    [FC_PDF_TO_TXT] = 20,    [FC_TXT_TO_PDF] = 10,
+    [FC_TXT_TO_HTML] = 500,  [FC_HTML_TO_TXT] = 500,
+    [FC_JSON_TO_TXT] = 2000, [FC_TXT_TO_JSON] = 300,
+    [FC_CSV_TO_JSON] = 64,   [FC_JSON_TO_CSV] = 60,
+    [FC_CSV_TO_ARROW] = 120, [FC_TXT_TO_ARROW] = 120,
+    [FC_CSV_TO_XLSX] = 16,
+};
+
+#define JOB_OVERHEAD_NS 100000ull       // open, stat, close
+#define TOOL_OVERHEAD_NS 10000000ull    // fork and exec
+
+static const char *const priority_names[FC_PRIORITY_LAST + 1] = { "interactive", "normal", "bulk" };
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint64_t fc_sched_cost(fc_conversion type, uint64_t input_size) {
+    const fc_converter_info *info = fc_converter(type);
+    if (!info) return JOB_OVERHEAD_NS;
+    uint64_t cost = input_size * 1000 / rate_mb[type] + JOB_OVERHEAD_NS;
+    if (info->tool) cost += TOOL_OVERHEAD_NS;
+    return cost;
+}
+
+fc_priority fc_priority_parse(const char *name, fc_priority fallback) {
+    for (int p = 0; name && p <= FC_PRIORITY_LAST; p++) {
+        if (strcasecmp(name, priority_names[p]) == 0) return (fc_priority)p;
+    }
+    return fallback;
+}
+
+const char *fc_priority_name(fc_priority priority) {
+    return (unsigned)priority <= FC_PRIORITY_LAST ? priority_names[priority] : NULL;
+}
+
+// Queues
+
+static int before(const sched_job *a, const sched_job *b) {
+    return a->deadline != b->deadline ? a->deadline < b->deadline : a->seq < b->seq;
+}
+
+static int heap_push(job_heap *h, const sched_job *job) {
+    if (h->count == h->capacity) {
+        int capacity = h->capacity ? h->capacity * 2 : 16;
+        sched_job *grown = realloc(h->jobs, capacity * sizeof(sched_job));
+        if (!grown) return -1;
+        h->jobs = grown;
+        h->capacity = capacity;
+    }
+    int i = h->count++;
+    while (i > 0 && before(job, &h->jobs[(i - 1) / 2])) {
+        h->jobs[i] = h->jobs[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h->jobs[i] = *job;
+    return 0;
+}
+
+static sched_job heap_pop(job_heap *h) {
+    sched_job top = h->jobs[0];
+    sched_job last = h->jobs[--h->count];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= h->count) break;
+        if (child + 1 < h->count && before(&h->jobs[child + 1], &h->jobs[child])) child++;
+        if (!before(&h->jobs[child], &last)) break;
+        h->jobs[i] = h->jobs[child];
+        i = child;
+    }
+    if (h->count) h->jobs[i] = last;
+    return top;
+}
+
+// The class a worker should take from next, or -1 if none it may run
+static int next_class(const fc_sched *s, int reserved) {
+    int last = reserved ? FC_PRIORITY_INTERACTIVE : FC_PRIORITY_LAST;
+    for (int p = 0; p <= last; p++) {
+        if (s->queues[p].count) return p;
+    }
+    return -1;
+}
+
+static int queued(const fc_sched *s) {
+    return s->queues[FC_PRIORITY_INTERACTIVE].count + s->limited;
+}
+
+// Workers
+
+static void worker_loop(fc_sched *s, int reserved) {
+    fc_context *ctx = fc_worker_context_new();
+
+    fc_trace_thread_name(reserved ? "interactive worker" : "sched worker");
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        int p;
+        while ((p = next_class(s, reserved)) < 0 && !s->stopping) {
+            pthread_cond_wait(reserved ? &s->urgent : &s->work, &s->lock);
+        }
+        if (p < 0) break;
+
+        sched_job job = heap_pop(&s->queues[p]);
+        if (p != FC_PRIORITY_INTERACTIVE) {
+            s->limited--;
+            pthread_cond_signal(&s->not_full);
+        }
+        s->active++;
+        fc_metrics_queue_depth(p, -1);
+        pthread_mutex_unlock(&s->lock);
+
+        fc_metrics_queue_wait(p, now_ns() - job.queued);
+        fc_trace_span span;
+        fc_trace_begin(&span, "job");
+        job.fn(ctx, job.arg);
+        fc_trace_end(&span, 0);
+
+        pthread_mutex_lock(&s->lock);
+        s->active--;
+        if (queued(s) == 0 && s->active == 0) pthread_cond_broadcast(&s->idle);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    fc_context_free(ctx);
+}
+
+static void *general_main(void *data) {
+    worker_loop(data, 0);
+    return NULL;
+}
+
+static void *reserved_main(void *data) {
+    worker_loop(data, 1);
+    return NULL;
+}
+
+fc_sched *fc_sched_new(int threads, int reserved, int queue_capacity) {
+    if (threads <= 0) threads = fc_default_threads();
+    if (reserved < 0) reserved = 1;
+    if (queue_capacity <= 0) queue_capacity = threads * 4;
+
+    fc_sched *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->threads = calloc(threads + reserved, sizeof(pthread_t));
+    if (!s->threads) {
+        free(s);
+        return NULL;
+    }
+    s->queue_capacity = queue_capacity;
+    s->settings = fc_worker_context_new();
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->work, NULL);
+    pthread_cond_init(&s->urgent, NULL);
+    pthread_cond_init(&s->not_full, NULL);
+    pthread_cond_init(&s->idle, NULL);
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&s->threads[s->general], NULL, general_main, s) != 0) break;
+        s->general++;
+    }
+    for (int i = 0; s->general && i < reserved; i++) {
+        if (pthread_create(&s->threads[s->general + s->reserved], NULL, reserved_main, s) != 0) break;
+        s->reserved++;
+    }
+    if (s->general == 0) {
+        fc_sched_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+int fc_sched_submit(fc_sched *s, fc_priority priority, uint64_t cost, fc_job_fn fn, void *arg) {
+    if ((unsigned)priority > FC_PRIORITY_LAST) priority = FC_PRIORITY_NORMAL;
+    int limited = priority != FC_PRIORITY_INTERACTIVE;
+
+    pthread_mutex_lock(&s->lock);
+    while (limited && s->limited >= s->queue_capacity && !s->stopping) {
+        pthread_cond_wait(&s->not_full, &s->lock);
+    }
+    if (s->stopping) {
+        pthread_mutex_unlock(&s->lock);
+        return -1;
+    }
+
+    sched_job job = { fn, arg, 0, s->seq++, now_ns() };
+    job.deadline = job.queued + cost;
+    if (heap_push(&s->queues[priority], &job) != 0) {
+        pthread_mutex_unlock(&s->lock);
+        return -1;
+    }
+    if (limited) {
+        s->limited++;
+    } else {
+        pthread_cond_signal(&s->urgent);
+    }
+    pthread_cond_signal(&s->work);
+    fc_metrics_queue_depth(priority, 1);
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+void fc_sched_wait_idle(fc_sched *s) {
+    pthread_mutex_lock(&s->lock);
+    while (queued(s) > 0 || s->active > 0) {
+        pthread_cond_wait(&s->idle, &s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+int fc_sched_threads(const fc_sched *s) {
+    return s->general;
+}
+
+void fc_sched_free(fc_sched *s) {
+    if (!s) return;
+
+    pthread_mutex_lock(&s->lock);
+    s->stopping = 1;
+    pthread_cond_broadcast(&s->work);
+    pthread_cond_broadcast(&s->urgent);
+    pthread_cond_broadcast(&s->not_full);
+    pthread_mutex_unlock(&s->lock);
+
+    for (int i = 0; i < s->general + s->reserved; i++) {
+        pthread_join(s->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->work);
+    pthread_cond_destroy(&s->urgent);
+    pthread_cond_destroy(&s->not_full);
+    pthread_cond_destroy(&s->idle);
+    for (int p = 0; p <= FC_PRIORITY_LAST; p++) free(s->queues[p].jobs);
+    fc_context_free(s->settings);
+    free(s->threads);
+    free(s);
+}
+
+// File conversions. A job is one piece covering the whole input, converted
+// with fc_convert_file(), or several covering consecutive line-aligned
+// ranges of it, each converted into its own part file.
+
+typedef struct file_job file_job;
+
+typedef struct {
+    file_job *job;
+    off_t start, end;
+    char *part;             // NULL for the first piece, which writes the output itself
+} piece;
+
+struct file_job {
+    fc_conversion type;
+    char *input, *output;
+    fc_sched_done_fn done;
+    void *arg;
+
+    pthread_mutex_t lock;
+    int remaining;
+    fc_status status;
+    uint64_t submitted, started;
+
+    int count;
+    piece pieces[];
+};
+
+typedef struct {
+    int fd;
+    off_t pos, end;
+} range;
+
+static ssize_t range_read(void *cookie, char *buf, size_t size) {
+    range *r = cookie;
+    if ((off_t)size > r->end - r->pos) size = r->end - r->pos;
+    if (size == 0) return 0;
+    ssize_t n;
+    do {
+        n = pread(r->fd, buf, size, r->pos);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) r->pos += n;
+    return n;
+}
+
+// Offsets are the file's, so stream positions (and the metrics taken
+// from them) match a plain read of it
+static int range_seek(void *cookie, off64_t *offset, int whence) {
+    range *r = cookie;
+    off_t pos = whence == SEEK_SET ? *offset : whence == SEEK_CUR ? r->pos + *offset : r->end + *offset;
+    if (pos < 0 || pos > r->end) return -1;
+    r->pos = pos;
+    *offset = pos;
+    return 0;
+}
+
+static int range_close(void *cookie) {
+    range *r = cookie;
+    int rc = close(r->fd);
+    free(r);
+    return rc;
+}
+
+// A FILE reading bytes [start, end) of path
+static FILE *open_range(const char *path, off_t start, off_t end) {
+    range *r = malloc(sizeof(*r));
+    if (!r) return NULL;
+    r->fd = open(path, O_RDONLY | O_CLOEXEC);
+    r->pos = start;
+    r->end = end;
+    cookie_io_functions_t io = { range_read, NULL, range_seek, range_close };
+    FILE *f = r->fd >= 0 ? fopencookie(r, "r", io) : NULL;
+    if (!f) {
+        if (r->fd >= 0) close(r->fd);
+        free(r);
+    }
+    return f;
+}
+
+static fc_status convert_piece(fc_context *ctx, const file_job *job, const piece *p) {
+    if (job->count == 1) return fc_convert_file(ctx, job->type, job->input, job->output);
+
+    FILE *in = open_range(job->input, p->start, p->end);
+    if (!in) return FC_ERR_INPUT;
+    FILE *out = fopen(p->part ? p->part : job->output, "w");
+    if (!out) {
+        fclose(in);
+        return FC_ERR_OUTPUT;
+    }
+    fc_status status = fc_convert_stream(ctx, job->type, in, out);
+    if (fclose(in) != 0 && status == FC_OK) status = FC_ERR_IO;
+    if (fclose(out) != 0 && status == FC_OK) status = FC_ERR_IO;
+    return status;
+}
+
+// Append the part files to the output, by the kernel where it can
+static fc_status join_parts(const file_job *job) {
+    int out_fd = open(job->output, O_WRONLY | O_CLOEXEC);
+    if (out_fd < 0 || lseek(out_fd, 0, SEEK_END) < 0) {
+        if (out_fd >= 0) close(out_fd);
+        return FC_ERR_OUTPUT;
+    }
+
+    fc_status status = FC_OK;
+    char *buf = NULL;
+    for (int i = 1; i < job->count && status == FC_OK; i++) {
+        int in_fd = open(job->pieces[i].part, O_RDONLY | O_CLOEXEC);
+        if (in_fd < 0) {
+            status = FC_ERR_IO;
+            break;
+        }
+        int kernel = 1;
+        for (;;) {
+            ssize_t n = -1;
+            if (kernel) {
+                n = copy_file_range(in_fd, NULL, out_fd, NULL, 1 << 30, 0);
+                if (n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+                    kernel = 0;
+                    continue;
+                }
+            } else if (buf || (buf = malloc(JOIN_BUFFER))) {
+                n = read(in_fd, buf, JOIN_BUFFER);
+                for (ssize_t done = 0; n > 0 && done < n;) {
+                    ssize_t w = write(out_fd, buf + done, n - done);
+                    if (w < 0 && errno == EINTR) continue;
+                    if (w <= 0) {
+                        n = -1;
+                        break;
+                    }
+                    done += w;
+                }
+            } else {
+                status = FC_ERR_NOMEM;
+                break;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) status = FC_ERR_IO;
+            if (n <= 0) break;
+        }
+        close(in_fd);
+    }
+    free(buf);
+    if (close(out_fd) != 0 && status == FC_OK) status = FC_ERR_IO;
+    return status;
+}
+
+static void free_file_job(file_job *job) {
+    for (int i = 1; i < job->count; i++) {
+        if (job->pieces[i].part) {
+            unlink(job->pieces[i].part);
+            free(job->pieces[i].part);
+        }
+    }
+    pthread_mutex_destroy(&job->lock);
+    free(job->input);
+    free(job->output);
+    free(job);
+}
+
+static void finish_job(file_job *job);
+
+static void run_piece(fc_context *ctx, void *arg) {
+    piece *p = arg;
+    file_job *job = p->job;
+    uint64_t start = now_ns();
+
+    fc_status status = convert_piece(ctx, job, p);
+
+    pthread_mutex_lock(&job->lock);
+    if (start < job->started) job->started = start;
+    if (status != FC_OK && job->status == FC_OK) job->status = status;
+    int last = --job->remaining == 0;
+    pthread_mutex_unlock(&job->lock);
+    if (last) finish_job(job);
+}
+
+// Join the parts and report, once the last piece is done
+static void finish_job(file_job *job) {
+    if (job->count > 1 && job->status == FC_OK) {
+        fc_trace_span span;
+        fc_trace_begin(&span, "join pieces");
+        job->status = join_parts(job);
+        fc_trace_end(&span, 0);
+    }
+    // As fc_convert_file does for a whole file: a failed split job leaves
+    // no partial output behind, devices are left alone
+    struct stat st;
+    if (job->count > 1 && job->status != FC_OK && stat(job->output, &st) == 0 && S_ISREG(st.st_mode))
+        unlink(job->output);
+
+    uint64_t started = job->started != UINT64_MAX ? job->started : job->submitted;
+    fc_sched_result result = { job->status, started - job->submitted, now_ns() - started, job->count };
+    fc_sched_done_fn done = job->done;
+    void *done_arg = job->arg;
+    free_file_job(job);
+    done(&result, done_arg);
+}
+
+// Whether input can be cut at line breaks: plain text, as the encoding stage
+// would read it piecewise, not compressed or UTF-16, into uncompressed output
+static int splittable(const fc_sched *s, fc_conversion type, const char *input_file, const char *output_file) {
+    const fc_converter_info *info = fc_converter(type);
+    if (!info || !(info->caps & FC_CAP_PARALLEL) || (info->caps & FC_CAP_PASSTHROUGH)) return 0;
+    if (fc_output_compression(s->settings, output_file) != FC_COMPRESS_NONE) return 0;
+
+    unsigned char head[4] = { 0 };
+    int fd = open(input_file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    ssize_t n = pread(fd, head, sizeof(head), 0);
+    close(fd);
+    if (n < 2) return 0;
+    if ((head[0] == 0xFF && head[1] == 0xFE) || (head[0] == 0xFE && head[1] == 0xFF)) return 0;
+    if (head[0] == 0x1F && head[1] == 0x8B) return 0;
+    if (n == 4 && head[0] == 0x28 && head[1] == 0xB5 && head[2] == 0x2F && head[3] == 0xFD) return 0;
+    return 1;
+}
+
+// Offset just past the first line break at or after from, or size if none
+static off_t line_start(int fd, off_t from, off_t size, char *buf) {
+    while (from < size) {
+        ssize_t n = pread(fd, buf, SPLIT_SCAN, from);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        const char *nl = memchr(buf, '\n', n);
+        if (nl) return from + (nl - buf) + 1;
+        from += n;
+    }
+    return size;
+}
+
+// Cut the input into up to count line-aligned ranges; returns how many
+static int cut_pieces(const char *input_file, off_t size, off_t *cuts, int count) {
+    char *buf = malloc(SPLIT_SCAN);
+    int fd = open(input_file, O_RDONLY | O_CLOEXEC);
+    int pieces = 1;
+    cuts[0] = 0;
+    if (buf && fd >= 0) {
+        for (int i = 1; i < count; i++) {
+            off_t from = size / count * i;
+            if (from < cuts[pieces - 1]) from = cuts[pieces - 1];
+            off_t cut = line_start(fd, from, size, buf);
+            if (cut >= size) break;
+            cuts[pieces++] = cut;
+        }
+    }
+    if (fd >= 0) close(fd);
+    free(buf);
+    cuts[pieces] = size;
+    return pieces;
+}
+
+static int make_part(file_job *job, int i) {
+    size_t len = strlen(job->output) + 32;
+    char *part = malloc(len);
+    if (!part) return -1;
+    snprintf(part, len, "%s.%d.XXXXXX", job->output, i);
+    int fd = mkstemp(part);
+    if (fd < 0) {
+        free(part);
+        return -1;
+    }
+    close(fd);
+    job->pieces[i].part = part;
+    return 0;
+}
+
+int fc_sched_convert_file(fc_sched *s, fc_priority priority, fc_conversion type,
+                          const char *input_file, const char *output_file,
+                          fc_sched_done_fn done, void *arg) {
+    struct stat st;
+    off_t size = stat(input_file, &st) == 0 ? st.st_size : 0;
+
+    int count = 1;
+    if (size >= FC_SCHED_SPLIT_SIZE && s->general > 1 && splittable(s, type, input_file, output_file)) {
+        count = size / SPLIT_PIECE_MIN < s->general ? (int)(size / SPLIT_PIECE_MIN) : s->general;
+    }
+    off_t cuts[count + 1];
+    if (count > 1) {
+        count = cut_pieces(input_file, size, cuts, count);
+    } else {
+        cuts[0] = 0;
+        cuts[1] = size;
+    }
+
+    file_job *job = calloc(1, sizeof(*job) + count * sizeof(piece));
+    if (!job) return -1;
+    job->type = type;
+    job->input = strdup(input_file);
+    job->output = strdup(output_file);
+    job->done = done;
+    job->arg = arg;
+    job->status = FC_OK;
+    job->started = UINT64_MAX;
+    job->count = count;
+    pthread_mutex_init(&job->lock, NULL);
+    int ok = job->input && job->output;
+    for (int i = 0; i < count; i++) {
+        job->pieces[i].job = job;
+        job->pieces[i].start = cuts[i];
+        job->pieces[i].end = cuts[i + 1];
+        if (ok && i > 0 && make_part(job, i) != 0) ok = 0;
+    }
+    if (!ok) {
+        free_file_job(job);
+        return -1;
+    }
+
+    // Hold the count at one more than queued so a piece finishing early
+    // cannot complete the job while the rest are being submitted
+    job->remaining = count + 1;
+    job->submitted = now_ns();
+    int submitted = 0;
+    for (; submitted < count; submitted++) {
+        const piece *p = &job->pieces[submitted];
+        if (fc_sched_submit(s, priority, fc_sched_cost(type, p->end - p->start), run_piece,
+                            &job->pieces[submitted]) != 0) break;
+    }
+
+    if (submitted == 0) {
+        free_file_job(job);
+        return -1;
+    }
+
+    // Pieces that could not be queued (shutting down) fail the job
+    pthread_mutex_lock(&job->lock);
+    job->remaining -= count + 1 - submitted;
+    int last = job->remaining == 0;
+    if (submitted < count && job->status == FC_OK) job->status = FC_ERR_UNSUPPORTED;
+    pthread_mutex_unlock(&job->lock);
+    if (last) finish_job(job);
+    return 0;
+}
@@ -0,0 +1,84 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+#include "converter.h"
+#include "threadpool.h"
+
+// Size-aware job scheduler in front of the conversion workers.
+//
+// Jobs come in priority classes and run strictly by class. Within a class
+// each job gets a deadline, its submission time plus its estimated cost
+// (fc_sched_cost), and the earliest deadline runs first: a small job
+// overtakes a large one queued just before it, but a large job is not
+// starved, since everything queued after its deadline sorts behind it.
+//
+// Some workers are reserved for interactive jobs and never pick up
+// anything else, so a user waiting on a conversion is never stuck behind
+// bulk work that already holds every other worker. Interactive jobs also
+// skip the queue limit.
+//
+// Each worker owns an fc_context, as in fc_pool. Queue depth and wait time
+// per class are recorded in the metrics.
+
+typedef enum {
+    FC_PRIORITY_INTERACTIVE,    // someone is waiting on it (the GUI, the CLI menu)
+    FC_PRIORITY_NORMAL,         // daemon clients
+    FC_PRIORITY_BULK            // watch folders and batch runs
+} fc_priority;
+
+#define FC_PRIORITY_LAST FC_PRIORITY_BULK
+
+// Inputs of FC_CAP_PARALLEL conversions at least this large are split
+// into one piece per worker, cut at line breaks
+#define FC_SCHED_SPLIT_SIZE (64L << 20)
+
+typedef struct fc_sched fc_sched;
+
+// threads <= 0 picks one worker per online CPU. reserved < 0 adds one
+// worker for interactive jobs on top of those. queue_capacity <= 0 picks
+// four slots per worker.
+fc_sched *fc_sched_new(int threads, int reserved, int queue_capacity);
+
+// Estimated run time in nanoseconds of a conversion of input_size bytes
+uint64_t fc_sched_cost(fc_conversion type, uint64_t input_size);
+
+// Queue a job. Blocks while the queue is full unless it is interactive.
+// Returns -1 once the scheduler is shutting down.
+int fc_sched_submit(fc_sched *sched, fc_priority priority, uint64_t cost, fc_job_fn fn, void *arg);
+
+typedef struct {
+    fc_status status;
+    uint64_t wait_ns;           // queued until the (first piece of the) job started
+    uint64_t run_ns;            // from then until it finished
+    int pieces;                 // 1 unless the input was split
+} fc_sched_result;
+
+typedef void (*fc_sched_done_fn)(const fc_sched_result *result, void *arg);
+
+// Convert input_file to output_file as a job of the given class, costed by
+// the input size. A large input of an FC_CAP_PARALLEL conversion (not
+// compressed, not UTF-16) runs as pieces on several workers, written to
+// temp files next to the output and joined when the last one finishes;
+// each piece counts as an operation in the metrics. done runs on the
+// worker that finished last. Returns -1, without calling done, if the job
+// could not be queued.
+int fc_sched_convert_file(fc_sched *sched, fc_priority priority, fc_conversion type,
+                          const char *input_file, const char *output_file,
+                          fc_sched_done_fn done, void *arg);
+
+// Block until every queue is empty and every worker is idle.
+void fc_sched_wait_idle(fc_sched *sched);
+
+// Workers that take any job (the reserved ones not counted)
+int fc_sched_threads(const fc_sched *sched);
+
+// Run the jobs still queued, then stop and join the workers.
+void fc_sched_free(fc_sched *sched);
+
+// "interactive", "normal" or "bulk" (case-insensitive); fallback otherwise
+fc_priority fc_priority_parse(const char *name, fc_priority fallback);
+const char *fc_priority_name(fc_priority priority);
+
+#endif
@@ -0,0 +1,1123 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+#include "table.h"
+#include "number.h"
+#include "arrow.h"
+#include "xlsx.h"
+#include "budget.h"
+
+#define SAMPLE_ROWS 1000          // rows looked at for column types and names
+#define SAMPLE_BYTES (1 << 20)    // ... unless they take more than this
+#define MAX_DEPTH 512             // JSON nesting
+#define FLUSH_SIZE 65536          // output is built up in a buffer and written this much at a time
+#define SPOOL_MEMORY (8 << 20)    // JSON to CSV rows held in memory before they spill to a file
+
+// Growable buffers
+
+typedef struct {
+    char *data;
+    size_t len, cap;
+    int failed;         // an append ran out of memory
+} buffer;
+
+typedef struct {
+    size_t off, len;
+} span;
+
+typedef struct {
+    span *v;
+    size_t n, cap;
+} span_list;
+
+static int reserve(buffer *b, size_t more) {
+    if (b->len + more <= b->cap) return 0;
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + more) cap *= 2;
+    char *data = realloc(b->data, cap);
+    if (!data) {
+        b->failed = 1;
+        return -1;
+    }
+    b->data = data;
+    b->cap = cap;
+    return 0;
+}
+
+static int append(buffer *b, const char *s, size_t n) {
+    if (n == 0) return 0;
+    if (reserve(b, n) != 0) return -1;
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+    return 0;
+}
+
+static int append_char(buffer *b, char c) {
+    if (b->len == b->cap && reserve(b, 1) != 0) return -1;
+    b->data[b->len++] = c;
+    return 0;
+}
+
+static int append_str(buffer *b, const char *s) {
+    return append(b, s, strlen(s));
+}
+
+// Output goes through a buffer: a stdio call per field or escape would cost
+// more than the conversion itself
+static fc_status flush(buffer *b, FILE *out) {
+    if (b->failed) return FC_ERR_NOMEM;
+    if (b->len && fwrite(b->data, 1, b->len, out) != b->len) return FC_ERR_IO;
+    b->len = 0;
+    return FC_OK;
+}
+
+static int add_span(span_list *l, size_t off, size_t len) {
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 16;
+        span *v = realloc(l->v, cap * sizeof(*v));
+        if (!v) return -1;
+        l->v = v;
+        l->cap = cap;
+    }
+    l->v[l->n++] = (span){ off, len };
+    return 0;
+}
+
+// Append s[0..len) as a JSON string
+static void append_json_string(buffer *b, const char *s, size_t len) {
+    const char *end = s + len;
+    append_char(b, '"');
+    while (s < end) {
+        const char *run = s;
+        while (s < end && (unsigned char)*s >= 0x20 && *s != '"' && *s != '\\') s++;
+        append(b, run, s - run);
+        if (s == end) break;
+        char escape[8];
+        switch (*s) {
+            case '"':  append_str(b, "\\\""); break;
+            case '\\': append_str(b, "\\\\"); break;
+            case '\b': append_str(b, "\\b"); break;
+            case '\f': append_str(b, "\\f"); break;
+            case '\n': append_str(b, "\\n"); break;
+            case '\r': append_str(b, "\\r"); break;
+            case '\t': append_str(b, "\\t"); break;
+            default:
+                snprintf(escape, sizeof(escape), "\\u%04x", (unsigned char)*s);
+                append_str(b, escape);
+        }
+        s++;
+    }
+    append_char(b, '"');
+}
+
+// CSV reading. A record's fields are unquoted into one buffer.
+
+typedef struct {
+    FILE *in;
+    char *block;
+    size_t block_size, pos, len;
+    buffer data;        // the current record's fields, back to back
+    span_list fields;
+    char delimiter;
+    int quoted;         // some field of the record was quoted
+} csv_reader;
+
+static int csv_fill(csv_reader *r) {
+    r->pos = 0;
+    r->len = fread(r->block, 1, r->block_size, r->in);
+    return r->len > 0;
+}
+
+// Read the next record: 1, 0 at the end of the input, -1 if out of memory
+static int csv_read(csv_reader *r) {
+    size_t start = 0;
+    int in_quotes = 0, any = 0;
+    r->data.len = 0;
+    r->fields.n = 0;
+    r->quoted = 0;
+    for (;;) {
+        if (r->pos == r->len && !csv_fill(r)) {
+            if (!any) return 0;
+            return add_span(&r->fields, start, r->data.len - start) == 0 ? 1 : -1;
+        }
+        any = 1;
+        const char *p = r->block + r->pos, *end = r->block + r->len;
+        if (in_quotes) {
+            const char *q = memchr(p, '"', end - p);
+            size_t n = (q ? q : end) - p;
+            if (append(&r->data, p, n) != 0) return -1;
+            r->pos += n;
+            if (!q) continue;
+            // Closing quote, or the first of a doubled one
+            r->pos++;
+            if (r->pos == r->len) csv_fill(r);
+            if (r->pos < r->len && r->block[r->pos] == '"') {
+                if (append_char(&r->data, '"') != 0) return -1;
+                r->pos++;
+            } else {
+                in_quotes = 0;
+            }
+            continue;
+        }
+
+        const char *q = p;
+        while (q < end && *q != r->delimiter && *q != '\n' && *q != '\r' && *q != '"') q++;
+        if (append(&r->data, p, q - p) != 0) return -1;
+        r->pos += q - p;
+        if (q == end) continue;
+        r->pos++;
+        if (*q == r->delimiter) {
+            if (add_span(&r->fields, start, r->data.len - start) != 0) return -1;
+            start = r->data.len;
+            continue;
+        }
+        switch (*q) {
+            case '"':
+                // Quotes open a field only at its start; elsewhere they are text
+                if (r->data.len == start) {
+                    in_quotes = r->quoted = 1;
+                } else if (append_char(&r->data, '"') != 0) {
+                    return -1;
+                }
+                break;
+            case '\r':
+                if (r->pos == r->len) csv_fill(r);
+                if (r->pos < r->len && r->block[r->pos] == '\n') r->pos++;
+                // fall through
+            default:
+                return add_span(&r->fields, start, r->data.len - start) == 0 ? 1 : -1;
+        }
+    }
+}
+
+static int blank_record(const csv_reader *r) {
+    return r->fields.n == 1 && r->fields.v[0].len == 0 && !r->quoted;
+}
+
+// Field values
+
+typedef enum { COL_STRING, COL_INT, COL_NUMBER, COL_BOOL } column_type;
+
+static int leading_zero(const char *s, size_t len) {
+    if (len && (*s == '-' || *s == '+')) s++, len--;
+    return len >= 2 && s[0] == '0' && s[1] >= '0' && s[1] <= '9';
+}
+
+static int is_int(const char *s, size_t len) {
+    long long value;
+    return !leading_zero(s, len) && fc_parse_int64(s, len, &value) == 0;
+}
+
+static int is_number(const char *s, size_t len) {
+    double value;
+    return !leading_zero(s, len) && fc_parse_double(s, len, &value) == 0;
+}
+
+// 1 for true, 0 for false, -1 for neither
+static int bool_value(const char *s, size_t len) {
+    if (len == 4 && strncasecmp(s, "true", 4) == 0) return 1;
+    if (len == 5 && strncasecmp(s, "false", 5) == 0) return 0;
+    return -1;
+}
+
+// Write a numeral accepted by is_number() as a JSON number. The spelling
+// JSON does not allow ("+1", ".5", "5.") is fixed up as text, so the value
+// is exactly what the input says.
+static void append_number(buffer *b, const char *s, size_t len) {
+    const char *end = s + len;
+    if (*s == '+') s++;
+    else if (*s == '-') append_char(b, *s++);
+    if (s == end || *s == '.') append_char(b, '0');
+    const char *digits = s;
+    while (s < end && *s >= '0' && *s <= '9') s++;
+    append(b, digits, s - digits);
+    if (s < end && *s == '.') {
+        const char *point = s++;
+        while (s < end && *s >= '0' && *s <= '9') s++;
+        if (s - point > 1) append(b, point, s - point);
+    }
+    append(b, s, end - s);
+}
+
+static void append_value(buffer *b, column_type type, const char *s, size_t len) {
+    if (len == 0 && type != COL_STRING) {
+        append_str(b, "null");
+        return;
+    }
+    int value;
+    switch (type) {
+        case COL_INT:
+        case COL_NUMBER:
+            // An int column may still hold the odd 2.5: still a number
+            if (is_number(s, len)) {
+                append_number(b, s, len);
+                return;
+            }
+            break;
+        case COL_BOOL:
+            if ((value = bool_value(s, len)) >= 0) {
+                append_str(b, value ? "true" : "false");
+                return;
+            }
+            break;
+        case COL_STRING:
+            break;
+    }
+    append_json_string(b, s, len);
+}
+
+// Tables read from CSV: the header row names the columns and the first
+// rows, kept as a sample, give their types
+
+typedef struct {
+    csv_reader r;
+    buffer names;           // column names, back to back
+    span_list name_spans;
+    size_t columns;
+    buffer sample;          // the sampled rows' fields
+    span_list sample_fields;
+    span_list sample_rows;  // each row's first field and count
+    column_type *types;
+    int more;               // the input goes on past the sample
+} csv_table;
+
+// Column names from the header row: blanks become "column N" and repeats
+// get "_2", "_3"... so that every name is distinct
+static int name_columns(csv_table *t) {
+    const buffer *header = &t->r.data;
+    const span_list *fields = &t->r.fields;
+    buffer *names = &t->names;
+    span_list *spans = &t->name_spans;
+    for (size_t i = 0; i < fields->n; i++) {
+        char text[32];
+        const char *name = header->data + fields->v[i].off;
+        size_t len = fields->v[i].len;
+        if (len == 0) {
+            len = snprintf(text, sizeof(text), "column %zu", i + 1);
+            name = text;
+        }
+        size_t off = names->len;
+        if (append(names, name, len) != 0) return -1;
+        for (int n = 2;; n++) {
+            size_t j = 0;
+            while (j < spans->n && (spans->v[j].len != names->len - off ||
+                                    memcmp(names->data + spans->v[j].off, names->data + off, names->len - off) != 0)) {
+                j++;
+            }
+            if (j == spans->n) break;
+            names->len = off + len;
+            if (append(names, text, snprintf(text, sizeof(text), "_%d", n)) != 0) return -1;
+        }
+        if (add_span(spans, off, names->len - off) != 0) return -1;
+    }
+    t->columns = spans->n;
+    return 0;
+}
+
+static const span *sample_row(const csv_table *t, size_t row, size_t *n) {
+    *n = t->sample_rows.v[row].len;
+    return t->sample_fields.v + t->sample_rows.v[row].off;
+}
+
+// Read the header row and the sample, and type the columns: 1, 0 for an
+// empty input, -1 if out of memory
+static int read_table_head(csv_table *t) {
+    int rc;
+    while ((rc = csv_read(&t->r)) > 0 && blank_record(&t->r)) {}
+    if (rc <= 0) return rc;
+    if (name_columns(t) != 0) return -1;
+
+    while (t->sample_rows.n < SAMPLE_ROWS && t->sample.len < SAMPLE_BYTES && (rc = csv_read(&t->r)) > 0) {
+        if (blank_record(&t->r)) continue;
+        size_t base = t->sample.len;
+        if (append(&t->sample, t->r.data.data, t->r.data.len) != 0 ||
+            add_span(&t->sample_rows, t->sample_fields.n, t->r.fields.n) != 0) return -1;
+        for (size_t i = 0; i < t->r.fields.n; i++) {
+            if (add_span(&t->sample_fields, base + t->r.fields.v[i].off, t->r.fields.v[i].len) != 0) return -1;
+        }
+    }
+    if (rc < 0) return -1;
+    t->more = rc > 0;
+
+    if (t->columns && !(t->types = malloc(t->columns * sizeof(*t->types)))) return -1;
+    for (size_t col = 0; col < t->columns; col++) {
+        int ints = 1, numbers = 1, bools = 1, seen = 0;
+        for (size_t row = 0; row < t->sample_rows.n; row++) {
+            size_t n;
+            const span *fields = sample_row(t, row, &n);
+            if (col >= n || fields[col].len == 0) continue;
+            const char *s = t->sample.data + fields[col].off;
+            size_t len = fields[col].len;
+            seen = 1;
+            if (ints && !is_int(s, len)) ints = 0;
+            if (numbers && !ints && !is_number(s, len)) numbers = 0;
+            if (bools && bool_value(s, len) < 0) bools = 0;
+        }
+        t->types[col] = !seen ? COL_STRING : ints ? COL_INT : numbers ? COL_NUMBER : bools ? COL_BOOL : COL_STRING;
+    }
+    return 1;
+}
+
+// Sample memory is no longer needed for a long run
+static void drop_sample(csv_table *t) {
+    free(t->sample.data);
+    t->sample = (buffer){ 0 };
+}
+
+static void free_table(csv_table *t) {
+    free(t->r.data.data);
+    free(t->r.fields.v);
+    free(t->names.data);
+    free(t->name_spans.v);
+    free(t->sample.data);
+    free(t->sample_fields.v);
+    free(t->sample_rows.v);
+    free(t->types);
+}
+
+// CSV to JSON
+
+typedef struct {
+    csv_table t;
+    buffer keys;            // '"name": ' for each column
+    span_list key_spans;
+    buffer out;
+    int first;
+} csv_json;
+
+static void write_object(csv_json *c, const char *data, const span *fields, size_t n) {
+    buffer *b = &c->out;
+    size_t columns = c->t.columns;
+    append_str(b, c->first ? "\n  {" : ",\n  {");
+    c->first = 0;
+    size_t count = n > columns ? n : columns;
+    for (size_t i = 0; i < count; i++) {
+        if (i) append_str(b, ", ");
+        if (i < columns) {
+            append(b, c->keys.data + c->key_spans.v[i].off, c->key_spans.v[i].len);
+        } else {
+            char key[32];
+            snprintf(key, sizeof(key), "\"column %zu\": ", i + 1);
+            append_str(b, key);
+        }
+        if (i >= n) {
+            append_str(b, "null");
+        } else {
+            append_value(b, i < columns ? c->t.types[i] : COL_STRING, data + fields[i].off, fields[i].len);
+        }
+    }
+    append_char(b, '}');
+}
+
+// Render the keys once
+static int render_keys(csv_json *c) {
+    for (size_t i = 0; i < c->t.columns; i++) {
+        const span *name = &c->t.name_spans.v[i];
+        size_t off = c->keys.len;
+        append_json_string(&c->keys, c->t.names.data + name->off, name->len);
+        append_str(&c->keys, ": ");
+        if (c->keys.failed || add_span(&c->key_spans, off, c->keys.len - off) != 0) return -1;
+    }
+    return 0;
+}
+
+fc_status fc_csv_to_json(FILE *in, FILE *out, char *block, size_t block_size) {
+    csv_json c = { .t = { .r = { .in = in, .block = block, .block_size = block_size, .delimiter = ',' } },
+                   .first = 1 };
+    fc_status status = FC_ERR_NOMEM;
+
+    int rc = read_table_head(&c.t);
+    if (rc < 0) goto done;
+    if (rc == 0) {
+        status = fputs("[]\n", out) >= 0 ? FC_OK : FC_ERR_IO;
+        goto done;
+    }
+    if (render_keys(&c) != 0) goto done;
+
+    append_char(&c.out, '[');
+    for (size_t row = 0; row < c.t.sample_rows.n; row++) {
+        size_t n;
+        const span *fields = sample_row(&c.t, row, &n);
+        write_object(&c, c.t.sample.data, fields, n);
+        if (c.out.len >= FLUSH_SIZE && (status = flush(&c.out, out)) != FC_OK) goto done;
+    }
+    drop_sample(&c.t);
+
+    while (c.t.more && (rc = csv_read(&c.t.r)) > 0) {
+        if (!blank_record(&c.t.r)) write_object(&c, c.t.r.data.data, c.t.r.fields.v, c.t.r.fields.n);
+        if (c.out.len >= FLUSH_SIZE && (status = flush(&c.out, out)) != FC_OK) goto done;
+    }
+    status = FC_ERR_NOMEM;
+    if (rc < 0) goto done;
+    append_str(&c.out, c.first ? "]\n" : "\n]\n");
+    status = flush(&c.out, out);
+done:
+    free_table(&c.t);
+    free(c.keys.data);
+    free(c.key_spans.v);
+    free(c.out.data);
+    return status;
+}
+
+// JSON reading
+
+typedef struct {
+    FILE *in;
+    const unsigned char *block;
+    size_t block_size, pos, len;
+} json_reader;
+
+static int json_peek(json_reader *r) {
+    if (r->pos == r->len) {
+        r->pos = 0;
+        r->len = fread((char *)r->block, 1, r->block_size, r->in);
+        if (r->len == 0) return EOF;
+    }
+    return r->block[r->pos];
+}
+
+static int json_skip_space(json_reader *r) {
+    int c;
+    while ((c = json_peek(r)) == ' ' || c == '\t' || c == '\n' || c == '\r') r->pos++;
+    return c;
+}
+
+static int json_hex4(json_reader *r, unsigned *code) {
+    *code = 0;
+    for (int i = 0; i < 4; i++) {
+        int c = json_peek(r);
+        int digit = c >= '0' && c <= '9' ? c - '0' :
+                    c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+                    c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) return -1;
+        *code = *code << 4 | digit;
+        r->pos++;
+    }
+    return 0;
+}
+
+static int append_utf8(buffer *b, unsigned code) {
+    char s[4];
+    size_t n;
+    if (code < 0x80) {
+        s[0] = code, n = 1;
+    } else if (code < 0x800) {
+        s[0] = 0xC0 | code >> 6, s[1] = 0x80 | (code & 0x3F), n = 2;
+    } else if (code < 0x10000) {
+        s[0] = 0xE0 | code >> 12, s[1] = 0x80 | (code >> 6 & 0x3F), s[2] = 0x80 | (code & 0x3F), n = 3;
+    } else {
+        s[0] = 0xF0 | code >> 18, s[1] = 0x80 | (code >> 12 & 0x3F);
+        s[2] = 0x80 | (code >> 6 & 0x3F), s[3] = 0x80 | (code & 0x3F), n = 4;
+    }
+    return append(b, s, n);
+}
+
+// Decode the string at r (its opening quote) onto the end of dst
+static fc_status json_string(json_reader *r, buffer *dst) {
+    r->pos++;
+    for (;;) {
+        if (json_peek(r) == EOF) return FC_ERR_FORMAT;
+        const unsigned char *p = r->block + r->pos, *end = r->block + r->len, *q = p;
+        while (q < end && *q != '"' && *q != '\\' && *q >= 0x20) q++;
+        if (append(dst, (const char *)p, q - p) != 0) return FC_ERR_NOMEM;
+        r->pos += q - p;
+        if (q == end) continue;
+        r->pos++;
+        if (*q == '"') return FC_OK;
+        if (*q < 0x20) return FC_ERR_FORMAT;
+
+        int c = json_peek(r);
+        if (c == EOF) return FC_ERR_FORMAT;
+        r->pos++;
+        unsigned code;
+        switch (c) {
+            case '"': case '\\': case '/': code = c; break;
+            case 'b': code = '\b'; break;
+            case 'f': code = '\f'; break;
+            case 'n': code = '\n'; break;
+            case 'r': code = '\r'; break;
+            case 't': code = '\t'; break;
+            case 'u':
+                if (json_hex4(r, &code) != 0) return FC_ERR_FORMAT;
+                if (code >= 0xD800 && code < 0xDC00 && json_peek(r) == '\\') {
+                    // A surrogate pair; a lone half becomes U+FFFD
+                    unsigned low;
+                    r->pos++;
+                    if (json_peek(r) != 'u') return FC_ERR_FORMAT;
+                    r->pos++;
+                    if (json_hex4(r, &low) != 0) return FC_ERR_FORMAT;
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    } else if (append_utf8(dst, 0xFFFD) != 0) {
+                        return FC_ERR_NOMEM;
+                    } else {
+                        code = low >= 0xD800 && low < 0xE000 ? 0xFFFD : low;
+                    }
+                } else if (code >= 0xD800 && code < 0xE000) {
+                    code = 0xFFFD;
+                }
+                break;
+            default:
+                return FC_ERR_FORMAT;
+        }
+        if (append_utf8(dst, code) != 0) return FC_ERR_NOMEM;
+    }
+}
+
+// -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+static int json_number(const char *s, size_t len) {
+    const char *end = s + len, *digits;
+    if (s < end && *s == '-') s++;
+    if (s < end && *s == '0') {
+        s++;
+    } else {
+        for (digits = s; s < end && *s >= '0' && *s <= '9'; s++) {}
+        if (s == digits) return 0;
+    }
+    if (s < end && *s == '.') {
+        for (digits = ++s; s < end && *s >= '0' && *s <= '9'; s++) {}
+        if (s == digits) return 0;
+    }
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        s++;
+        if (s < end && (*s == '+' || *s == '-')) s++;
+        for (digits = s; s < end && *s >= '0' && *s <= '9'; s++) {}
+        if (s == digits) return 0;
+    }
+    return s == end;
+}
+
+// Flattened records: a (path, value) pair per scalar or empty container,
+// both held in bytes
+typedef struct {
+    buffer bytes;
+    span_list keys, values;
+    buffer path;            // where the parser is, "a.b.0"
+} flat;
+
+static fc_status add_leaf(flat *f, size_t value_off) {
+    size_t value_len = f->bytes.len - value_off, key_off = f->bytes.len;
+    int rc = f->path.len ? append(&f->bytes, f->path.data, f->path.len) : append(&f->bytes, "value", 5);
+    if (rc != 0 || add_span(&f->keys, key_off, f->bytes.len - key_off) != 0 ||
+        add_span(&f->values, value_off, value_len) != 0) {
+        return FC_ERR_NOMEM;
+    }
+    return FC_OK;
+}
+
+static fc_status json_value(json_reader *r, flat *f, int depth) {
+    size_t value_off = f->bytes.len, mark = f->path.len;
+    fc_status status;
+    int c = json_skip_space(r);
+    if (depth > MAX_DEPTH) return FC_ERR_FORMAT;
+
+    if (c == '{' || c == '[') {
+        int object = c == '{';
+        char close = object ? '}' : ']';
+        r->pos++;
+        if (json_skip_space(r) == close) {
+            r->pos++;
+            return append(&f->bytes, object ? "{}" : "[]", 2) == 0 ? add_leaf(f, value_off) : FC_ERR_NOMEM;
+        }
+        for (size_t index = 0;; index++) {
+            if (mark && append_char(&f->path, '.') != 0) return FC_ERR_NOMEM;
+            if (object) {
+                if (json_skip_space(r) != '"') return FC_ERR_FORMAT;
+                if ((status = json_string(r, &f->path)) != FC_OK) return status;
+                if (json_skip_space(r) != ':') return FC_ERR_FORMAT;
+                r->pos++;
+            } else {
+                char text[24];
+                if (append(&f->path, text, snprintf(text, sizeof(text), "%zu", index)) != 0) return FC_ERR_NOMEM;
+            }
+            if ((status = json_value(r, f, depth + 1)) != FC_OK) return status;
+            f->path.len = mark;
+            c = json_skip_space(r);
+            if (c != close && c != ',') return FC_ERR_FORMAT;
+            r->pos++;
+            if (c == close) return FC_OK;
+        }
+    }
+    if (c == '"') {
+        if ((status = json_string(r, &f->bytes)) != FC_OK) return status;
+        return add_leaf(f, value_off);
+    }
+
+    // Number or literal
+    while ((c = json_peek(r)) != EOF && ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+                                        c == '-' || c == '+' || c == '.' || c == 'E')) {
+        if (append_char(&f->bytes, c) != 0) return FC_ERR_NOMEM;
+        r->pos++;
+    }
+    const char *token = f->bytes.data + value_off;
+    size_t len = f->bytes.len - value_off;
+    if (len == 4 && memcmp(token, "null", 4) == 0) {
+        f->bytes.len = value_off;   // an empty field
+    } else if (!(len == 4 && memcmp(token, "true", 4) == 0) &&
+               !(len == 5 && memcmp(token, "false", 5) == 0) && !json_number(token, len)) {
+        return FC_ERR_FORMAT;
+    }
+    return add_leaf(f, value_off);
+}
+
+// Columns, found by name through an open-addressing table
+
+typedef struct {
+    buffer names;
+    span_list spans;
+    size_t *slots;          // column + 1, 0 for a free slot
+    size_t slot_count;      // a power of two, at least twice the columns
+} column_set;
+
+static size_t hash_name(const char *s, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 0x100000001b3ull;
+    return (size_t)h;
+}
+
+// Slot holding name, or the free slot where it would go
+static size_t *column_slot(const column_set *cs, const char *name, size_t len) {
+    size_t mask = cs->slot_count - 1;
+    for (size_t i = hash_name(name, len) & mask;; i = (i + 1) & mask) {
+        size_t col = cs->slots[i];
+        if (!col) return &cs->slots[i];
+        const span *s = &cs->spans.v[col - 1];
+        if (s->len == len && memcmp(cs->names.data + s->off, name, len) == 0) return &cs->slots[i];
+    }
+}
+
+static long column_find(const column_set *cs, const char *name, size_t len) {
+    return cs->slot_count ? (long)*column_slot(cs, name, len) - 1 : -1;
+}
+
+static int column_add(column_set *cs, const char *name, size_t len) {
+    if (column_find(cs, name, len) >= 0) return 0;
+    if (2 * (cs->spans.n + 1) > cs->slot_count) {
+        size_t count = cs->slot_count ? cs->slot_count * 2 : 64;
+        size_t *slots = calloc(count, sizeof(*slots));
+        if (!slots) return -1;
+        free(cs->slots);
+        cs->slots = slots;
+        cs->slot_count = count;
+        for (size_t col = 0; col < cs->spans.n; col++) {
+            const span *s = &cs->spans.v[col];
+            *column_slot(cs, cs->names.data + s->off, s->len) = col + 1;
+        }
+    }
+    size_t off = cs->names.len;
+    if (append(&cs->names, name, len) != 0 || add_span(&cs->spans, off, len) != 0) return -1;
+    *column_slot(cs, name, len) = cs->spans.n;
+    return 0;
+}
+
+// A CSV field, quoted when it has to be
+static void append_field(buffer *b, const char *s, size_t len) {
+    size_t i = 0;
+    while (i < len && s[i] != ',' && s[i] != '"' && s[i] != '\n' && s[i] != '\r') i++;
+    if (i == len) {
+        append(b, s, len);
+        return;
+    }
+    append_char(b, '"');
+    for (const char *end = s + len; s < end;) {
+        const char *quote = memchr(s, '"', end - s);
+        const char *stop = quote ? quote + 1 : end;
+        append(b, s, stop - s);
+        if (quote) append_char(b, '"');
+        s = stop;
+    }
+    append_char(b, '"');
+}
+
+// JSON to CSV. The columns are the keys in the order they are first seen,
+// so the header can only be written once the input is read: meanwhile the
+// rows go to a spool, each as wide as the columns known when it was
+// written, and are widened with empty fields as they are copied out.
+
+typedef struct {
+    uint64_t end;           // spool offset where the run's rows end
+    size_t columns;         // columns those rows have
+} row_run;
+
+typedef struct {
+    json_reader r;
+    flat f;
+    column_set columns;
+    size_t *value_of;       // entry holding each column's value in this record
+    size_t *stamp;          // record number value_of[] was last set for
+    size_t slots;           // columns value_of[] and stamp[] have room for
+    size_t record;
+    buffer out;
+    FILE *spool;
+    uint64_t spooled;       // bytes written to the spool
+    row_run *runs;          // rows narrower than the last ones, oldest first
+    size_t run_count, run_cap;
+} json_csv;
+
+static fc_status spool_rows(json_csv *j) {
+    size_t len = j->out.len;
+    fc_status status = flush(&j->out, j->spool);
+    if (status == FC_OK) j->spooled += len;
+    return status;
+}
+
+static int add_column(json_csv *j, const char *name, size_t len) {
+    if (column_add(&j->columns, name, len) != 0) return -1;
+    size_t count = j->columns.spans.n;
+    if (count <= j->slots) return 0;
+    size_t slots = j->slots ? j->slots * 2 : 64;
+    size_t *value_of = realloc(j->value_of, slots * sizeof(*value_of));
+    if (value_of) j->value_of = value_of;
+    size_t *stamp = value_of ? realloc(j->stamp, slots * sizeof(*stamp)) : NULL;
+    if (!stamp) return -1;
+    memset(stamp + j->slots, 0, (slots - j->slots) * sizeof(*stamp));
+    j->stamp = stamp;
+    j->slots = slots;
+    return 0;
+}
+
+// The rows written so far keep the columns they had
+static int end_run(json_csv *j, size_t columns) {
+    uint64_t end = j->spooled + j->out.len;
+    if (end == 0) return 0;
+    if (j->run_count == j->run_cap) {
+        size_t cap = j->run_cap ? j->run_cap * 2 : 8;
+        row_run *runs = realloc(j->runs, cap * sizeof(*runs));
+        if (!runs) return -1;
+        j->runs = runs;
+        j->run_cap = cap;
+    }
+    j->runs[j->run_count++] = (row_run){ end, columns };
+    return 0;
+}
+
+static fc_status write_row(json_csv *j) {
+    size_t columns = j->columns.spans.n;
+    j->record++;
+    for (size_t e = 0; e < j->f.keys.n; e++) {
+        const span *key = &j->f.keys.v[e];
+        const char *name = j->f.bytes.data + key->off;
+        long col = column_find(&j->columns, name, key->len);
+        if (col < 0) {
+            if (add_column(j, name, key->len) != 0) return FC_ERR_NOMEM;
+            col = (long)j->columns.spans.n - 1;
+        }
+        j->value_of[col] = e;
+        j->stamp[col] = j->record;
+    }
+    if (j->columns.spans.n > columns && end_run(j, columns) != 0) return FC_ERR_NOMEM;
+
+    for (size_t col = 0; col < j->columns.spans.n; col++) {
+        if (col) append_char(&j->out, ',');
+        if (j->stamp[col] != j->record) continue;
+        const span *value = &j->f.values.v[j->value_of[col]];
+        append_field(&j->out, j->f.bytes.data + value->off, value->len);
+    }
+    append_char(&j->out, '\n');
+    return FC_OK;
+}
+
+static void reset_flat(flat *f) {
+    f->bytes.len = 0;
+    f->keys.n = f->values.n = 0;
+    f->path.len = 0;
+}
+
+static fc_status json_record(json_csv *j) {
+    fc_status status = json_value(&j->r, &j->f, 1);
+    if (status == FC_OK) status = write_row(j);
+    reset_flat(&j->f);
+    if (status == FC_OK && j->out.len >= FLUSH_SIZE) status = spool_rows(j);
+    return status;
+}
+
+// Copy len spooled bytes to the output buffer, with pad empty fields added
+// to the end of each row
+static fc_status widen_rows(json_csv *j, FILE *out, char *block, size_t block_size, uint64_t len, size_t pad) {
+    int quoted = 0;
+    while (len) {
+        size_t n = fread(block, 1, len < block_size ? len : block_size, j->spool);
+        if (n == 0) return FC_ERR_IO;
+        len -= n;
+        if (!pad) {
+            fc_status status = flush(&j->out, out);
+            if (status != FC_OK) return status;
+            if (fwrite(block, 1, n, out) != n) return FC_ERR_IO;
+            continue;
+        }
+        size_t from = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (block[i] == '"') {
+                quoted = !quoted;
+            } else if (block[i] == '\n' && !quoted) {
+                append(&j->out, block + from, i - from);
+                for (size_t p = 0; p < pad; p++) append_char(&j->out, ',');
+                from = i;
+            }
+        }
+        append(&j->out, block + from, n - from);
+        if (j->out.len >= FLUSH_SIZE) {
+            fc_status status = flush(&j->out, out);
+            if (status != FC_OK) return status;
+        }
+    }
+    return FC_OK;
+}
+
+// The header, then the spooled rows, all as wide as it
+static fc_status write_csv(json_csv *j, FILE *out, char *block, size_t block_size) {
+    size_t count = j->columns.spans.n;
+    fc_status status = spool_rows(j);
+    if (status != FC_OK || !count) return status;
+    if (fflush(j->spool) != 0 || fseeko(j->spool, 0, SEEK_SET) != 0) return FC_ERR_IO;
+
+    for (size_t col = 0; col < count; col++) {
+        if (col) append_char(&j->out, ',');
+        append_field(&j->out, j->columns.names.data + j->columns.spans.v[col].off, j->columns.spans.v[col].len);
+    }
+    append_char(&j->out, '\n');
+
+    uint64_t pos = 0;
+    for (size_t i = 0; i < j->run_count; i++) {
+        status = widen_rows(j, out, block, block_size, j->runs[i].end - pos, count - j->runs[i].columns);
+        if (status != FC_OK) return status;
+        pos = j->runs[i].end;
+    }
+    status = widen_rows(j, out, block, block_size, j->spooled - pos, 0);
+    return status == FC_OK ? flush(&j->out, out) : status;
+}
+
+fc_status fc_json_to_csv(FILE *in, FILE *out, char *block, size_t block_size) {
+    json_csv j = { .r = { .in = in, .block = (unsigned char *)block, .block_size = block_size } };
+    fc_status status = FC_OK;
+    int c;
+
+    j.spool = fc_spill_open(SPOOL_MEMORY);
+    if (!j.spool) return FC_ERR_NOMEM;
+
+    // Each top-level value is a record, or a list of them if it is an array
+    while (status == FC_OK && (c = json_skip_space(&j.r)) != EOF) {
+        if (c != '[') {
+            status = json_record(&j);
+            continue;
+        }
+        j.r.pos++;
+        if (json_skip_space(&j.r) == ']') {
+            j.r.pos++;
+            continue;
+        }
+        while (status == FC_OK && (status = json_record(&j)) == FC_OK) {
+            c = json_skip_space(&j.r);
+            if (c != ']' && c != ',') status = FC_ERR_FORMAT;
+            else j.r.pos++;
+            if (c == ']') break;
+        }
+    }
+    // The input is read, so its block is free to copy the spool through
+    if (status == FC_OK) status = write_csv(&j, out, block, block_size);
+
+    fclose(j.spool);
+    free(j.f.bytes.data);
+    free(j.f.keys.v);
+    free(j.f.values.v);
+    free(j.f.path.data);
+    free(j.columns.names.data);
+    free(j.columns.spans.v);
+    free(j.columns.slots);
+    free(j.value_of);
+    free(j.stamp);
+    free(j.runs);
+    free(j.out.data);
+    return status;
+}
+
+// CSV to Arrow
+
+// A string column is dictionary encoded when the sample repeats its values:
+// no more than one distinct value in DICT_RATIO
+#define DICT_RATIO 4
+
+static size_t distinct_values(const csv_table *t, size_t col) {
+    size_t rows = t->sample_rows.n, count = 0, slot_count = 64;
+    while (slot_count < 2 * rows) slot_count *= 2;
+    const span **slots = calloc(slot_count, sizeof(*slots));
+    if (!slots) return rows;
+    for (size_t row = 0; row < rows; row++) {
+        size_t n;
+        const span *fields = sample_row(t, row, &n);
+        if (col >= n) continue;
+        const span *f = &fields[col];
+        const char *s = t->sample.data + f->off;
+        size_t i = hash_name(s, f->len) & (slot_count - 1);
+        while (slots[i] && (slots[i]->len != f->len || memcmp(t->sample.data + slots[i]->off, s, f->len) != 0)) {
+            i = (i + 1) & (slot_count - 1);
+        }
+        if (!slots[i]) {
+            slots[i] = f;
+            count++;
+        }
+    }
+    free(slots);
+    return count;
+}
+
+// An empty cell is null. -1 if the value does not fit the column's type,
+// which the schema already written can no longer change.
+static int set_arrow_value(fc_arrow_writer *w, size_t col, column_type type, const char *s, size_t len) {
+    long long i;
+    double d;
+    int b;
+    if (len == 0) return 0;
+    switch (type) {
+        case COL_INT:
+            if (leading_zero(s, len) || fc_parse_int64(s, len, &i) != 0) return -1;
+            fc_arrow_set_int64(w, col, i);
+            break;
+        case COL_NUMBER:
+            if (leading_zero(s, len) || fc_parse_double(s, len, &d) != 0) return -1;
+            fc_arrow_set_double(w, col, d);
+            break;
+        case COL_BOOL:
+            if ((b = bool_value(s, len)) < 0) return -1;
+            fc_arrow_set_bool(w, col, b);
+            break;
+        case COL_STRING:
+            fc_arrow_set_string(w, col, s, len);
+            break;
+    }
+    return 0;
+}
+
+static fc_status write_arrow_row(fc_arrow_writer *w, const csv_table *t, const char *data,
+                                 const span *fields, size_t n) {
+    if (n > t->columns) n = t->columns;
+    for (size_t col = 0; col < n; col++) {
+        if (set_arrow_value(w, col, t->types[col], data + fields[col].off, fields[col].len) != 0) {
+            return FC_ERR_FORMAT;
+        }
+    }
+    return fc_arrow_end_row(w);
+}
+
+fc_status fc_csv_to_arrow(FILE *in, FILE *out, char delimiter, char *block, size_t block_size) {
+    csv_table t = { .r = { .in = in, .block = block, .block_size = block_size, .delimiter = delimiter } };
+    const char **names = NULL;
+    size_t *name_lens = NULL;
+    fc_arrow_type *types = NULL;
+    fc_arrow_writer *w = NULL;
+    fc_status status = FC_ERR_NOMEM;
+
+    int rc = read_table_head(&t);
+    if (rc < 0) goto done;
+    size_t count = t.columns ? t.columns : 1;
+    names = malloc(count * sizeof(*names));
+    name_lens = malloc(count * sizeof(*name_lens));
+    types = malloc(count * sizeof(*types));
+    if (!names || !name_lens || !types) goto done;
+    for (size_t col = 0; col < t.columns; col++) {
+        names[col] = t.names.data + t.name_spans.v[col].off;
+        name_lens[col] = t.name_spans.v[col].len;
+        switch (t.types[col]) {
+            case COL_INT:    types[col] = FC_ARROW_INT64; break;
+            case COL_NUMBER: types[col] = FC_ARROW_DOUBLE; break;
+            case COL_BOOL:   types[col] = FC_ARROW_BOOL; break;
+            case COL_STRING:
+                types[col] = t.sample_rows.n && distinct_values(&t, col) * DICT_RATIO <= t.sample_rows.n ?
+                             FC_ARROW_DICT_UTF8 : FC_ARROW_UTF8;
+        }
+    }
+    if (!(w = fc_arrow_writer_new(out, names, name_lens, types, t.columns))) goto done;
+
+    for (size_t row = 0; row < t.sample_rows.n; row++) {
+        size_t n;
+        const span *fields = sample_row(&t, row, &n);
+        if ((status = write_arrow_row(w, &t, t.sample.data, fields, n)) != FC_OK) goto done;
+    }
+    drop_sample(&t);
+
+    status = FC_OK;
+    while (t.more && (rc = csv_read(&t.r)) > 0) {
+        if (blank_record(&t.r)) continue;
+        if ((status = write_arrow_row(w, &t, t.r.data.data, t.r.fields.v, t.r.fields.n)) != FC_OK) goto done;
+    }
+    if (rc < 0) status = FC_ERR_NOMEM;
+done:
+    if (w) {
+        fc_status finished = fc_arrow_writer_finish(w, status != FC_OK);
+        if (status == FC_OK) status = finished;
+    }
+    free_table(&t);
+    free(names);
+    free(name_lens);
+    free(types);
+    return status;
+}
+
+#ifdef FC_HAVE_ZLIB
+// CSV to XLSX
+
+#define EXACT_DIGITS 15     // a spreadsheet keeps this many digits of a number
+
+// An integer with more digits than a spreadsheet keeps: an id, a card or
+// phone number. It stays text rather than come back rounded.
+static int long_integer(const char *s, size_t len) {
+    if (len && (*s == '-' || *s == '+')) s++, len--;
+    if (len <= EXACT_DIGITS) return 0;
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] < '0' || s[i] > '9') return 0;
+    }
+    return 1;
+}
+
+// Each cell is typed on its own, as a spreadsheet does when it opens a CSV
+static void add_xlsx_cell(fc_xlsx_writer *w, buffer *number, const char *s, size_t len) {
+    int value;
+    if (len == 0) {
+        fc_xlsx_skip(w);
+    } else if (is_number(s, len) && !long_integer(s, len)) {
+        number->len = 0;
+        append_number(number, s, len);
+        if (number->failed) fc_xlsx_string(w, s, len);
+        else fc_xlsx_number(w, number->data, number->len);
+    } else if ((value = bool_value(s, len)) >= 0) {
+        fc_xlsx_bool(w, value);
+    } else {
+        fc_xlsx_string(w, s, len);
+    }
+}
+
+fc_status fc_csv_to_xlsx(FILE *in, FILE *out, char *block, size_t block_size) {
+    csv_reader r = { .in = in, .block = block, .block_size = block_size, .delimiter = ',' };
+    buffer number = { 0 };
+    fc_status status = FC_OK;
+    int rc, header = 1;
+
+    fc_xlsx_writer *w = fc_xlsx_writer_new(out);
+    if (!w) return FC_ERR_NOMEM;
+    while ((rc = csv_read(&r)) > 0) {
+        if (blank_record(&r)) continue;
+        for (size_t i = 0; i < r.fields.n; i++) {
+            const char *s = r.data.data + r.fields.v[i].off;
+            size_t len = r.fields.v[i].len;
+            // The header row is names, never numbers
+            if (header && len) fc_xlsx_string(w, s, len);
+            else if (header) fc_xlsx_skip(w);
+            else add_xlsx_cell(w, &number, s, len);
+        }
+        header = 0;
+        if ((status = fc_xlsx_end_row(w)) != FC_OK) break;
+    }
+    if (status == FC_OK && rc < 0) status = FC_ERR_NOMEM;
+
+    fc_status finished = fc_xlsx_writer_finish(w, status != FC_OK);
+    if (status == FC_OK) status = finished;
+    free(r.data.data);
+    free(r.fields.v);
+    free(number.data);
+    return status;
+}
+#endif
@@ -0,0 +1,50 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "converter.h"
+
+// Tabular conversions between CSV and JSON, and from CSV to Arrow and
+// XLSX. All stream: memory grows with the longest record and the
+// type/column sample (plus one Arrow record batch, or the bounded XLSX
+// shared strings), never with the input; Arrow dictionaries grow with the
+// distinct values of their columns (see arrow.h). JSON to CSV
+// holds its rows until the header is known: up to 8 MB in memory, the
+// rest in a temporary file (see fc_spill_open()).
+// block is scratch for reading (the context's block buffer).
+
+// CSV (RFC 4180: quoted fields, doubled quotes, line breaks inside quotes,
+// CRLF) to a JSON array with one object per row, keyed by the header row.
+// Column types are inferred from the first rows: a column whose values are
+// all integers, all numbers or all true/false is written as such, with
+// empty cells as null; a later value that does not fit is written as a
+// string. Numerals with a leading zero ("007") are taken as text.
+fc_status fc_csv_to_json(FILE *in, FILE *out, char *block, size_t block_size);
+
+// JSON to CSV: a top-level array of records, JSON Lines, or values one
+// after another. Each record is flattened into columns with dotted paths
+// ({"a": {"b": [1]}} gives column "a.b.0"); a scalar record is the column
+// "value". The columns are every key of every record, in the order they
+// first appear; a record without some of them has empty fields there.
+// Malformed JSON gives FC_ERR_FORMAT.
+fc_status fc_json_to_csv(FILE *in, FILE *out, char *block, size_t block_size);
+
+// CSV, or any table of fields split by delimiter, to an Arrow IPC file
+// (arrow.h). Columns are named and typed as for JSON: integer, number and
+// true/false columns become int64, double and bool, with empty cells as
+// null; the rest are utf8, dictionary encoded when the sample has at most
+// one distinct value in four. The types are in the schema at the start of
+// the file, so a later value that does not fit its column's type fails the
+// conversion with FC_ERR_FORMAT rather than be lost. Fields past the
+// header's are dropped, missing ones are null.
+fc_status fc_csv_to_arrow(FILE *in, FILE *out, char delimiter, char *block, size_t block_size);
+
+// CSV to an XLSX workbook (xlsx.h), one worksheet row per record. Cells are
+// typed one by one: numbers (but not integers of more than 15 digits, which
+// a spreadsheet would round, nor numerals with a leading zero), true/false,
+// and text; empty cells are left out. Needs FC_HAVE_ZLIB.
+fc_status fc_csv_to_xlsx(FILE *in, FILE *out, char *block, size_t block_size);
+
+#endif
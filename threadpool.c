@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "threadpool.h"
+#include "trace.h"
+
+typedef struct {
+    fc_job_fn fn;
+    void *arg;
+} pool_job;
+
+struct fc_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_cond_t idle;
+
+    pool_job *queue;        // ring buffer of queue_capacity slots
+    int queue_capacity;
+    int head, count;
+    int active;             // jobs currently running
+    int stopping;
+
+    pthread_t *threads;
+    int thread_count;
+};
+
+static fc_context_setup_fn worker_setup;
+
+void fc_set_worker_setup(fc_context_setup_fn setup) {
+    worker_setup = setup;
+}
+
+fc_context *fc_worker_context_new(void) {
+    fc_context *ctx = fc_context_new();
+    if (ctx && worker_setup) worker_setup(ctx);
+    return ctx;
+}
+
+int fc_default_threads(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+static void *worker_main(void *data) {
+    fc_pool *pool = data;
+    fc_context *ctx = fc_worker_context_new();
+
+    fc_trace_thread_name("pool worker");
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->count == 0 && !pool->stopping) {
+            pthread_cond_wait(&pool->not_empty, &pool->lock);
+        }
+        if (pool->count == 0 && pool->stopping) break;
+
+        pool_job job = pool->queue[pool->head];
+        pool->head = (pool->head + 1) % pool->queue_capacity;
+        pool->count--;
+        pool->active++;
+        pthread_cond_signal(&pool->not_full);
+        pthread_mutex_unlock(&pool->lock);
+
+        fc_trace_span span;
+        fc_trace_begin(&span, "job");
+        job.fn(ctx, job.arg);
+        fc_trace_end(&span, 0);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active--;
+        if (pool->count == 0 && pool->active == 0) {
+            pthread_cond_broadcast(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    fc_context_free(ctx);
+    return NULL;
+}
+
+fc_pool *fc_pool_new(int threads, int queue_capacity) {
+    if (threads <= 0) threads = fc_default_threads();
+    if (queue_capacity <= 0) queue_capacity = threads * 4;
+
+    fc_pool *pool = calloc(1, sizeof(*pool));
+    if (!pool) return NULL;
+
+    pool->queue = calloc(queue_capacity, sizeof(pool_job));
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    if (!pool->queue || !pool->threads) {
+        free(pool->queue);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    pool->queue_capacity = queue_capacity;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->not_empty, NULL);
+    pthread_cond_init(&pool->not_full, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) break;
+        pool->thread_count++;
+    }
+    if (pool->thread_count == 0) {
+        fc_pool_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+static int enqueue(fc_pool *pool, fc_job_fn fn, void *arg, int block) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count == pool->queue_capacity && !pool->stopping) {
+        if (!block) {
+            pthread_mutex_unlock(&pool->lock);
+            return 1;
+        }
+        pthread_cond_wait(&pool->not_full, &pool->lock);
+    }
+    if (pool->stopping) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+
+    int tail = (pool->head + pool->count) % pool->queue_capacity;
+    pool->queue[tail].fn = fn;
+    pool->queue[tail].arg = arg;
+    pool->count++;
+    pthread_cond_signal(&pool->not_empty);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+int fc_pool_submit(fc_pool *pool, fc_job_fn fn, void *arg) {
+    return enqueue(pool, fn, arg, 1);
+}
+
+int fc_pool_try_submit(fc_pool *pool, fc_job_fn fn, void *arg) {
+    return enqueue(pool, fn, arg, 0);
+}
+
+void fc_pool_wait_idle(fc_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count > 0 || pool->active > 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int fc_pool_threads(const fc_pool *pool) {
+    return pool->thread_count;
+}
+
+void fc_pool_free(fc_pool *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->not_empty);
+    pthread_cond_broadcast(&pool->not_full);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->not_empty);
+    pthread_cond_destroy(&pool->not_full);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->queue);
+    free(pool->threads);
+    free(pool);
+}
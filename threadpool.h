@@ -0,0 +1,45 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "converter.h"
+
+// Fixed-size pool of conversion workers fed from a bounded job queue.
+// Each worker owns an fc_context for its lifetime and passes it to every job
+// it runs, so jobs never allocate their own scratch buffers.
+
+typedef void (*fc_job_fn)(fc_context *ctx, void *arg);
+
+typedef struct fc_pool fc_pool;
+
+// threads <= 0 picks one worker per online CPU. queue_capacity <= 0 picks
+// four slots per worker.
+fc_pool *fc_pool_new(int threads, int queue_capacity);
+
+// Queue a job, blocking while the queue is full (backpressure).
+// Returns -1 once the pool is shutting down.
+int fc_pool_submit(fc_pool *pool, fc_job_fn fn, void *arg);
+
+// Like fc_pool_submit but returns 1 instead of blocking when the queue is full.
+int fc_pool_try_submit(fc_pool *pool, fc_job_fn fn, void *arg);
+
+// Block until the queue is empty and every worker is idle.
+void fc_pool_wait_idle(fc_pool *pool);
+
+int fc_pool_threads(const fc_pool *pool);
+
+// Run the jobs still queued, then stop and join the workers.
+void fc_pool_free(fc_pool *pool);
+
+int fc_default_threads(void);
+
+// Settings for worker contexts. The setup function, if any, is applied to
+// the context of every pool and scheduler worker started after the call, as
+// a program applies it to the contexts it makes itself. Set it before
+// starting workers.
+typedef void (*fc_context_setup_fn)(fc_context *ctx);
+void fc_set_worker_setup(fc_context_setup_fn setup);
+
+// A new context with the worker setup applied. NULL if out of memory.
+fc_context *fc_worker_context_new(void);
+
+#endif
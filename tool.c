@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "tool.h"
+
+#define REPLY_SIZE 512
+#define EXIT_GRACE_MS 1000      // for helpers to exit once their stdin closes
+#define REAP_POLL_MS 10
+
+extern char **environ;
+
+typedef struct {
+    pid_t pid;                  // 0 when not running
+    int fd;                     // our end of the helper's stdin/stdout
+    int busy;
+} helper;
+
+struct fc_tool_pool {
+    char *tool;
+    char **argv;                // NULL-terminated, in one allocation with the words
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+    int count;
+    helper helpers[];
+};
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Milliseconds left before deadline for poll(): -1 for no deadline
+static int remaining(long long deadline) {
+    if (deadline < 0) return -1;
+    long long left = deadline - now_ms();
+    return left > 0 ? (int)(left < 60000 ? left : 60000) : 0;
+}
+
+// Keep errors on one line for the log
+static void tidy_errors(char *errors) {
+    size_t len = strlen(errors);
+    for (size_t i = 0; i < len; i++) {
+        if (errors[i] == '\n' || errors[i] == '\r' || errors[i] == '\t') errors[i] = ' ';
+    }
+    while (len && isspace((unsigned char)errors[len - 1])) errors[--len] = '\0';
+}
+
+// Tools run in their own process group so that whatever they started
+// goes down with them
+static void kill_and_reap(pid_t pid) {
+    kill(-pid, SIGKILL);
+    while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {}
+}
+
+// Spawn argv in a new process group; 0 or an errno value
+static int spawn(pid_t *pid, char *const argv[], const posix_spawn_file_actions_t *actions) {
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attr, 0);
+    int rc = posix_spawnp(pid, argv[0], actions, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    return rc;
+}
+
+// Wait for pid until deadline; 1 and *status if it exited, 0 if not
+static int reap_by(pid_t pid, long long deadline, int *status) {
+    for (;;) {
+        pid_t r = waitpid(pid, status, WNOHANG);
+        if (r == pid) return 1;
+        if (r < 0 && errno != EINTR) {
+            *status = 0;
+            return 1;
+        }
+        if (deadline >= 0 && now_ms() >= deadline) return 0;
+        poll(NULL, 0, REAP_POLL_MS);
+    }
+}
+
+fc_status fc_tool_run(char *const argv[], int timeout_ms, char *errors, size_t errors_size) {
+    char scratch[1];
+    if (!errors || !errors_size) {
+        errors = scratch;
+        errors_size = sizeof(scratch);
+    }
+    errors[0] = '\0';
+    if (!argv || !argv[0]) return FC_ERR_INVALID;
+
+    int err_pipe[2];
+    if (pipe2(err_pipe, O_CLOEXEC) != 0) {
+        snprintf(errors, errors_size, "%s: %s", argv[0], strerror(errno));
+        return FC_ERR_TOOL;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, err_pipe[1], STDERR_FILENO);
+    pid_t pid;
+    int rc = spawn(&pid, argv, &actions);
+    posix_spawn_file_actions_destroy(&actions);
+    close(err_pipe[1]);
+    if (rc != 0) {
+        close(err_pipe[0]);
+        snprintf(errors, errors_size, "%s: %s", argv[0], strerror(rc));
+        return FC_ERR_TOOL;
+    }
+
+    // Collect stderr until it closes, keeping what fits
+    long long deadline = timeout_ms > 0 ? now_ms() + timeout_ms : -1;
+    size_t kept = 0;
+    int timed_out = 0;
+    for (;;) {
+        struct pollfd p = { err_pipe[0], POLLIN, 0 };
+        int ready = poll(&p, 1, remaining(deadline));
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready == 0) {
+            if (deadline >= 0 && now_ms() >= deadline) {
+                timed_out = 1;
+                break;
+            }
+            continue;
+        }
+        char buf[4096];
+        ssize_t n = read(err_pipe[0], buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        size_t take = (size_t)n < errors_size - 1 - kept ? (size_t)n : errors_size - 1 - kept;
+        memcpy(errors + kept, buf, take);
+        kept += take;
+        errors[kept] = '\0';
+    }
+    close(err_pipe[0]);
+
+    // A tool may close stderr and keep running
+    int status = 0;
+    if (timed_out || !reap_by(pid, deadline, &status)) {
+        kill_and_reap(pid);
+        snprintf(errors, errors_size, "%s: timed out after %d s", argv[0], (timeout_ms + 999) / 1000);
+        return FC_ERR_TOOL;
+    }
+    tidy_errors(errors);
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) return FC_OK;
+
+    if (!errors[0] && WIFEXITED(status)) {
+        snprintf(errors, errors_size, "%s: exit status %d", argv[0], WEXITSTATUS(status));
+    } else if (!errors[0] && WIFSIGNALED(status)) {
+        snprintf(errors, errors_size, "%s: killed by signal %d", argv[0], WTERMSIG(status));
+    }
+    return FC_ERR_TOOL;
+}
+
+// Pool
+
+fc_tool_pool *fc_tool_pool_new(const char *tool, char *const argv[], int helpers) {
+    if (!tool || !argv || !argv[0] || helpers < 1) return NULL;
+
+    int argc = 0;
+    size_t bytes = strlen(tool) + 1;
+    while (argv[argc]) bytes += strlen(argv[argc++]) + 1;
+
+    fc_tool_pool *pool = calloc(1, sizeof(*pool) + helpers * sizeof(helper));
+    char **words = pool ? malloc((argc + 1) * sizeof(char *) + bytes) : NULL;
+    if (!words) {
+        free(pool);
+        return NULL;
+    }
+    char *p = (char *)(words + argc + 1);
+    for (int i = 0; i < argc; i++) {
+        words[i] = p;
+        p = stpcpy(p, argv[i]) + 1;
+    }
+    words[argc] = NULL;
+    pool->tool = strcpy(p, tool);
+    pool->argv = words;
+    pool->count = helpers;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    return pool;
+}
+
+fc_tool_pool *fc_tool_pool_from_env(const char *tool, int helpers) {
+    char name[64];
+    size_t len = snprintf(name, sizeof(name), "FC_%s_HELPER", tool ? tool : "");
+    if (!tool || len >= sizeof(name)) return NULL;
+    for (char *c = name; *c; c++) *c = isalnum((unsigned char)*c) ? toupper((unsigned char)*c) : '_';
+
+    const char *command = getenv(name);
+    if (!command) return NULL;
+    char *copy = strdup(command);
+    char *argv[32];
+    int argc = 0;
+    char *save = NULL;
+    for (char *w = copy ? strtok_r(copy, " \t", &save) : NULL; w && argc < 31; w = strtok_r(NULL, " \t", &save)) {
+        argv[argc++] = w;
+    }
+    argv[argc] = NULL;
+    fc_tool_pool *pool = argc ? fc_tool_pool_new(tool, argv, helpers) : NULL;
+    free(copy);
+    return pool;
+}
+
+const char *fc_tool_pool_tool(const fc_tool_pool *pool) {
+    return pool ? pool->tool : NULL;
+}
+
+static int helper_start(fc_tool_pool *pool, helper *h, char *errors, size_t errors_size) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+        snprintf(errors, errors_size, "%s: %s", pool->argv[0], strerror(errno));
+        return -1;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    int rc = spawn(&h->pid, pool->argv, &actions);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (rc != 0) {
+        close(fds[0]);
+        h->pid = 0;
+        snprintf(errors, errors_size, "%s: %s", pool->argv[0], strerror(rc));
+        return -1;
+    }
+    h->fd = fds[0];
+    return 0;
+}
+
+static void helper_stop(helper *h) {
+    close(h->fd);
+    kill_and_reap(h->pid);
+    h->pid = 0;
+}
+
+static int send_all(int fd, const char *data, size_t len) {
+    while (len) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Read the helper's reply line; 0, -1 if it closed, -2 on timeout
+static int read_reply(helper *h, long long deadline, char *reply, size_t size) {
+    size_t len = 0;
+    for (;;) {
+        struct pollfd p = { h->fd, POLLIN, 0 };
+        int ready = poll(&p, 1, remaining(deadline));
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready == 0) {
+            if (deadline >= 0 && now_ms() >= deadline) return -2;
+            continue;
+        }
+        char c;
+        ssize_t n = read(h->fd, &c, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        if (c == '\n') break;
+        if (len < size - 1) reply[len++] = c;
+    }
+    reply[len] = '\0';
+    return 0;
+}
+
+fc_status fc_tool_pool_run(fc_tool_pool *pool, const char *input_file, const char *output_file,
+                           int timeout_ms, char *errors, size_t errors_size) {
+    char scratch[1];
+    if (!errors || !errors_size) {
+        errors = scratch;
+        errors_size = sizeof(scratch);
+    }
+    errors[0] = '\0';
+    if (!pool || !input_file || !output_file) return FC_ERR_INVALID;
+    if (strpbrk(input_file, "\t\n") || strpbrk(output_file, "\t\n")) return FC_ERR_UNSUPPORTED;
+
+    size_t len = strlen(input_file) + strlen(output_file) + 3;
+    char *job = malloc(len);
+    if (!job) return FC_ERR_NOMEM;
+    snprintf(job, len, "%s\t%s\n", input_file, output_file);
+
+    pthread_mutex_lock(&pool->lock);
+    helper *h = NULL;
+    for (;;) {
+        for (int i = 0; i < pool->count && !h; i++) {
+            if (!pool->helpers[i].busy) h = &pool->helpers[i];
+        }
+        if (h) break;
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    h->busy = 1;
+    pthread_mutex_unlock(&pool->lock);
+
+    // A helper left over from earlier jobs may have exited since; retry on a
+    // fresh one if the job cannot even be sent
+    fc_status status = FC_ERR_TOOL;
+    int sent = -1;
+    for (int attempt = 0; attempt < 2 && sent != 0; attempt++) {
+        if (!h->pid && helper_start(pool, h, errors, errors_size) != 0) break;
+        sent = send_all(h->fd, job, len - 1);
+        if (sent != 0) helper_stop(h);
+    }
+    free(job);
+
+    if (sent == 0) {
+        char reply[REPLY_SIZE];
+        long long deadline = timeout_ms > 0 ? now_ms() + timeout_ms : -1;
+        int rc = read_reply(h, deadline, reply, sizeof(reply));
+        if (rc == 0 && strcmp(reply, "ok") == 0) {
+            status = FC_OK;
+        } else if (rc == 0) {
+            snprintf(errors, errors_size, "%s: %s", pool->argv[0], reply);
+            tidy_errors(errors);
+        } else if (rc == -2) {
+            snprintf(errors, errors_size, "%s: timed out after %d s", pool->argv[0], (timeout_ms + 999) / 1000);
+            helper_stop(h);
+        } else {
+            snprintf(errors, errors_size, "%s: helper exited", pool->argv[0]);
+            helper_stop(h);
+        }
+    } else if (!errors[0]) {
+        snprintf(errors, errors_size, "%s: helper exited", pool->argv[0]);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    h->busy = 0;
+    pthread_cond_signal(&pool->idle);
+    pthread_mutex_unlock(&pool->lock);
+    return status;
+}
+
+void fc_tool_pool_free(fc_tool_pool *pool) {
+    if (!pool) return;
+    long long deadline = now_ms() + EXIT_GRACE_MS;
+    for (int i = 0; i < pool->count; i++) {
+        if (pool->helpers[i].pid) close(pool->helpers[i].fd);
+    }
+    for (int i = 0; i < pool->count; i++) {
+        helper *h = &pool->helpers[i];
+        int status;
+        if (h->pid && !reap_by(h->pid, deadline, &status)) kill_and_reap(h->pid);
+    }
+    pthread_cond_destroy(&pool->idle);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->argv);
+    free(pool);
+}
@@ -0,0 +1,49 @@
+#ifndef TOOL_H
+#define TOOL_H
+
+#include <stddef.h>
+#include "converter.h"
+
+// External tool runner. Tools are started with posix_spawn from an argv
+// array, never through a shell, so file names are passed as they are.
+//
+// One-shot runs get /dev/null for stdin and stdout and a pipe for stderr,
+// whose first bytes are kept for the caller's log. A run that outlives its
+// timeout is killed.
+//
+// Tools that can take jobs in batches are driven by a pool of long-lived
+// helpers instead, so a batch pays for spawning once per helper rather than
+// once per file. A helper reads one job per line on stdin, "INPUT\tOUTPUT\n",
+// converts INPUT into OUTPUT the way the tool would and answers with one line
+// on stdout: "ok", or anything else as the error. Helpers exit when stdin
+// closes.
+
+#define FC_TOOL_ERROR_SIZE 256
+
+// Run argv[0] (looked up in PATH) and wait for it. FC_OK if it exited with
+// status 0; otherwise FC_ERR_TOOL with errors holding its stderr, or why it
+// could not run or was stopped, on one line. timeout_ms <= 0 waits for ever.
+fc_status fc_tool_run(char *const argv[], int timeout_ms, char *errors, size_t errors_size);
+
+// Up to helpers processes running argv, started as jobs need them. tool is
+// the one-shot tool the helpers stand in for ("pdftotext").
+fc_tool_pool *fc_tool_pool_new(const char *tool, char *const argv[], int helpers);
+
+// The pool for tool configured in the environment, or NULL. The helper
+// command is read from FC_<TOOL>_HELPER (FC_PDFTOTEXT_HELPER,
+// FC_TXT2PDF_HELPER) as words separated by blanks, without quoting.
+fc_tool_pool *fc_tool_pool_from_env(const char *tool, int helpers);
+
+const char *fc_tool_pool_tool(const fc_tool_pool *pool);
+
+// Hand one job to an idle helper, waiting for one if all are busy. A helper
+// that dies or times out is killed and replaced for the next job.
+// FC_ERR_UNSUPPORTED (nothing run) if a path holds a tab or newline and
+// cannot be sent; run the tool one-shot instead.
+fc_status fc_tool_pool_run(fc_tool_pool *pool, const char *input_file, const char *output_file,
+                           int timeout_ms, char *errors, size_t errors_size);
+
+// Close the helpers' stdin and reap them. No job may be running.
+void fc_tool_pool_free(fc_tool_pool *pool);
+
+#endif
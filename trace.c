@@ -0,0 +1,190 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+#define CHUNK_EVENTS 4096
+#define MAX_THREAD_EVENTS (1u << 20)    // per thread; later spans are counted as dropped
+
+typedef struct {
+    const char *name;
+    uint64_t start, end;
+    uint64_t bytes;
+} trace_event;
+
+typedef struct event_chunk {
+    trace_event events[CHUNK_EVENTS];
+    size_t count;                   // published with release ordering
+    struct event_chunk *next;
+} event_chunk;
+
+// One per thread that ever recorded a span. Only the owning thread appends;
+// fc_trace_stop() reads whatever has been published.
+typedef struct thread_buffer {
+    int tid;
+    char name[32];
+    event_chunk *head, *tail;
+    size_t total;
+    uint64_t dropped;
+    struct thread_buffer *next;
+} thread_buffer;
+
+int fc_trace_enabled;
+
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static thread_buffer *threads;
+static char *trace_path;
+static uint64_t trace_epoch;
+
+// A thread's buffer belongs to the trace it was made for; the generation
+// changes on every stop so no thread appends to a freed buffer
+static unsigned generation;
+static __thread thread_buffer *current;
+static __thread unsigned current_generation;
+
+uint64_t fc_trace_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static thread_buffer *thread_buffer_get(void) {
+    unsigned gen = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+    if (current && current_generation == gen) return current;
+    thread_buffer *tb = calloc(1, sizeof(*tb));
+    if (!tb) return NULL;
+    tb->tid = (int)syscall(SYS_gettid);
+
+    pthread_mutex_lock(&threads_lock);
+    tb->next = threads;
+    threads = tb;
+    pthread_mutex_unlock(&threads_lock);
+    current = tb;
+    current_generation = gen;
+    return tb;
+}
+
+void fc_trace_emit(const char *name, uint64_t start, uint64_t bytes) {
+    if (!fc_trace_enabled) return;      // a span that began before a stop
+    uint64_t end = fc_trace_clock();
+    thread_buffer *tb = thread_buffer_get();
+    if (!tb) return;
+
+    event_chunk *c = tb->tail;
+    if (!c || c->count == CHUNK_EVENTS) {
+        if (tb->total >= MAX_THREAD_EVENTS || !(c = calloc(1, sizeof(*c)))) {
+            tb->dropped++;
+            return;
+        }
+        if (tb->tail) __atomic_store_n(&tb->tail->next, c, __ATOMIC_RELEASE);
+        else __atomic_store_n(&tb->head, c, __ATOMIC_RELEASE);
+        tb->tail = c;
+    }
+    trace_event *e = &c->events[c->count];
+    e->name = name;
+    e->start = start;
+    e->end = end;
+    e->bytes = bytes;
+    __atomic_store_n(&c->count, c->count + 1, __ATOMIC_RELEASE);
+    tb->total++;
+}
+
+void fc_trace_thread_name(const char *name) {
+    if (!fc_trace_enabled) return;
+    thread_buffer *tb = thread_buffer_get();
+    if (tb) snprintf(tb->name, sizeof(tb->name), "%s", name);
+}
+
+int fc_trace_start(const char *path) {
+    if (!path || !*path || trace_path) return -1;
+    trace_path = strdup(path);
+    if (!trace_path) return -1;
+    trace_epoch = fc_trace_clock();
+    fc_trace_enabled = 1;
+    fc_trace_thread_name("main");
+    return 0;
+}
+
+int fc_trace_start_env(void) {
+    return fc_trace_start(getenv("FC_TRACE"));
+}
+
+static void write_json_name(FILE *f, const char *s) {
+    putc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') putc('\\', f);
+        if ((unsigned char)*s >= 0x20) putc(*s, f);
+    }
+    putc('"', f);
+}
+
+// Call once worker threads are done: their buffers are freed here
+int fc_trace_stop(void) {
+    if (!trace_path) return 0;
+    fc_trace_enabled = 0;
+
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", trace_path);
+    FILE *f = fopen(tmp, "w");
+    int pid = (int)getpid(), first = 1;
+    uint64_t dropped = 0;
+
+    pthread_mutex_lock(&threads_lock);
+    if (f) fputs("{\"traceEvents\":[\n", f);
+    for (thread_buffer *tb = threads; tb; tb = tb->next) {
+        if (f && tb->name[0]) {
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                    first ? "" : ",\n", pid, tb->tid);
+            write_json_name(f, tb->name);
+            fputs("}}", f);
+            first = 0;
+        }
+        for (event_chunk *c = __atomic_load_n(&tb->head, __ATOMIC_ACQUIRE); c;
+             c = __atomic_load_n(&c->next, __ATOMIC_ACQUIRE)) {
+            size_t n = __atomic_load_n(&c->count, __ATOMIC_ACQUIRE);
+            for (size_t i = 0; f && i < n; i++) {
+                const trace_event *e = &c->events[i];
+                fprintf(f, "%s{\"name\":", first ? "" : ",\n");
+                write_json_name(f, e->name);
+                fprintf(f, ",\"cat\":\"fc\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                        (e->start - trace_epoch) / 1e3, (e->end - e->start) / 1e3, pid, tb->tid);
+                if (e->bytes) fprintf(f, ",\"args\":{\"bytes\":%llu}", (unsigned long long)e->bytes);
+                putc('}', f);
+                first = 0;
+            }
+        }
+        dropped += tb->dropped;
+    }
+
+    while (threads) {
+        thread_buffer *tb = threads;
+        threads = tb->next;
+        for (event_chunk *c = tb->head, *next; c; c = next) {
+            next = c->next;
+            free(c);
+        }
+        free(tb);
+    }
+    __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+    current = NULL;
+    pthread_mutex_unlock(&threads_lock);
+
+    int rc = -1;
+    if (f) {
+        fprintf(f, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":%llu}}\n",
+                (unsigned long long)dropped);
+        rc = ferror(f) ? -1 : 0;
+        if (fclose(f) != 0) rc = -1;
+        if (rc == 0 && rename(tmp, trace_path) != 0) rc = -1;
+        if (rc != 0) unlink(tmp);
+    }
+    free(trace_path);
+    trace_path = NULL;
+    return rc;
+}
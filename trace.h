@@ -0,0 +1,54 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Optional tracing of hot-path phases (open, read, transform, write, fsync,
+// logging, codec and worker activity) in Chrome trace-event format, which
+// opens in Perfetto (ui.perfetto.dev) or chrome://tracing.
+//
+// Spans are recorded into per-thread buffers without locking and written
+// out as one JSON file by fc_trace_stop(). When tracing is off a span costs
+// a load and a branch.
+//
+//     fc_trace_span span;
+//     fc_trace_begin(&span, "read");
+//     n = fread(...);
+//     fc_trace_end(&span, n);      // bytes, or 0 if not meaningful
+//
+// Span names must be string literals (or otherwise outlive the trace).
+
+extern int fc_trace_enabled;
+
+typedef struct {
+    const char *name;
+    uint64_t start;     // 0 when tracing is off
+} fc_trace_span;
+
+uint64_t fc_trace_clock(void);
+void fc_trace_emit(const char *name, uint64_t start, uint64_t bytes);
+
+static inline void fc_trace_begin(fc_trace_span *span, const char *name) {
+    span->name = name;
+    span->start = fc_trace_enabled ? fc_trace_clock() : 0;
+}
+
+static inline void fc_trace_end(fc_trace_span *span, uint64_t bytes) {
+    if (span->start) fc_trace_emit(span->name, span->start, bytes);
+}
+
+// Name the calling thread in the trace ("worker", "gzip codec")
+void fc_trace_thread_name(const char *name);
+
+// Start recording; the trace is written to path by fc_trace_stop().
+// Returns 0 on success.
+int fc_trace_start(const char *path);
+
+// Start recording if FC_TRACE names an output file. Returns 0 if started.
+int fc_trace_start_env(void);
+
+// Stop recording and write the trace file. Returns 0 on success (or if
+// tracing was never started).
+int fc_trace_stop(void);
+
+#endif
@@ -0,0 +1,278 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+
+#include "watch.h"
+#include "scheduler.h"
+
+#define EVENT_BUFFER_SIZE 65536
+
+typedef struct {
+    fc_conversion type;
+    char input[PATH_MAX];
+    char output[PATH_MAX];
+} watch_job;
+
+static const fc_conversion default_rules[] = {
+    FC_HTML_TO_TXT, FC_JSON_TO_TXT, FC_CSV_TO_TXT, FC_PDF_TO_TXT
+};
+
+// Watcher state. There is one watcher per process.
+static fc_sched *sched;
+static void (*log_fn)(const char *message);
+static const fc_conversion *watch_rules;
+static int watch_rule_count;
+static char watch_in[PATH_MAX], watch_out[PATH_MAX];
+static mode_t output_mode;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long long converted, failed, up_to_date;
+
+static void watch_log(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void watch_log(const char *fmt, ...) {
+    if (!log_fn) return;
+    char message[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(message, sizeof(message), fmt, ap);
+    va_end(ap);
+    log_fn(message);
+}
+
+static int ignored_name(const char *name) {
+    size_t len = strlen(name);
+    if (name[0] == '.' || len == 0 || name[len - 1] == '~') return 1;
+    const char *ext = strrchr(name, '.');
+    return ext && (strcasecmp(ext, ".tmp") == 0 || strcasecmp(ext, ".part") == 0 ||
+                   strcasecmp(ext, ".swp") == 0);
+}
+
+static fc_conversion match_rule(const char *format) {
+    for (int i = 0; format && i < watch_rule_count; i++) {
+        if (strcmp(fc_source_format(watch_rules[i]), format) == 0) return watch_rules[i];
+    }
+    return 0;
+}
+
+static int newer(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec != b->tv_sec ? a->tv_sec > b->tv_sec : a->tv_nsec > b->tv_nsec;
+}
+
+static void count(unsigned long long *counter) {
+    pthread_mutex_lock(&stats_lock);
+    (*counter)++;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+// Worker side
+
+static void run_watch_job(fc_context *ctx, void *arg) {
+    watch_job *job = arg;
+    struct stat in_st, out_st;
+
+    // The same file can be queued by an event and by a rescan; whoever runs
+    // second finds the output already up to date.
+    if (stat(job->input, &in_st) != 0 || !S_ISREG(in_st.st_mode)) {
+        free(job);
+        return;
+    }
+    if (stat(job->output, &out_st) == 0 && !newer(&in_st.st_mtim, &out_st.st_mtim)) {
+        count(&up_to_date);
+        free(job);
+        return;
+    }
+
+    // Convert under a hidden temp name so readers of out_dir never see a
+    // partial output
+    char tmp[PATH_MAX + 16];
+    const char *base = strrchr(job->output, '/') + 1;
+    snprintf(tmp, sizeof(tmp), "%.*s.%s.XXXXXX", (int)(base - job->output), job->output, base);
+    int fd = mkstemp(tmp);
+    fc_status status = FC_ERR_OUTPUT;
+    if (fd >= 0) {
+        fchmod(fd, output_mode);
+        close(fd);
+        status = fc_convert_file(ctx, job->type, job->input, tmp);
+        if (status == FC_OK && rename(tmp, job->output) != 0) status = FC_ERR_OUTPUT;
+        if (status != FC_OK) unlink(tmp);
+    }
+
+    if (status == FC_OK) {
+        count(&converted);
+        watch_log("Watch %s conversion complete: %s -> %s",
+                  fc_conversion_name(job->type), job->input, job->output);
+    } else {
+        count(&failed);
+        watch_log("Watch %s conversion failed for %s: %s",
+                  fc_conversion_name(job->type), job->input, fc_status_message(status));
+    }
+    free(job);
+}
+
+// Watcher side
+
+// Queue name from in_dir if a rule covers it. Blocks while the queue is full.
+static void queue_file(const char *name) {
+    if (ignored_name(name)) return;
+
+    char input[PATH_MAX];
+    if (snprintf(input, sizeof(input), "%s/%s", watch_in, name) >= (int)sizeof(input)) return;
+    fc_conversion type = match_rule(fc_detect_format(input));
+    if (!type) return;
+
+    watch_job *job = malloc(sizeof(*job));
+    if (!job) return;
+    job->type = type;
+    memcpy(job->input, input, sizeof(input));
+
+    // Output is <stem>.<target>, with the target format lower-cased
+    char extension[16];
+    const char *target = fc_target_format(type);
+    size_t e = 0;
+    for (; target[e] && e < sizeof(extension) - 1; e++) extension[e] = tolower((unsigned char)target[e]);
+    extension[e] = 0;
+    const char *dot = strrchr(name, '.');
+    int stem = dot && dot != name ? (int)(dot - name) : (int)strlen(name);
+    if (snprintf(job->output, sizeof(job->output), "%s/%.*s.%s", watch_out, stem, name, extension) >=
+        (int)sizeof(job->output)) {
+        free(job);
+        return;
+    }
+
+    // Bulk work, smallest first, so one huge file does not hold up the rest
+    struct stat st;
+    uint64_t size = stat(input, &st) == 0 ? (uint64_t)st.st_size : 0;
+    if (fc_sched_submit(sched, FC_PRIORITY_BULK, fc_sched_cost(type, size), run_watch_job, job) != 0) free(job);
+}
+
+// Queue every file in in_dir; jobs whose output is current finish at once
+static void rescan(const char *reason) {
+    DIR *dir = opendir(watch_in);
+    if (!dir) return;
+    int queued = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (de->d_type != DT_REG && de->d_type != DT_UNKNOWN) continue;
+        queue_file(de->d_name);
+        queued++;
+    }
+    closedir(dir);
+    watch_log("Watch rescan (%s): %d files checked.", reason, queued);
+}
+
+int fc_watch_run(const char *in_dir, const char *out_dir,
+                 const fc_conversion *rules, int rule_count, int threads,
+                 void (*log)(const char *message)) {
+    log_fn = log;
+    watch_rules = rules && rule_count > 0 ? rules : default_rules;
+    watch_rule_count = rules && rule_count > 0 ? rule_count : (int)(sizeof(default_rules) / sizeof(default_rules[0]));
+
+    if (!realpath(in_dir, watch_in) || !realpath(out_dir, watch_out)) return -1;
+    if (strcmp(watch_in, watch_out) == 0) {
+        errno = EINVAL;     // outputs would be picked up as inputs
+        return -1;
+    }
+    mode_t mask = umask(0);
+    umask(mask);
+    output_mode = 0666 & ~mask;
+
+    // Deliver SIGINT/SIGTERM through a signalfd so no worker thread sees them
+    sigset_t sigmask, old_mask;
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGINT);
+    sigaddset(&sigmask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigmask, &old_mask);
+    int signal_fd = signalfd(-1, &sigmask, SFD_CLOEXEC);
+
+    // Watch before the startup rescan so nothing slips in between the two
+    int inotify_fd = inotify_init1(IN_CLOEXEC);
+    int wd = inotify_fd >= 0 ? inotify_add_watch(inotify_fd, watch_in,
+                                                 IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+                             : -1;
+    sched = wd >= 0 && signal_fd >= 0 ? fc_sched_new(threads, 0, 0) : NULL;
+    if (!sched) {
+        int saved = errno;
+        if (inotify_fd >= 0) close(inotify_fd);
+        if (signal_fd >= 0) close(signal_fd);
+        pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+        errno = saved;
+        return -1;
+    }
+    watch_log("Watching %s into %s with %d workers.", watch_in, watch_out, fc_sched_threads(sched));
+    rescan("startup");
+
+    struct pollfd fds[2] = {
+        { .fd = inotify_fd, .events = POLLIN },
+        { .fd = signal_fd, .events = POLLIN },
+    };
+    char *events = aligned_alloc(__alignof__(struct inotify_event), EVENT_BUFFER_SIZE);
+    int rc = events ? 0 : -1;
+
+    while (events) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            rc = -1;
+            break;
+        }
+        if (fds[1].revents) {
+            // Consume the signal, or it is delivered once the mask is restored
+            struct signalfd_siginfo info;
+            if (read(signal_fd, &info, sizeof(info)) < 0) {}
+            break;
+        }
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        ssize_t n = read(inotify_fd, events, EVENT_BUFFER_SIZE);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            rc = -1;
+            break;
+        }
+
+        int gone = 0;
+        for (char *p = events; p < events + n;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                rescan("event queue overflow");
+            } else if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                gone = 1;
+            } else if (ev->len > 0 && !(ev->mask & IN_ISDIR)) {
+                queue_file(ev->name);
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+        if (gone) {
+            watch_log("Watch directory %s was removed.", watch_in);
+            rc = -1;
+            break;
+        }
+    }
+
+    // Finish what is queued before reporting
+    fc_sched_free(sched);
+    sched = NULL;
+    free(events);
+    close(inotify_fd);
+    close(signal_fd);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    watch_log("Watch stopped: %llu converted, %llu failed, %llu already up to date.",
+              converted, failed, up_to_date);
+    return rc;
+}
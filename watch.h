@@ -0,0 +1,31 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "converter.h"
+
+// Watch-folder mode: every file written into in_dir is converted into
+// out_dir, on a worker pool, until SIGINT or SIGTERM. Files are queued as
+// bulk jobs on a scheduler (scheduler.h), so small ones overtake large ones.
+//
+// A file is picked up once its writer closes it (IN_CLOSE_WRITE) or when it
+// is moved in whole (IN_MOVED_TO), so half-written files are never read.
+// Hidden and editor temp files (".x", "x~", "x.tmp", "x.part", "x.swp") are
+// ignored. Its format comes from fc_detect_format() (the extension, or the
+// content when that is missing or the file is really a PDF); the first rule
+// whose source format matches decides the conversion. Outputs are named <stem>.<target> and appear
+// atomically (written to a temp name, then renamed).
+//
+// On startup, and whenever the kernel event queue overflows, in_dir is
+// rescanned and every file whose output is missing or older than the input
+// is queued, so nothing that arrived while the watcher was down or too busy
+// is missed. When the queue is full the watcher stops reading events
+// and lets the kernel queue them (backpressure).
+
+// rules may be NULL to use the defaults: HTML, JSON, CSV and PDF to TXT.
+// threads <= 0 uses one worker per CPU. log, if not NULL, receives one line
+// per file and per lifecycle event. Returns 0 after a clean shutdown.
+int fc_watch_run(const char *in_dir, const char *out_dir,
+                 const fc_conversion *rules, int rule_count, int threads,
+                 void (*log)(const char *message));
+
+#endif
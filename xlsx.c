@@ -0,0 +1,586 @@
+#ifdef FC_HAVE_ZLIB
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#include "xlsx.h"
+
+#define MAX_ROWS 1048576            // per sheet, Excel's limit
+#define MAX_COLUMNS 16384           // XFD
+#define MAX_CELL_TEXT 32767         // Excel rejects longer cells
+#define SHEET_MAX_BYTES (2ull << 30)    // start a new sheet past this, so zip sizes fit 32 bits
+#define FLUSH_SIZE 65536            // part text is deflated this much at a time
+#define DEFLATE_LEVEL 1             // sheet XML is repetitive: the fastest level still gets ~10x
+#define ZIP_DATE 0x21               // 1980-01-01, so the same input gives the same file
+#define ZIP32_MAX 0xFFFFFFFFull
+
+#define XML_HEADER "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+#define NS_MAIN "http://schemas.openxmlformats.org/spreadsheetml/2006/main"
+#define NS_REL "http://schemas.openxmlformats.org/officeDocument/2006/relationships"
+#define NS_PACKAGE_REL "http://schemas.openxmlformats.org/package/2006/relationships"
+#define CT_PREFIX "application/vnd.openxmlformats-officedocument.spreadsheetml."
+
+typedef struct {
+    char *data;
+    size_t len, cap;
+    int failed;
+} buffer;
+
+static int reserve(buffer *b, size_t more) {
+    if (b->len + more <= b->cap) return 0;
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + more) cap *= 2;
+    char *data = realloc(b->data, cap);
+    if (!data) {
+        b->failed = 1;
+        return -1;
+    }
+    b->data = data;
+    b->cap = cap;
+    return 0;
+}
+
+static void append(buffer *b, const void *s, size_t n) {
+    if (n == 0 || reserve(b, n) != 0) return;
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+}
+
+static void append_str(buffer *b, const char *s) {
+    append(b, s, strlen(s));
+}
+
+static void append_uint(buffer *b, uint64_t v) {
+    char text[24];
+    append(b, text, snprintf(text, sizeof(text), "%llu", (unsigned long long)v));
+}
+
+typedef struct {
+    char *name;
+    uint32_t crc;
+    uint64_t compressed, size, offset;
+} zip_entry;
+
+struct fc_xlsx_writer {
+    FILE *out;
+    fc_status status;
+    uint64_t offset;            // bytes written so far
+
+    // The zip entry being written
+    z_stream z;
+    int z_ready;
+    zip_entry entry;
+    zip_entry *entries;
+    size_t entry_count, entry_cap;
+    unsigned char zout[FLUSH_SIZE];
+    buffer xml;                 // part text not yet deflated
+
+    // Position in the sheet
+    int sheets;
+    size_t rows;                // in the current sheet
+    size_t col;
+    size_t next_col;            // the column a cell without a reference would land in
+    int row_open;
+    char row_ref[16];           // the row number, for cell references
+    size_t row_ref_len;
+
+    // Shared strings, found through an open-addressing table
+    buffer strings;             // back to back
+    uint32_t *string_ends;      // end of each string in strings
+    uint32_t *slots;            // string + 1, 0 for a free slot
+    size_t slot_count, string_count;
+};
+
+static void fail(fc_xlsx_writer *w, fc_status status) {
+    if (w->status == FC_OK) w->status = status;
+}
+
+static void emit(fc_xlsx_writer *w, const void *p, size_t n) {
+    if (w->status != FC_OK || n == 0) return;
+    if (fwrite(p, 1, n, w->out) != n) fail(w, FC_ERR_IO);
+    w->offset += n;
+}
+
+static unsigned char *put16(unsigned char *p, unsigned v) {
+    p[0] = v, p[1] = v >> 8;
+    return p + 2;
+}
+
+static unsigned char *put32(unsigned char *p, uint32_t v) {
+    p[0] = v, p[1] = v >> 8, p[2] = v >> 16, p[3] = v >> 24;
+    return p + 4;
+}
+
+static unsigned char *put64(unsigned char *p, uint64_t v) {
+    return put32(put32(p, (uint32_t)v), (uint32_t)(v >> 32));
+}
+
+// Zip entries. Each is deflated as it is written and followed by a data
+// descriptor with its CRC and sizes, since the header went out first.
+
+static void deflate_out(fc_xlsx_writer *w, int flush) {
+    int rc;
+    do {
+        w->z.next_out = w->zout;
+        w->z.avail_out = sizeof(w->zout);
+        rc = deflate(&w->z, flush);
+        if (rc == Z_STREAM_ERROR) {
+            fail(w, FC_ERR_NOMEM);
+            return;
+        }
+        size_t n = sizeof(w->zout) - w->z.avail_out;
+        emit(w, w->zout, n);
+        w->entry.compressed += n;
+    } while (w->z.avail_out == 0 || (flush == Z_FINISH && rc != Z_STREAM_END));
+}
+
+static void entry_write(fc_xlsx_writer *w, const void *p, size_t n) {
+    const unsigned char *s = p;
+    while (n && w->status == FC_OK) {
+        uInt chunk = n > (1u << 30) ? 1u << 30 : (uInt)n;
+        w->entry.crc = crc32(w->entry.crc, s, chunk);
+        w->entry.size += chunk;
+        w->z.next_in = (unsigned char *)s;
+        w->z.avail_in = chunk;
+        deflate_out(w, Z_NO_FLUSH);
+        s += chunk;
+        n -= chunk;
+    }
+}
+
+static void flush_xml(fc_xlsx_writer *w) {
+    if (w->xml.failed) fail(w, FC_ERR_NOMEM);
+    entry_write(w, w->xml.data, w->xml.len);
+    w->xml.len = 0;
+}
+
+static void begin_entry(fc_xlsx_writer *w, const char *name) {
+    size_t name_len = strlen(name);
+    w->entry = (zip_entry){ .offset = w->offset };
+    if (!(w->entry.name = strdup(name))) fail(w, FC_ERR_NOMEM);
+    if (deflateReset(&w->z) != Z_OK) fail(w, FC_ERR_NOMEM);
+
+    unsigned char header[30], *p = header;
+    p = put32(p, 0x04034b50);
+    p = put16(p, 20);               // version needed
+    p = put16(p, 0x0008);           // sizes in the data descriptor
+    p = put16(p, 8);                // deflate
+    p = put16(p, 0);                // time
+    p = put16(p, ZIP_DATE);
+    p = put32(p, 0);                // crc and sizes follow the data
+    p = put32(p, 0);
+    p = put32(p, 0);
+    p = put16(p, name_len);
+    put16(p, 0);
+    emit(w, header, sizeof(header));
+    emit(w, name, name_len);
+}
+
+static void end_entry(fc_xlsx_writer *w) {
+    flush_xml(w);
+    w->z.next_in = NULL;
+    w->z.avail_in = 0;
+    deflate_out(w, Z_FINISH);
+
+    unsigned char descriptor[16], *p = descriptor;
+    p = put32(p, 0x08074b50);
+    p = put32(p, w->entry.crc);
+    p = put32(p, (uint32_t)w->entry.compressed);
+    put32(p, (uint32_t)w->entry.size);
+    emit(w, descriptor, sizeof(descriptor));
+
+    if (w->entry_count == w->entry_cap) {
+        size_t cap = w->entry_cap ? w->entry_cap * 2 : 16;
+        zip_entry *entries = realloc(w->entries, cap * sizeof(*entries));
+        if (!entries) {
+            free(w->entry.name);
+            fail(w, FC_ERR_NOMEM);
+            return;
+        }
+        w->entries = entries;
+        w->entry_cap = cap;
+    }
+    w->entries[w->entry_count++] = w->entry;
+    w->entry.name = NULL;
+}
+
+static void write_part(fc_xlsx_writer *w, const char *name, const char *text) {
+    begin_entry(w, name);
+    append_str(&w->xml, text);
+    end_entry(w);
+}
+
+// The central directory, in zip64 form if the archive outgrew 4 GB
+static void write_directory(fc_xlsx_writer *w) {
+    if (w->status != FC_OK) return;
+    uint64_t start = w->offset;
+    for (size_t i = 0; i < w->entry_count; i++) {
+        const zip_entry *e = &w->entries[i];
+        int wide = e->offset >= ZIP32_MAX;
+        size_t name_len = strlen(e->name);
+        unsigned char header[46 + 12], *p = header;
+        p = put32(p, 0x02014b50);
+        p = put16(p, wide ? 45 : 20);   // version made by
+        p = put16(p, wide ? 45 : 20);   // version needed
+        p = put16(p, 0x0008);
+        p = put16(p, 8);
+        p = put16(p, 0);
+        p = put16(p, ZIP_DATE);
+        p = put32(p, e->crc);
+        p = put32(p, (uint32_t)e->compressed);
+        p = put32(p, (uint32_t)e->size);
+        p = put16(p, name_len);
+        p = put16(p, wide ? 12 : 0);    // extra
+        p = put16(p, 0);                // comment
+        p = put16(p, 0);                // disk
+        p = put16(p, 0);                // internal attributes
+        p = put32(p, 0);                // external attributes
+        p = put32(p, wide ? (uint32_t)ZIP32_MAX : (uint32_t)e->offset);
+        emit(w, header, p - header);
+        emit(w, e->name, name_len);
+        if (wide) {
+            p = put16(header, 0x0001);
+            p = put16(p, 8);
+            p = put64(p, e->offset);
+            emit(w, header, p - header);
+        }
+    }
+    uint64_t size = w->offset - start, count = w->entry_count;
+
+    unsigned char end[56 + 20 + 22], *p = end;
+    int wide = start >= ZIP32_MAX || w->offset >= ZIP32_MAX;
+    if (wide) {
+        uint64_t record = w->offset;
+        p = put32(p, 0x06064b50);
+        p = put64(p, 44);               // size of the rest of the record
+        p = put16(p, 45);
+        p = put16(p, 45);
+        p = put32(p, 0);
+        p = put32(p, 0);
+        p = put64(p, count);
+        p = put64(p, count);
+        p = put64(p, size);
+        p = put64(p, start);
+        p = put32(p, 0x07064b50);       // locator
+        p = put32(p, 0);
+        p = put64(p, record);
+        p = put32(p, 1);
+    }
+    p = put32(p, 0x06054b50);
+    p = put16(p, 0);
+    p = put16(p, 0);
+    p = put16(p, count);
+    p = put16(p, count);
+    p = put32(p, wide ? (uint32_t)ZIP32_MAX : (uint32_t)size);
+    p = put32(p, wide ? (uint32_t)ZIP32_MAX : (uint32_t)start);
+    p = put16(p, 0);
+    emit(w, end, p - end);
+}
+
+// Sheet XML
+
+// Text for a <t> element. Control characters XML cannot carry are written
+// the OOXML way, "_x0001_", so a literal "_x0041_" has its underscore
+// escaped too.
+static void append_text(buffer *b, const char *s, size_t len) {
+    const char *end = s + len;
+    while (s < end) {
+        const char *run = s;
+        while (s < end && (unsigned char)*s >= 0x20 && *s != '&' && *s != '<' && *s != '>' && *s != '_') s++;
+        append(b, run, s - run);
+        if (s == end) break;
+        char c = *s++;
+        switch (c) {
+            case '&': append_str(b, "&amp;"); break;
+            case '<': append_str(b, "&lt;"); break;
+            case '>': append_str(b, "&gt;"); break;
+            case '\t': case '\n': case '\r': append(b, &c, 1); break;
+            case '_':
+                if (end - s >= 6 && s[0] == 'x' && s[5] == '_' && strspn(s + 1, "0123456789abcdefABCDEF") >= 4) {
+                    append_str(b, "_x005F_");
+                } else {
+                    append(b, &c, 1);
+                }
+                break;
+            default: {
+                char escape[8];
+                append(b, escape, snprintf(escape, sizeof(escape), "_x%04X_", (unsigned char)c));
+            }
+        }
+    }
+}
+
+// Excel's cell limit, cut on a character boundary
+static size_t cell_text_len(const char *s, size_t len) {
+    if (len <= MAX_CELL_TEXT) return len;
+    len = MAX_CELL_TEXT;
+    while (len && ((unsigned char)s[len] & 0xC0) == 0x80) len--;
+    return len;
+}
+
+static void begin_sheet(fc_xlsx_writer *w) {
+    char name[40];
+    snprintf(name, sizeof(name), "xl/worksheets/sheet%d.xml", ++w->sheets);
+    begin_entry(w, name);
+    append_str(&w->xml, XML_HEADER "<worksheet xmlns=\"" NS_MAIN "\"><sheetData>");
+    w->rows = 0;
+}
+
+static void end_sheet(fc_xlsx_writer *w) {
+    append_str(&w->xml, "</sheetData></worksheet>");
+    end_entry(w);
+}
+
+// Open the row on its first cell, on a new sheet if this one is full
+static void begin_row(fc_xlsx_writer *w) {
+    if (w->rows == MAX_ROWS || w->entry.size + w->xml.len >= SHEET_MAX_BYTES) {
+        end_sheet(w);
+        begin_sheet(w);
+    }
+    w->row_ref_len = snprintf(w->row_ref, sizeof(w->row_ref), "%zu", w->rows + 1);
+    append_str(&w->xml, "<row r=\"");
+    append(&w->xml, w->row_ref, w->row_ref_len);
+    append_str(&w->xml, "\">");
+    w->row_open = 1;
+}
+
+// Start the next cell: "<c" and its type. The reference ("B7") is only
+// needed after an empty cell; otherwise readers count along the row, and
+// leaving it out saves a good part of the sheet. 0 past the last column.
+static int begin_cell(fc_xlsx_writer *w, const char *type) {
+    size_t col = w->col++;
+    if (w->status != FC_OK || col >= MAX_COLUMNS) return 0;
+    if (!w->row_open) begin_row(w);
+
+    buffer *b = &w->xml;
+    if (col == w->next_col) {
+        append(b, "<c", 2);
+    } else {
+        char ref[4];
+        size_t n = sizeof(ref);
+        for (size_t c = col + 1; c; c = (c - 1) / 26) ref[--n] = 'A' + (c - 1) % 26;
+        append_str(b, "<c r=\"");
+        append(b, ref + n, sizeof(ref) - n);
+        append(b, w->row_ref, w->row_ref_len);
+        append(b, "\"", 1);
+    }
+    w->next_col = col + 1;
+    append_str(b, type);
+    return 1;
+}
+
+void fc_xlsx_number(fc_xlsx_writer *w, const char *s, size_t len) {
+    if (!begin_cell(w, "><v>")) return;
+    append(&w->xml, s, len);
+    append_str(&w->xml, "</v></c>");
+}
+
+void fc_xlsx_bool(fc_xlsx_writer *w, int value) {
+    if (!begin_cell(w, " t=\"b\"><v>")) return;
+    append_str(&w->xml, value ? "1</v></c>" : "0</v></c>");
+}
+
+void fc_xlsx_skip(fc_xlsx_writer *w) {
+    w->col++;
+}
+
+// Shared strings
+
+static size_t hash_bytes(const char *s, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 0x100000001b3ull;
+    return (size_t)h;
+}
+
+static uint32_t *string_slot(const fc_xlsx_writer *w, const char *s, size_t len) {
+    size_t mask = w->slot_count - 1;
+    for (size_t i = hash_bytes(s, len) & mask;; i = (i + 1) & mask) {
+        uint32_t entry = w->slots[i];
+        if (!entry) return &w->slots[i];
+        uint32_t start = entry > 1 ? w->string_ends[entry - 2] : 0, end = w->string_ends[entry - 1];
+        if (end - start == len && memcmp(w->strings.data + start, s, len) == 0) return &w->slots[i];
+    }
+}
+
+// The shared string index of s, added if there is room; -1 if it is not shared
+static long shared_string(fc_xlsx_writer *w, const char *s, size_t len) {
+    if (len >= FC_XLSX_SHARED_LONGEST) return -1;
+    uint32_t *slot = string_slot(w, s, len);
+    if (*slot) return (long)*slot - 1;
+    if (w->string_count == FC_XLSX_SHARED_MAX || w->strings.len + len > FC_XLSX_SHARED_BYTES) return -1;
+    append(&w->strings, s, len);
+    if (w->strings.failed) return -1;
+    w->string_ends[w->string_count++] = (uint32_t)w->strings.len;
+    *slot = (uint32_t)w->string_count;
+    return (long)w->string_count - 1;
+}
+
+// Leading or trailing blanks are kept only with xml:space
+static const char *text_open(const char *s, size_t len) {
+    int blank = len && (s[0] == ' ' || s[0] == '\t' || s[0] == '\n' || s[0] == '\r' ||
+                        s[len - 1] == ' ' || s[len - 1] == '\t' || s[len - 1] == '\n' || s[len - 1] == '\r');
+    return blank ? "<t xml:space=\"preserve\">" : "<t>";
+}
+
+void fc_xlsx_string(fc_xlsx_writer *w, const char *s, size_t len) {
+    len = cell_text_len(s, len);
+    long index = shared_string(w, s, len);
+    if (index >= 0) {
+        if (!begin_cell(w, " t=\"s\"><v>")) return;
+        append_uint(&w->xml, (uint64_t)index);
+        append_str(&w->xml, "</v></c>");
+        return;
+    }
+    if (!begin_cell(w, " t=\"inlineStr\"><is>")) return;
+    append_str(&w->xml, text_open(s, len));
+    append_text(&w->xml, s, len);
+    append_str(&w->xml, "</t></is></c>");
+}
+
+fc_status fc_xlsx_end_row(fc_xlsx_writer *w) {
+    if (w->row_open) append_str(&w->xml, "</row>");
+    w->row_open = 0;
+    w->col = w->next_col = 0;
+    w->rows++;
+    if (w->xml.len >= FLUSH_SIZE) flush_xml(w);
+    return w->status;
+}
+
+// The rest of the package
+
+static const char styles_xml[] =
+    XML_HEADER "<styleSheet xmlns=\"" NS_MAIN "\">"
+    "<fonts count=\"1\"><font><sz val=\"11\"/><name val=\"Calibri\"/></font></fonts>"
+    "<fills count=\"2\"><fill><patternFill patternType=\"none\"/></fill>"
+    "<fill><patternFill patternType=\"gray125\"/></fill></fills>"
+    "<borders count=\"1\"><border><left/><right/><top/><bottom/><diagonal/></border></borders>"
+    "<cellStyleXfs count=\"1\"><xf numFmtId=\"0\" fontId=\"0\" fillId=\"0\" borderId=\"0\"/></cellStyleXfs>"
+    "<cellXfs count=\"1\"><xf numFmtId=\"0\" fontId=\"0\" fillId=\"0\" borderId=\"0\" xfId=\"0\"/></cellXfs>"
+    "<cellStyles count=\"1\"><cellStyle name=\"Normal\" xfId=\"0\" builtinId=\"0\"/></cellStyles>"
+    "</styleSheet>";
+
+static const char package_rels_xml[] =
+    XML_HEADER "<Relationships xmlns=\"" NS_PACKAGE_REL "\">"
+    "<Relationship Id=\"rId1\" Type=\"" NS_REL "/officeDocument\" Target=\"xl/workbook.xml\"/>"
+    "</Relationships>";
+
+static void write_shared_strings(fc_xlsx_writer *w) {
+    buffer *b = &w->xml;
+    begin_entry(w, "xl/sharedStrings.xml");
+    append_str(b, XML_HEADER "<sst xmlns=\"" NS_MAIN "\" uniqueCount=\"");
+    append_uint(b, w->string_count);
+    append_str(b, "\">");
+    for (size_t i = 0, start = 0; i < w->string_count; start = w->string_ends[i++]) {
+        const char *s = w->strings.data + start;
+        size_t len = w->string_ends[i] - start;
+        append_str(b, "<si>");
+        append_str(b, text_open(s, len));
+        append_text(b, s, len);
+        append_str(b, "</t></si>");
+        if (b->len >= FLUSH_SIZE) flush_xml(w);
+    }
+    append_str(b, "</sst>");
+    end_entry(w);
+}
+
+static void write_workbook(fc_xlsx_writer *w) {
+    buffer *b = &w->xml;
+    begin_entry(w, "xl/workbook.xml");
+    append_str(b, XML_HEADER "<workbook xmlns=\"" NS_MAIN "\" xmlns:r=\"" NS_REL "\"><sheets>");
+    for (int i = 1; i <= w->sheets; i++) {
+        char sheet[96];
+        snprintf(sheet, sizeof(sheet), "<sheet name=\"Sheet%d\" sheetId=\"%d\" r:id=\"rId%d\"/>", i, i, i);
+        append_str(b, sheet);
+    }
+    append_str(b, "</sheets></workbook>");
+    end_entry(w);
+
+    begin_entry(w, "xl/_rels/workbook.xml.rels");
+    append_str(b, XML_HEADER "<Relationships xmlns=\"" NS_PACKAGE_REL "\">");
+    for (int i = 1; i <= w->sheets; i++) {
+        char rel[192];
+        snprintf(rel, sizeof(rel), "<Relationship Id=\"rId%d\" Type=\"" NS_REL "/worksheet\" "
+                 "Target=\"worksheets/sheet%d.xml\"/>", i, i);
+        append_str(b, rel);
+    }
+    char rel[192];
+    snprintf(rel, sizeof(rel), "<Relationship Id=\"rId%d\" Type=\"" NS_REL "/styles\" Target=\"styles.xml\"/>",
+             w->sheets + 1);
+    append_str(b, rel);
+    snprintf(rel, sizeof(rel), "<Relationship Id=\"rId%d\" Type=\"" NS_REL "/sharedStrings\" "
+             "Target=\"sharedStrings.xml\"/>", w->sheets + 2);
+    append_str(b, rel);
+    append_str(b, "</Relationships>");
+    end_entry(w);
+
+    begin_entry(w, "[Content_Types].xml");
+    append_str(b, XML_HEADER "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+               "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+               "<Default Extension=\"xml\" ContentType=\"application/xml\"/>"
+               "<Override PartName=\"/xl/workbook.xml\" ContentType=\"" CT_PREFIX "sheet.main+xml\"/>"
+               "<Override PartName=\"/xl/styles.xml\" ContentType=\"" CT_PREFIX "styles+xml\"/>"
+               "<Override PartName=\"/xl/sharedStrings.xml\" ContentType=\"" CT_PREFIX "sharedStrings+xml\"/>");
+    for (int i = 1; i <= w->sheets; i++) {
+        char part[160];
+        snprintf(part, sizeof(part), "<Override PartName=\"/xl/worksheets/sheet%d.xml\" "
+                 "ContentType=\"" CT_PREFIX "worksheet+xml\"/>", i);
+        append_str(b, part);
+    }
+    append_str(b, "</Types>");
+    end_entry(w);
+}
+
+// The writer
+
+static void free_writer(fc_xlsx_writer *w) {
+    if (w->z_ready) deflateEnd(&w->z);
+    for (size_t i = 0; i < w->entry_count; i++) free(w->entries[i].name);
+    free(w->entries);
+    free(w->entry.name);
+    free(w->xml.data);
+    free(w->strings.data);
+    free(w->string_ends);
+    free(w->slots);
+    free(w);
+}
+
+fc_xlsx_writer *fc_xlsx_writer_new(FILE *out) {
+    fc_xlsx_writer *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    w->out = out;
+    w->slot_count = 2 * FC_XLSX_SHARED_MAX;
+    w->slots = calloc(w->slot_count, sizeof(*w->slots));
+    w->string_ends = malloc(FC_XLSX_SHARED_MAX * sizeof(*w->string_ends));
+    if (!w->slots || !w->string_ends ||
+        deflateInit2(&w->z, DEFLATE_LEVEL, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free_writer(w);
+        return NULL;
+    }
+    w->z_ready = 1;
+    begin_sheet(w);
+    return w;
+}
+
+fc_status fc_xlsx_writer_finish(fc_xlsx_writer *w, int abandon) {
+    if (!w) return FC_ERR_NOMEM;
+    if (abandon) {
+        free_writer(w);
+        return FC_OK;
+    }
+    if (w->row_open) fc_xlsx_end_row(w);
+    end_sheet(w);
+    write_shared_strings(w);
+    write_part(w, "xl/styles.xml", styles_xml);
+    write_part(w, "_rels/.rels", package_rels_xml);
+    write_workbook(w);
+    write_directory(w);
+
+    fc_status status = w->status;
+    free_writer(w);
+    return status;
+}
+
+#endif
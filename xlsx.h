@@ -0,0 +1,47 @@
+#ifndef XLSX_H
+#define XLSX_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "converter.h"
+
+// Streaming XLSX writer. Rows go straight into the worksheet part of the
+// zip container, deflated as they come, so memory does not depend on the
+// number of rows and the output need not be seekable (entries carry data
+// descriptors). A sheet full at 1048576 rows, Excel's limit, continues on
+// a new one.
+//
+// Strings go to the shared-strings table while it has room (up to
+// FC_XLSX_SHARED_MAX distinct strings and FC_XLSX_SHARED_BYTES of text,
+// each shorter than FC_XLSX_SHARED_LONGEST); the rest are written inline in
+// their cells.
+//
+// Needs FC_HAVE_ZLIB (link -lz).
+
+#define FC_XLSX_SHARED_MAX 65536
+#define FC_XLSX_SHARED_BYTES (16 << 20)
+#define FC_XLSX_SHARED_LONGEST 256
+
+typedef struct fc_xlsx_writer fc_xlsx_writer;
+
+// Start a workbook on out. NULL if out of memory.
+fc_xlsx_writer *fc_xlsx_writer_new(FILE *out);
+
+// Add the next cell of the current row. A number is given as its numeral,
+// which must be a valid xsd:double ("-12.5e3"). Cells past column XFD
+// (16384) are dropped.
+void fc_xlsx_number(fc_xlsx_writer *w, const char *s, size_t len);
+void fc_xlsx_bool(fc_xlsx_writer *w, int value);
+void fc_xlsx_string(fc_xlsx_writer *w, const char *s, size_t len);
+void fc_xlsx_skip(fc_xlsx_writer *w);   // leave the cell empty
+
+// Finish the current row. Returns the writer's status: once a write or an
+// allocation fails every later call keeps returning that error.
+fc_status fc_xlsx_end_row(fc_xlsx_writer *w);
+
+// Write the shared strings and the rest of the package, then free w.
+// With abandon set, just free it.
+fc_status fc_xlsx_writer_finish(fc_xlsx_writer *w, int abandon);
+
+#endif